@@ -0,0 +1,136 @@
+/*  object_pool.c
+
+    Implementation of the fixed-size object pool.
+
+    Free objects are chained together through their own storage - the first
+    pointer-sized word of a free object holds the address of the next free
+    object. This is why the element size is rounded up to at least the size
+    of a pointer. When the free list runs dry a new chunk is allocated and
+    threaded onto it. Chunks are only returned to the system when the whole
+    pool is freed. */
+
+#include "object_pool.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_CHUNK_ELEMS 256
+#define DEFAULT_CHUNK_LIST_CAPACITY 8
+
+struct object_pool {
+    /*  Size of a single element in bytes, rounded up so that every element
+        is pointer aligned and can hold a free list link. */
+    unsigned int elem_size;
+
+    /*  Number of elements allocated in each chunk. */
+    unsigned int chunk_elems;
+
+    /*  Head of the free list, NULL when empty. */
+    void *free_list;
+
+    /*  Array of chunk base pointers, kept so that they can be freed. */
+    void **chunks;
+    unsigned int num_chunks;
+    unsigned int chunk_capacity;
+
+    /*  Number of elements currently handed out. */
+    unsigned int in_use;
+};
+
+/*  Forward declarations of helper functions. */
+static void object_pool_grow(object_pool_t pool);
+
+/*  Create a pool. A chunk size of 0 selects the default. */
+object_pool_t create_object_pool(unsigned int elem_size, unsigned int chunk_elems) {
+    assert(elem_size > 0);
+
+    object_pool_t pool = malloc(sizeof(struct object_pool));
+    assert(pool);
+
+    /*  Round the element size up to a multiple of the pointer size. */
+    unsigned int align = sizeof(void *);
+    pool->elem_size = ((elem_size + align - 1) / align) * align;
+
+    pool->chunk_elems = chunk_elems ? chunk_elems : DEFAULT_CHUNK_ELEMS;
+    pool->free_list = NULL;
+
+    pool->chunks = malloc(sizeof(void *) * DEFAULT_CHUNK_LIST_CAPACITY);
+    assert(pool->chunks);
+    pool->num_chunks = 0;
+    pool->chunk_capacity = DEFAULT_CHUNK_LIST_CAPACITY;
+
+    pool->in_use = 0;
+
+    return pool;
+}
+
+/*  Free every chunk, regardless of whether objects are still in use. */
+void free_object_pool(object_pool_t pool) {
+    assert(pool);
+
+    unsigned int i;
+    for (i = 0; i < pool->num_chunks; i++) {
+        free(pool->chunks[i]);
+    }
+
+    free(pool->chunks);
+    free(pool);
+}
+
+/*  Pop an element off the free list, growing the pool if necessary. */
+void * object_pool_alloc(object_pool_t pool) {
+    assert(pool);
+
+    if (pool->free_list == NULL) {
+        object_pool_grow(pool);
+    }
+
+    void *elem = pool->free_list;
+    pool->free_list = *((void **) elem);
+    pool->in_use = pool->in_use + 1;
+
+    return elem;
+}
+
+/*  Push an element back onto the free list. */
+void object_pool_release(object_pool_t pool, void *elem) {
+    assert(pool);
+    assert(elem);
+    assert(pool->in_use > 0);
+
+    *((void **) elem) = pool->free_list;
+    pool->free_list = elem;
+    pool->in_use = pool->in_use - 1;
+}
+
+/*  Number of live elements. */
+unsigned int object_pool_in_use(object_pool_t pool) {
+    return pool->in_use;
+}
+
+/*  Helper functions. */
+
+/*  Allocate a new chunk and thread all of its elements onto the free list.
+    Elements are linked in address order so that consecutive allocations
+    from a fresh chunk are adjacent in memory. */
+static void object_pool_grow(object_pool_t pool) {
+    if (pool->num_chunks == pool->chunk_capacity) {
+        pool->chunk_capacity = 2 * pool->chunk_capacity;
+        pool->chunks = realloc(pool->chunks, sizeof(void *) * pool->chunk_capacity);
+        assert(pool->chunks);
+    }
+
+    char *chunk = malloc((size_t) pool->elem_size * pool->chunk_elems);
+    assert(chunk);
+    pool->chunks[pool->num_chunks] = chunk;
+    pool->num_chunks = pool->num_chunks + 1;
+
+    int i;
+    for (i = pool->chunk_elems - 1; i >= 0; i--) {
+        void *elem = chunk + (size_t) i * pool->elem_size;
+        *((void **) elem) = pool->free_list;
+        pool->free_list = elem;
+    }
+}
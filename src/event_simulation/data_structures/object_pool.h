@@ -0,0 +1,25 @@
+/*  object_pool.h
+
+    Fixed-size object pool. Simulation models allocate and release very large
+    numbers of small, identically sized objects (packet descriptors, cell runs,
+    replica headers and so on). Going to malloc for each of these is slow and
+    scatters them across memory, so instead objects are carved out of large
+    chunks and recycled through a free list.
+
+    Objects never move once allocated, so pointers to them remain valid until
+    they are released. */
+
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+struct object_pool;
+
+typedef struct object_pool * object_pool_t;
+
+object_pool_t create_object_pool(unsigned int elem_size, unsigned int chunk_elems);
+void free_object_pool(object_pool_t pool);
+void * object_pool_alloc(object_pool_t pool);
+void object_pool_release(object_pool_t pool, void *elem);
+unsigned int object_pool_in_use(object_pool_t pool);
+
+#endif
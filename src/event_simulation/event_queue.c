@@ -266,7 +266,7 @@ double event_queue_dequeue_double_time(
 
     double_time_t time = (double_time_t) time_ptr;
 
-    unsigned int time_val = time->time;
+    double time_val = time->time;
 
     /*  Free time structure. */
     free(time);
@@ -280,6 +280,11 @@ event_queue_t free_event_queue(event_queue_t queue) {
         should free the event structures as well as the
         underyling time and data payloads. */
     free_heap(queue->heap);
+
+    /*  Free the queue structure itself. */
+    free(queue);
+
+    return NULL;
 }
 
 /*  Time representation functions. */
@@ -0,0 +1,118 @@
+/*  event_source.c
+
+    Implementation of lazy event sources. Each source embeds a single event
+    which is rescheduled for the time of the item it is holding. */
+
+#include "event_source.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+struct event_source {
+    struct sim_event event;
+
+    func_source_next_t next;
+    void *next_state;
+
+    func_source_emit_t emit;
+    void *emit_arg;
+
+    /*  Item pulled from the generator but not yet emitted. */
+    void *pending_item;
+    unsigned int pending_time;
+
+    /*  Whether an item is pending in the simulator. */
+    int active;
+
+    unsigned long emitted;
+};
+
+/*  Forward declarations of helper functions. */
+static int event_source_pull(event_source_t source, simulator_t sim);
+static void event_source_fire(simulator_t sim, sim_event_t event);
+
+/*  Create an inactive source. */
+event_source_t create_event_source(
+    func_source_next_t next,
+    void *next_state,
+    func_source_emit_t emit,
+    void *emit_arg
+) {
+    assert(next);
+    assert(emit);
+
+    event_source_t source = malloc(sizeof(struct event_source));
+    assert(source);
+
+    sim_event_init(&source->event, event_source_fire, source);
+    source->next = next;
+    source->next_state = next_state;
+    source->emit = emit;
+    source->emit_arg = emit_arg;
+    source->pending_item = NULL;
+    source->pending_time = 0;
+    source->active = 0;
+    source->emitted = 0;
+
+    return source;
+}
+
+/*  Free the source. It must not have an event pending in a simulator that
+    will be run again. */
+void free_event_source(event_source_t source) {
+    assert(source);
+    free(source);
+}
+
+/*  Pull the first item and schedule it. Returns 0 if the generator was
+    already exhausted. */
+int event_source_start(event_source_t source, simulator_t sim) {
+    assert(!source->active);
+    return event_source_pull(source, sim);
+}
+
+/*  Whether the source still has an item pending. */
+int event_source_is_active(event_source_t source) {
+    return source->active;
+}
+
+/*  Number of items emitted so far. */
+unsigned long event_source_emitted(event_source_t source) {
+    return source->emitted;
+}
+
+/*  Helper functions. */
+
+/*  Pull the next item from the generator and schedule it. */
+static int event_source_pull(event_source_t source, simulator_t sim) {
+    unsigned int time;
+    void *item;
+
+    if (!source->next(source->next_state, &time, &item)) {
+        source->active = 0;
+        return 0;
+    }
+
+    assert(time >= simulator_now(sim));
+
+    source->pending_item = item;
+    source->pending_time = time;
+    source->active = 1;
+
+    simulator_schedule(sim, &source->event, time);
+
+    return 1;
+}
+
+/*  Emit the pending item and pull its successor. The successor is pulled
+    first so that the emit function sees a consistent source. */
+static void event_source_fire(simulator_t sim, sim_event_t event) {
+    event_source_t source = (event_source_t) event->arg;
+    void *item = source->pending_item;
+
+    source->emitted = source->emitted + 1;
+    event_source_pull(source, sim);
+
+    source->emit(sim, item, source->emit_arg);
+}
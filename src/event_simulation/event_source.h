@@ -0,0 +1,46 @@
+/*  event_source.h
+
+    Lazy event sources.
+
+    A workload made up of millions of arrivals should not be enqueued up
+    front - the heap would grow to hold every one of them and each insert
+    would pay for the size. An event source instead wraps a generator
+    function which produces items one at a time in non-decreasing time
+    order. Only the next item from each source is ever held in the event
+    queue, and the following item is pulled from the generator when that
+    one is emitted.
+
+    Traffic generators and trace readers plug in here by providing a next
+    function. */
+
+#ifndef EVENT_SOURCE_H
+#define EVENT_SOURCE_H
+
+#include "simulator.h"
+
+struct event_source;
+
+typedef struct event_source * event_source_t;
+
+/*  Produce the next item and its time. The first argument is the generator
+    state given at creation time. Returns 0 when the generator is exhausted,
+    in which case the outputs are ignored. Times must be non-decreasing. */
+typedef int (*func_source_next_t)(void *, unsigned int *, void **);
+
+/*  Called at the time of each item with the item and the emit_arg given at
+    creation time. */
+typedef void (*func_source_emit_t)(simulator_t, void *, void *);
+
+event_source_t create_event_source(
+    func_source_next_t next,
+    void *next_state,
+    func_source_emit_t emit,
+    void *emit_arg
+);
+
+void free_event_source(event_source_t source);
+int event_source_start(event_source_t source, simulator_t sim);
+int event_source_is_active(event_source_t source);
+unsigned long event_source_emitted(event_source_t source);
+
+#endif
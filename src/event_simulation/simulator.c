@@ -0,0 +1,137 @@
+/*  simulator.c
+
+    Implementation of the simulator dispatch kernel. */
+
+#include "simulator.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+struct simulator {
+    /*  Underlying event queue using unsigned integer time. Data payloads are
+        always sim_event pointers. */
+    event_queue_t queue;
+
+    /*  Current simulated time - the time of the last dispatched event. */
+    unsigned int now;
+
+    /*  Count of handlers invoked, useful for measuring how many events a
+        model generates. */
+    unsigned long dispatched;
+};
+
+/*  Free function passed to the event queue. Only called for events still
+    pending when the simulator is torn down - dispatched events are the
+    responsibility of their handlers. */
+static void simulator_free_event(void *event_ptr, void *sim_ptr) {
+    sim_event_t event = (sim_event_t) event_ptr;
+
+    if (event->free_event) {
+        event->free_event(event, sim_ptr);
+    }
+}
+
+/*  Initialise an embedded event. */
+void sim_event_init(sim_event_t event, func_event_handler_t handler, void *arg) {
+    assert(event);
+    assert(handler);
+
+    event->handler = handler;
+    event->free_event = NULL;
+    event->arg = arg;
+}
+
+/*  Create a simulator at time 0 with an empty queue. */
+simulator_t create_simulator(void) {
+    simulator_t sim = malloc(sizeof(struct simulator));
+    assert(sim);
+
+    sim->queue = create_queue_uint_time(simulator_free_event, sim);
+    sim->now = 0;
+    sim->dispatched = 0;
+
+    return sim;
+}
+
+/*  Free the simulator along with any events still pending. */
+void free_simulator(simulator_t sim) {
+    assert(sim);
+
+    free_event_queue(sim->queue);
+    free(sim);
+}
+
+/*  Current simulated time. */
+unsigned int simulator_now(simulator_t sim) {
+    return sim->now;
+}
+
+/*  Number of events waiting in the queue. */
+unsigned int simulator_pending(simulator_t sim) {
+    return event_queue_size(sim->queue);
+}
+
+/*  Number of events dispatched so far. */
+unsigned long simulator_events_dispatched(simulator_t sim) {
+    return sim->dispatched;
+}
+
+/*  Schedule an event at an absolute time, which must not be in the past. */
+void simulator_schedule(simulator_t sim, sim_event_t event, unsigned int time) {
+    assert(sim);
+    assert(event);
+    assert(time >= sim->now);
+
+    event_queue_enqueue_uint_time(sim->queue, (void *) event, time);
+}
+
+/*  Schedule an event relative to the current time. */
+void simulator_schedule_after(simulator_t sim, sim_event_t event, unsigned int delay) {
+    simulator_schedule(sim, event, sim->now + delay);
+}
+
+/*  Look up the time of the next pending event. Returns 0 if the queue is
+    empty, in which case time_out is left untouched. */
+int simulator_next_time(simulator_t sim, unsigned int *time_out) {
+    if (event_queue_size(sim->queue) == 0) {
+        return 0;
+    }
+
+    void *event;
+    *time_out = event_queue_peek_uint_time(sim->queue, &event);
+
+    return 1;
+}
+
+/*  Dispatch a single event. Returns 0 if there was nothing to dispatch. */
+int simulator_step(simulator_t sim) {
+    if (event_queue_size(sim->queue) == 0) {
+        return 0;
+    }
+
+    void *event_ptr;
+    unsigned int time = event_queue_dequeue_uint_time(sim->queue, &event_ptr);
+    sim_event_t event = (sim_event_t) event_ptr;
+
+    assert(time >= sim->now);
+    sim->now = time;
+    sim->dispatched = sim->dispatched + 1;
+
+    event->handler(sim, event);
+
+    return 1;
+}
+
+/*  Dispatch events until the queue is empty or the next event lies beyond
+    end_time. Returns the number of events dispatched. */
+unsigned long simulator_run_until(simulator_t sim, unsigned int end_time) {
+    unsigned long start = sim->dispatched;
+    unsigned int next;
+
+    while (simulator_next_time(sim, &next) && next <= end_time) {
+        simulator_step(sim);
+    }
+
+    return sim->dispatched - start;
+}
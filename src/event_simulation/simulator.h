@@ -0,0 +1,77 @@
+/*  simulator.h
+
+    Declares a small dispatch kernel built on top of the event queue.
+
+    The event queue is deliberately generic - it stores pairs of data and time
+    pointers and has no notion of what an event means. Switch and network
+    models do however need a common way of saying "call this function at time
+    t". The simulator therefore wraps an unsigned integer time event queue
+    whose data payloads are always sim_event structures, each of which
+    carries a handler that is invoked when the event reaches the front of the
+    queue.
+
+    Time is measured in abstract ticks. Models do not assume a particular
+    unit, but rates are expressed per thousand ticks so that with 1 tick = 1
+    nanosecond they read as Mbit/s.
+
+    Models normally embed their sim_event structures inside their own state
+    (one per port, link, shaper etc.) and reschedule the same structure over
+    and over, so scheduling an event never allocates anything on the model
+    side. */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "event_queue.h"
+
+struct simulator;
+
+typedef struct simulator * simulator_t;
+
+struct sim_event;
+
+typedef struct sim_event * sim_event_t;
+
+/*  An event handler is called with the simulator, whose current time has
+    already been advanced to the time of the event, and the event itself. */
+typedef void (*func_event_handler_t)(simulator_t, sim_event_t);
+
+/*  The event structure is public so that models can embed it in their own
+    state rather than allocating events separately. */
+struct sim_event {
+    /*  Function called when the event fires. */
+    func_event_handler_t handler;
+
+    /*  Function used to release the event if it is still pending when the
+        simulator is freed. It is passed the event and the simulator. NULL
+        for events whose storage is owned by a model. */
+    func_free_t free_event;
+
+    /*  Model state associated with the event. */
+    void *arg;
+};
+
+void sim_event_init(sim_event_t event, func_event_handler_t handler, void *arg);
+
+simulator_t create_simulator(void);
+void free_simulator(simulator_t sim);
+unsigned int simulator_now(simulator_t sim);
+unsigned int simulator_pending(simulator_t sim);
+unsigned long simulator_events_dispatched(simulator_t sim);
+void simulator_schedule(simulator_t sim, sim_event_t event, unsigned int time);
+void simulator_schedule_after(simulator_t sim, sim_event_t event, unsigned int delay);
+int simulator_next_time(simulator_t sim, unsigned int *time_out);
+int simulator_step(simulator_t sim);
+unsigned long simulator_run_until(simulator_t sim, unsigned int end_time);
+
+/*  Time taken to serialise a number of bytes at a rate given in bits per
+    thousand ticks, rounded up to a whole tick. */
+static inline unsigned int sim_transmission_time(
+    unsigned int bytes,
+    unsigned int rate
+) {
+    unsigned long long bits = (unsigned long long) bytes * 8 * 1000;
+    return (unsigned int) ((bits + rate - 1) / rate);
+}
+
+#endif
@@ -0,0 +1,677 @@
+/*  fluid.c
+
+    Implementation of the flow level model.
+
+    Flow and link state are held as parallel arrays, as in the transport
+    models. Each link keeps the list of active flows crossing it, and each
+    hop of a flow's path remembers where the flow sits in that link's list,
+    so flows join and leave links in constant time per hop.
+
+    The flows and links to recompute are found by a breadth first walk from
+    the links of the flow that arrived or left, alternating between links
+    and the flows crossing them, with stamps marking what has been visited.
+
+    Water filling repeatedly takes the link offering the smallest fair
+    share - its unallocated capacity over the number of flows on it not yet
+    given a rate - and fixes the rate of each of those flows at that share,
+    taking it off the other links they cross. The share of those links can
+    only go up, as the flows leaving them got no more than the share they
+    were offering. Links are kept in a heap by share, and one whose share
+    has changed since it was pushed is pushed again rather than moved, the
+    old entry being skipped when popped. */
+
+#include "fluid.h"
+#include "../event_simulation/event_queue.h"
+#include "../event_simulation/data_structures/object_pool.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_FLOW_CAPACITY 64
+#define DEFAULT_PATH_CAPACITY 256
+#define DEFAULT_MEMBER_CAPACITY 4
+
+#define FLOW_PENDING 0
+#define FLOW_ACTIVE 1
+#define FLOW_DONE 2
+
+/*  Payload of the events in the queue. A completion is stale once the
+    version of its flow has moved on. */
+struct fluid_event {
+    unsigned int flow;
+    unsigned int version;
+    int arrival;
+};
+
+struct fluid_heap_entry {
+    double share;
+    unsigned int link;
+};
+
+struct fluid {
+    double now;
+    event_queue_t events;
+    object_pool_t records;
+
+    func_fluid_complete_t complete;
+    void *complete_arg;
+
+    /*  Link state, one entry per link in each array. */
+    unsigned int num_links;
+    double *capacity;
+    unsigned int **members;
+    unsigned int *member_count;
+    unsigned int *member_capacity;
+    unsigned int *link_stamp;
+    double *residual;
+    unsigned int *unfrozen;
+    double *share;
+
+    /*  Flow state, one entry per flow in each array. The rate of a flow
+        has held since updated, when remaining was last brought up to date. */
+    unsigned int num_flows;
+    unsigned int flow_capacity;
+    unsigned int active;
+    double *start;
+    double *remaining;
+    double *rate;
+    double *updated;
+    double *finish;
+    unsigned int *version;
+    unsigned int *path_offset;
+    unsigned int *path_length;
+    unsigned int *flow_stamp;
+    unsigned int *frozen;
+    unsigned char *state;
+
+    /*  Hops of every path: the link, and the position of the flow in the
+        link's list of members. */
+    unsigned int *path_links;
+    unsigned int *path_slots;
+    unsigned int path_count;
+    unsigned int path_capacity;
+
+    /*  Scratch space for recomputing rates. */
+    unsigned int *component_links;
+    struct fluid_heap_entry *heap;
+    unsigned int heap_size;
+    unsigned int heap_capacity;
+    unsigned int stamp;
+
+    unsigned long processed;
+    unsigned long stale;
+    unsigned long rate_changes;
+};
+
+/*  Forward declarations of helper functions. */
+static void fluid_grow_flows(fluid_t fluid);
+static void fluid_schedule(fluid_t fluid, unsigned int flow, double time, int arrival);
+static void fluid_step(fluid_t fluid);
+static void fluid_attach(fluid_t fluid, unsigned int flow);
+static void fluid_detach(fluid_t fluid, unsigned int flow);
+static void fluid_recompute(fluid_t fluid, unsigned int flow);
+static void fluid_set_rate(fluid_t fluid, unsigned int flow, double rate);
+static void heap_push(fluid_t fluid, double share, unsigned int link);
+static struct fluid_heap_entry heap_pop(fluid_t fluid);
+static void release_record(void *record, void *pool);
+
+/*  Create a fluid model of the given number of links with the given
+    capacities in bytes per tick. */
+fluid_t create_fluid(unsigned int num_links, const double *capacities) {
+    assert(num_links > 0);
+    assert(capacities);
+
+    fluid_t fluid = malloc(sizeof(struct fluid));
+    assert(fluid);
+
+    fluid->now = 0;
+    fluid->records = create_object_pool(sizeof(struct fluid_event), 0);
+    fluid->events = create_queue_double_time(release_record, fluid->records);
+    fluid->complete = NULL;
+    fluid->complete_arg = NULL;
+
+    fluid->num_links = num_links;
+    fluid->capacity = malloc(sizeof(double) * num_links);
+    assert(fluid->capacity);
+    fluid->members = malloc(sizeof(unsigned int *) * num_links);
+    assert(fluid->members);
+    fluid->member_count = malloc(sizeof(unsigned int) * num_links);
+    assert(fluid->member_count);
+    fluid->member_capacity = malloc(sizeof(unsigned int) * num_links);
+    assert(fluid->member_capacity);
+    fluid->link_stamp = malloc(sizeof(unsigned int) * num_links);
+    assert(fluid->link_stamp);
+    fluid->residual = malloc(sizeof(double) * num_links);
+    assert(fluid->residual);
+    fluid->unfrozen = malloc(sizeof(unsigned int) * num_links);
+    assert(fluid->unfrozen);
+    fluid->share = malloc(sizeof(double) * num_links);
+    assert(fluid->share);
+    fluid->component_links = malloc(sizeof(unsigned int) * num_links);
+    assert(fluid->component_links);
+
+    unsigned int link;
+    for (link = 0; link < num_links; link++) {
+        assert(capacities[link] > 0);
+
+        fluid->capacity[link] = capacities[link];
+        fluid->members[link] = malloc(sizeof(unsigned int) * DEFAULT_MEMBER_CAPACITY);
+        assert(fluid->members[link]);
+        fluid->member_count[link] = 0;
+        fluid->member_capacity[link] = DEFAULT_MEMBER_CAPACITY;
+        fluid->link_stamp[link] = 0;
+    }
+
+    fluid->num_flows = 0;
+    fluid->flow_capacity = 0;
+    fluid->active = 0;
+    fluid->start = NULL;
+    fluid->remaining = NULL;
+    fluid->rate = NULL;
+    fluid->updated = NULL;
+    fluid->finish = NULL;
+    fluid->version = NULL;
+    fluid->path_offset = NULL;
+    fluid->path_length = NULL;
+    fluid->flow_stamp = NULL;
+    fluid->frozen = NULL;
+    fluid->state = NULL;
+    fluid_grow_flows(fluid);
+
+    fluid->path_links = malloc(sizeof(unsigned int) * DEFAULT_PATH_CAPACITY);
+    assert(fluid->path_links);
+    fluid->path_slots = malloc(sizeof(unsigned int) * DEFAULT_PATH_CAPACITY);
+    assert(fluid->path_slots);
+    fluid->path_count = 0;
+    fluid->path_capacity = DEFAULT_PATH_CAPACITY;
+
+    fluid->heap_capacity = num_links;
+    fluid->heap = malloc(sizeof(struct fluid_heap_entry) * fluid->heap_capacity);
+    assert(fluid->heap);
+    fluid->heap_size = 0;
+    fluid->stamp = 0;
+
+    fluid->processed = 0;
+    fluid->stale = 0;
+    fluid->rate_changes = 0;
+
+    return fluid;
+}
+
+void free_fluid(fluid_t fluid) {
+    assert(fluid);
+
+    free_event_queue(fluid->events);
+    free_object_pool(fluid->records);
+
+    unsigned int link;
+    for (link = 0; link < fluid->num_links; link++) {
+        free(fluid->members[link]);
+    }
+    free(fluid->capacity);
+    free(fluid->members);
+    free(fluid->member_count);
+    free(fluid->member_capacity);
+    free(fluid->link_stamp);
+    free(fluid->residual);
+    free(fluid->unfrozen);
+    free(fluid->share);
+    free(fluid->component_links);
+
+    free(fluid->start);
+    free(fluid->remaining);
+    free(fluid->rate);
+    free(fluid->updated);
+    free(fluid->finish);
+    free(fluid->version);
+    free(fluid->path_offset);
+    free(fluid->path_length);
+    free(fluid->flow_stamp);
+    free(fluid->frozen);
+    free(fluid->state);
+
+    free(fluid->path_links);
+    free(fluid->path_slots);
+    free(fluid->heap);
+    free(fluid);
+}
+
+/*  Be told when flows finish. */
+void fluid_set_completion(fluid_t fluid, func_fluid_complete_t complete, void *complete_arg) {
+    fluid->complete = complete;
+    fluid->complete_arg = complete_arg;
+}
+
+/*  Add a flow of the given number of bytes starting at the given time,
+    which must not be in the past, over a path of distinct links. Returns
+    the flow number. */
+unsigned int fluid_add_flow(fluid_t fluid, double start, double bytes, const unsigned int *path, unsigned int path_length) {
+    assert(start >= fluid->now);
+    assert(bytes > 0);
+    assert(path_length > 0);
+
+    if (fluid->num_flows == fluid->flow_capacity) {
+        fluid_grow_flows(fluid);
+    }
+
+    while (fluid->path_count + path_length > fluid->path_capacity) {
+        fluid->path_capacity = fluid->path_capacity * 2;
+        fluid->path_links = realloc(fluid->path_links, sizeof(unsigned int) * fluid->path_capacity);
+        assert(fluid->path_links);
+        fluid->path_slots = realloc(fluid->path_slots, sizeof(unsigned int) * fluid->path_capacity);
+        assert(fluid->path_slots);
+    }
+
+    unsigned int flow = fluid->num_flows;
+    unsigned int hop;
+    unsigned int other;
+
+    fluid->num_flows = flow + 1;
+
+    for (hop = 0; hop < path_length; hop++) {
+        assert(path[hop] < fluid->num_links);
+        for (other = 0; other < hop; other++) {
+            assert(path[other] != path[hop]);
+        }
+        fluid->path_links[fluid->path_count + hop] = path[hop];
+    }
+
+    fluid->start[flow] = start;
+    fluid->remaining[flow] = bytes;
+    fluid->rate[flow] = 0;
+    fluid->updated[flow] = start;
+    fluid->finish[flow] = 0;
+    fluid->version[flow] = 0;
+    fluid->path_offset[flow] = fluid->path_count;
+    fluid->path_length[flow] = path_length;
+    fluid->flow_stamp[flow] = 0;
+    fluid->frozen[flow] = 0;
+    fluid->state[flow] = FLOW_PENDING;
+    fluid->path_count = fluid->path_count + path_length;
+
+    fluid_schedule(fluid, flow, start, 1);
+
+    return flow;
+}
+
+/*  Process every event up to the given time, then move the clock on to
+    it. */
+void fluid_run_until(fluid_t fluid, double until) {
+    void *record;
+
+    while (event_queue_size(fluid->events) > 0 &&
+        event_queue_peek_double_time(fluid->events, &record) <= until) {
+        fluid_step(fluid);
+    }
+
+    if (until > fluid->now) {
+        fluid->now = until;
+    }
+}
+
+/*  Process events until every flow has finished. */
+void fluid_run(fluid_t fluid) {
+    while (event_queue_size(fluid->events) > 0) {
+        fluid_step(fluid);
+    }
+}
+
+double fluid_now(fluid_t fluid) {
+    return fluid->now;
+}
+
+/*  Number of flows added so far. */
+unsigned int fluid_flows(fluid_t fluid) {
+    return fluid->num_flows;
+}
+
+/*  Number of flows that have started and not yet finished. */
+unsigned int fluid_active_flows(fluid_t fluid) {
+    return fluid->active;
+}
+
+int fluid_flow_done(fluid_t fluid, unsigned int flow) {
+    assert(flow < fluid->num_flows);
+
+    return fluid->state[flow] == FLOW_DONE;
+}
+
+/*  Current rate of a flow in bytes per tick, 0 unless it is active. */
+double fluid_flow_rate(fluid_t fluid, unsigned int flow) {
+    assert(flow < fluid->num_flows);
+
+    return fluid->rate[flow];
+}
+
+/*  Bytes of a flow still to be sent at the current time. */
+double fluid_flow_remaining(fluid_t fluid, unsigned int flow) {
+    assert(flow < fluid->num_flows);
+
+    if (fluid->state[flow] != FLOW_ACTIVE) {
+        return fluid->remaining[flow];
+    }
+
+    double remaining = fluid->remaining[flow] - fluid->rate[flow] * (fluid->now - fluid->updated[flow]);
+    return remaining > 0 ? remaining : 0;
+}
+
+/*  Time from the start of a finished flow to its end. */
+double fluid_flow_completion_time(fluid_t fluid, unsigned int flow) {
+    assert(flow < fluid->num_flows);
+    assert(fluid->state[flow] == FLOW_DONE);
+
+    return fluid->finish[flow] - fluid->start[flow];
+}
+
+/*  Sum of the rates of the flows crossing a link. */
+double fluid_link_load(fluid_t fluid, unsigned int link) {
+    assert(link < fluid->num_links);
+
+    double load = 0;
+    unsigned int i;
+    for (i = 0; i < fluid->member_count[link]; i++) {
+        load = load + fluid->rate[fluid->members[link][i]];
+    }
+
+    return load;
+}
+
+/*  Number of arrivals and completions processed. */
+unsigned long fluid_events(fluid_t fluid) {
+    return fluid->processed;
+}
+
+/*  Number of completion events skipped because the rate of their flow had
+    changed. */
+unsigned long fluid_stale_events(fluid_t fluid) {
+    return fluid->stale;
+}
+
+/*  Number of times a flow was given a new rate, including its first. */
+unsigned long fluid_rate_changes(fluid_t fluid) {
+    return fluid->rate_changes;
+}
+
+/*  Helper functions. */
+
+#define GROW(array, type) \
+    fluid->array = realloc(fluid->array, sizeof(type) * capacity); \
+    assert(fluid->array)
+
+static void fluid_grow_flows(fluid_t fluid) {
+    unsigned int capacity = fluid->flow_capacity ? fluid->flow_capacity * 2 : DEFAULT_FLOW_CAPACITY;
+
+    GROW(start, double);
+    GROW(remaining, double);
+    GROW(rate, double);
+    GROW(updated, double);
+    GROW(finish, double);
+    GROW(version, unsigned int);
+    GROW(path_offset, unsigned int);
+    GROW(path_length, unsigned int);
+    GROW(flow_stamp, unsigned int);
+    GROW(frozen, unsigned int);
+    GROW(state, unsigned char);
+
+    fluid->flow_capacity = capacity;
+}
+
+#undef GROW
+
+static void fluid_schedule(fluid_t fluid, unsigned int flow, double time, int arrival) {
+    struct fluid_event *record = object_pool_alloc(fluid->records);
+
+    record->flow = flow;
+    record->version = fluid->version[flow];
+    record->arrival = arrival;
+
+    event_queue_enqueue_double_time(fluid->events, record, time);
+}
+
+static void fluid_step(fluid_t fluid) {
+    void *record_ptr;
+    double time = event_queue_dequeue_double_time(fluid->events, &record_ptr);
+    struct fluid_event record = *(struct fluid_event *) record_ptr;
+    unsigned int flow = record.flow;
+
+    object_pool_release(fluid->records, record_ptr);
+
+    if (!record.arrival && record.version != fluid->version[flow]) {
+        fluid->stale = fluid->stale + 1;
+        return;
+    }
+
+    fluid->now = time;
+    fluid->processed = fluid->processed + 1;
+
+    if (record.arrival) {
+        fluid->state[flow] = FLOW_ACTIVE;
+        fluid->active = fluid->active + 1;
+        fluid_attach(fluid, flow);
+        fluid_recompute(fluid, flow);
+        return;
+    }
+
+    fluid->state[flow] = FLOW_DONE;
+    fluid->active = fluid->active - 1;
+    fluid->finish[flow] = time;
+    fluid->remaining[flow] = 0;
+    fluid->rate[flow] = 0;
+    fluid->version[flow] = fluid->version[flow] + 1;
+    fluid_detach(fluid, flow);
+    fluid_recompute(fluid, flow);
+
+    if (fluid->complete) {
+        fluid->complete(fluid, flow, fluid->complete_arg);
+    }
+}
+
+/*  Add a flow to the member list of each link on its path. */
+static void fluid_attach(fluid_t fluid, unsigned int flow) {
+    unsigned int offset = fluid->path_offset[flow];
+    unsigned int hop;
+
+    for (hop = 0; hop < fluid->path_length[flow]; hop++) {
+        unsigned int link = fluid->path_links[offset + hop];
+
+        if (fluid->member_count[link] == fluid->member_capacity[link]) {
+            fluid->member_capacity[link] = fluid->member_capacity[link] * 2;
+            fluid->members[link] = realloc(fluid->members[link], sizeof(unsigned int) * fluid->member_capacity[link]);
+            assert(fluid->members[link]);
+        }
+
+        fluid->path_slots[offset + hop] = fluid->member_count[link];
+        fluid->members[link][fluid->member_count[link]] = flow;
+        fluid->member_count[link] = fluid->member_count[link] + 1;
+    }
+}
+
+/*  Take a flow out of the member lists, moving the last member of each
+    list into its place. */
+static void fluid_detach(fluid_t fluid, unsigned int flow) {
+    unsigned int offset = fluid->path_offset[flow];
+    unsigned int hop;
+
+    for (hop = 0; hop < fluid->path_length[flow]; hop++) {
+        unsigned int link = fluid->path_links[offset + hop];
+        unsigned int slot = fluid->path_slots[offset + hop];
+        unsigned int last = fluid->members[link][fluid->member_count[link] - 1];
+
+        fluid->members[link][slot] = last;
+        fluid->member_count[link] = fluid->member_count[link] - 1;
+
+        if (last != flow) {
+            unsigned int other = fluid->path_offset[last];
+            while (fluid->path_links[other] != link) {
+                other++;
+            }
+            fluid->path_slots[other] = slot;
+        }
+    }
+}
+
+/*  Recompute max-min rates for every flow connected to the links of the
+    given flow. */
+static void fluid_recompute(fluid_t fluid, unsigned int flow) {
+    unsigned int stamp = fluid->stamp + 1;
+    unsigned int num_links = 0;
+    unsigned int offset = fluid->path_offset[flow];
+    unsigned int i;
+    unsigned int j;
+    unsigned int hop;
+
+    fluid->stamp = stamp;
+
+    for (hop = 0; hop < fluid->path_length[flow]; hop++) {
+        unsigned int link = fluid->path_links[offset + hop];
+        fluid->link_stamp[link] = stamp;
+        fluid->component_links[num_links++] = link;
+    }
+
+    for (i = 0; i < num_links; i++) {
+        unsigned int link = fluid->component_links[i];
+
+        for (j = 0; j < fluid->member_count[link]; j++) {
+            unsigned int member = fluid->members[link][j];
+
+            if (fluid->flow_stamp[member] == stamp) {
+                continue;
+            }
+            fluid->flow_stamp[member] = stamp;
+
+            unsigned int member_offset = fluid->path_offset[member];
+            for (hop = 0; hop < fluid->path_length[member]; hop++) {
+                unsigned int next = fluid->path_links[member_offset + hop];
+                if (fluid->link_stamp[next] != stamp) {
+                    fluid->link_stamp[next] = stamp;
+                    fluid->component_links[num_links++] = next;
+                }
+            }
+        }
+    }
+
+    /*  Water filling over the links found. */
+    fluid->heap_size = 0;
+    for (i = 0; i < num_links; i++) {
+        unsigned int link = fluid->component_links[i];
+
+        fluid->residual[link] = fluid->capacity[link];
+        fluid->unfrozen[link] = fluid->member_count[link];
+        if (fluid->unfrozen[link] > 0) {
+            fluid->share[link] = fluid->residual[link] / fluid->unfrozen[link];
+            heap_push(fluid, fluid->share[link], link);
+        }
+    }
+
+    while (fluid->heap_size > 0) {
+        struct fluid_heap_entry entry = heap_pop(fluid);
+        unsigned int link = entry.link;
+
+        if (fluid->unfrozen[link] == 0 || entry.share != fluid->share[link]) {
+            continue;
+        }
+
+        for (j = 0; j < fluid->member_count[link]; j++) {
+            unsigned int member = fluid->members[link][j];
+
+            if (fluid->frozen[member] == stamp) {
+                continue;
+            }
+            fluid->frozen[member] = stamp;
+            fluid_set_rate(fluid, member, entry.share);
+
+            unsigned int member_offset = fluid->path_offset[member];
+            for (hop = 0; hop < fluid->path_length[member]; hop++) {
+                unsigned int other = fluid->path_links[member_offset + hop];
+                if (other == link) {
+                    continue;
+                }
+
+                fluid->residual[other] = fluid->residual[other] - entry.share;
+                if (fluid->residual[other] < 0) {
+                    fluid->residual[other] = 0;
+                }
+                fluid->unfrozen[other] = fluid->unfrozen[other] - 1;
+                if (fluid->unfrozen[other] > 0) {
+                    fluid->share[other] = fluid->residual[other] / fluid->unfrozen[other];
+                    heap_push(fluid, fluid->share[other], other);
+                }
+            }
+        }
+        fluid->unfrozen[link] = 0;
+    }
+}
+
+/*  Give a flow a new rate, bringing its remaining bytes up to date and
+    enqueueing its completion at the new time. */
+static void fluid_set_rate(fluid_t fluid, unsigned int flow, double rate) {
+    if (rate == fluid->rate[flow]) {
+        return;
+    }
+
+    double remaining = fluid->remaining[flow] - fluid->rate[flow] * (fluid->now - fluid->updated[flow]);
+
+    fluid->remaining[flow] = remaining > 0 ? remaining : 0;
+    fluid->updated[flow] = fluid->now;
+    fluid->rate[flow] = rate;
+    fluid->version[flow] = fluid->version[flow] + 1;
+    fluid->rate_changes = fluid->rate_changes + 1;
+
+    fluid_schedule(fluid, flow, fluid->now + fluid->remaining[flow] / rate, 0);
+}
+
+static void heap_push(fluid_t fluid, double share, unsigned int link) {
+    if (fluid->heap_size == fluid->heap_capacity) {
+        fluid->heap_capacity = fluid->heap_capacity * 2;
+        fluid->heap = realloc(fluid->heap, sizeof(struct fluid_heap_entry) * fluid->heap_capacity);
+        assert(fluid->heap);
+    }
+
+    unsigned int index = fluid->heap_size;
+    fluid->heap_size = index + 1;
+
+    while (index > 0) {
+        unsigned int parent = (index - 1) / 2;
+        if (fluid->heap[parent].share <= share) {
+            break;
+        }
+        fluid->heap[index] = fluid->heap[parent];
+        index = parent;
+    }
+
+    fluid->heap[index].share = share;
+    fluid->heap[index].link = link;
+}
+
+static struct fluid_heap_entry heap_pop(fluid_t fluid) {
+    struct fluid_heap_entry top = fluid->heap[0];
+    struct fluid_heap_entry last = fluid->heap[fluid->heap_size - 1];
+    unsigned int size = fluid->heap_size - 1;
+    unsigned int index = 0;
+
+    fluid->heap_size = size;
+
+    while (2 * index + 1 < size) {
+        unsigned int child = 2 * index + 1;
+        if (child + 1 < size && fluid->heap[child + 1].share < fluid->heap[child].share) {
+            child = child + 1;
+        }
+        if (last.share <= fluid->heap[child].share) {
+            break;
+        }
+        fluid->heap[index] = fluid->heap[child];
+        index = child;
+    }
+
+    if (size > 0) {
+        fluid->heap[index] = last;
+    }
+
+    return top;
+}
+
+static void release_record(void *record, void *pool) {
+    object_pool_release((object_pool_t) pool, record);
+}
@@ -0,0 +1,60 @@
+/*  fluid.h
+
+    Flow level (fluid) network model with max-min fair rates.
+
+    Rather than packets, the unit of simulation is the flow: a number of
+    bytes crossing a fixed path of links. Every active flow is given its
+    max-min fair share of the links it crosses, found by water filling, and
+    holds that rate until a flow arrives or finishes somewhere that affects
+    it. Those are the only events, so a run costs a few events per flow
+    however many bytes flows carry, which makes flow completion time studies
+    of large networks over long periods feasible.
+
+    Max-min rates in one part of the network do not depend on flows that
+    share no link with it, directly or through other flows. An arrival or
+    completion therefore only recomputes the rates of the flows connected
+    to it in this way, over the links they cross, which in a loaded but
+    well spread network is a small part of the whole.
+
+    Completion events are kept in a double time event queue. When the rate
+    of a flow changes its completion is enqueued again at the new time, and
+    the event it had becomes stale and is skipped when it comes to the
+    front, since the event queue has no way of removing it. Flows whose rate
+    comes out unchanged keep their event.
+
+    Links are numbered from 0 and are unidirectional; with a topology the
+    port numbers can serve as link numbers, a port standing for the link
+    leaving it. Capacities are in bytes per tick and time is in ticks, kept
+    as doubles. */
+
+#ifndef FLUID_H
+#define FLUID_H
+
+struct fluid;
+
+typedef struct fluid * fluid_t;
+
+/*  Called when a flow finishes, with the fluid model, the flow and the
+    complete_arg given to fluid_set_completion. New flows may be added from
+    it. */
+typedef void (*func_fluid_complete_t)(fluid_t, unsigned int, void *);
+
+fluid_t create_fluid(unsigned int num_links, const double *capacities);
+void free_fluid(fluid_t fluid);
+void fluid_set_completion(fluid_t fluid, func_fluid_complete_t complete, void *complete_arg);
+unsigned int fluid_add_flow(fluid_t fluid, double start, double bytes, const unsigned int *path, unsigned int path_length);
+void fluid_run_until(fluid_t fluid, double until);
+void fluid_run(fluid_t fluid);
+double fluid_now(fluid_t fluid);
+unsigned int fluid_flows(fluid_t fluid);
+unsigned int fluid_active_flows(fluid_t fluid);
+int fluid_flow_done(fluid_t fluid, unsigned int flow);
+double fluid_flow_rate(fluid_t fluid, unsigned int flow);
+double fluid_flow_remaining(fluid_t fluid, unsigned int flow);
+double fluid_flow_completion_time(fluid_t fluid, unsigned int flow);
+double fluid_link_load(fluid_t fluid, unsigned int link);
+unsigned long fluid_events(fluid_t fluid);
+unsigned long fluid_stale_events(fluid_t fluid);
+unsigned long fluid_rate_changes(fluid_t fluid);
+
+#endif
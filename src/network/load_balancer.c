@@ -0,0 +1,371 @@
+/*  load_balancer.c
+
+    Implementation of the load balancing policies.
+
+    Selecting a port comes down to picking the n-th set bit of a next hop
+    set, where n is a hash reduced to the number of next hops. The reduction
+    uses the high half of a multiplication rather than a modulo, which is
+    just as uniform and avoids a division on every packet.
+
+    The batch function hashes a whole vector of packets and prefetches their
+    next hop sets and flowlet entries before making any decisions, so that
+    the hashes and memory accesses of different packets overlap. */
+
+#include "load_balancer.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_FLOWLET_ENTRIES 4096
+#define LOAD_BALANCER_NO_PORT 0xffff
+#define LOAD_BALANCER_BATCH 64
+#define CRC32C_POLY 0x82f63b78
+#define LOAD_BALANCER_SEED 0x9e3779b9
+
+/*  A flowlet table entry. */
+struct flowlet_entry {
+    uint32_t last_seen;
+    uint16_t tag;
+    uint16_t port;
+};
+
+struct load_balancer {
+    load_balancing_mode_t mode;
+    routing_t routing;
+    unsigned int node;
+    uint32_t seed;
+
+    /*  Next hop sets of this switch for every destination. */
+    const uint64_t *row;
+    unsigned int words;
+
+    /*  Flowlet table, a power of two in size. */
+    struct flowlet_entry *flowlets;
+    unsigned int flowlet_mask;
+    unsigned int flowlet_gap;
+    unsigned long new_flowlets;
+
+    /*  Position of the next packet in the spraying rotation. */
+    unsigned int spray_next;
+};
+
+/*  Software CRC32C table, and whether the crc32 and pdep instructions are
+    available. All are set up the first time a hash is needed. */
+static uint32_t crc32c_table[256];
+static int crc32c_hardware = -1;
+static int pdep_hardware = 0;
+
+/*  Forward declarations of helper functions. */
+static inline void crc32c_init(void);
+static inline uint32_t crc32c_u32(uint32_t crc, uint32_t value);
+static inline uint32_t crc32c_hash(uint32_t seed, uint32_t value);
+static inline unsigned int load_balancer_count(const uint64_t *set, unsigned int words);
+static inline unsigned int load_balancer_nth(const uint64_t *set, unsigned int n);
+static inline unsigned int load_balancer_reduce(uint32_t hash, unsigned int count);
+static unsigned int load_balancer_select_hashed(
+    load_balancer_t balancer,
+    packet_t packet,
+    const uint64_t *set,
+    uint32_t hash,
+    unsigned int now
+);
+
+/*  Create the balancer of one switch. flowlet_gap and flowlet_entries are
+    only used for flowlet switching; flowlet_entries must be a power of two,
+    or 0 for the default. */
+load_balancer_t create_load_balancer(
+    load_balancing_mode_t mode,
+    routing_t routing,
+    unsigned int node,
+    unsigned int flowlet_gap,
+    unsigned int flowlet_entries
+) {
+    assert(routing);
+
+    if (flowlet_entries == 0) {
+        flowlet_entries = DEFAULT_FLOWLET_ENTRIES;
+    }
+    assert((flowlet_entries & (flowlet_entries - 1)) == 0);
+
+    crc32c_init();
+
+    load_balancer_t balancer = malloc(sizeof(struct load_balancer));
+    assert(balancer);
+
+    balancer->mode = mode;
+    balancer->routing = routing;
+    balancer->node = node;
+    balancer->seed = load_balancer_hash(LOAD_BALANCER_SEED, node);
+    balancer->row = routing_next_hops(routing, node, 0);
+    balancer->words = routing_words(routing);
+    balancer->flowlets = NULL;
+    balancer->flowlet_mask = 0;
+    balancer->flowlet_gap = flowlet_gap;
+    balancer->new_flowlets = 0;
+    balancer->spray_next = 0;
+
+    if (mode == LOAD_BALANCE_FLOWLET) {
+        balancer->flowlets = malloc(sizeof(struct flowlet_entry) * flowlet_entries);
+        assert(balancer->flowlets);
+
+        unsigned int i;
+        for (i = 0; i < flowlet_entries; i++) {
+            balancer->flowlets[i].last_seen = 0;
+            balancer->flowlets[i].tag = 0;
+            balancer->flowlets[i].port = LOAD_BALANCER_NO_PORT;
+        }
+
+        balancer->flowlet_mask = flowlet_entries - 1;
+    }
+
+    return balancer;
+}
+
+void free_load_balancer(load_balancer_t balancer) {
+    assert(balancer);
+
+    free(balancer->flowlets);
+    free(balancer);
+}
+
+/*  Choose the egress port of a packet heading for a destination of the
+    routing tables. The choice is stored in the packet's egress_port and
+    returned. The switch must not be the destination itself. */
+unsigned int load_balancer_select(
+    load_balancer_t balancer,
+    packet_t packet,
+    unsigned int destination,
+    unsigned int now
+) {
+    assert(destination < routing_num_destinations(balancer->routing));
+
+    const uint64_t *set = balancer->row + (size_t) destination * balancer->words;
+    uint32_t hash = crc32c_hash(balancer->seed, packet->flow_id);
+
+    return load_balancer_select_hashed(balancer, packet, set, hash, now);
+}
+
+/*  Choose egress ports for a vector of packets, all arriving at time now.
+    The result is the same as calling load_balancer_select on each packet in
+    turn. */
+void load_balancer_select_batch(
+    load_balancer_t balancer,
+    packet_t *packets,
+    const unsigned int *destinations,
+    unsigned int n,
+    unsigned int now
+) {
+    const uint64_t *sets[LOAD_BALANCER_BATCH];
+    uint32_t hashes[LOAD_BALANCER_BATCH];
+    unsigned int start, i;
+
+    for (start = 0; start < n; start += LOAD_BALANCER_BATCH) {
+        unsigned int count = n - start < LOAD_BALANCER_BATCH ? n - start : LOAD_BALANCER_BATCH;
+
+        for (i = 0; i < count; i++) {
+            hashes[i] = crc32c_hash(balancer->seed, packets[start + i]->flow_id);
+            sets[i] = balancer->row + (size_t) destinations[start + i] * balancer->words;
+
+            __builtin_prefetch(sets[i]);
+            if (balancer->flowlets) {
+                __builtin_prefetch(&balancer->flowlets[hashes[i] & balancer->flowlet_mask], 1);
+            }
+        }
+
+        for (i = 0; i < count; i++) {
+            load_balancer_select_hashed(balancer, packets[start + i], sets[i], hashes[i], now);
+        }
+    }
+}
+
+/*  Number of flowlets started so far. */
+unsigned long load_balancer_flowlets(load_balancer_t balancer) {
+    return balancer->new_flowlets;
+}
+
+/*  CRC32C of a 32 bit value, starting from a seed. */
+uint32_t load_balancer_hash(uint32_t seed, uint32_t value) {
+    crc32c_init();
+
+    return crc32c_hash(seed, value);
+}
+
+/*  CRC32C of an IPv4 5-tuple, for callers that have real headers rather
+    than flow identifiers. */
+uint32_t load_balancer_hash_tuple(
+    uint32_t seed,
+    uint32_t src_addr,
+    uint32_t dst_addr,
+    uint16_t src_port,
+    uint16_t dst_port,
+    uint8_t protocol
+) {
+    crc32c_init();
+
+    uint32_t crc = ~seed;
+    crc = crc32c_u32(crc, src_addr);
+    crc = crc32c_u32(crc, dst_addr);
+    crc = crc32c_u32(crc, ((uint32_t) src_port << 16) | dst_port);
+    crc = crc32c_u32(crc, protocol);
+
+    return ~crc;
+}
+
+/*  Helper functions. */
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_u32_hardware(uint32_t crc, uint32_t value) {
+    return __builtin_ia32_crc32si(crc, value);
+}
+#endif
+
+#if defined(__x86_64__)
+__attribute__((target("bmi2")))
+static uint64_t pdep_u64_hardware(uint64_t value, uint64_t mask) {
+    return __builtin_ia32_pdep_di(value, mask);
+}
+#endif
+
+static inline void crc32c_init(void) {
+    if (crc32c_hardware >= 0) {
+        return;
+    }
+
+    unsigned int i, bit;
+    for (i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        }
+        crc32c_table[i] = crc;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    crc32c_hardware = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+    crc32c_hardware = 0;
+#endif
+#if defined(__x86_64__)
+    pdep_hardware = __builtin_cpu_supports("bmi2") ? 1 : 0;
+#endif
+}
+
+/*  Fold the four bytes of value, least significant first, into a CRC. */
+static inline uint32_t crc32c_u32(uint32_t crc, uint32_t value) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (crc32c_hardware > 0) {
+        return crc32c_u32_hardware(crc, value);
+    }
+#endif
+
+    crc = crc ^ value;
+    crc = crc32c_table[crc & 0xff] ^ (crc >> 8);
+    crc = crc32c_table[crc & 0xff] ^ (crc >> 8);
+    crc = crc32c_table[crc & 0xff] ^ (crc >> 8);
+    crc = crc32c_table[crc & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static inline uint32_t crc32c_hash(uint32_t seed, uint32_t value) {
+    return ~crc32c_u32(~seed, value);
+}
+
+static inline unsigned int load_balancer_count(const uint64_t *set, unsigned int words) {
+    unsigned int count = 0;
+    unsigned int i;
+
+    for (i = 0; i < words; i++) {
+        count = count + __builtin_popcountll(set[i]);
+    }
+
+    return count;
+}
+
+/*  Local port number of the n-th set bit, counting from 0. */
+static inline unsigned int load_balancer_nth(const uint64_t *set, unsigned int n) {
+    unsigned int word = 0;
+
+    while (n >= (unsigned int) __builtin_popcountll(set[word])) {
+        n = n - __builtin_popcountll(set[word]);
+        word = word + 1;
+    }
+
+    uint64_t bits = set[word];
+
+    /*  pdep deposits a single bit at the position of the n-th set bit,
+        avoiding a loop whose length changes from packet to packet. */
+#if defined(__x86_64__)
+    if (pdep_hardware) {
+        return word * 64 + __builtin_ctzll(pdep_u64_hardware((uint64_t) 1 << n, bits));
+    }
+#endif
+
+    while (n > 0) {
+        bits = bits & (bits - 1);
+        n = n - 1;
+    }
+
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+static inline unsigned int load_balancer_reduce(uint32_t hash, unsigned int count) {
+    return (unsigned int) (((uint64_t) hash * count) >> 32);
+}
+
+static unsigned int load_balancer_select_hashed(
+    load_balancer_t balancer,
+    packet_t packet,
+    const uint64_t *set,
+    uint32_t hash,
+    unsigned int now
+) {
+    unsigned int count = load_balancer_count(set, balancer->words);
+    unsigned int port;
+
+    assert(count > 0);
+
+    switch (balancer->mode) {
+        case LOAD_BALANCE_ECMP:
+            port = load_balancer_nth(set, load_balancer_reduce(hash, count));
+            break;
+
+        case LOAD_BALANCE_FLOWLET: {
+            struct flowlet_entry *entry = &balancer->flowlets[hash & balancer->flowlet_mask];
+            uint16_t tag = (uint16_t) (hash >> 16);
+
+            /*  Keep the current port within a flowlet, as long as it is
+                still a next hop. */
+            if (entry->port != LOAD_BALANCER_NO_PORT &&
+                entry->tag == tag &&
+                now - entry->last_seen < balancer->flowlet_gap &&
+                (set[entry->port / 64] >> (entry->port % 64)) & 1) {
+                port = entry->port;
+            } else {
+                port = load_balancer_nth(set, load_balancer_reduce(crc32c_hash(hash, now), count));
+                entry->tag = tag;
+                entry->port = (uint16_t) port;
+                balancer->new_flowlets = balancer->new_flowlets + 1;
+            }
+
+            entry->last_seen = now;
+            break;
+        }
+
+        case LOAD_BALANCE_SPRAY:
+        default:
+            if (balancer->spray_next >= count) {
+                balancer->spray_next = 0;
+            }
+            port = load_balancer_nth(set, balancer->spray_next);
+            balancer->spray_next = balancer->spray_next + 1;
+            break;
+    }
+
+    packet->egress_port = port;
+
+    return port;
+}
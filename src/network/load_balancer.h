@@ -0,0 +1,75 @@
+/*  load_balancer.h
+
+    Choice of egress port among the equal cost next hops given by the
+    routing tables, made per packet at every switch.
+
+    Three policies are offered:
+
+    - ECMP hashes the flow of the packet, so all packets of a flow take the
+      same path.
+    - Flowlet switching keeps the port chosen for each flow in a small table
+      together with the time its last packet was seen. A packet arriving
+      after a gap of at least flowlet_gap ticks starts a new flowlet, which
+      may take a different path without risking reordering.
+    - Packet spraying sends successive packets round robin over the next
+      hops, ignoring flows altogether.
+
+    Hashes are CRC32C, computed with the SSE 4.2 crc32 instruction when the
+    processor has it. Every switch is given its own seed so that hashing
+    decisions at successive hops are independent.
+
+    The flowlet table is indexed by flow hash, with part of the hash kept as
+    a tag to tell colliding flows apart. Each entry is 8 bytes, so the default
+    4096 entries take 32 KB and sit comfortably in L2. */
+
+#ifndef LOAD_BALANCER_H
+#define LOAD_BALANCER_H
+
+#include "routing.h"
+#include "../switch/packet.h"
+
+#include <stdint.h>
+
+struct load_balancer;
+
+typedef struct load_balancer * load_balancer_t;
+
+typedef enum load_balancing_mode {
+    LOAD_BALANCE_ECMP,
+    LOAD_BALANCE_FLOWLET,
+    LOAD_BALANCE_SPRAY
+} load_balancing_mode_t;
+
+load_balancer_t create_load_balancer(
+    load_balancing_mode_t mode,
+    routing_t routing,
+    unsigned int node,
+    unsigned int flowlet_gap,
+    unsigned int flowlet_entries
+);
+void free_load_balancer(load_balancer_t balancer);
+unsigned int load_balancer_select(
+    load_balancer_t balancer,
+    packet_t packet,
+    unsigned int destination,
+    unsigned int now
+);
+void load_balancer_select_batch(
+    load_balancer_t balancer,
+    packet_t *packets,
+    const unsigned int *destinations,
+    unsigned int n,
+    unsigned int now
+);
+unsigned long load_balancer_flowlets(load_balancer_t balancer);
+uint32_t load_balancer_hash(uint32_t seed, uint32_t value);
+uint32_t load_balancer_hash_tuple(
+    uint32_t seed,
+    uint32_t src_addr,
+    uint32_t dst_addr,
+    uint16_t src_port,
+    uint16_t dst_port,
+    uint8_t protocol
+);
+
+#endif
@@ -0,0 +1,416 @@
+/*  routing.c
+
+    Implementation of the routing tables.
+
+    The table is one array indexed by switch, then destination, then word,
+    so the next hop sets of a switch for all destinations are contiguous.
+    Each worker thread takes every num_threads-th destination and runs a
+    breadth first search over the switches from it. A port of switch s is a
+    next hop towards the destination whenever the switch at its far end is
+    one step closer. Workers only write the entries of their own
+    destinations, so no locking is needed.
+
+    The cache file holds a fixed size header followed by the table exactly as
+    it is laid out in memory, so a loaded table is used straight out of the
+    mapping. Files are only ever replaced whole, never rewritten in place,
+    so a mapping stays valid however many times the file is saved again. */
+
+#define _DEFAULT_SOURCE
+
+#include "routing.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*  Constant definitions. */
+#define ROUTING_FILE_MAGIC 0x52544231
+#define ROUTING_FILE_VERSION 1
+#define ROUTING_NO_DESTINATION UINT_MAX
+#define ROUTING_UNREACHED UINT_MAX
+
+/*  Header of a cache file, followed directly by the table. */
+struct routing_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t topology_hash;
+    uint32_t num_switches;
+    uint32_t num_destinations;
+    uint32_t words;
+    uint32_t reserved;
+};
+
+struct routing {
+    topology_t topology;
+
+    unsigned int num_destinations;
+    unsigned int words;
+
+    /*  Destination index of each switch, or ROUTING_NO_DESTINATION if no
+        hosts are attached to it, and the switch of each destination. */
+    unsigned int *destination_of;
+    unsigned int *destination_switch;
+
+    uint64_t *table;
+
+    /*  Set when the table lives in a mapped cache file. */
+    void *mapping;
+    size_t mapping_size;
+};
+
+/*  Work given to one thread. */
+struct routing_worker {
+    routing_t routing;
+    unsigned int first;
+    unsigned int stride;
+};
+
+/*  Forward declarations of helper functions. */
+static routing_t routing_alloc(topology_t topology);
+static size_t routing_table_words(routing_t routing);
+static void * routing_worker_run(void *worker_ptr);
+static void routing_compute(routing_t routing, unsigned int destination, unsigned int *dist, unsigned int *queue);
+
+/*  Compute the routing tables of a topology using the given number of
+    threads, or one per processor if num_threads is 0. The topology must
+    outlive the tables. */
+routing_t create_routing(topology_t topology, unsigned int num_threads) {
+    routing_t routing = routing_alloc(topology);
+
+    routing->table = calloc(routing_table_words(routing), sizeof(uint64_t));
+    assert(routing->table);
+
+    if (num_threads == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = processors > 0 ? (unsigned int) processors : 1;
+    }
+    if (num_threads > routing->num_destinations) {
+        num_threads = routing->num_destinations;
+    }
+
+    struct routing_worker *workers = malloc(sizeof(struct routing_worker) * num_threads);
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    assert(workers && threads);
+
+    unsigned int i;
+    for (i = 0; i < num_threads; i++) {
+        workers[i].routing = routing;
+        workers[i].first = i;
+        workers[i].stride = num_threads;
+    }
+
+    /*  The calling thread takes the first share itself. */
+    for (i = 1; i < num_threads; i++) {
+        int result = pthread_create(&threads[i], NULL, routing_worker_run, &workers[i]);
+        assert(result == 0);
+    }
+    if (num_threads > 0) {
+        routing_worker_run(&workers[0]);
+    }
+    for (i = 1; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    free(workers);
+
+    return routing;
+}
+
+/*  Map tables saved by save_routing. Returns NULL if the file cannot be
+    read or was saved for a different topology. */
+routing_t load_routing(topology_t topology, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(struct routing_file_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    routing_t routing = routing_alloc(topology);
+    struct routing_file_header *header = (struct routing_file_header *) mapping;
+    size_t expected = sizeof(struct routing_file_header) + routing_table_words(routing) * sizeof(uint64_t);
+
+    if (header->magic != ROUTING_FILE_MAGIC ||
+        header->version != ROUTING_FILE_VERSION ||
+        header->topology_hash != topology_hash(topology) ||
+        header->num_switches != topology->num_switches ||
+        header->num_destinations != routing->num_destinations ||
+        header->words != routing->words ||
+        (size_t) info.st_size != expected) {
+        munmap(mapping, info.st_size);
+        free_routing(routing);
+        return NULL;
+    }
+
+    routing->table = (uint64_t *) (header + 1);
+    routing->mapping = mapping;
+    routing->mapping_size = info.st_size;
+
+    return routing;
+}
+
+/*  Write the tables to a file for load_routing. Returns 1 on success and 0
+    on failure. The tables are written to a temporary file next to path,
+    which is synced and then renamed over path. Other processes that mapped
+    the old file keep their mapping intact, and a crash part way through
+    never leaves a torn file at path. */
+int save_routing(routing_t routing, const char *path) {
+    size_t length = strlen(path) + 32;
+    char *temporary = malloc(length);
+    assert(temporary);
+    snprintf(temporary, length, "%s.tmp.%ld", path, (long) getpid());
+
+    FILE *file = fopen(temporary, "wb");
+    if (file == NULL) {
+        free(temporary);
+        return 0;
+    }
+
+    struct routing_file_header header;
+    header.magic = ROUTING_FILE_MAGIC;
+    header.version = ROUTING_FILE_VERSION;
+    header.topology_hash = topology_hash(routing->topology);
+    header.num_switches = routing->topology->num_switches;
+    header.num_destinations = routing->num_destinations;
+    header.words = routing->words;
+    header.reserved = 0;
+
+    size_t words = routing_table_words(routing);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(routing->table, sizeof(uint64_t), words, file) == words &&
+        fflush(file) == 0 &&
+        fsync(fileno(file)) == 0;
+
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (ok && rename(temporary, path) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(temporary);
+    }
+
+    free(temporary);
+    return ok;
+}
+
+/*  Load the tables from path if it holds tables for this topology, and
+    otherwise compute them and try to save them there. */
+routing_t create_routing_cached(topology_t topology, unsigned int num_threads, const char *path) {
+    routing_t routing = load_routing(topology, path);
+
+    if (routing == NULL) {
+        routing = create_routing(topology, num_threads);
+        save_routing(routing, path);
+    }
+
+    return routing;
+}
+
+void free_routing(routing_t routing) {
+    assert(routing);
+
+    if (routing->mapping) {
+        munmap(routing->mapping, routing->mapping_size);
+    } else {
+        free(routing->table);
+    }
+
+    free(routing->destination_of);
+    free(routing->destination_switch);
+    free(routing);
+}
+
+/*  Number of destination switches. */
+unsigned int routing_num_destinations(routing_t routing) {
+    return routing->num_destinations;
+}
+
+/*  Destination index under which routes to a host are found. */
+unsigned int routing_destination(routing_t routing, unsigned int host) {
+    topology_t topology = routing->topology;
+
+    assert(host < topology->num_hosts);
+
+    return routing->destination_of[topology_host_switch(topology, host) - topology->num_hosts];
+}
+
+/*  Number of words in each next hop set. */
+unsigned int routing_words(routing_t routing) {
+    return routing->words;
+}
+
+/*  Set of local ports of a switch leading towards a destination. */
+const uint64_t * routing_next_hops(routing_t routing, unsigned int node, unsigned int destination) {
+    topology_t topology = routing->topology;
+
+    assert(node >= topology->num_hosts && node < topology->num_nodes);
+    assert(destination < routing->num_destinations);
+
+    size_t entry = (size_t) (node - topology->num_hosts) * routing->num_destinations + destination;
+
+    return routing->table + entry * routing->words;
+}
+
+/*  Number of ports in a next hop set. */
+unsigned int routing_next_hop_count(routing_t routing, unsigned int node, unsigned int destination) {
+    const uint64_t *set = routing_next_hops(routing, node, destination);
+    unsigned int count = 0;
+    unsigned int i;
+
+    for (i = 0; i < routing->words; i++) {
+        count = count + __builtin_popcountll(set[i]);
+    }
+
+    return count;
+}
+
+/*  Whether the tables were loaded from a cache file. */
+int routing_is_mapped(routing_t routing) {
+    return routing->mapping != NULL;
+}
+
+/*  Helper functions. */
+
+/*  Allocate tables for a topology without the table itself, numbering the
+    destinations and sizing the next hop sets. */
+static routing_t routing_alloc(topology_t topology) {
+    assert(topology);
+
+    routing_t routing = malloc(sizeof(struct routing));
+    assert(routing);
+
+    unsigned int num_hosts = topology->num_hosts;
+    unsigned int num_switches = topology->num_switches;
+
+    routing->topology = topology;
+    routing->table = NULL;
+    routing->mapping = NULL;
+    routing->mapping_size = 0;
+
+    routing->destination_of = malloc(sizeof(unsigned int) * num_switches);
+    routing->destination_switch = malloc(sizeof(unsigned int) * num_switches);
+    assert(routing->destination_of && routing->destination_switch);
+
+    unsigned int s;
+    for (s = 0; s < num_switches; s++) {
+        routing->destination_of[s] = ROUTING_NO_DESTINATION;
+    }
+
+    /*  Number destinations in order of switch. */
+    unsigned int h;
+    for (h = 0; h < num_hosts; h++) {
+        routing->destination_of[topology_host_switch(topology, h) - num_hosts] = 0;
+    }
+
+    unsigned int max_degree = 0;
+    routing->num_destinations = 0;
+    for (s = 0; s < num_switches; s++) {
+        if (routing->destination_of[s] != ROUTING_NO_DESTINATION) {
+            routing->destination_of[s] = routing->num_destinations;
+            routing->destination_switch[routing->num_destinations] = num_hosts + s;
+            routing->num_destinations = routing->num_destinations + 1;
+        }
+        if (topology_degree(topology, num_hosts + s) > max_degree) {
+            max_degree = topology_degree(topology, num_hosts + s);
+        }
+    }
+
+    routing->words = max_degree > 0 ? (max_degree + 63) / 64 : 1;
+
+    return routing;
+}
+
+static size_t routing_table_words(routing_t routing) {
+    return (size_t) routing->topology->num_switches * routing->num_destinations * routing->words;
+}
+
+static void * routing_worker_run(void *worker_ptr) {
+    struct routing_worker *worker = (struct routing_worker *) worker_ptr;
+    routing_t routing = worker->routing;
+    unsigned int num_switches = routing->topology->num_switches;
+
+    unsigned int *dist = malloc(sizeof(unsigned int) * num_switches);
+    unsigned int *queue = malloc(sizeof(unsigned int) * num_switches);
+    assert(dist && queue);
+
+    unsigned int d;
+    for (d = worker->first; d < routing->num_destinations; d += worker->stride) {
+        routing_compute(routing, d, dist, queue);
+    }
+
+    free(dist);
+    free(queue);
+
+    return NULL;
+}
+
+/*  Fill in the next hop sets of every switch for one destination. */
+static void routing_compute(routing_t routing, unsigned int destination, unsigned int *dist, unsigned int *queue) {
+    topology_t topology = routing->topology;
+    unsigned int num_hosts = topology->num_hosts;
+    unsigned int num_switches = topology->num_switches;
+    unsigned int words = routing->words;
+    unsigned int i, p;
+
+    for (i = 0; i < num_switches; i++) {
+        dist[i] = ROUTING_UNREACHED;
+    }
+
+    /*  Breadth first search over switches only - hosts never forward. */
+    unsigned int head = 0;
+    unsigned int tail = 0;
+    unsigned int root = routing->destination_switch[destination] - num_hosts;
+
+    dist[root] = 0;
+    queue[tail++] = root;
+
+    while (head < tail) {
+        unsigned int s = queue[head++];
+        unsigned int node = num_hosts + s;
+
+        for (p = topology->port_offset[node]; p < topology->port_offset[node + 1]; p++) {
+            unsigned int peer = topology_peer_node(topology, p);
+            if (peer >= num_hosts && dist[peer - num_hosts] == ROUTING_UNREACHED) {
+                dist[peer - num_hosts] = dist[s] + 1;
+                queue[tail++] = peer - num_hosts;
+            }
+        }
+    }
+
+    /*  Every reached switch other than the root takes the ports leading one
+        step closer. */
+    for (i = 1; i < tail; i++) {
+        unsigned int s = queue[i];
+        unsigned int node = num_hosts + s;
+        unsigned int first = topology->port_offset[node];
+        uint64_t *set = routing->table + ((size_t) s * routing->num_destinations + destination) * words;
+
+        for (p = first; p < topology->port_offset[node + 1]; p++) {
+            unsigned int peer = topology_peer_node(topology, p);
+            if (peer >= num_hosts && dist[peer - num_hosts] + 1 == dist[s]) {
+                set[(p - first) / 64] |= (uint64_t) 1 << ((p - first) % 64);
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/*  routing.h
+
+    Shortest path routing tables with equal cost multipath (ECMP) next hop
+    sets, computed for every switch of a topology.
+
+    Hosts are reached through the switch they are attached to, so routes are
+    computed per destination switch rather than per host - every switch with
+    hosts attached is a destination, standing for the prefix of hosts below
+    it. For each switch and each destination the table holds the set of
+    ports, numbered locally from 0 to the degree of the switch, that lie on
+    a shortest path. Sets are stored as bitsets of routing_words 64 bit words,
+    so a k = 64 fat-tree needs a single word per entry.
+
+    Tables are computed with one breadth first search per destination,
+    spread over a number of threads. Since the result only depends on the
+    topology, it can be saved to a file and mapped back in on later runs;
+    create_routing_cached does this automatically, using a hash of the
+    topology to detect a stale file.
+
+    At the destination switch itself the set is empty, and the packet leaves
+    by the port its host is attached to. */
+
+#ifndef ROUTING_H
+#define ROUTING_H
+
+#include "topology.h"
+
+#include <stdint.h>
+
+struct routing;
+
+typedef struct routing * routing_t;
+
+routing_t create_routing(topology_t topology, unsigned int num_threads);
+routing_t load_routing(topology_t topology, const char *path);
+int save_routing(routing_t routing, const char *path);
+routing_t create_routing_cached(topology_t topology, unsigned int num_threads, const char *path);
+void free_routing(routing_t routing);
+unsigned int routing_num_destinations(routing_t routing);
+unsigned int routing_destination(routing_t routing, unsigned int host);
+unsigned int routing_words(routing_t routing);
+const uint64_t * routing_next_hops(routing_t routing, unsigned int node, unsigned int destination);
+unsigned int routing_next_hop_count(routing_t routing, unsigned int node, unsigned int destination);
+int routing_is_mapped(routing_t routing);
+
+#endif
@@ -0,0 +1,337 @@
+/*  topology.c
+
+    Implementation of the topology builders.
+
+    Each builder first lists its links as pairs of node numbers, then the
+    CSR arrays are built from the list in two passes: one counting the
+    degree of every node to give port_offset, and one handing out ports in
+    the order the links were listed. Builders list links so that the ports
+    of each switch come out in a useful order - downward ports before upward
+    ones. */
+
+#include "topology.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define TOPOLOGY_HASH_BASIS 0xcbf29ce484222325ULL
+#define TOPOLOGY_HASH_PRIME 0x100000001b3ULL
+
+/*  Links listed by a builder before the CSR arrays are filled in. */
+struct link_list {
+    unsigned int *a;
+    unsigned int *b;
+    unsigned char *type;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+/*  Forward declarations of helper functions. */
+static topology_t topology_alloc(unsigned int num_hosts, unsigned int num_switches);
+static void link_list_init(struct link_list *links, unsigned int capacity);
+static void link_list_add(struct link_list *links, unsigned int a, unsigned int b, topology_link_type_t type);
+static void topology_build_ports(topology_t topology, struct link_list *links);
+static inline uint64_t topology_hash_word(uint64_t hash, uint32_t word);
+
+/*  Build a k-ary fat-tree: k pods of k / 2 edge and k / 2 aggregation
+    switches, (k / 2)^2 core switches and k^3 / 4 hosts. Edge switches are
+    level 1, aggregation level 2 and core level 3. */
+topology_t create_fat_tree(unsigned int k) {
+    assert(k >= 2 && k % 2 == 0);
+
+    unsigned int half = k / 2;
+    unsigned int num_hosts = k * half * half;
+    unsigned int num_edge = k * half;
+    unsigned int num_core = half * half;
+
+    topology_t topology = topology_alloc(num_hosts, 2 * num_edge + num_core);
+
+    unsigned int first_edge = num_hosts;
+    unsigned int first_agg = first_edge + num_edge;
+    unsigned int first_core = first_agg + num_edge;
+
+    struct link_list links;
+    link_list_init(&links, num_hosts + 2 * num_edge * half);
+
+    unsigned int i;
+    for (i = 0; i < num_hosts; i++) {
+        link_list_add(&links, i, first_edge + i / half, TOPOLOGY_HOST_LINK);
+    }
+
+    unsigned int pod, e, a, c;
+    for (pod = 0; pod < k; pod++) {
+        for (e = 0; e < half; e++) {
+            for (a = 0; a < half; a++) {
+                link_list_add(&links, first_edge + pod * half + e, first_agg + pod * half + a, TOPOLOGY_LOCAL_LINK);
+            }
+        }
+    }
+
+    /*  Aggregation switch a of every pod connects to the a-th group of k / 2
+        core switches, so core switch ports are numbered by pod. */
+    for (pod = 0; pod < k; pod++) {
+        for (a = 0; a < half; a++) {
+            for (c = 0; c < half; c++) {
+                link_list_add(&links, first_agg + pod * half + a, first_core + a * half + c, TOPOLOGY_LOCAL_LINK);
+            }
+        }
+    }
+
+    for (i = first_edge; i < first_agg; i++) {
+        topology->level[i] = 1;
+    }
+    for (i = first_agg; i < first_core; i++) {
+        topology->level[i] = 2;
+    }
+    for (i = first_core; i < topology->num_nodes; i++) {
+        topology->level[i] = 3;
+    }
+
+    topology_build_ports(topology, &links);
+
+    return topology;
+}
+
+/*  Build a two tier leaf-spine network in which every leaf is connected to
+    every spine. Leaves are level 1 and spines level 2. */
+topology_t create_leaf_spine(unsigned int num_leaves, unsigned int num_spines, unsigned int hosts_per_leaf) {
+    assert(num_leaves > 0);
+    assert(num_spines > 0);
+    assert(hosts_per_leaf > 0);
+
+    unsigned int num_hosts = num_leaves * hosts_per_leaf;
+    topology_t topology = topology_alloc(num_hosts, num_leaves + num_spines);
+
+    unsigned int first_leaf = num_hosts;
+    unsigned int first_spine = first_leaf + num_leaves;
+
+    struct link_list links;
+    link_list_init(&links, num_hosts + num_leaves * num_spines);
+
+    unsigned int i, s;
+    for (i = 0; i < num_hosts; i++) {
+        link_list_add(&links, i, first_leaf + i / hosts_per_leaf, TOPOLOGY_HOST_LINK);
+    }
+
+    for (i = 0; i < num_leaves; i++) {
+        for (s = 0; s < num_spines; s++) {
+            link_list_add(&links, first_leaf + i, first_spine + s, TOPOLOGY_LOCAL_LINK);
+        }
+    }
+
+    for (i = first_leaf; i < first_spine; i++) {
+        topology->level[i] = 1;
+    }
+    for (i = first_spine; i < topology->num_nodes; i++) {
+        topology->level[i] = 2;
+    }
+
+    topology_build_ports(topology, &links);
+
+    return topology;
+}
+
+/*  Build a dragonfly with the maximum number of groups,
+    routers_per_group * global_per_router + 1. Routers within a group are
+    fully connected by local links, and every pair of groups is joined by
+    exactly one global link. All routers are level 1.
+
+    Global links are assigned consecutively: the j-th global port of router r
+    in group g has index i = r * global_per_router + j within the group, and
+    leads to group i if i < g and to group i + 1 otherwise. */
+topology_t create_dragonfly(unsigned int hosts_per_router, unsigned int routers_per_group, unsigned int global_per_router) {
+    assert(hosts_per_router > 0);
+    assert(routers_per_group > 0);
+    assert(global_per_router > 0);
+
+    unsigned int global_per_group = routers_per_group * global_per_router;
+    unsigned int num_groups = global_per_group + 1;
+    unsigned int num_routers = num_groups * routers_per_group;
+    unsigned int num_hosts = num_routers * hosts_per_router;
+
+    topology_t topology = topology_alloc(num_hosts, num_routers);
+
+    unsigned int first_router = num_hosts;
+
+    struct link_list links;
+    link_list_init(&links,
+        num_hosts +
+        num_groups * routers_per_group * (routers_per_group - 1) / 2 +
+        num_groups * global_per_group / 2
+    );
+
+    unsigned int i, g, r, s;
+    for (i = 0; i < num_hosts; i++) {
+        link_list_add(&links, i, first_router + i / hosts_per_router, TOPOLOGY_HOST_LINK);
+    }
+
+    for (g = 0; g < num_groups; g++) {
+        unsigned int base = first_router + g * routers_per_group;
+        for (r = 0; r < routers_per_group; r++) {
+            for (s = r + 1; s < routers_per_group; s++) {
+                link_list_add(&links, base + r, base + s, TOPOLOGY_LOCAL_LINK);
+            }
+        }
+    }
+
+    /*  Each global link is listed once, from the lower numbered group. On
+        the far side it has index g, since g is below the target group.
+        Listing in this order leaves the global ports of every router in
+        index order after its host and local ports. */
+    for (g = 0; g < num_groups; g++) {
+        for (i = 0; i < global_per_group; i++) {
+            unsigned int target = i < g ? i : i + 1;
+            if (target < g) {
+                continue;
+            }
+
+            link_list_add(&links,
+                first_router + g * routers_per_group + i / global_per_router,
+                first_router + target * routers_per_group + g / global_per_router,
+                TOPOLOGY_GLOBAL_LINK
+            );
+        }
+    }
+
+    for (i = first_router; i < topology->num_nodes; i++) {
+        topology->level[i] = 1;
+    }
+
+    topology_build_ports(topology, &links);
+
+    return topology;
+}
+
+void free_topology(topology_t topology) {
+    assert(topology);
+
+    free(topology->port_offset);
+    free(topology->peer);
+    free(topology->port_node);
+    free(topology->link_type);
+    free(topology->level);
+    free(topology);
+}
+
+/*  Hash of the structure of a topology, identical for topologies with the
+    same nodes, ports and links. Used to key data derived from a topology,
+    such as cached routing tables. */
+uint64_t topology_hash(topology_t topology) {
+    uint64_t hash = TOPOLOGY_HASH_BASIS;
+    unsigned int i;
+
+    hash = topology_hash_word(hash, topology->num_nodes);
+    hash = topology_hash_word(hash, topology->num_hosts);
+    hash = topology_hash_word(hash, topology->num_ports);
+
+    for (i = 0; i <= topology->num_nodes; i++) {
+        hash = topology_hash_word(hash, topology->port_offset[i]);
+    }
+    for (i = 0; i < topology->num_ports; i++) {
+        hash = topology_hash_word(hash, topology->peer[i] | ((uint32_t) topology->link_type[i] << 30));
+    }
+
+    return hash;
+}
+
+/*  Helper functions. */
+
+/*  One step of 64 bit FNV-1a, taking a whole word at a time. */
+static inline uint64_t topology_hash_word(uint64_t hash, uint32_t word) {
+    return (hash ^ word) * TOPOLOGY_HASH_PRIME;
+}
+
+static topology_t topology_alloc(unsigned int num_hosts, unsigned int num_switches) {
+    topology_t topology = malloc(sizeof(struct topology));
+    assert(topology);
+
+    topology->num_hosts = num_hosts;
+    topology->num_switches = num_switches;
+    topology->num_nodes = num_hosts + num_switches;
+    topology->num_ports = 0;
+
+    topology->port_offset = NULL;
+    topology->peer = NULL;
+    topology->port_node = NULL;
+    topology->link_type = NULL;
+
+    /*  Hosts are level 0, switches are set by the builder. */
+    topology->level = calloc(topology->num_nodes, sizeof(unsigned char));
+    assert(topology->level);
+
+    return topology;
+}
+
+static void link_list_init(struct link_list *links, unsigned int capacity) {
+    links->a = malloc(sizeof(unsigned int) * capacity);
+    links->b = malloc(sizeof(unsigned int) * capacity);
+    links->type = malloc(sizeof(unsigned char) * capacity);
+    assert(links->a && links->b && links->type);
+
+    links->count = 0;
+    links->capacity = capacity;
+}
+
+static void link_list_add(struct link_list *links, unsigned int a, unsigned int b, topology_link_type_t type) {
+    assert(links->count < links->capacity);
+    assert(a != b);
+
+    links->a[links->count] = a;
+    links->b[links->count] = b;
+    links->type[links->count] = (unsigned char) type;
+    links->count = links->count + 1;
+}
+
+/*  Fill in the CSR arrays from the link list, which is then freed. */
+static void topology_build_ports(topology_t topology, struct link_list *links) {
+    unsigned int num_nodes = topology->num_nodes;
+    unsigned int num_ports = 2 * links->count;
+    unsigned int i, n;
+
+    topology->num_ports = num_ports;
+    topology->port_offset = calloc(num_nodes + 1, sizeof(unsigned int));
+    topology->peer = malloc(sizeof(unsigned int) * num_ports);
+    topology->port_node = malloc(sizeof(unsigned int) * num_ports);
+    topology->link_type = malloc(sizeof(unsigned char) * num_ports);
+    assert(topology->port_offset && topology->peer && topology->port_node && topology->link_type);
+
+    /*  Count degrees into port_offset[n + 1], then take prefix sums. */
+    for (i = 0; i < links->count; i++) {
+        topology->port_offset[links->a[i] + 1] += 1;
+        topology->port_offset[links->b[i] + 1] += 1;
+    }
+    for (n = 0; n < num_nodes; n++) {
+        topology->port_offset[n + 1] += topology->port_offset[n];
+    }
+
+    /*  Hand out ports in link order, using a cursor per node. */
+    unsigned int *cursor = malloc(sizeof(unsigned int) * num_nodes);
+    assert(cursor);
+    for (n = 0; n < num_nodes; n++) {
+        cursor[n] = topology->port_offset[n];
+    }
+
+    for (i = 0; i < links->count; i++) {
+        unsigned int a = links->a[i];
+        unsigned int b = links->b[i];
+        unsigned int port_a = cursor[a];
+        unsigned int port_b = cursor[b];
+
+        cursor[a] = port_a + 1;
+        cursor[b] = port_b + 1;
+
+        topology->peer[port_a] = port_b;
+        topology->peer[port_b] = port_a;
+        topology->port_node[port_a] = a;
+        topology->port_node[port_b] = b;
+        topology->link_type[port_a] = links->type[i];
+        topology->link_type[port_b] = links->type[i];
+    }
+
+    free(cursor);
+    free(links->a);
+    free(links->b);
+    free(links->type);
+}
@@ -0,0 +1,80 @@
+/*  topology.h
+
+    Multi-switch network topologies stored as flat arrays.
+
+    A topology is a set of nodes - hosts and switches - joined by
+    bidirectional links. Rather than a graph of pointers, it is held in
+    compressed sparse row (CSR) form: the ports of every node are numbered
+    consecutively in one global index space, port_offset[n] being the first
+    port of node n and port_offset[n + 1] one past its last. Each link is a
+    pair of ports, and peer[p] is the port at the other end of port p, so
+    that peer[peer[p]] == p. Everything needed to walk the network is in a
+    handful of integer arrays, which keeps traversal cheap and lets models
+    index per-port state with the same port numbers.
+
+    Hosts are numbered first, from 0 to num_hosts - 1, followed by the
+    switches from the lowest tier up. Every host has exactly one port.
+
+    The structure is public so that routing and the models built on top of it
+    can read the arrays directly, but it must only be modified through the
+    functions below. */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdint.h>
+
+struct topology;
+
+typedef struct topology * topology_t;
+
+/*  Kind of link a port belongs to, allowing different rates and delays to be
+    given to different parts of the network. */
+typedef enum topology_link_type {
+    TOPOLOGY_HOST_LINK,
+    TOPOLOGY_LOCAL_LINK,
+    TOPOLOGY_GLOBAL_LINK
+} topology_link_type_t;
+
+struct topology {
+    unsigned int num_nodes;
+    unsigned int num_hosts;
+    unsigned int num_switches;
+    unsigned int num_ports;
+
+    /*  First port of each node, num_nodes + 1 entries. */
+    unsigned int *port_offset;
+
+    /*  Per port: the port at the other end of the link, the node the port
+        belongs to and the kind of link. */
+    unsigned int *peer;
+    unsigned int *port_node;
+    unsigned char *link_type;
+
+    /*  Per node: the tier it sits in, 0 for hosts and counting up from the
+        switches hosts are attached to. */
+    unsigned char *level;
+};
+
+topology_t create_fat_tree(unsigned int k);
+topology_t create_leaf_spine(unsigned int num_leaves, unsigned int num_spines, unsigned int hosts_per_leaf);
+topology_t create_dragonfly(unsigned int hosts_per_router, unsigned int routers_per_group, unsigned int global_per_router);
+void free_topology(topology_t topology);
+uint64_t topology_hash(topology_t topology);
+
+/*  Number of ports of a node. */
+static inline unsigned int topology_degree(topology_t topology, unsigned int node) {
+    return topology->port_offset[node + 1] - topology->port_offset[node];
+}
+
+/*  Node at the other end of a port. */
+static inline unsigned int topology_peer_node(topology_t topology, unsigned int port) {
+    return topology->port_node[topology->peer[port]];
+}
+
+/*  Switch a host is attached to. */
+static inline unsigned int topology_host_switch(topology_t topology, unsigned int host) {
+    return topology_peer_node(topology, topology->port_offset[host]);
+}
+
+#endif
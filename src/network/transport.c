@@ -0,0 +1,816 @@
+/*  transport.c
+
+    Implementation of the end-host transport models.
+
+    Per flow state lives in parallel arrays that all grow together. Round
+    trip times are smoothed as in RFC 6298, keeping eight times the smoothed
+    round trip time and four times its variation so that the gains are
+    shifts.
+
+    Until the first round trip has been measured the timeout is five times
+    the minimum, the ratio of the usual one second initial timeout to the
+    usual 200 millisecond minimum.
+
+    Window reductions happen at most once per window of data: after one,
+    the flow records one past the highest segment it had sent, and reacts
+    again only once everything up to there has been acknowledged.
+
+    The timing wheel has WHEEL_SLOTS slots of a sixteenth of the minimum
+    timeout each. Timers are threaded through the slots by flow number, so
+    the wheel allocates nothing. A timer goes in the slot of its deadline
+    rounded up, or the last slot if the deadline lies beyond the wheel. Its
+    event is scheduled for the next occupied slot but never more than one
+    minimum timeout ahead. Since every deadline is at least one minimum
+    timeout away when it is set, a timer never needs the event earlier than
+    it is already scheduled, and the event is never cancelled. */
+
+#include "transport.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define CWND_ONE 1024
+#define INITIAL_CWND (10 * CWND_ONE)
+#define MIN_SSTHRESH (2 * CWND_ONE)
+#define INITIAL_SSTHRESH 0x7fffffffu
+#define INITIAL_RTO_FACTOR 5
+#define DUPACK_THRESHOLD 3
+#define ACK_BYTES 64
+#define DCTCP_GAIN_SHIFT 4
+#define MAX_BACKOFF 64
+#define WHEEL_SLOTS 256
+#define WHEEL_SLOTS_PER_RTO 16
+#define WHEEL_WORDS (WHEEL_SLOTS / 64)
+#define DEFAULT_FLOW_CAPACITY 64
+#define DEFAULT_BATCH_CAPACITY 16
+#define FLOW_NONE 0xffffffffu
+
+#define FLOW_DONE 0x1
+#define FLOW_ARMED 0x2
+#define FLOW_IN_WHEEL 0x4
+
+/*  An acknowledgement waiting to be processed. */
+struct transport_ack {
+    unsigned int flow;
+    unsigned int seq;
+    unsigned int sent;
+    int echo;
+};
+
+struct transport_host {
+    transport_t transport;
+
+    /*  Fires a tick after the batch was started, by which time every
+        acknowledgement arriving at the same time has joined it. */
+    struct sim_event event;
+    int pending;
+
+    struct transport_ack *acks;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+struct transport {
+    transport_mode_t mode;
+    object_pool_t packet_pool;
+    unsigned int mss;
+    unsigned int min_rto;
+
+    func_transport_send_t send;
+    void *send_arg;
+    func_transport_complete_t complete;
+    void *complete_arg;
+
+    /*  One way delays of data packets and flow completion times, if
+        wanted. */
+    histogram_t latencies;
+    histogram_t completions;
+
+    struct transport_host *hosts;
+    unsigned int num_hosts;
+
+    /*  Flow state, one entry per flow in each array. */
+    unsigned int num_flows;
+    unsigned int flow_capacity;
+    unsigned int *source;
+    unsigned int *destination;
+    unsigned int *segments;
+    unsigned int *last_length;
+    unsigned int *snd_una;
+    unsigned int *snd_nxt;
+    unsigned int *cwnd;
+    unsigned int *ssthresh;
+    unsigned int *recover;
+    unsigned int *dupacks;
+    unsigned int *alpha;
+    unsigned int *acked;
+    unsigned int *marked;
+    unsigned int *window_end;
+    unsigned int *srtt;
+    unsigned int *rttvar;
+    unsigned int *rto;
+    unsigned int *deadline;
+    unsigned int *rcv_nxt;
+    unsigned int *start;
+    unsigned int *finish;
+    unsigned int *wheel_next;
+    unsigned int *touched;
+    unsigned char *state;
+
+    /*  Flows touched by the batch being processed. */
+    unsigned int *batch_flows;
+    unsigned int batch_stamp;
+
+    /*  Timing wheel. Slot s holds the timers due in absolute slot s, s +
+        WHEEL_SLOTS and so on, and cursor is the next absolute slot to
+        process. */
+    unsigned int wheel_heads[WHEEL_SLOTS];
+    uint64_t wheel_occupied[WHEEL_WORDS];
+    unsigned int granularity;
+    unsigned int cursor;
+    unsigned int wheel_count;
+    struct sim_event wheel_event;
+    int wheel_pending;
+
+    unsigned long acks;
+    unsigned long ack_batches;
+    unsigned long retransmits;
+    unsigned long timeouts;
+};
+
+/*  Forward declarations of helper functions. */
+static void transport_grow(transport_t transport);
+static void transport_process_ack(transport_t transport, simulator_t sim, const struct transport_ack *ack);
+static void transport_reduce(transport_t transport, unsigned int flow, unsigned int cwnd);
+static void transport_send_window(transport_t transport, simulator_t sim, unsigned int flow);
+static void transport_emit(transport_t transport, simulator_t sim, unsigned int flow, unsigned int seq);
+static void transport_timeout(transport_t transport, simulator_t sim, unsigned int flow);
+static void transport_batch(simulator_t sim, sim_event_t event);
+static void wheel_insert(transport_t transport, simulator_t sim, unsigned int flow);
+static void wheel_schedule(transport_t transport, simulator_t sim);
+static void wheel_tick(simulator_t sim, sim_event_t event);
+
+/*  Create a transport for the given number of hosts. Flows send segments of
+    mss bytes, and retransmission timeouts are never shorter than min_rto
+    ticks. */
+transport_t create_transport(
+    transport_mode_t mode,
+    object_pool_t packet_pool,
+    unsigned int num_hosts,
+    unsigned int mss,
+    unsigned int min_rto,
+    func_transport_send_t send,
+    void *send_arg
+) {
+    assert(packet_pool);
+    assert(num_hosts > 0);
+    assert(mss > 0);
+    assert(min_rto >= WHEEL_SLOTS_PER_RTO);
+    assert(send);
+
+    transport_t transport = malloc(sizeof(struct transport));
+    assert(transport);
+
+    transport->mode = mode;
+    transport->packet_pool = packet_pool;
+    transport->mss = mss;
+    transport->min_rto = min_rto;
+    transport->send = send;
+    transport->send_arg = send_arg;
+    transport->complete = NULL;
+    transport->complete_arg = NULL;
+    transport->latencies = NULL;
+    transport->completions = NULL;
+
+    transport->hosts = malloc(sizeof(struct transport_host) * num_hosts);
+    assert(transport->hosts);
+    transport->num_hosts = num_hosts;
+
+    unsigned int host;
+    for (host = 0; host < num_hosts; host++) {
+        struct transport_host *h = &transport->hosts[host];
+
+        h->transport = transport;
+        sim_event_init(&h->event, transport_batch, h);
+        h->pending = 0;
+        h->acks = malloc(sizeof(struct transport_ack) * DEFAULT_BATCH_CAPACITY);
+        assert(h->acks);
+        h->count = 0;
+        h->capacity = DEFAULT_BATCH_CAPACITY;
+    }
+
+    transport->num_flows = 0;
+    transport->flow_capacity = 0;
+    transport->source = NULL;
+    transport->destination = NULL;
+    transport->segments = NULL;
+    transport->last_length = NULL;
+    transport->snd_una = NULL;
+    transport->snd_nxt = NULL;
+    transport->cwnd = NULL;
+    transport->ssthresh = NULL;
+    transport->recover = NULL;
+    transport->dupacks = NULL;
+    transport->alpha = NULL;
+    transport->acked = NULL;
+    transport->marked = NULL;
+    transport->window_end = NULL;
+    transport->srtt = NULL;
+    transport->rttvar = NULL;
+    transport->rto = NULL;
+    transport->deadline = NULL;
+    transport->rcv_nxt = NULL;
+    transport->start = NULL;
+    transport->finish = NULL;
+    transport->wheel_next = NULL;
+    transport->touched = NULL;
+    transport->state = NULL;
+    transport->batch_flows = NULL;
+    transport->batch_stamp = 0;
+    transport_grow(transport);
+
+    unsigned int slot;
+    for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+        transport->wheel_heads[slot] = FLOW_NONE;
+    }
+    for (slot = 0; slot < WHEEL_WORDS; slot++) {
+        transport->wheel_occupied[slot] = 0;
+    }
+    transport->granularity = min_rto / WHEEL_SLOTS_PER_RTO;
+    transport->cursor = 0;
+    transport->wheel_count = 0;
+    sim_event_init(&transport->wheel_event, wheel_tick, transport);
+    transport->wheel_pending = 0;
+
+    transport->acks = 0;
+    transport->ack_batches = 0;
+    transport->retransmits = 0;
+    transport->timeouts = 0;
+
+    return transport;
+}
+
+/*  Free the transport. Packets in the network are not freed, and no events
+    may be pending. */
+void free_transport(transport_t transport) {
+    assert(transport);
+
+    unsigned int host;
+    for (host = 0; host < transport->num_hosts; host++) {
+        free(transport->hosts[host].acks);
+    }
+    free(transport->hosts);
+
+    free(transport->source);
+    free(transport->destination);
+    free(transport->segments);
+    free(transport->last_length);
+    free(transport->snd_una);
+    free(transport->snd_nxt);
+    free(transport->cwnd);
+    free(transport->ssthresh);
+    free(transport->recover);
+    free(transport->dupacks);
+    free(transport->alpha);
+    free(transport->acked);
+    free(transport->marked);
+    free(transport->window_end);
+    free(transport->srtt);
+    free(transport->rttvar);
+    free(transport->rto);
+    free(transport->deadline);
+    free(transport->rcv_nxt);
+    free(transport->start);
+    free(transport->finish);
+    free(transport->wheel_next);
+    free(transport->touched);
+    free(transport->state);
+    free(transport->batch_flows);
+    free(transport);
+}
+
+/*  Be told when flows finish. */
+void transport_set_completion(transport_t transport, func_transport_complete_t complete, void *complete_arg) {
+    transport->complete = complete;
+    transport->complete_arg = complete_arg;
+}
+
+/*  Record in histograms the time each data packet takes from its source to
+    its destination, and the completion time of each flow. Either may be
+    NULL. */
+void transport_set_histograms(transport_t transport, histogram_t latencies, histogram_t completions) {
+    transport->latencies = latencies;
+    transport->completions = completions;
+}
+
+/*  Start a flow of the given number of bytes now, sending its initial
+    window straight away. Returns the flow number. */
+unsigned int transport_add_flow(transport_t transport, simulator_t sim, unsigned int source, unsigned int destination, unsigned int bytes) {
+    assert(source < transport->num_hosts);
+    assert(destination < transport->num_hosts);
+    assert(bytes > 0);
+
+    if (transport->num_flows == transport->flow_capacity) {
+        transport_grow(transport);
+    }
+
+    unsigned int flow = transport->num_flows;
+    transport->num_flows = flow + 1;
+
+    transport->source[flow] = source;
+    transport->destination[flow] = destination;
+    transport->segments[flow] = (bytes + transport->mss - 1) / transport->mss;
+    transport->last_length[flow] = bytes - (transport->segments[flow] - 1) * transport->mss;
+    transport->snd_una[flow] = 0;
+    transport->snd_nxt[flow] = 0;
+    transport->cwnd[flow] = INITIAL_CWND;
+    transport->ssthresh[flow] = INITIAL_SSTHRESH;
+    transport->recover[flow] = 0;
+    transport->dupacks[flow] = 0;
+    transport->alpha[flow] = TRANSPORT_ALPHA_ONE;
+    transport->acked[flow] = 0;
+    transport->marked[flow] = 0;
+    transport->window_end[flow] = 0;
+    transport->srtt[flow] = 0;
+    transport->rttvar[flow] = 0;
+    transport->rto[flow] = transport->min_rto * INITIAL_RTO_FACTOR;
+    transport->deadline[flow] = 0;
+    transport->rcv_nxt[flow] = 0;
+    transport->start[flow] = simulator_now(sim);
+    transport->finish[flow] = 0;
+    transport->wheel_next[flow] = FLOW_NONE;
+    transport->touched[flow] = 0;
+    transport->state[flow] = 0;
+
+    transport_send_window(transport, sim, flow);
+
+    return flow;
+}
+
+/*  A packet of one of the flows has arrived at the end it was sent to. */
+void transport_receive(transport_t transport, simulator_t sim, packet_t packet) {
+    unsigned int flow = packet->flow_id;
+
+    assert(flow < transport->num_flows);
+
+    if (packet->flags & PACKET_FLAG_ACK) {
+        struct transport_host *host = &transport->hosts[transport->source[flow]];
+
+        if (host->count == host->capacity) {
+            host->capacity = host->capacity * 2;
+            host->acks = realloc(host->acks, sizeof(struct transport_ack) * host->capacity);
+            assert(host->acks);
+        }
+
+        struct transport_ack *ack = &host->acks[host->count];
+        ack->flow = flow;
+        ack->seq = packet->seq;
+        ack->sent = packet->created;
+        ack->echo = (packet->flags & PACKET_FLAG_ECN_ECHO) != 0;
+        host->count = host->count + 1;
+        transport->acks = transport->acks + 1;
+
+        object_pool_release(transport->packet_pool, packet);
+
+        if (!host->pending) {
+            host->pending = 1;
+            simulator_schedule(sim, &host->event, simulator_now(sim) + 1);
+        }
+        return;
+    }
+
+    /*  Data - accept it if it is the next segment expected, and turn the
+        descriptor round as the acknowledgement. */
+    if (transport->latencies) {
+        histogram_record(transport->latencies, simulator_now(sim) - packet->created);
+    }
+    if (packet->seq == transport->rcv_nxt[flow]) {
+        transport->rcv_nxt[flow] = transport->rcv_nxt[flow] + 1;
+    }
+
+    unsigned int echo = (packet->flags & PACKET_FLAG_ECN_MARKED) ? PACKET_FLAG_ECN_ECHO : 0;
+    packet->next = NULL;
+    packet->flags = PACKET_FLAG_ACK | echo;
+    packet->seq = transport->rcv_nxt[flow];
+    packet->length = ACK_BYTES;
+
+    transport->send(sim, packet, transport->send_arg);
+}
+
+/*  Number of flows added so far. */
+unsigned int transport_flows(transport_t transport) {
+    return transport->num_flows;
+}
+
+unsigned int transport_flow_source(transport_t transport, unsigned int flow) {
+    assert(flow < transport->num_flows);
+
+    return transport->source[flow];
+}
+
+unsigned int transport_flow_destination(transport_t transport, unsigned int flow) {
+    assert(flow < transport->num_flows);
+
+    return transport->destination[flow];
+}
+
+/*  Whether every segment of a flow has been acknowledged. */
+int transport_flow_done(transport_t transport, unsigned int flow) {
+    assert(flow < transport->num_flows);
+
+    return (transport->state[flow] & FLOW_DONE) != 0;
+}
+
+/*  Ticks from the start of a finished flow to its last acknowledgement. */
+unsigned int transport_flow_completion_time(transport_t transport, unsigned int flow) {
+    assert(flow < transport->num_flows);
+    assert(transport->state[flow] & FLOW_DONE);
+
+    return transport->finish[flow] - transport->start[flow];
+}
+
+/*  Congestion window of a flow in bytes. */
+unsigned int transport_cwnd(transport_t transport, unsigned int flow) {
+    assert(flow < transport->num_flows);
+
+    return (unsigned int) (((uint64_t) transport->cwnd[flow] * transport->mss) / CWND_ONE);
+}
+
+/*  DCTCP estimate of the fraction of marked bytes, in units of
+    1 / TRANSPORT_ALPHA_ONE. */
+unsigned int transport_alpha(transport_t transport, unsigned int flow) {
+    assert(flow < transport->num_flows);
+
+    return transport->alpha[flow];
+}
+
+/*  Number of acknowledgements received. */
+unsigned long transport_acks(transport_t transport) {
+    return transport->acks;
+}
+
+/*  Number of batches the acknowledgements were processed in. */
+unsigned long transport_ack_batches(transport_t transport) {
+    return transport->ack_batches;
+}
+
+/*  Number of times a flow went back to resend unacknowledged segments. */
+unsigned long transport_retransmits(transport_t transport) {
+    return transport->retransmits;
+}
+
+/*  Number of retransmission timeouts. */
+unsigned long transport_timeouts(transport_t transport) {
+    return transport->timeouts;
+}
+
+/*  Helper functions. */
+
+#define GROW(array, type) \
+    transport->array = realloc(transport->array, sizeof(type) * capacity); \
+    assert(transport->array)
+
+static void transport_grow(transport_t transport) {
+    unsigned int capacity = transport->flow_capacity ? transport->flow_capacity * 2 : DEFAULT_FLOW_CAPACITY;
+
+    GROW(source, unsigned int);
+    GROW(destination, unsigned int);
+    GROW(segments, unsigned int);
+    GROW(last_length, unsigned int);
+    GROW(snd_una, unsigned int);
+    GROW(snd_nxt, unsigned int);
+    GROW(cwnd, unsigned int);
+    GROW(ssthresh, unsigned int);
+    GROW(recover, unsigned int);
+    GROW(dupacks, unsigned int);
+    GROW(alpha, unsigned int);
+    GROW(acked, unsigned int);
+    GROW(marked, unsigned int);
+    GROW(window_end, unsigned int);
+    GROW(srtt, unsigned int);
+    GROW(rttvar, unsigned int);
+    GROW(rto, unsigned int);
+    GROW(deadline, unsigned int);
+    GROW(rcv_nxt, unsigned int);
+    GROW(start, unsigned int);
+    GROW(finish, unsigned int);
+    GROW(wheel_next, unsigned int);
+    GROW(touched, unsigned int);
+    GROW(state, unsigned char);
+    GROW(batch_flows, unsigned int);
+
+    transport->flow_capacity = capacity;
+}
+
+#undef GROW
+
+static void transport_process_ack(transport_t transport, simulator_t sim, const struct transport_ack *ack) {
+    unsigned int flow = ack->flow;
+    unsigned int now = simulator_now(sim);
+
+    if (transport->state[flow] & FLOW_DONE) {
+        return;
+    }
+
+    if (ack->seq <= transport->snd_una[flow]) {
+        /*  Duplicate. Three in a row while data is outstanding start a
+            retransmission, unless one is already under way. */
+        if (ack->seq == transport->snd_una[flow] && transport->snd_nxt[flow] > transport->snd_una[flow]) {
+            transport->dupacks[flow] = transport->dupacks[flow] + 1;
+            if (transport->dupacks[flow] == DUPACK_THRESHOLD &&
+                transport->snd_una[flow] >= transport->recover[flow]) {
+                transport_reduce(transport, flow, transport->cwnd[flow] / 2);
+                transport->snd_nxt[flow] = transport->snd_una[flow];
+                transport->retransmits = transport->retransmits + 1;
+            }
+        }
+        return;
+    }
+
+    unsigned int newly = ack->seq - transport->snd_una[flow];
+    transport->snd_una[flow] = ack->seq;
+    transport->dupacks[flow] = 0;
+    if (transport->snd_nxt[flow] < ack->seq) {
+        transport->snd_nxt[flow] = ack->seq;
+    }
+
+    /*  RFC 6298 smoothing, with srtt kept times 8 and rttvar times 4. */
+    unsigned int sample = now - ack->sent;
+    if (transport->srtt[flow] == 0) {
+        transport->srtt[flow] = sample << 3;
+        transport->rttvar[flow] = sample << 1;
+    } else {
+        int error = (int) sample - (int) (transport->srtt[flow] >> 3);
+        transport->srtt[flow] = (unsigned int) ((int) transport->srtt[flow] + error);
+        if (error < 0) {
+            error = -error;
+        }
+        transport->rttvar[flow] = (unsigned int) ((int) transport->rttvar[flow] + error - (int) (transport->rttvar[flow] >> 2));
+    }
+    unsigned int rto = (transport->srtt[flow] >> 3) + transport->rttvar[flow];
+    transport->rto[flow] = rto > transport->min_rto ? rto : transport->min_rto;
+
+    /*  Congestion signals. */
+    if (transport->mode == TRANSPORT_DCTCP) {
+        transport->acked[flow] = transport->acked[flow] + newly;
+        if (ack->echo) {
+            transport->marked[flow] = transport->marked[flow] + newly;
+        }
+
+        if (ack->seq >= transport->window_end[flow]) {
+            unsigned int fraction = (unsigned int) (((uint64_t) transport->marked[flow] * TRANSPORT_ALPHA_ONE) / transport->acked[flow]);
+            int alpha = (int) transport->alpha[flow];
+            alpha = alpha + (((int) fraction - alpha) >> DCTCP_GAIN_SHIFT);
+            transport->alpha[flow] = (unsigned int) alpha;
+
+            if (transport->marked[flow] > 0) {
+                uint64_t cut = ((uint64_t) transport->cwnd[flow] * transport->alpha[flow]) >> 17;
+                transport_reduce(transport, flow, transport->cwnd[flow] - (unsigned int) cut);
+            }
+
+            transport->acked[flow] = 0;
+            transport->marked[flow] = 0;
+            transport->window_end[flow] = transport->snd_nxt[flow];
+        }
+    } else if (ack->echo && ack->seq >= transport->recover[flow]) {
+        transport_reduce(transport, flow, transport->cwnd[flow] / 2);
+    }
+
+    /*  Slow start, then additive increase of a segment per window. */
+    if (transport->cwnd[flow] < transport->ssthresh[flow]) {
+        transport->cwnd[flow] = transport->cwnd[flow] + newly * CWND_ONE;
+    } else {
+        transport->cwnd[flow] = transport->cwnd[flow] +
+            (unsigned int) (((uint64_t) newly * CWND_ONE * CWND_ONE) / transport->cwnd[flow]);
+    }
+
+    if (transport->snd_una[flow] == transport->segments[flow]) {
+        transport->state[flow] = (transport->state[flow] | FLOW_DONE) & ~FLOW_ARMED;
+        transport->finish[flow] = now;
+        if (transport->completions) {
+            histogram_record(transport->completions, now - transport->start[flow]);
+        }
+        if (transport->complete) {
+            transport->complete(sim, flow, transport->complete_arg);
+        }
+        return;
+    }
+
+    /*  Progress restarts the timer. */
+    transport->deadline[flow] = now + transport->rto[flow];
+}
+
+/*  Set the window to cwnd, but no less than two segments, and hold off
+    further reductions until what has been sent is acknowledged. */
+static void transport_reduce(transport_t transport, unsigned int flow, unsigned int cwnd) {
+    if (cwnd < MIN_SSTHRESH) {
+        cwnd = MIN_SSTHRESH;
+    }
+
+    transport->ssthresh[flow] = cwnd;
+    transport->cwnd[flow] = cwnd;
+    transport->recover[flow] = transport->snd_nxt[flow] + 1;
+}
+
+/*  Send whatever the window allows, and make sure a timer is running while
+    anything is outstanding. */
+static void transport_send_window(transport_t transport, simulator_t sim, unsigned int flow) {
+    unsigned int now = simulator_now(sim);
+
+    if (transport->state[flow] & FLOW_DONE) {
+        return;
+    }
+
+    while (transport->snd_nxt[flow] < transport->segments[flow] &&
+        (uint64_t) (transport->snd_nxt[flow] - transport->snd_una[flow]) * CWND_ONE < transport->cwnd[flow]) {
+        transport_emit(transport, sim, flow, transport->snd_nxt[flow]);
+        transport->snd_nxt[flow] = transport->snd_nxt[flow] + 1;
+    }
+
+    if (transport->snd_nxt[flow] == transport->snd_una[flow]) {
+        transport->state[flow] = transport->state[flow] & ~FLOW_ARMED;
+        return;
+    }
+
+    if (!(transport->state[flow] & FLOW_ARMED)) {
+        transport->state[flow] = transport->state[flow] | FLOW_ARMED;
+        transport->deadline[flow] = now + transport->rto[flow];
+    }
+    if (!(transport->state[flow] & FLOW_IN_WHEEL)) {
+        wheel_insert(transport, sim, flow);
+    }
+}
+
+static void transport_emit(transport_t transport, simulator_t sim, unsigned int flow, unsigned int seq) {
+    packet_t packet = packet_pool_alloc(transport->packet_pool);
+
+    packet->flow_id = flow;
+    packet->seq = seq;
+    packet->length = seq + 1 == transport->segments[flow] ? transport->last_length[flow] : transport->mss;
+    packet->created = simulator_now(sim);
+    packet->flags = PACKET_FLAG_ECN_CAPABLE;
+
+    transport->send(sim, packet, transport->send_arg);
+}
+
+/*  Nothing acknowledged for a whole timeout: back off, drop to a window of
+    one segment and go back to the first unacknowledged one. */
+static void transport_timeout(transport_t transport, simulator_t sim, unsigned int flow) {
+    unsigned int outstanding = transport->snd_nxt[flow] - transport->snd_una[flow];
+    unsigned int rto = transport->rto[flow] * 2;
+
+    transport->timeouts = transport->timeouts + 1;
+    transport->retransmits = transport->retransmits + 1;
+
+    transport_reduce(transport, flow, outstanding * CWND_ONE / 2);
+    transport->cwnd[flow] = CWND_ONE;
+    transport->snd_nxt[flow] = transport->snd_una[flow];
+    transport->dupacks[flow] = 0;
+    transport->acked[flow] = 0;
+    transport->marked[flow] = 0;
+    transport->window_end[flow] = transport->snd_una[flow];
+    transport->rto[flow] = rto < transport->min_rto * MAX_BACKOFF ? rto : transport->min_rto * MAX_BACKOFF;
+
+    transport->state[flow] = transport->state[flow] & ~FLOW_ARMED;
+    transport_send_window(transport, sim, flow);
+}
+
+/*  Process every acknowledgement that reached a host at this time, then let
+    each flow they touched send. */
+static void transport_batch(simulator_t sim, sim_event_t event) {
+    struct transport_host *host = (struct transport_host *) event->arg;
+    transport_t transport = host->transport;
+    unsigned int num_touched = 0;
+    unsigned int i;
+
+    transport->batch_stamp = transport->batch_stamp + 1;
+    transport->ack_batches = transport->ack_batches + 1;
+
+    for (i = 0; i < host->count; i++) {
+        unsigned int flow = host->acks[i].flow;
+
+        transport_process_ack(transport, sim, &host->acks[i]);
+        if (transport->touched[flow] != transport->batch_stamp) {
+            transport->touched[flow] = transport->batch_stamp;
+            transport->batch_flows[num_touched++] = flow;
+        }
+    }
+
+    host->count = 0;
+    host->pending = 0;
+
+    for (i = 0; i < num_touched; i++) {
+        transport_send_window(transport, sim, transport->batch_flows[i]);
+    }
+}
+
+/*  Put a flow's timer in the slot of its deadline. */
+static void wheel_insert(transport_t transport, simulator_t sim, unsigned int flow) {
+    unsigned int granularity = transport->granularity;
+    unsigned int slot = (transport->deadline[flow] + granularity - 1) / granularity;
+
+    if (transport->wheel_count == 0 && !transport->wheel_pending) {
+        transport->cursor = simulator_now(sim) / granularity;
+    }
+    if (slot < transport->cursor) {
+        slot = transport->cursor;
+    }
+    if (slot - transport->cursor >= WHEEL_SLOTS) {
+        slot = transport->cursor + WHEEL_SLOTS - 1;
+    }
+
+    unsigned int index = slot & (WHEEL_SLOTS - 1);
+    transport->wheel_next[flow] = transport->wheel_heads[index];
+    transport->wheel_heads[index] = flow;
+    transport->wheel_occupied[index / 64] |= (uint64_t) 1 << (index % 64);
+    transport->wheel_count = transport->wheel_count + 1;
+    transport->state[flow] = transport->state[flow] | FLOW_IN_WHEEL;
+
+    if (!transport->wheel_pending) {
+        wheel_schedule(transport, sim);
+    }
+}
+
+/*  Schedule the wheel event for the next occupied slot, but no more than a
+    minimum timeout from now. */
+static void wheel_schedule(transport_t transport, simulator_t sim) {
+    unsigned int now = simulator_now(sim);
+    unsigned int distance;
+
+    for (distance = 0; distance < WHEEL_SLOTS; distance++) {
+        unsigned int index = (transport->cursor + distance) & (WHEEL_SLOTS - 1);
+        uint64_t word = transport->wheel_occupied[index / 64] >> (index % 64);
+
+        if (word & 1) {
+            break;
+        }
+
+        /*  Skip the rest of an empty word. */
+        if (word == 0) {
+            distance = distance + (63 - index % 64);
+        }
+    }
+    assert(distance < WHEEL_SLOTS);
+
+    unsigned int time = (transport->cursor + distance) * transport->granularity;
+    if (time < now) {
+        time = now;
+    }
+    if (time > now + transport->min_rto) {
+        time = now + transport->min_rto;
+    }
+
+    transport->wheel_pending = 1;
+    simulator_schedule(sim, &transport->wheel_event, time);
+}
+
+/*  Work through every slot up to the current time. Timers that are due
+    fire, and those whose deadline has moved on go back in the wheel. */
+static void wheel_tick(simulator_t sim, sim_event_t event) {
+    transport_t transport = (transport_t) event->arg;
+    unsigned int now = simulator_now(sim);
+    unsigned int last = now / transport->granularity;
+
+    if (last - transport->cursor >= WHEEL_SLOTS) {
+        transport->cursor = last - WHEEL_SLOTS + 1;
+    }
+
+    /*  The event still counts as pending while the slots are worked
+        through, so that timers going back in neither move the cursor nor
+        schedule the event for a slot about to be processed. */
+
+    while (transport->cursor <= last) {
+        unsigned int index = transport->cursor & (WHEEL_SLOTS - 1);
+        unsigned int flow = transport->wheel_heads[index];
+
+        transport->wheel_heads[index] = FLOW_NONE;
+        transport->wheel_occupied[index / 64] &= ~((uint64_t) 1 << (index % 64));
+
+        while (flow != FLOW_NONE) {
+            unsigned int next = transport->wheel_next[flow];
+
+            transport->wheel_count = transport->wheel_count - 1;
+            transport->state[flow] = transport->state[flow] & ~FLOW_IN_WHEEL;
+
+            if (transport->state[flow] & FLOW_ARMED) {
+                if (transport->deadline[flow] <= now) {
+                    transport_timeout(transport, sim, flow);
+                } else {
+                    wheel_insert(transport, sim, flow);
+                }
+            }
+
+            flow = next;
+        }
+
+        transport->cursor = transport->cursor + 1;
+    }
+
+    transport->wheel_pending = 0;
+    if (transport->wheel_count > 0) {
+        wheel_schedule(transport, sim);
+    }
+}
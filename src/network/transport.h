@@ -0,0 +1,98 @@
+/*  transport.h
+
+    End-host transport: window based congestion control in the style of
+    TCP Reno with ECN, and DCTCP.
+
+    One transport instance models the end hosts of a whole network. Flows
+    are numbered from 0 as they are added, and their state is held as a
+    structure of arrays indexed by flow number, so that the per flow loops
+    of ACK processing touch only the fields they need and a million flows
+    cost a few tens of bytes each rather than a heap allocated structure
+    apiece.
+
+    Data is sent in segments of mss bytes, numbered from 0 within each
+    flow. Packets leave through the send function given at creation, which
+    is expected to carry data packets from the source of their flow to its
+    destination and acknowledgements, which carry PACKET_FLAG_ACK, the
+    other way. Both are handed back with transport_receive when they
+    arrive. The receiver accepts segments in order only and acknowledges
+    each with the next segment it expects, reusing the data packet
+    descriptor for the acknowledgement and echoing any congestion
+    experienced mark. Packet descriptors come from the given pool and go
+    back to it when acknowledgements are consumed.
+
+    Acknowledgements are not processed as they arrive. Each host collects
+    those arriving at the same time and processes them together from a
+    single event one tick later, after which every flow they touched sends
+    what its window allows. The tick is needed because events due at the
+    same time fire in no particular order.
+
+    Retransmission timeouts are kept in a hashed timing wheel with a single
+    event rather than one event per flow. Rearming a timer on each
+    acknowledgement only moves its deadline, and a timer found in the wheel
+    before its deadline is simply moved on. Timeouts fire at most one slot,
+    a sixteenth of the minimum timeout, late.
+
+    On a timeout, or three duplicate acknowledgements, the window shrinks
+    and the flow goes back to its first unacknowledged segment. Reno halves
+    its window on an ECN echo at most once per window of data. DCTCP keeps
+    the fraction alpha of marked bytes, starting from 1 and updated once
+    per window with gain 1/16, and cuts the window by alpha / 2. All state
+    is integer: windows are in 1/1024 segments and alpha in units of
+    1/65536.
+
+    One way delays of data packets and flow completion times can be
+    recorded in histograms set with transport_set_histograms. */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "../event_simulation/simulator.h"
+#include "../switch/packet.h"
+#include "../stats/histogram.h"
+
+#define TRANSPORT_ALPHA_ONE 65536
+
+struct transport;
+
+typedef struct transport * transport_t;
+
+typedef enum transport_mode {
+    TRANSPORT_RENO,
+    TRANSPORT_DCTCP
+} transport_mode_t;
+
+/*  Called to put a packet into the network, with the send_arg given at
+    creation time. */
+typedef void (*func_transport_send_t)(simulator_t, packet_t, void *);
+
+/*  Called when the last segment of a flow has been acknowledged. */
+typedef void (*func_transport_complete_t)(simulator_t, unsigned int, void *);
+
+transport_t create_transport(
+    transport_mode_t mode,
+    object_pool_t packet_pool,
+    unsigned int num_hosts,
+    unsigned int mss,
+    unsigned int min_rto,
+    func_transport_send_t send,
+    void *send_arg
+);
+void free_transport(transport_t transport);
+void transport_set_completion(transport_t transport, func_transport_complete_t complete, void *complete_arg);
+void transport_set_histograms(transport_t transport, histogram_t latencies, histogram_t completions);
+unsigned int transport_add_flow(transport_t transport, simulator_t sim, unsigned int source, unsigned int destination, unsigned int bytes);
+void transport_receive(transport_t transport, simulator_t sim, packet_t packet);
+unsigned int transport_flows(transport_t transport);
+unsigned int transport_flow_source(transport_t transport, unsigned int flow);
+unsigned int transport_flow_destination(transport_t transport, unsigned int flow);
+int transport_flow_done(transport_t transport, unsigned int flow);
+unsigned int transport_flow_completion_time(transport_t transport, unsigned int flow);
+unsigned int transport_cwnd(transport_t transport, unsigned int flow);
+unsigned int transport_alpha(transport_t transport, unsigned int flow);
+unsigned long transport_acks(transport_t transport);
+unsigned long transport_ack_batches(transport_t transport);
+unsigned long transport_retransmits(transport_t transport);
+unsigned long transport_timeouts(transport_t transport);
+
+#endif
@@ -0,0 +1,243 @@
+/*  histogram.c
+
+    Implementation of the high dynamic range histogram.
+
+    With b bits of precision and h = 2^(b - 1), a value v below 2^b is in
+    bucket v. A larger value whose highest set bit is bit k has exponent
+    e = k - b + 1, and v >> e lies in [h, 2h), so bucket e * h + (v >> e)
+    follows on from the buckets of the exponent below it. The bucket holds
+    the values from (v >> e) << e to that plus 2^e - 1. */
+
+#include "histogram.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+
+struct histogram {
+    unsigned int precision;
+    uint64_t max_value;
+    unsigned int num_buckets;
+    uint64_t *counts;
+
+    uint64_t total;
+    uint64_t overflows;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+};
+
+/*  Forward declarations of helper functions. */
+static inline unsigned int histogram_index(unsigned int precision, uint64_t value);
+static uint64_t histogram_bucket_high(histogram_t histogram, unsigned int index);
+
+/*  Create a histogram for values up to max_value, to precision bits. */
+histogram_t create_histogram(uint64_t max_value, unsigned int precision) {
+    assert(precision >= HISTOGRAM_MIN_PRECISION && precision <= HISTOGRAM_MAX_PRECISION);
+
+    histogram_t histogram = malloc(sizeof(struct histogram));
+    assert(histogram);
+
+    histogram->precision = precision;
+    histogram->max_value = max_value;
+    histogram->num_buckets = histogram_index(precision, max_value) + 1;
+    histogram->counts = malloc(sizeof(uint64_t) * histogram->num_buckets);
+    assert(histogram->counts);
+
+    histogram_reset(histogram);
+
+    return histogram;
+}
+
+void free_histogram(histogram_t histogram) {
+    assert(histogram);
+
+    free(histogram->counts);
+    free(histogram);
+}
+
+void histogram_record(histogram_t histogram, uint64_t value) {
+    histogram_record_count(histogram, value, 1);
+}
+
+/*  Record count occurrences of a value. */
+void histogram_record_count(histogram_t histogram, uint64_t value, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->total = histogram->total + count;
+    histogram->sum = histogram->sum + (double) value * (double) count;
+
+    if (value > histogram->max_value) {
+        histogram->overflows = histogram->overflows + count;
+        value = histogram->max_value;
+    }
+    unsigned int index = histogram_index(histogram->precision, value);
+    histogram->counts[index] = histogram->counts[index] + count;
+}
+
+/*  Add the values recorded in other to histogram. Both must have been
+    created with the same maximum and precision. */
+void histogram_merge(histogram_t histogram, histogram_t other) {
+    assert(histogram->precision == other->precision);
+    assert(histogram->max_value == other->max_value);
+
+    unsigned int i;
+    for (i = 0; i < histogram->num_buckets; i++) {
+        histogram->counts[i] = histogram->counts[i] + other->counts[i];
+    }
+
+    if (other->total > 0) {
+        if (other->min < histogram->min) {
+            histogram->min = other->min;
+        }
+        if (other->max > histogram->max) {
+            histogram->max = other->max;
+        }
+    }
+    histogram->total = histogram->total + other->total;
+    histogram->overflows = histogram->overflows + other->overflows;
+    histogram->sum = histogram->sum + other->sum;
+}
+
+/*  Forget every value recorded. */
+void histogram_reset(histogram_t histogram) {
+    memset(histogram->counts, 0, sizeof(uint64_t) * histogram->num_buckets);
+    histogram->total = 0;
+    histogram->overflows = 0;
+    histogram->min = UINT64_MAX;
+    histogram->max = 0;
+    histogram->sum = 0;
+}
+
+uint64_t histogram_count(histogram_t histogram) {
+    return histogram->total;
+}
+
+/*  Number of values recorded above the maximum of the histogram. */
+uint64_t histogram_overflows(histogram_t histogram) {
+    return histogram->overflows;
+}
+
+/*  Smallest value recorded, or 0 if there are none. */
+uint64_t histogram_min(histogram_t histogram) {
+    return histogram->total > 0 ? histogram->min : 0;
+}
+
+uint64_t histogram_max(histogram_t histogram) {
+    return histogram->max;
+}
+
+double histogram_mean(histogram_t histogram) {
+    return histogram->total > 0 ? histogram->sum / (double) histogram->total : 0;
+}
+
+/*  Value that the given percentage of the values recorded are at or below,
+    to the precision of the histogram. */
+uint64_t histogram_percentile(histogram_t histogram, double percentile) {
+    assert(percentile >= 0 && percentile <= 100);
+
+    if (histogram->total == 0) {
+        return 0;
+    }
+
+    /*  Rank of the value looked for, from 1. */
+    double target = percentile / 100 * (double) histogram->total;
+    uint64_t rank = (uint64_t) target;
+    if ((double) rank < target || rank == 0) {
+        rank = rank + 1;
+    }
+
+    uint64_t seen = 0;
+    unsigned int i;
+    for (i = 0; i < histogram->num_buckets; i++) {
+        seen = seen + histogram->counts[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    uint64_t value = histogram_bucket_high(histogram, i);
+    if (value < histogram->min) {
+        value = histogram->min;
+    }
+    return value > histogram->max ? histogram->max : value;
+}
+
+/*  Fraction of the values recorded at or below value, counting the whole
+    of the bucket value falls in. */
+double histogram_cdf(histogram_t histogram, uint64_t value) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    if (value >= histogram->max_value) {
+        return value >= histogram->max ? 1 : (double) (histogram->total - histogram->overflows) / (double) histogram->total;
+    }
+
+    unsigned int last = histogram_index(histogram->precision, value);
+    uint64_t seen = 0;
+    unsigned int i;
+    for (i = 0; i <= last; i++) {
+        seen = seen + histogram->counts[i];
+    }
+    return (double) seen / (double) histogram->total;
+}
+
+/*  Write the CDF as up to max_points pairs of the highest value of each
+    bucket holding values and the fraction of values at or below it, in
+    increasing order of value. Returns the number of points written. */
+unsigned int histogram_export_cdf(histogram_t histogram, uint64_t *values, double *fractions, unsigned int max_points) {
+    unsigned int points = 0;
+    uint64_t seen = 0;
+    unsigned int i;
+
+    for (i = 0; i < histogram->num_buckets && points < max_points; i++) {
+        if (histogram->counts[i] == 0) {
+            continue;
+        }
+        seen = seen + histogram->counts[i];
+
+        uint64_t value = histogram_bucket_high(histogram, i);
+        values[points] = value > histogram->max ? histogram->max : value;
+        fractions[points] = (double) seen / (double) histogram->total;
+        points = points + 1;
+    }
+    return points;
+}
+
+/*  Number of buckets, which sets the memory the histogram takes. */
+unsigned int histogram_buckets(histogram_t histogram) {
+    return histogram->num_buckets;
+}
+
+/*  Helper functions. */
+
+static inline unsigned int histogram_index(unsigned int precision, uint64_t value) {
+    if (value < (1ULL << precision)) {
+        return (unsigned int) value;
+    }
+
+    unsigned int exponent = 63 - __builtin_clzll(value) - precision + 1;
+    return (exponent << (precision - 1)) + (unsigned int) (value >> exponent);
+}
+
+/*  Highest value falling in a bucket. */
+static uint64_t histogram_bucket_high(histogram_t histogram, unsigned int index) {
+    unsigned int precision = histogram->precision;
+
+    if (index < (1u << precision)) {
+        return index;
+    }
+
+    unsigned int exponent = (index >> (precision - 1)) - 1;
+    uint64_t sub = index - (exponent << (precision - 1));
+    return (sub << exponent) + (1ULL << exponent) - 1;
+}
@@ -0,0 +1,55 @@
+/*  histogram.h
+
+    High dynamic range histogram of non-negative integer values such as
+    queueing delays, latencies and flow completion times, in the manner of
+    HdrHistogram: fixed memory, constant time recording and a bounded
+    relative error whatever the magnitude of the values.
+
+    Values below 2^precision each have a bucket of their own. Above that,
+    every power of two range [2^k, 2^(k+1)) is split into 2^(precision - 1)
+    buckets of equal width, so a value is known to within a relative error
+    of 2^-(precision - 1), which is under 1% for a precision of 8 bits. The
+    bucket of a value is found from the position of its highest set bit and
+    the bits just below it, with no search or division. Buckets cover the
+    values up to the max_value given at creation time; larger values are
+    counted in the last bucket and as overflows. With 8 bits of precision,
+    covering the whole 32 bit range of simulated time takes 3328 buckets,
+    26 KB, however many values are recorded.
+
+    Histograms with the same precision and maximum can be merged, so that
+    each thread of a parallel run can record into its own and the results
+    be combined at the end. Percentiles and the CDF are read from the
+    buckets, and report the highest value of the bucket they fall in,
+    clamped to the extremes actually recorded, which are kept exactly, as
+    are the count and the mean. */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define HISTOGRAM_MIN_PRECISION 1
+#define HISTOGRAM_MAX_PRECISION 16
+
+struct histogram;
+
+typedef struct histogram * histogram_t;
+
+histogram_t create_histogram(uint64_t max_value, unsigned int precision);
+void free_histogram(histogram_t histogram);
+void histogram_record(histogram_t histogram, uint64_t value);
+void histogram_record_count(histogram_t histogram, uint64_t value, uint64_t count);
+void histogram_merge(histogram_t histogram, histogram_t other);
+void histogram_reset(histogram_t histogram);
+uint64_t histogram_count(histogram_t histogram);
+uint64_t histogram_overflows(histogram_t histogram);
+uint64_t histogram_min(histogram_t histogram);
+uint64_t histogram_max(histogram_t histogram);
+double histogram_mean(histogram_t histogram);
+uint64_t histogram_percentile(histogram_t histogram, double percentile);
+double histogram_cdf(histogram_t histogram, uint64_t value);
+unsigned int histogram_export_cdf(histogram_t histogram, uint64_t *values, double *fractions, unsigned int max_points);
+unsigned int histogram_buckets(histogram_t histogram);
+
+#endif
@@ -0,0 +1,243 @@
+/*  time_series.c
+
+    Implementation of the windowed time series.
+
+    Windows are numbered from 0 at time 0, in units of the current width,
+    and window w of series s is kept in slot w % capacity of the buffer of
+    s. Each series remembers the last window it was updated in; the slots
+    of later windows may hold stale data, and read as zero for sums and as
+    the current level for peaks. The last window of the whole set is the
+    latest of any series, or the one time_series_advance was given. In
+    ring mode windows more than capacity before it are gone. In
+    downsampling mode window numbers stay below capacity, so slots never
+    wrap. */
+
+#include "time_series.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+
+struct time_series {
+    time_series_kind_t kind;
+    int downsample;
+    unsigned int num_series;
+    unsigned int capacity;
+    unsigned int window;
+
+    /*  Buffers of all series, capacity slots each, one after the other. */
+    uint64_t *values;
+
+    /*  Per series state. */
+    unsigned int *last;
+    uint64_t *level;
+
+    unsigned int newest;
+    unsigned int downsamples;
+};
+
+/*  Forward declarations of helper functions. */
+static unsigned int time_series_at(time_series_t series, unsigned int now);
+static void time_series_catch_up(time_series_t series, unsigned int index, unsigned int window);
+static uint64_t time_series_value(time_series_t series, unsigned int index, unsigned int window);
+static void time_series_halve(time_series_t series);
+
+/*  Create num_series series of the given kind, in windows of width ticks,
+    holding capacity windows each. With downsample set the capacity must be
+    even. */
+time_series_t create_time_series(time_series_kind_t kind, unsigned int num_series, unsigned int window, unsigned int capacity, int downsample) {
+    assert(num_series > 0);
+    assert(window > 0);
+    assert(capacity > 1);
+    assert(!downsample || capacity % 2 == 0);
+
+    time_series_t series = malloc(sizeof(struct time_series));
+    assert(series);
+
+    series->kind = kind;
+    series->downsample = downsample;
+    series->num_series = num_series;
+    series->capacity = capacity;
+    series->window = window;
+
+    series->values = calloc((size_t) num_series * capacity, sizeof(uint64_t));
+    assert(series->values);
+    series->last = calloc(num_series, sizeof(unsigned int));
+    assert(series->last);
+    series->level = calloc(num_series, sizeof(uint64_t));
+    assert(series->level);
+
+    series->newest = 0;
+    series->downsamples = 0;
+
+    return series;
+}
+
+void free_time_series(time_series_t series) {
+    assert(series);
+
+    free(series->values);
+    free(series->last);
+    free(series->level);
+    free(series);
+}
+
+/*  Add amount to the window of now in a series of sums, or set the level
+    of a series of peaks to amount at now. Updates of a series must come in
+    order of time. */
+void time_series_add(time_series_t series, unsigned int index, unsigned int now, uint64_t amount) {
+    assert(index < series->num_series);
+
+    unsigned int window = time_series_at(series, now);
+    uint64_t *slot;
+
+    time_series_catch_up(series, index, window);
+    slot = &series->values[(size_t) index * series->capacity + window % series->capacity];
+
+    if (series->kind == TIME_SERIES_SUM) {
+        *slot = *slot + amount;
+    } else {
+        series->level[index] = amount;
+        if (amount > *slot) {
+            *slot = amount;
+        }
+    }
+}
+
+/*  Make the window of now the last one of the set, so that an export
+    covers the time up to now even if nothing was updated lately. */
+void time_series_advance(time_series_t series, unsigned int now) {
+    time_series_at(series, now);
+}
+
+/*  Value of a window of a series, which must be between the first and last
+    windows of the set. */
+uint64_t time_series_get(time_series_t series, unsigned int index, unsigned int window) {
+    assert(index < series->num_series);
+    assert(window >= time_series_first(series) && window <= series->newest);
+
+    return time_series_value(series, index, window);
+}
+
+/*  Current width of the windows in ticks. */
+unsigned int time_series_window(time_series_t series) {
+    return series->window;
+}
+
+/*  Number of the oldest window still held. */
+unsigned int time_series_first(time_series_t series) {
+    if (!series->downsample && series->newest >= series->capacity) {
+        return series->newest - series->capacity + 1;
+    }
+    return 0;
+}
+
+/*  Number of the latest window. */
+unsigned int time_series_last(time_series_t series) {
+    return series->newest;
+}
+
+/*  Write out up to max_windows windows, the oldest first: the start time of
+    each in starts, and its value in each series in values, series by
+    series within each window. Returns the number of windows written. */
+unsigned int time_series_export(time_series_t series, unsigned int *starts, uint64_t *values, unsigned int max_windows) {
+    unsigned int first = time_series_first(series);
+    unsigned int count = series->newest - first + 1;
+    unsigned int i, index;
+
+    if (count > max_windows) {
+        count = max_windows;
+    }
+
+    for (i = 0; i < count; i++) {
+        starts[i] = (first + i) * series->window;
+        for (index = 0; index < series->num_series; index++) {
+            values[(size_t) i * series->num_series + index] = time_series_value(series, index, first + i);
+        }
+    }
+    return count;
+}
+
+/*  Number of times the window width has doubled. */
+unsigned int time_series_downsamples(time_series_t series) {
+    return series->downsamples;
+}
+
+/*  Helper functions. */
+
+/*  Window of a time, downsampling first if it would not fit, and moving
+    the last window of the set up to it. */
+static unsigned int time_series_at(time_series_t series, unsigned int now) {
+    unsigned int window = now / series->window;
+
+    while (series->downsample && window >= series->capacity) {
+        time_series_halve(series);
+        window = now / series->window;
+    }
+
+    if (window > series->newest) {
+        series->newest = window;
+    }
+    return window;
+}
+
+/*  Clear the windows of a series after its last update up to window, to
+    zero for sums and to the level for peaks. Only the last capacity of
+    them can still be held. */
+static void time_series_catch_up(time_series_t series, unsigned int index, unsigned int window) {
+    unsigned int last = series->last[index];
+
+    assert(window >= last);
+
+    if (window == last) {
+        return;
+    }
+
+    uint64_t fill = series->kind == TIME_SERIES_SUM ? 0 : series->level[index];
+    uint64_t *buffer = &series->values[(size_t) index * series->capacity];
+    unsigned int from = window - last > series->capacity ? window - series->capacity + 1 : last + 1;
+    unsigned int w;
+
+    for (w = from; w <= window; w++) {
+        buffer[w % series->capacity] = fill;
+    }
+    series->last[index] = window;
+}
+
+static uint64_t time_series_value(time_series_t series, unsigned int index, unsigned int window) {
+    if (window > series->last[index]) {
+        return series->kind == TIME_SERIES_SUM ? 0 : series->level[index];
+    }
+    return series->values[(size_t) index * series->capacity + window % series->capacity];
+}
+
+/*  Merge the windows of every series in pairs and double the width. */
+static void time_series_halve(time_series_t series) {
+    unsigned int half = series->capacity / 2;
+    unsigned int index, w;
+
+    for (index = 0; index < series->num_series; index++) {
+        uint64_t *buffer = &series->values[(size_t) index * series->capacity];
+
+        for (w = 0; w < half; w++) {
+            uint64_t a = time_series_value(series, index, 2 * w);
+            uint64_t b = time_series_value(series, index, 2 * w + 1);
+
+            if (series->kind == TIME_SERIES_SUM) {
+                buffer[w] = a + b;
+            } else {
+                buffer[w] = a > b ? a : b;
+            }
+        }
+        memset(buffer + half, 0, sizeof(uint64_t) * half);
+
+        /*  The merged window holding the last update covers the window after
+            it too, which the merge has already filled in. */
+        series->last[index] = series->last[index] / 2;
+    }
+
+    series->window = series->window * 2;
+    series->newest = series->newest / 2;
+    series->downsamples = series->downsamples + 1;
+}
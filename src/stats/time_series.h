@@ -0,0 +1,51 @@
+/*  time_series.h
+
+    Counters binned into windows of simulated time, such as the bytes each
+    port sends or the peak occupancy of each queue per microsecond, kept
+    for a number of series side by side in preallocated memory.
+
+    Each series has a buffer of capacity windows, allocated up front.
+    Windows are advanced lazily: an update works out the window of the
+    time it is given, and clears the windows the series skipped since its
+    last update, so no timer events are needed and a series nobody updates
+    costs nothing. In a series of sums an update adds an amount to its
+    window. In a series of peaks an update sets the current level, which
+    holds until the next one, and a window records the highest level seen
+    during it.
+
+    Once a run outlasts capacity windows one of two things happens. By
+    default the buffers are rings and keep only the latest capacity
+    windows. With downsampling they instead keep the whole run: every time
+    the run outgrows the buffers, all series have their windows merged in
+    pairs and the window width doubles, so memory stays fixed while the
+    resolution halves as the run grows.
+
+    time_series_export writes out every window still held, for all series
+    at once. */
+
+#ifndef TIME_SERIES_H
+#define TIME_SERIES_H
+
+#include <stdint.h>
+
+struct time_series;
+
+typedef struct time_series * time_series_t;
+
+typedef enum time_series_kind {
+    TIME_SERIES_SUM,
+    TIME_SERIES_PEAK
+} time_series_kind_t;
+
+time_series_t create_time_series(time_series_kind_t kind, unsigned int num_series, unsigned int window, unsigned int capacity, int downsample);
+void free_time_series(time_series_t series);
+void time_series_add(time_series_t series, unsigned int index, unsigned int now, uint64_t amount);
+void time_series_advance(time_series_t series, unsigned int now);
+uint64_t time_series_get(time_series_t series, unsigned int index, unsigned int window);
+unsigned int time_series_window(time_series_t series);
+unsigned int time_series_first(time_series_t series);
+unsigned int time_series_last(time_series_t series);
+unsigned int time_series_export(time_series_t series, unsigned int *starts, uint64_t *values, unsigned int max_windows);
+unsigned int time_series_downsamples(time_series_t series);
+
+#endif
@@ -0,0 +1,165 @@
+/*  time_weighted.c
+
+    Implementation of the time-weighted statistics. The statistics cover
+    the period from start, or the last reset, to the last update, and the
+    current value is added on for the rest of the time asked about. */
+
+#include "time_weighted.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+
+struct time_weighted {
+    unsigned int start;
+    unsigned int last;
+    unsigned int value;
+    unsigned int min;
+    unsigned int max;
+    uint64_t area;
+
+    unsigned int num_bins;
+    unsigned int bin_width;
+    uint64_t *time_in;
+
+    unsigned long updates;
+};
+
+/*  Forward declarations of helper functions. */
+static inline unsigned int time_weighted_bin(time_weighted_t stats, unsigned int value);
+
+/*  Create statistics of a value starting out at value at time start, with
+    num_bins ranges of bin_width to track the time spent in, or none if
+    num_bins is 0. */
+time_weighted_t create_time_weighted(unsigned int start, unsigned int value, unsigned int num_bins, unsigned int bin_width) {
+    assert(num_bins == 0 || bin_width > 0);
+
+    time_weighted_t stats = malloc(sizeof(struct time_weighted));
+    assert(stats);
+
+    stats->num_bins = num_bins;
+    stats->bin_width = bin_width;
+    stats->time_in = NULL;
+    if (num_bins > 0) {
+        stats->time_in = malloc(sizeof(uint64_t) * num_bins);
+        assert(stats->time_in);
+    }
+
+    stats->value = value;
+    time_weighted_reset(stats, start);
+
+    return stats;
+}
+
+void free_time_weighted(time_weighted_t stats) {
+    assert(stats);
+
+    free(stats->time_in);
+    free(stats);
+}
+
+/*  The value has changed to value at time now. */
+void time_weighted_update(time_weighted_t stats, unsigned int now, unsigned int value) {
+    assert(now >= stats->last);
+
+    unsigned int elapsed = now - stats->last;
+
+    stats->area = stats->area + (uint64_t) stats->value * elapsed;
+    if (stats->num_bins > 0) {
+        unsigned int bin = time_weighted_bin(stats, stats->value);
+        stats->time_in[bin] = stats->time_in[bin] + elapsed;
+    }
+
+    stats->last = now;
+    stats->value = value;
+    if (value < stats->min) {
+        stats->min = value;
+    }
+    if (value > stats->max) {
+        stats->max = value;
+    }
+    stats->updates = stats->updates + 1;
+}
+
+/*  Start the statistics again from now, keeping the current value. */
+void time_weighted_reset(time_weighted_t stats, unsigned int now) {
+    stats->start = now;
+    stats->last = now;
+    stats->min = stats->value;
+    stats->max = stats->value;
+    stats->area = 0;
+    stats->updates = 0;
+    if (stats->num_bins > 0) {
+        memset(stats->time_in, 0, sizeof(uint64_t) * stats->num_bins);
+    }
+}
+
+unsigned int time_weighted_value(time_weighted_t stats) {
+    return stats->value;
+}
+
+unsigned int time_weighted_min(time_weighted_t stats) {
+    return stats->min;
+}
+
+unsigned int time_weighted_max(time_weighted_t stats) {
+    return stats->max;
+}
+
+/*  Integral of the value over time, from the start up to now. */
+uint64_t time_weighted_area(time_weighted_t stats, unsigned int now) {
+    assert(now >= stats->last);
+
+    return stats->area + (uint64_t) stats->value * (now - stats->last);
+}
+
+/*  Time average of the value from the start up to now, or the value itself
+    if no time has passed. */
+double time_weighted_mean(time_weighted_t stats, unsigned int now) {
+    if (now == stats->start) {
+        return stats->value;
+    }
+    return (double) time_weighted_area(stats, now) / (double) (now - stats->start);
+}
+
+/*  Time the value has spent in the range of a bin, from the start up to
+    now. */
+uint64_t time_weighted_time_in(time_weighted_t stats, unsigned int bin, unsigned int now) {
+    assert(bin < stats->num_bins);
+    assert(now >= stats->last);
+
+    uint64_t time = stats->time_in[bin];
+    if (time_weighted_bin(stats, stats->value) == bin) {
+        time = time + (now - stats->last);
+    }
+    return time;
+}
+
+/*  Fraction of the time from the start up to now that the value spent in
+    the range of a bin. */
+double time_weighted_fraction_in(time_weighted_t stats, unsigned int bin, unsigned int now) {
+    assert(bin < stats->num_bins);
+
+    if (now == stats->start) {
+        return time_weighted_bin(stats, stats->value) == bin;
+    }
+    return (double) time_weighted_time_in(stats, bin, now) / (double) (now - stats->start);
+}
+
+unsigned int time_weighted_bins(time_weighted_t stats) {
+    return stats->num_bins;
+}
+
+/*  Number of updates since the start. */
+unsigned long time_weighted_updates(time_weighted_t stats) {
+    return stats->updates;
+}
+
+/*  Helper functions. */
+
+static inline unsigned int time_weighted_bin(time_weighted_t stats, unsigned int value) {
+    unsigned int bin = value / stats->bin_width;
+
+    return bin < stats->num_bins ? bin : stats->num_bins - 1;
+}
@@ -0,0 +1,42 @@
+/*  time_weighted.h
+
+    Time-weighted statistics of a value that changes at discrete simulated
+    times, such as the length of a queue: its time average, its extremes
+    and the time it spends in each of a set of ranges.
+
+    Nothing is sampled. The value is reported whenever it changes, and each
+    report adds the old value times the time it was held to a running
+    area, so the exact time average costs one multiply-add per change and
+    no events at all. The time the value spends in each range of bin_width
+    is kept the same way, one addition per change, the last bin taking
+    every value beyond the others. Reads take the current value as held up
+    to the time they are given, so statistics can be read at any time
+    without a report.
+
+    Values are unsigned 32 bit integers and the area a 64 bit one, enough
+    for a queue of 4 GB held for four billion ticks. */
+
+#ifndef TIME_WEIGHTED_H
+#define TIME_WEIGHTED_H
+
+#include <stdint.h>
+
+struct time_weighted;
+
+typedef struct time_weighted * time_weighted_t;
+
+time_weighted_t create_time_weighted(unsigned int start, unsigned int value, unsigned int num_bins, unsigned int bin_width);
+void free_time_weighted(time_weighted_t stats);
+void time_weighted_update(time_weighted_t stats, unsigned int now, unsigned int value);
+void time_weighted_reset(time_weighted_t stats, unsigned int now);
+unsigned int time_weighted_value(time_weighted_t stats);
+unsigned int time_weighted_min(time_weighted_t stats);
+unsigned int time_weighted_max(time_weighted_t stats);
+uint64_t time_weighted_area(time_weighted_t stats, unsigned int now);
+double time_weighted_mean(time_weighted_t stats, unsigned int now);
+uint64_t time_weighted_time_in(time_weighted_t stats, unsigned int bin, unsigned int now);
+double time_weighted_fraction_in(time_weighted_t stats, unsigned int bin, unsigned int now);
+unsigned int time_weighted_bins(time_weighted_t stats);
+unsigned long time_weighted_updates(time_weighted_t stats);
+
+#endif
@@ -0,0 +1,204 @@
+/*  cell_fabric.c
+
+    Implementation of the cell fabric model.
+
+    Each egress port is fed by a fabric link which carries one cell every
+    cell_time ticks. Runs destined for the same egress are serialised on that
+    link in the order they were sent, so the time at which the last cell of
+    a run arrives can be computed up front when the run is sent. That is the
+    only point at which anything needs to happen at the egress, and so it is
+    the only event scheduled. */
+
+#include "cell_fabric.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  A run in transit across the fabric. The embedded event fires when the
+    last cell of the run reaches the egress. */
+struct cell_transfer {
+    struct sim_event event;
+    cell_fabric_t fabric;
+    packet_t packet;
+    cell_run_t run;
+};
+
+typedef struct cell_transfer * cell_transfer_t;
+
+/*  Per-port state. Ingress and egress state for the same port number is kept
+    together since the fabric is symmetric. */
+struct cell_fabric_port {
+    /*  Index the next cell segmented at this ingress will be given. */
+    unsigned int next_cell;
+
+    /*  Time at which the fabric link into this egress becomes free. */
+    unsigned int busy_until;
+
+    /*  Cells sent towards this egress that have not yet been reassembled. */
+    unsigned int cells_in_flight;
+
+    /*  Packets reassembled at this egress. */
+    unsigned long packets_reassembled;
+};
+
+struct cell_fabric {
+    unsigned int num_ports;
+    unsigned int cell_size;
+    unsigned int cell_time;
+
+    func_cell_deliver_t deliver;
+    void *deliver_arg;
+
+    struct cell_fabric_port *ports;
+
+    /*  Pool of in-flight transfers. */
+    object_pool_t transfers;
+
+    /*  Bytes wasted padding the last cell of each packet. */
+    unsigned long padding_bytes;
+};
+
+/*  Forward declarations of helper functions. */
+static void cell_fabric_reassemble(simulator_t sim, sim_event_t event);
+
+/*  Create a fabric with the given number of ports, cell payload size in
+    bytes and time taken to move one cell across a fabric link. */
+cell_fabric_t create_cell_fabric(
+    unsigned int num_ports,
+    unsigned int cell_size,
+    unsigned int cell_time,
+    func_cell_deliver_t deliver,
+    void *deliver_arg
+) {
+    assert(num_ports > 0);
+    assert(cell_size > 0);
+    assert(deliver);
+
+    cell_fabric_t fabric = malloc(sizeof(struct cell_fabric));
+    assert(fabric);
+
+    fabric->num_ports = num_ports;
+    fabric->cell_size = cell_size;
+    fabric->cell_time = cell_time;
+    fabric->deliver = deliver;
+    fabric->deliver_arg = deliver_arg;
+
+    fabric->ports = calloc(num_ports, sizeof(struct cell_fabric_port));
+    assert(fabric->ports);
+
+    fabric->transfers = create_object_pool(sizeof(struct cell_transfer), 0);
+    fabric->padding_bytes = 0;
+
+    return fabric;
+}
+
+/*  Free the fabric. Transfer events live in the fabric's pool and a
+    simulator would still reach them if freed or run later, so no cells may
+    be left crossing the fabric. */
+void free_cell_fabric(cell_fabric_t fabric) {
+    assert(fabric);
+
+    unsigned int i;
+    for (i = 0; i < fabric->num_ports; i++) {
+        assert(fabric->ports[i].cells_in_flight == 0);
+    }
+
+    free_object_pool(fabric->transfers);
+    free(fabric->ports);
+    free(fabric);
+}
+
+/*  Number of cells needed to carry a packet of the given length. Even an
+    empty packet occupies one cell. */
+unsigned int cell_fabric_cells_for(cell_fabric_t fabric, unsigned int length) {
+    if (length == 0) {
+        return 1;
+    }
+
+    return (length + fabric->cell_size - 1) / fabric->cell_size;
+}
+
+/*  Segment a packet at its ingress port. This only allocates the range of
+    cell indices - nothing is sent. */
+cell_run_t cell_fabric_segment(cell_fabric_t fabric, packet_t packet) {
+    assert(packet->ingress_port < fabric->num_ports);
+
+    struct cell_fabric_port *ingress = &fabric->ports[packet->ingress_port];
+
+    cell_run_t run;
+    run.first_cell = ingress->next_cell;
+    run.count = cell_fabric_cells_for(fabric, packet->length);
+
+    ingress->next_cell = ingress->next_cell + run.count;
+    fabric->padding_bytes +=
+        (unsigned long) run.count * fabric->cell_size - packet->length;
+
+    return run;
+}
+
+/*  Segment a packet and send its cells towards the packet's egress port.
+    The cells follow any already queued for the same egress, and a single
+    event is scheduled for when the last of them arrives. */
+cell_run_t cell_fabric_send(cell_fabric_t fabric, simulator_t sim, packet_t packet) {
+    assert(packet->egress_port < fabric->num_ports);
+
+    cell_run_t run = cell_fabric_segment(fabric, packet);
+    struct cell_fabric_port *egress = &fabric->ports[packet->egress_port];
+
+    /*  The run starts once both the cells and the fabric link are ready. */
+    unsigned int now = simulator_now(sim);
+    unsigned int start = egress->busy_until > now ? egress->busy_until : now;
+    unsigned int finish = start + run.count * fabric->cell_time;
+
+    egress->busy_until = finish;
+    egress->cells_in_flight = egress->cells_in_flight + run.count;
+
+    cell_transfer_t transfer = object_pool_alloc(fabric->transfers);
+    sim_event_init(&transfer->event, cell_fabric_reassemble, transfer);
+    transfer->fabric = fabric;
+    transfer->packet = packet;
+    transfer->run = run;
+
+    simulator_schedule(sim, &transfer->event, finish);
+
+    return run;
+}
+
+/*  Cells currently crossing the fabric towards an egress port. */
+unsigned int cell_fabric_cells_in_flight(cell_fabric_t fabric, unsigned int egress) {
+    assert(egress < fabric->num_ports);
+    return fabric->ports[egress].cells_in_flight;
+}
+
+/*  Packets reassembled at an egress port so far. */
+unsigned long cell_fabric_packets_reassembled(cell_fabric_t fabric, unsigned int egress) {
+    assert(egress < fabric->num_ports);
+    return fabric->ports[egress].packets_reassembled;
+}
+
+/*  Total bytes of cell padding across all segmented packets. */
+unsigned long cell_fabric_padding_bytes(cell_fabric_t fabric) {
+    return fabric->padding_bytes;
+}
+
+/*  Helper functions. */
+
+/*  Fired when the last cell of a run reaches the egress. Since the cells of
+    a run are carried back to back, every cell of the packet has now arrived
+    and it can be reassembled and handed on. */
+static void cell_fabric_reassemble(simulator_t sim, sim_event_t event) {
+    cell_transfer_t transfer = (cell_transfer_t) event->arg;
+    cell_fabric_t fabric = transfer->fabric;
+    packet_t packet = transfer->packet;
+
+    struct cell_fabric_port *egress = &fabric->ports[packet->egress_port];
+    assert(egress->cells_in_flight >= transfer->run.count);
+
+    egress->cells_in_flight = egress->cells_in_flight - transfer->run.count;
+    egress->packets_reassembled = egress->packets_reassembled + 1;
+
+    object_pool_release(fabric->transfers, transfer);
+
+    fabric->deliver(sim, packet, fabric->deliver_arg);
+}
@@ -0,0 +1,54 @@
+/*  cell_fabric.h
+
+    Model of a cell-switched fabric connecting the ingress and egress sides
+    of a switch. Packets arriving at an ingress port are segmented into fixed
+    size cells, carried across the fabric and reassembled at the egress port,
+    so endpoints see variable sized packets while the fabric only ever moves
+    cells.
+
+    Cells are never materialised individually. Segmenting a packet produces a
+    cell run - the index of its first cell and the number of cells - and the
+    fabric schedules a single event per run, at the time the last cell of the
+    run reaches the egress. A 9 KB jumbo frame carried in 64 byte cells is
+    therefore one event rather than around 150. */
+
+#ifndef CELL_FABRIC_H
+#define CELL_FABRIC_H
+
+#include "../event_simulation/simulator.h"
+#include "packet.h"
+
+struct cell_fabric;
+
+typedef struct cell_fabric * cell_fabric_t;
+
+/*  A contiguous run of cells belonging to one packet. Cell indices are
+    allocated sequentially per ingress port. */
+struct cell_run {
+    unsigned int first_cell;
+    unsigned int count;
+};
+
+typedef struct cell_run cell_run_t;
+
+/*  Called once a packet has been fully reassembled at its egress port. The
+    last argument is the deliver_arg given at creation time. */
+typedef void (*func_cell_deliver_t)(simulator_t, packet_t, void *);
+
+cell_fabric_t create_cell_fabric(
+    unsigned int num_ports,
+    unsigned int cell_size,
+    unsigned int cell_time,
+    func_cell_deliver_t deliver,
+    void *deliver_arg
+);
+
+void free_cell_fabric(cell_fabric_t fabric);
+unsigned int cell_fabric_cells_for(cell_fabric_t fabric, unsigned int length);
+cell_run_t cell_fabric_segment(cell_fabric_t fabric, packet_t packet);
+cell_run_t cell_fabric_send(cell_fabric_t fabric, simulator_t sim, packet_t packet);
+unsigned int cell_fabric_cells_in_flight(cell_fabric_t fabric, unsigned int egress);
+unsigned long cell_fabric_packets_reassembled(cell_fabric_t fabric, unsigned int egress);
+unsigned long cell_fabric_padding_bytes(cell_fabric_t fabric);
+
+#endif
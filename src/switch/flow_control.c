@@ -0,0 +1,568 @@
+/*  flow_control.c
+
+    Implementation of the PFC and credit based flow control models.
+
+    Each priority has a FIFO at the sender and a control channel back from
+    the receiver. The channel holds the message in flight, whose event is
+    embedded in the channel, and the merged follow-up, if any. A pause
+    message carries the time at which the pause ends, so a resume is simply
+    a pause that ends as soon as it arrives, and the sender keeps nothing
+    but that time. A credit message carries a number of bytes. */
+
+#include "flow_control.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  A per priority FIFO of waiting packets. */
+struct fc_queue {
+    packet_t head;
+    packet_t tail;
+};
+
+/*  Control messages from the receiver back to the sender. */
+struct fc_channel {
+    struct sim_event event;
+    int in_flight;
+    unsigned int value;
+
+    /*  Messages sent while another was in flight, merged. */
+    int has_next;
+    unsigned int next_value;
+    unsigned int next_arrival;
+};
+
+enum fc_merge {
+    FC_MERGE_PAUSE,
+    FC_MERGE_CREDIT
+};
+
+struct pfc_priority {
+    pfc_t pfc;
+
+    /*  Sender end. Packets of the priority may not start before
+        paused_until. The expiry event wakes the port when they may. */
+    struct fc_queue queue;
+    unsigned int paused_until;
+    struct sim_event expiry;
+    int expiry_pending;
+
+    /*  Receiver end. Whether the last message sent was a pause, and when
+        the sender will see that pause end. */
+    unsigned int buffered;
+    unsigned int max_buffered;
+    int xoff;
+    unsigned int pause_end;
+
+    struct fc_channel channel;
+};
+
+struct pfc {
+    unsigned int delay;
+    unsigned int quanta;
+    unsigned int xoff;
+    unsigned int xon;
+    unsigned int headroom;
+
+    port_t port;
+    simulator_t sim;
+
+    /*  Bit p set if priority p holds packets at the sender. */
+    unsigned int backlogged;
+    struct pfc_priority priorities[FLOW_CONTROL_PRIORITIES];
+
+    unsigned long frames_sent;
+    unsigned long frames_delivered;
+    unsigned long headroom_drops;
+};
+
+struct credit_fc_priority {
+    credit_fc_t credit_fc;
+
+    /*  Sender end, and the bytes of receiver buffer it may still fill. */
+    struct fc_queue queue;
+    unsigned int credits;
+
+    /*  Receiver end. */
+    unsigned int buffered;
+
+    struct fc_channel channel;
+};
+
+struct credit_fc {
+    unsigned int delay;
+    unsigned int buffer;
+
+    port_t port;
+    simulator_t sim;
+
+    unsigned int backlogged;
+    struct credit_fc_priority priorities[FLOW_CONTROL_PRIORITIES];
+
+    unsigned long returns_sent;
+    unsigned long returns_delivered;
+};
+
+/*  Forward declarations of helper functions. */
+static inline unsigned int fc_priority(packet_t packet);
+static inline void fc_queue_push(struct fc_queue *queue, packet_t packet);
+static inline packet_t fc_queue_pop(struct fc_queue *queue);
+static void fc_channel_init(struct fc_channel *channel, func_event_handler_t handler, void *arg);
+static void fc_channel_send(struct fc_channel *channel, simulator_t sim, unsigned int value, unsigned int arrival, enum fc_merge merge);
+static unsigned int fc_channel_landed(struct fc_channel *channel, simulator_t sim);
+static void pfc_send(pfc_t pfc, struct pfc_priority *priority, simulator_t sim, unsigned int until);
+static void pfc_enqueue(void *arg, packet_t packet, unsigned int now);
+static packet_t pfc_dequeue(void *arg, unsigned int now);
+static void pfc_landed(simulator_t sim, sim_event_t event);
+static void pfc_expired(simulator_t sim, sim_event_t event);
+static void credit_fc_enqueue(void *arg, packet_t packet, unsigned int now);
+static packet_t credit_fc_dequeue(void *arg, unsigned int now);
+static void credit_fc_landed(simulator_t sim, sim_event_t event);
+
+/*  Create PFC for a link with the given propagation delay. Pauses last
+    quanta ticks, and thresholds and headroom are in bytes per priority. */
+pfc_t create_pfc(unsigned int delay, unsigned int quanta, unsigned int xoff, unsigned int xon, unsigned int headroom) {
+    assert(quanta > 0);
+    assert(xon < xoff);
+
+    pfc_t pfc = malloc(sizeof(struct pfc));
+    assert(pfc);
+
+    pfc->delay = delay;
+    pfc->quanta = quanta;
+    pfc->xoff = xoff;
+    pfc->xon = xon;
+    pfc->headroom = headroom;
+    pfc->port = NULL;
+    pfc->sim = NULL;
+    pfc->backlogged = 0;
+    pfc->frames_sent = 0;
+    pfc->frames_delivered = 0;
+    pfc->headroom_drops = 0;
+
+    unsigned int p;
+    for (p = 0; p < FLOW_CONTROL_PRIORITIES; p++) {
+        struct pfc_priority *priority = &pfc->priorities[p];
+
+        priority->pfc = pfc;
+        priority->queue.head = NULL;
+        priority->queue.tail = NULL;
+        priority->paused_until = 0;
+        sim_event_init(&priority->expiry, pfc_expired, priority);
+        priority->expiry_pending = 0;
+        priority->buffered = 0;
+        priority->max_buffered = 0;
+        priority->xoff = 0;
+        priority->pause_end = 0;
+        fc_channel_init(&priority->channel, pfc_landed, priority);
+    }
+
+    return pfc;
+}
+
+/*  Free the model. Packets still queued are not freed since their
+    descriptors belong to whoever allocated them. The model must have no
+    events pending: no message in flight and no pause waiting to expire. */
+void free_pfc(pfc_t pfc) {
+    assert(pfc);
+
+    unsigned int p;
+    for (p = 0; p < FLOW_CONTROL_PRIORITIES; p++) {
+        assert(!pfc->priorities[p].channel.in_flight);
+        assert(!pfc->priorities[p].expiry_pending);
+    }
+
+    free(pfc);
+}
+
+/*  Make the model the scheduler of the port at the sending end. */
+void pfc_attach(pfc_t pfc, port_t port, simulator_t sim) {
+    pfc->port = port;
+    pfc->sim = sim;
+
+    port_set_scheduler(port, pfc_enqueue, pfc_dequeue, pfc);
+}
+
+/*  A packet has arrived at the receiving end. Returns 0 if it found no room
+    left in the headroom and must be dropped. */
+int pfc_receive(pfc_t pfc, simulator_t sim, packet_t packet) {
+    struct pfc_priority *priority = &pfc->priorities[fc_priority(packet)];
+    unsigned int now = simulator_now(sim);
+
+    if (priority->buffered + packet->length > pfc->xoff + pfc->headroom) {
+        pfc->headroom_drops = pfc->headroom_drops + 1;
+        return 0;
+    }
+
+    priority->buffered = priority->buffered + packet->length;
+    if (priority->buffered > priority->max_buffered) {
+        priority->max_buffered = priority->buffered;
+    }
+
+    /*  Pause, or refresh a pause that is more than half way through. */
+    if (priority->buffered >= pfc->xoff &&
+        (!priority->xoff || (int) (priority->pause_end - (now + pfc->delay)) < (int) (pfc->quanta / 2))) {
+        priority->xoff = 1;
+        priority->pause_end = now + pfc->delay + pfc->quanta;
+        pfc_send(pfc, priority, sim, priority->pause_end);
+    }
+
+    return 1;
+}
+
+/*  A packet has left the buffer at the receiving end. */
+void pfc_release(pfc_t pfc, simulator_t sim, packet_t packet) {
+    struct pfc_priority *priority = &pfc->priorities[fc_priority(packet)];
+
+    assert(priority->buffered >= packet->length);
+
+    priority->buffered = priority->buffered - packet->length;
+
+    if (priority->xoff && priority->buffered <= pfc->xon) {
+        priority->xoff = 0;
+        pfc_send(pfc, priority, sim, simulator_now(sim) + pfc->delay);
+    }
+}
+
+/*  Whether the sender may not start packets of a priority at the given
+    time, as far as the pauses it has received so far go. */
+int pfc_is_paused(pfc_t pfc, unsigned int priority, unsigned int now) {
+    assert(priority < FLOW_CONTROL_PRIORITIES);
+
+    return now < pfc->priorities[priority].paused_until;
+}
+
+/*  Bytes of a priority buffered at the receiving end. */
+unsigned int pfc_buffered(pfc_t pfc, unsigned int priority) {
+    assert(priority < FLOW_CONTROL_PRIORITIES);
+
+    return pfc->priorities[priority].buffered;
+}
+
+/*  Most bytes of a priority ever buffered at the receiving end. */
+unsigned int pfc_max_buffered(pfc_t pfc, unsigned int priority) {
+    assert(priority < FLOW_CONTROL_PRIORITIES);
+
+    return pfc->priorities[priority].max_buffered;
+}
+
+/*  Number of pause and resume frames sent by the receiver. */
+unsigned long pfc_frames_sent(pfc_t pfc) {
+    return pfc->frames_sent;
+}
+
+/*  Number of, possibly merged, frames that have reached the sender. */
+unsigned long pfc_frames_delivered(pfc_t pfc) {
+    return pfc->frames_delivered;
+}
+
+/*  Number of packets dropped for lack of headroom. */
+unsigned long pfc_headroom_drops(pfc_t pfc) {
+    return pfc->headroom_drops;
+}
+
+/*  Create credit based flow control for a link with the given propagation
+    delay and a receiver buffer of the given number of bytes per priority.
+    The sender starts with credit for the whole buffer. */
+credit_fc_t create_credit_fc(unsigned int delay, unsigned int buffer) {
+    assert(buffer > 0);
+
+    credit_fc_t credit_fc = malloc(sizeof(struct credit_fc));
+    assert(credit_fc);
+
+    credit_fc->delay = delay;
+    credit_fc->buffer = buffer;
+    credit_fc->port = NULL;
+    credit_fc->sim = NULL;
+    credit_fc->backlogged = 0;
+    credit_fc->returns_sent = 0;
+    credit_fc->returns_delivered = 0;
+
+    unsigned int p;
+    for (p = 0; p < FLOW_CONTROL_PRIORITIES; p++) {
+        struct credit_fc_priority *priority = &credit_fc->priorities[p];
+
+        priority->credit_fc = credit_fc;
+        priority->queue.head = NULL;
+        priority->queue.tail = NULL;
+        priority->credits = buffer;
+        priority->buffered = 0;
+        fc_channel_init(&priority->channel, credit_fc_landed, priority);
+    }
+
+    return credit_fc;
+}
+
+/*  Free the model. As for free_pfc, queued packets are not freed and no
+    credit return may be in flight. */
+void free_credit_fc(credit_fc_t credit_fc) {
+    assert(credit_fc);
+
+    unsigned int p;
+    for (p = 0; p < FLOW_CONTROL_PRIORITIES; p++) {
+        assert(!credit_fc->priorities[p].channel.in_flight);
+    }
+
+    free(credit_fc);
+}
+
+/*  Make the model the scheduler of the port at the sending end. */
+void credit_fc_attach(credit_fc_t credit_fc, port_t port, simulator_t sim) {
+    credit_fc->port = port;
+    credit_fc->sim = sim;
+
+    port_set_scheduler(port, credit_fc_enqueue, credit_fc_dequeue, credit_fc);
+}
+
+/*  A packet has arrived at the receiving end. It always fits. */
+void credit_fc_receive(credit_fc_t credit_fc, simulator_t sim, packet_t packet) {
+    struct credit_fc_priority *priority = &credit_fc->priorities[fc_priority(packet)];
+
+    (void) sim;
+
+    priority->buffered = priority->buffered + packet->length;
+    assert(priority->buffered <= credit_fc->buffer);
+}
+
+/*  A packet has left the buffer at the receiving end, so its bytes go back
+    to the sender. */
+void credit_fc_release(credit_fc_t credit_fc, simulator_t sim, packet_t packet) {
+    struct credit_fc_priority *priority = &credit_fc->priorities[fc_priority(packet)];
+
+    assert(priority->buffered >= packet->length);
+
+    priority->buffered = priority->buffered - packet->length;
+    credit_fc->returns_sent = credit_fc->returns_sent + 1;
+    fc_channel_send(&priority->channel, sim, packet->length,
+        simulator_now(sim) + credit_fc->delay, FC_MERGE_CREDIT);
+}
+
+/*  Bytes the sender may still send at a priority. */
+unsigned int credit_fc_credits(credit_fc_t credit_fc, unsigned int priority) {
+    assert(priority < FLOW_CONTROL_PRIORITIES);
+
+    return credit_fc->priorities[priority].credits;
+}
+
+/*  Bytes of a priority buffered at the receiving end. */
+unsigned int credit_fc_buffered(credit_fc_t credit_fc, unsigned int priority) {
+    assert(priority < FLOW_CONTROL_PRIORITIES);
+
+    return credit_fc->priorities[priority].buffered;
+}
+
+/*  Number of credit returns sent by the receiver, one per packet. */
+unsigned long credit_fc_returns_sent(credit_fc_t credit_fc) {
+    return credit_fc->returns_sent;
+}
+
+/*  Number of, possibly merged, credit returns that have reached the
+    sender. */
+unsigned long credit_fc_returns_delivered(credit_fc_t credit_fc) {
+    return credit_fc->returns_delivered;
+}
+
+/*  Helper functions. */
+
+static inline unsigned int fc_priority(packet_t packet) {
+    return packet->priority < FLOW_CONTROL_PRIORITIES ? packet->priority : FLOW_CONTROL_PRIORITIES - 1;
+}
+
+static inline void fc_queue_push(struct fc_queue *queue, packet_t packet) {
+    packet->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = packet;
+    } else {
+        queue->head = packet;
+    }
+    queue->tail = packet;
+}
+
+static inline packet_t fc_queue_pop(struct fc_queue *queue) {
+    packet_t packet = queue->head;
+
+    queue->head = packet->next;
+    if (queue->head == NULL) {
+        queue->tail = NULL;
+    }
+    packet->next = NULL;
+
+    return packet;
+}
+
+static void fc_channel_init(struct fc_channel *channel, func_event_handler_t handler, void *arg) {
+    sim_event_init(&channel->event, handler, arg);
+    channel->in_flight = 0;
+    channel->value = 0;
+    channel->has_next = 0;
+    channel->next_value = 0;
+    channel->next_arrival = 0;
+}
+
+/*  Send a message, or merge it into the follow-up if one is in flight. A
+    merged pause keeps the arrival of the first part and the end of the
+    last, merged credits add up and arrive with the last part. */
+static void fc_channel_send(struct fc_channel *channel, simulator_t sim, unsigned int value, unsigned int arrival, enum fc_merge merge) {
+    if (!channel->in_flight) {
+        channel->in_flight = 1;
+        channel->value = value;
+        simulator_schedule(sim, &channel->event, arrival);
+        return;
+    }
+
+    if (merge == FC_MERGE_PAUSE) {
+        if (!channel->has_next) {
+            channel->next_arrival = arrival;
+        }
+        channel->next_value = value;
+    } else {
+        channel->next_value = channel->has_next ? channel->next_value + value : value;
+        channel->next_arrival = arrival;
+    }
+    channel->has_next = 1;
+}
+
+/*  The message in flight has landed. Send the follow-up, if any, and
+    return the value of the message that landed. */
+static unsigned int fc_channel_landed(struct fc_channel *channel, simulator_t sim) {
+    unsigned int value = channel->value;
+
+    if (channel->has_next) {
+        channel->has_next = 0;
+        channel->value = channel->next_value;
+        simulator_schedule(sim, &channel->event, channel->next_arrival);
+    } else {
+        channel->in_flight = 0;
+    }
+
+    return value;
+}
+
+static void pfc_send(pfc_t pfc, struct pfc_priority *priority, simulator_t sim, unsigned int until) {
+    pfc->frames_sent = pfc->frames_sent + 1;
+    fc_channel_send(&priority->channel, sim, until, simulator_now(sim) + pfc->delay, FC_MERGE_PAUSE);
+}
+
+static void pfc_enqueue(void *arg, packet_t packet, unsigned int now) {
+    pfc_t pfc = (pfc_t) arg;
+    unsigned int p = fc_priority(packet);
+
+    (void) now;
+
+    fc_queue_push(&pfc->priorities[p].queue, packet);
+    pfc->backlogged = pfc->backlogged | (1u << p);
+}
+
+/*  Serve the lowest numbered priority that is not paused. Paused priorities
+    with packets get their expiry armed on the way past. */
+static packet_t pfc_dequeue(void *arg, unsigned int now) {
+    pfc_t pfc = (pfc_t) arg;
+    unsigned int mask = pfc->backlogged;
+
+    while (mask) {
+        unsigned int p = (unsigned int) __builtin_ctz(mask);
+        struct pfc_priority *priority = &pfc->priorities[p];
+
+        mask = mask & (mask - 1);
+
+        if (now < priority->paused_until) {
+            if (!priority->expiry_pending) {
+                priority->expiry_pending = 1;
+                simulator_schedule(pfc->sim, &priority->expiry, priority->paused_until);
+            }
+            continue;
+        }
+
+        packet_t packet = fc_queue_pop(&priority->queue);
+        if (priority->queue.head == NULL) {
+            pfc->backlogged = pfc->backlogged & ~(1u << p);
+        }
+        return packet;
+    }
+
+    return NULL;
+}
+
+/*  A pause or resume has reached the sender. A resume may let the port
+    start straight away. */
+static void pfc_landed(simulator_t sim, sim_event_t event) {
+    struct pfc_priority *priority = (struct pfc_priority *) event->arg;
+    pfc_t pfc = priority->pfc;
+
+    priority->paused_until = fc_channel_landed(&priority->channel, sim);
+    pfc->frames_delivered = pfc->frames_delivered + 1;
+
+    if (priority->paused_until <= simulator_now(sim) && pfc->port) {
+        port_resume(pfc->port, sim);
+    }
+}
+
+/*  The pause the expiry was armed for has ended, unless it was refreshed in
+    the meantime, in which case wait for the new end. */
+static void pfc_expired(simulator_t sim, sim_event_t event) {
+    struct pfc_priority *priority = (struct pfc_priority *) event->arg;
+    pfc_t pfc = priority->pfc;
+    unsigned int now = simulator_now(sim);
+
+    if (now < priority->paused_until) {
+        simulator_schedule(sim, &priority->expiry, priority->paused_until);
+        return;
+    }
+
+    priority->expiry_pending = 0;
+    port_resume(pfc->port, sim);
+}
+
+static void credit_fc_enqueue(void *arg, packet_t packet, unsigned int now) {
+    credit_fc_t credit_fc = (credit_fc_t) arg;
+    unsigned int p = fc_priority(packet);
+
+    (void) now;
+
+    /*  A packet bigger than the buffer could never be sent. */
+    assert(packet->length <= credit_fc->buffer);
+
+    fc_queue_push(&credit_fc->priorities[p].queue, packet);
+    credit_fc->backlogged = credit_fc->backlogged | (1u << p);
+}
+
+/*  Serve the lowest numbered priority with credit for its head packet. */
+static packet_t credit_fc_dequeue(void *arg, unsigned int now) {
+    credit_fc_t credit_fc = (credit_fc_t) arg;
+    unsigned int mask = credit_fc->backlogged;
+
+    (void) now;
+
+    while (mask) {
+        unsigned int p = (unsigned int) __builtin_ctz(mask);
+        struct credit_fc_priority *priority = &credit_fc->priorities[p];
+
+        mask = mask & (mask - 1);
+
+        if (priority->queue.head->length > priority->credits) {
+            continue;
+        }
+
+        packet_t packet = fc_queue_pop(&priority->queue);
+        if (priority->queue.head == NULL) {
+            credit_fc->backlogged = credit_fc->backlogged & ~(1u << p);
+        }
+        priority->credits = priority->credits - packet->length;
+        return packet;
+    }
+
+    return NULL;
+}
+
+static void credit_fc_landed(simulator_t sim, sim_event_t event) {
+    struct credit_fc_priority *priority = (struct credit_fc_priority *) event->arg;
+    credit_fc_t credit_fc = priority->credit_fc;
+
+    priority->credits = priority->credits + fc_channel_landed(&priority->channel, sim);
+    credit_fc->returns_delivered = credit_fc->returns_delivered + 1;
+
+    if (credit_fc->port) {
+        port_resume(credit_fc->port, sim);
+    }
+}
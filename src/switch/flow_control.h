@@ -0,0 +1,80 @@
+/*  flow_control.h
+
+    Link level flow control: priority flow control (IEEE 802.1Qbb) and
+    credit based flow control.
+
+    Both models stand for the two ends of one link. The sending end is
+    attached to the upstream port as its scheduler, holding a FIFO per
+    priority and serving the lowest numbered priority that may send. The
+    receiving end is told about each packet that arrives over the link and
+    each packet that leaves the downstream buffer, and answers with control
+    messages that reach the sender after the propagation delay of the link.
+
+    With PFC the receiver counts the bytes buffered for each priority. When
+    they reach the XOFF threshold it sends a pause with a given number of
+    ticks of quanta, and when they fall to the XON threshold it sends a
+    resume, i.e. a pause of zero quanta. While a priority stays above XOFF
+    the pause is refreshed by packets arriving in the second half of its
+    quanta. Packets that arrive to find the XOFF threshold plus the headroom
+    already full are dropped and counted, so a correctly sized headroom
+    shows up as no drops at all.
+
+    With credits the sender holds a budget of buffer bytes for each
+    priority, spends it on each packet it starts, and only starts a packet
+    the budget covers. The receiver returns the bytes as packets leave its
+    buffer. The buffer can therefore never overflow.
+
+    Control messages are coalesced rather than given an event each. Each
+    priority has at most one message in flight. Anything sent while it is
+    in flight is merged into a single follow-up message, which is scheduled
+    when the first lands. A merged pause takes effect when the earliest of
+    its parts would have and lasts until the latest would have ended, and
+    merged credits arrive together when the last of them would have. A
+    pause can only be lengthened by this, and credits only delayed, so
+    neither model loses its guarantee. Pause expiry uses one wake-up
+    event per priority that is only armed while that priority holds packets
+    it may not send, and is pushed back lazily when the pause is refreshed.
+    A pause storm therefore keeps at most two events per priority in the
+    event queue. */
+
+#ifndef FLOW_CONTROL_H
+#define FLOW_CONTROL_H
+
+#include "../event_simulation/simulator.h"
+#include "packet.h"
+#include "port.h"
+
+/*  Packets with a higher priority number share the last priority. */
+#define FLOW_CONTROL_PRIORITIES 8
+
+struct pfc;
+
+typedef struct pfc * pfc_t;
+
+pfc_t create_pfc(unsigned int delay, unsigned int quanta, unsigned int xoff, unsigned int xon, unsigned int headroom);
+void free_pfc(pfc_t pfc);
+void pfc_attach(pfc_t pfc, port_t port, simulator_t sim);
+int pfc_receive(pfc_t pfc, simulator_t sim, packet_t packet);
+void pfc_release(pfc_t pfc, simulator_t sim, packet_t packet);
+int pfc_is_paused(pfc_t pfc, unsigned int priority, unsigned int now);
+unsigned int pfc_buffered(pfc_t pfc, unsigned int priority);
+unsigned int pfc_max_buffered(pfc_t pfc, unsigned int priority);
+unsigned long pfc_frames_sent(pfc_t pfc);
+unsigned long pfc_frames_delivered(pfc_t pfc);
+unsigned long pfc_headroom_drops(pfc_t pfc);
+
+struct credit_fc;
+
+typedef struct credit_fc * credit_fc_t;
+
+credit_fc_t create_credit_fc(unsigned int delay, unsigned int buffer);
+void free_credit_fc(credit_fc_t credit_fc);
+void credit_fc_attach(credit_fc_t credit_fc, port_t port, simulator_t sim);
+void credit_fc_receive(credit_fc_t credit_fc, simulator_t sim, packet_t packet);
+void credit_fc_release(credit_fc_t credit_fc, simulator_t sim, packet_t packet);
+unsigned int credit_fc_credits(credit_fc_t credit_fc, unsigned int priority);
+unsigned int credit_fc_buffered(credit_fc_t credit_fc, unsigned int priority);
+unsigned long credit_fc_returns_sent(credit_fc_t credit_fc);
+unsigned long credit_fc_returns_delivered(credit_fc_t credit_fc);
+
+#endif
@@ -0,0 +1,157 @@
+/*  link.c
+
+    Implementation of the link model.
+
+    The delay line is a circular buffer of in-flight entries whose capacity
+    is always a power of two, so wrapping an index is a single mask. It
+    doubles in size when full and never shrinks. */
+
+#include "link.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_LINE_CAPACITY 16
+
+/*  A packet in flight. */
+struct link_entry {
+    packet_t packet;
+
+    /*  Time the head of the packet reaches the far end. */
+    unsigned int head_arrival;
+
+    /*  Time the packet is handed to the far end. This is when the tail has
+        arrived, or the head arrival if the packet was sent late. */
+    unsigned int delivery;
+};
+
+struct link {
+    unsigned int delay;
+
+    func_link_deliver_t deliver;
+    void *deliver_arg;
+
+    /*  Circular delay line. */
+    struct link_entry *line;
+    unsigned int capacity;
+    unsigned int front;
+    unsigned int count;
+
+    /*  Fires when the packet at the front of the line lands. */
+    struct sim_event arrival;
+};
+
+/*  Forward declarations of helper functions. */
+static void link_grow(link_t link);
+static void link_arrived(simulator_t sim, sim_event_t event);
+
+/*  Create an empty link with the given propagation delay in ticks. */
+link_t create_link(unsigned int delay, func_link_deliver_t deliver, void *deliver_arg) {
+    assert(deliver);
+
+    link_t link = malloc(sizeof(struct link));
+    assert(link);
+
+    link->delay = delay;
+    link->deliver = deliver;
+    link->deliver_arg = deliver_arg;
+
+    link->line = malloc(sizeof(struct link_entry) * DEFAULT_LINE_CAPACITY);
+    assert(link->line);
+    link->capacity = DEFAULT_LINE_CAPACITY;
+    link->front = 0;
+    link->count = 0;
+
+    sim_event_init(&link->arrival, link_arrived, link);
+
+    return link;
+}
+
+/*  Free the link. Packets still in flight are not freed. */
+void free_link(link_t link) {
+    assert(link);
+
+    free(link->line);
+    free(link);
+}
+
+/*  Put a packet on the link. Called when its tail leaves the sender, with
+    the time at which its head left. */
+void link_send(link_t link, simulator_t sim, packet_t packet, unsigned int head_departure) {
+    assert(link);
+    assert(packet);
+
+    if (link->count == link->capacity) {
+        link_grow(link);
+    }
+
+    unsigned int now = simulator_now(sim);
+    unsigned int index = (link->front + link->count) & (link->capacity - 1);
+    struct link_entry *entry = &link->line[index];
+
+    entry->packet = packet;
+    entry->head_arrival = head_departure + link->delay;
+    entry->delivery = now + link->delay;
+
+    /*  Successive deliveries are non-decreasing since the current time
+        never goes backwards. */
+    assert(link->count == 0 ||
+        link->line[(index - 1) & (link->capacity - 1)].delivery <= entry->delivery);
+
+    link->count = link->count + 1;
+
+    /*  Only the front of the line is ever scheduled. */
+    if (link->count == 1) {
+        simulator_schedule(sim, &link->arrival, entry->delivery);
+    }
+}
+
+/*  Number of packets currently in flight. */
+unsigned int link_in_flight(link_t link) {
+    return link->count;
+}
+
+/*  Propagation delay of the link. */
+unsigned int link_delay(link_t link) {
+    return link->delay;
+}
+
+/*  Helper functions. */
+
+/*  Double the capacity of the delay line, unwrapping its contents so that
+    the front is at index 0. */
+static void link_grow(link_t link) {
+    unsigned int new_capacity = 2 * link->capacity;
+    struct link_entry *new_line = malloc(sizeof(struct link_entry) * new_capacity);
+    assert(new_line);
+
+    unsigned int i;
+    for (i = 0; i < link->count; i++) {
+        new_line[i] = link->line[(link->front + i) & (link->capacity - 1)];
+    }
+
+    free(link->line);
+    link->line = new_line;
+    link->capacity = new_capacity;
+    link->front = 0;
+}
+
+/*  The packet at the front of the line has landed. Reschedule for the next
+    packet, if any, before handing this one on. */
+static void link_arrived(simulator_t sim, sim_event_t event) {
+    link_t link = (link_t) event->arg;
+
+    assert(link->count > 0);
+
+    struct link_entry entry = link->line[link->front];
+    link->front = (link->front + 1) & (link->capacity - 1);
+    link->count = link->count - 1;
+
+    if (link->count > 0) {
+        simulator_schedule(sim, &link->arrival, link->line[link->front].delivery);
+    }
+
+    link->deliver(sim, entry.packet, entry.head_arrival, link->deliver_arg);
+}
@@ -0,0 +1,40 @@
+/*  link.h
+
+    Model of a point to point link with a fixed propagation delay.
+
+    A long, fast link can hold a very large number of packets in flight, and
+    scheduling an arrival event for each of them would fill the event queue.
+    Instead the link keeps its in-flight packets in a FIFO delay line. Since
+    every packet experiences the same delay, packets arrive in the order they
+    were sent and the delay line is time ordered by construction. Only the
+    packet at the front of the line has an event in the queue, and when it
+    lands the event is rescheduled for the next packet. The event queue
+    therefore holds at most one event per link.
+
+    Links are designed to sit between ports - link_send has the same
+    signature as the port transmit callback apart from the first argument,
+    and delivered packets are reported with their head arrival time as
+    port_receive expects. */
+
+#ifndef LINK_H
+#define LINK_H
+
+#include "../event_simulation/simulator.h"
+#include "packet.h"
+
+struct link;
+
+typedef struct link * link_t;
+
+/*  Called when a packet lands at the far end of the link. The third argument
+    is the time at which its head arrived, the last is the deliver_arg given
+    at creation time. */
+typedef void (*func_link_deliver_t)(simulator_t, packet_t, unsigned int, void *);
+
+link_t create_link(unsigned int delay, func_link_deliver_t deliver, void *deliver_arg);
+void free_link(link_t link);
+void link_send(link_t link, simulator_t sim, packet_t packet, unsigned int head_departure);
+unsigned int link_in_flight(link_t link);
+unsigned int link_delay(link_t link);
+
+#endif
@@ -0,0 +1,102 @@
+/*  packet.h
+
+    Packet descriptor shared by the switch models.
+
+    A simulated packet has no payload - only the metadata that the models need
+    to make forwarding, scheduling and accounting decisions. Descriptors are
+    expected to be allocated from an object pool rather than with malloc, see
+    packet_pool_alloc below. */
+
+#ifndef PACKET_H
+#define PACKET_H
+
+#include "../event_simulation/data_structures/object_pool.h"
+
+#include <stddef.h>
+
+struct packet;
+
+typedef struct packet * packet_t;
+
+/*  Flag bits stored in the flags field. */
+#define PACKET_FLAG_ECN_CAPABLE 0x1
+#define PACKET_FLAG_ECN_MARKED  0x2
+
+/*  Colour given by a policer, green when neither bit is set. */
+#define PACKET_FLAG_YELLOW      0x4
+#define PACKET_FLAG_RED         0x8
+#define PACKET_FLAG_COLOR_MASK  0xc
+
+/*  Set by transport models on acknowledgements, and on those echoing a
+    congestion experienced mark. */
+#define PACKET_FLAG_ACK         0x10
+#define PACKET_FLAG_ECN_ECHO    0x20
+
+struct packet {
+    /*  Link used by whichever model currently holds the packet, allowing
+        queues of packets to be built without any extra allocation. A packet
+        can therefore only sit in one queue at a time. */
+    packet_t next;
+
+    /*  Unique identifier, chosen by the traffic source. */
+    unsigned int id;
+
+    /*  Length in bytes. */
+    unsigned int length;
+
+    /*  Ports the packet entered and will leave the current switch by. */
+    unsigned int ingress_port;
+    unsigned int egress_port;
+
+    /*  Flow the packet belongs to. */
+    unsigned int flow_id;
+
+    /*  Traffic class, 0 being the highest priority. */
+    unsigned int priority;
+
+    /*  Segment number within the flow for data packets sent by a transport
+        model, next segment expected for acknowledgements. */
+    unsigned int seq;
+
+    /*  Time the packet was created by its source. */
+    unsigned int created;
+
+    /*  Time the head of the packet arrived at the model currently holding
+        it. */
+    unsigned int arrived;
+
+    /*  PACKET_FLAG_* bits. */
+    unsigned int flags;
+
+    /*  Number of replicas sharing the descriptor, 0 for a packet that has
+        not been replicated. See replicator.h. */
+    unsigned int references;
+};
+
+/*  Allocate a zeroed descriptor from a pool created with
+    create_packet_pool. */
+static inline packet_t packet_pool_alloc(object_pool_t pool) {
+    packet_t packet = (packet_t) object_pool_alloc(pool);
+
+    packet->next = NULL;
+    packet->id = 0;
+    packet->length = 0;
+    packet->ingress_port = 0;
+    packet->egress_port = 0;
+    packet->flow_id = 0;
+    packet->priority = 0;
+    packet->seq = 0;
+    packet->created = 0;
+    packet->arrived = 0;
+    packet->flags = 0;
+    packet->references = 0;
+
+    return packet;
+}
+
+/*  Create a pool sized for packet descriptors. */
+static inline object_pool_t create_packet_pool(void) {
+    return create_object_pool(sizeof(struct packet), 0);
+}
+
+#endif
@@ -0,0 +1,304 @@
+/*  pipeline.c
+
+    Implementation of the cycle accurate pipeline.
+
+    The remaining count of a stage is the number of cycles its packet still
+    needs there, so a packet entering a stage of n cycles at cycle c is done
+    with it at cycle c + n, and then either moves on in that same cycle or
+    stalls with a count of 0.
+
+    The event of the pipeline is only ever pending while the clock runs,
+    for the next cycle that must be stepped from an event: one at which a
+    packet leaves, or one at or after the next event of somebody else. */
+
+#include "pipeline.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+struct pipeline {
+    unsigned int num_stages;
+    unsigned int cycle_ticks;
+
+    /*  Stage state, one entry per stage in each array. */
+    unsigned int *stage_cycles;
+    unsigned int *remaining;
+    packet_t *slot;
+    func_pipeline_action_t *action;
+    void **action_arg;
+    unsigned long *busy;
+    unsigned long *stalls;
+
+    func_pipeline_output_t output;
+    void *output_arg;
+
+    /*  Packets waiting to enter the first stage. */
+    packet_t input_head;
+    packet_t input_tail;
+    unsigned int input_packets;
+
+    /*  Number of stages holding a packet. */
+    unsigned int occupied;
+
+    struct sim_event event;
+    int running;
+
+    /*  Time of the first cycle not yet stepped or skipped. */
+    unsigned int next_cycle;
+
+    unsigned long packets_out;
+    unsigned long cycles;
+    unsigned long skipped;
+    unsigned long events;
+};
+
+/*  Forward declarations of helper functions. */
+static void pipeline_clock(simulator_t sim, sim_event_t event);
+static void pipeline_step(pipeline_t pipeline, simulator_t sim, unsigned int cycle);
+
+/*  Create a pipeline of the given number of stages, a packet taking
+    stage_cycles[s] cycles in stage s, with a clock period of cycle_ticks. */
+pipeline_t create_pipeline(
+    unsigned int num_stages,
+    const unsigned int *stage_cycles,
+    unsigned int cycle_ticks,
+    func_pipeline_output_t output,
+    void *output_arg
+) {
+    assert(num_stages > 0);
+    assert(stage_cycles);
+    assert(cycle_ticks > 0);
+    assert(output);
+
+    pipeline_t pipeline = malloc(sizeof(struct pipeline));
+    assert(pipeline);
+
+    pipeline->num_stages = num_stages;
+    pipeline->cycle_ticks = cycle_ticks;
+
+    pipeline->stage_cycles = malloc(sizeof(unsigned int) * num_stages);
+    assert(pipeline->stage_cycles);
+    pipeline->remaining = malloc(sizeof(unsigned int) * num_stages);
+    assert(pipeline->remaining);
+    pipeline->slot = malloc(sizeof(packet_t) * num_stages);
+    assert(pipeline->slot);
+    pipeline->action = malloc(sizeof(func_pipeline_action_t) * num_stages);
+    assert(pipeline->action);
+    pipeline->action_arg = malloc(sizeof(void *) * num_stages);
+    assert(pipeline->action_arg);
+    pipeline->busy = malloc(sizeof(unsigned long) * num_stages);
+    assert(pipeline->busy);
+    pipeline->stalls = malloc(sizeof(unsigned long) * num_stages);
+    assert(pipeline->stalls);
+
+    unsigned int stage;
+    for (stage = 0; stage < num_stages; stage++) {
+        assert(stage_cycles[stage] > 0);
+
+        pipeline->stage_cycles[stage] = stage_cycles[stage];
+        pipeline->remaining[stage] = 0;
+        pipeline->slot[stage] = NULL;
+        pipeline->action[stage] = NULL;
+        pipeline->action_arg[stage] = NULL;
+        pipeline->busy[stage] = 0;
+        pipeline->stalls[stage] = 0;
+    }
+
+    pipeline->output = output;
+    pipeline->output_arg = output_arg;
+
+    pipeline->input_head = NULL;
+    pipeline->input_tail = NULL;
+    pipeline->input_packets = 0;
+    pipeline->occupied = 0;
+
+    sim_event_init(&pipeline->event, pipeline_clock, pipeline);
+    pipeline->running = 0;
+    pipeline->next_cycle = 0;
+
+    pipeline->packets_out = 0;
+    pipeline->cycles = 0;
+    pipeline->skipped = 0;
+    pipeline->events = 0;
+
+    return pipeline;
+}
+
+/*  Free the pipeline. Packets still inside are not freed. */
+void free_pipeline(pipeline_t pipeline) {
+    assert(pipeline);
+
+    free(pipeline->stage_cycles);
+    free(pipeline->remaining);
+    free(pipeline->slot);
+    free(pipeline->action);
+    free(pipeline->action_arg);
+    free(pipeline->busy);
+    free(pipeline->stalls);
+    free(pipeline);
+}
+
+/*  Have a function called on each packet as it finishes a stage, or stop
+    doing so if action is NULL. */
+void pipeline_set_action(pipeline_t pipeline, unsigned int stage, func_pipeline_action_t action, void *action_arg) {
+    assert(stage < pipeline->num_stages);
+
+    pipeline->action[stage] = action;
+    pipeline->action_arg[stage] = action_arg;
+}
+
+/*  A packet has arrived at the pipeline. It joins the input FIFO and enters
+    the first stage at a cycle after now once the stage is free. */
+void pipeline_receive(pipeline_t pipeline, simulator_t sim, packet_t packet) {
+    unsigned int now = simulator_now(sim);
+
+    packet->next = NULL;
+    packet->arrived = now;
+
+    if (pipeline->input_tail) {
+        pipeline->input_tail->next = packet;
+    } else {
+        pipeline->input_head = packet;
+    }
+    pipeline->input_tail = packet;
+    pipeline->input_packets = pipeline->input_packets + 1;
+
+    /*  Restart the clock, skipping the idle cycles. */
+    if (!pipeline->running) {
+        unsigned int cycle = (now / pipeline->cycle_ticks + 1) * pipeline->cycle_ticks;
+
+        if (cycle > pipeline->next_cycle) {
+            pipeline->skipped = pipeline->skipped + (cycle - pipeline->next_cycle) / pipeline->cycle_ticks;
+        }
+        pipeline->running = 1;
+        simulator_schedule(sim, &pipeline->event, cycle);
+    }
+}
+
+/*  Number of packets in the pipeline, including those waiting to enter. */
+unsigned int pipeline_packets(pipeline_t pipeline) {
+    return pipeline->occupied + pipeline->input_packets;
+}
+
+unsigned long pipeline_packets_out(pipeline_t pipeline) {
+    return pipeline->packets_out;
+}
+
+/*  Number of cycles stepped. */
+unsigned long pipeline_cycles(pipeline_t pipeline) {
+    return pipeline->cycles;
+}
+
+/*  Number of cycles skipped while the pipeline was empty. */
+unsigned long pipeline_idle_cycles_skipped(pipeline_t pipeline) {
+    return pipeline->skipped;
+}
+
+/*  Number of events the pipeline has taken. */
+unsigned long pipeline_events(pipeline_t pipeline) {
+    return pipeline->events;
+}
+
+/*  Number of cycles a stage spent working on a packet. */
+unsigned long pipeline_stage_busy(pipeline_t pipeline, unsigned int stage) {
+    assert(stage < pipeline->num_stages);
+
+    return pipeline->busy[stage];
+}
+
+/*  Number of cycles a stage held a finished packet the next stage had no
+    room for. */
+unsigned long pipeline_stage_stalls(pipeline_t pipeline, unsigned int stage) {
+    assert(stage < pipeline->num_stages);
+
+    return pipeline->stalls[stage];
+}
+
+/*  Helper functions. */
+
+/*  Step the cycle at the current time, then as many more as can be stepped
+    without an event, and schedule the next one that needs one. */
+static void pipeline_clock(simulator_t sim, sim_event_t event) {
+    pipeline_t pipeline = (pipeline_t) event->arg;
+    unsigned int last = pipeline->num_stages - 1;
+    unsigned int cycle = simulator_now(sim);
+    unsigned int next_event;
+
+    pipeline->events = pipeline->events + 1;
+
+    while (1) {
+        pipeline_step(pipeline, sim, cycle);
+        pipeline->next_cycle = cycle + pipeline->cycle_ticks;
+
+        if (pipeline->occupied == 0 && pipeline->input_packets == 0) {
+            pipeline->running = 0;
+            return;
+        }
+
+        cycle = cycle + pipeline->cycle_ticks;
+
+        if ((pipeline->slot[last] && pipeline->remaining[last] <= 1) ||
+            (simulator_next_time(sim, &next_event) && next_event <= cycle)) {
+            simulator_schedule(sim, &pipeline->event, cycle);
+            return;
+        }
+    }
+}
+
+/*  Advance every stage by one cycle, from the last to the first, then let
+    a packet into the first stage if it is free. */
+static void pipeline_step(pipeline_t pipeline, simulator_t sim, unsigned int cycle) {
+    unsigned int last = pipeline->num_stages - 1;
+    unsigned int stage = pipeline->num_stages;
+
+    while (stage-- > 0) {
+        packet_t packet = pipeline->slot[stage];
+
+        if (!packet) {
+            continue;
+        }
+
+        if (pipeline->remaining[stage] > 0) {
+            pipeline->remaining[stage] = pipeline->remaining[stage] - 1;
+            pipeline->busy[stage] = pipeline->busy[stage] + 1;
+
+            if (pipeline->remaining[stage] == 0 && pipeline->action[stage]) {
+                pipeline->action[stage](pipeline->action_arg[stage], packet);
+            }
+        }
+
+        if (pipeline->remaining[stage] > 0) {
+            continue;
+        }
+
+        if (stage == last) {
+            pipeline->slot[stage] = NULL;
+            pipeline->occupied = pipeline->occupied - 1;
+            pipeline->packets_out = pipeline->packets_out + 1;
+            pipeline->output(sim, packet, pipeline->output_arg);
+        } else if (!pipeline->slot[stage + 1]) {
+            pipeline->slot[stage + 1] = packet;
+            pipeline->remaining[stage + 1] = pipeline->stage_cycles[stage + 1];
+            pipeline->slot[stage] = NULL;
+        } else {
+            pipeline->stalls[stage] = pipeline->stalls[stage] + 1;
+        }
+    }
+
+    packet_t head = pipeline->input_head;
+    if (!pipeline->slot[0] && head && head->arrived < cycle) {
+        pipeline->input_head = head->next;
+        if (!pipeline->input_head) {
+            pipeline->input_tail = NULL;
+        }
+        pipeline->input_packets = pipeline->input_packets - 1;
+        head->next = NULL;
+
+        pipeline->slot[0] = head;
+        pipeline->remaining[0] = pipeline->stage_cycles[0];
+        pipeline->occupied = pipeline->occupied + 1;
+    }
+
+    pipeline->cycles = pipeline->cycles + 1;
+}
@@ -0,0 +1,68 @@
+/*  pipeline.h
+
+    Cycle accurate model of a switch ASIC pipeline: a parser, match-action
+    stages and a traffic manager, or any other chain of stages, clocked
+    together.
+
+    Each stage holds at most one packet, which occupies it for the number
+    of cycles given for that stage and then moves to the next stage as soon
+    as that one is free, or stalls where it is until it is. Packets enter
+    the first stage from an input FIFO and leave the last through an output
+    function. Every cycle stages are advanced from the last to the first, so
+    a packet leaving a stage frees it for the one behind in the same cycle.
+    An action may be set for a stage, called on each packet as it finishes
+    there, to do whatever work the stage stands for.
+
+    The pipeline is driven from the event kernel but does not schedule an
+    event per cycle. While any packet is in the pipeline its single event
+    steps cycle after cycle in a tight loop, stopping only at the cycle a
+    packet leaves, so that the output function is called at the right
+    time, or before the time of the next event pending in the simulator,
+    which may bring a new packet. Once the pipeline is empty the clock
+    stops altogether, and the next arrival restarts it at the first cycle
+    after it, skipping every idle cycle in between. Cycles stepped in the
+    loop therefore run ahead of the simulator's time, but only up to an
+    event, and nothing outside the pipeline can see them until then.
+
+    A packet arriving at a cycle boundary is taken at the following cycle,
+    whatever order events at the same time fire in. Stage state is held as
+    a structure of arrays so the per cycle loop stays within a few cache
+    lines. */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "../event_simulation/simulator.h"
+#include "packet.h"
+
+struct pipeline;
+
+typedef struct pipeline * pipeline_t;
+
+/*  Called when a packet leaves the last stage, with the output_arg given at
+    creation time. */
+typedef void (*func_pipeline_output_t)(simulator_t, packet_t, void *);
+
+/*  Called as a packet finishes a stage, with the action_arg given to
+    pipeline_set_action. */
+typedef void (*func_pipeline_action_t)(void *, packet_t);
+
+pipeline_t create_pipeline(
+    unsigned int num_stages,
+    const unsigned int *stage_cycles,
+    unsigned int cycle_ticks,
+    func_pipeline_output_t output,
+    void *output_arg
+);
+void free_pipeline(pipeline_t pipeline);
+void pipeline_set_action(pipeline_t pipeline, unsigned int stage, func_pipeline_action_t action, void *action_arg);
+void pipeline_receive(pipeline_t pipeline, simulator_t sim, packet_t packet);
+unsigned int pipeline_packets(pipeline_t pipeline);
+unsigned long pipeline_packets_out(pipeline_t pipeline);
+unsigned long pipeline_cycles(pipeline_t pipeline);
+unsigned long pipeline_idle_cycles_skipped(pipeline_t pipeline);
+unsigned long pipeline_events(pipeline_t pipeline);
+unsigned long pipeline_stage_busy(pipeline_t pipeline, unsigned int stage);
+unsigned long pipeline_stage_stalls(pipeline_t pipeline, unsigned int stage);
+
+#endif
@@ -0,0 +1,448 @@
+/*  port.c
+
+    Implementation of the egress port model.
+
+    The port owns a single embedded departure event, which is scheduled for
+    the tail departure of whichever packet is currently being transmitted.
+    Waiting packets are chained through their next pointers, so queueing
+    costs nothing beyond the descriptor itself. In store and forward mode a
+    small reception record is taken from a pool for each packet being
+    received. */
+
+#include "port.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  A packet being received in store and forward mode. The event fires when
+    its tail has arrived. */
+struct port_reception {
+    struct sim_event event;
+    port_t port;
+    packet_t packet;
+};
+
+typedef struct port_reception * port_reception_t;
+
+struct port {
+    port_forwarding_mode_t mode;
+
+    /*  Rates of the link feeding the port and of the output link, in bits
+        per thousand ticks. */
+    unsigned int in_rate;
+    unsigned int out_rate;
+
+    /*  Bytes that must arrive before a cut-through decision can be made. */
+    unsigned int header_bytes;
+
+    func_port_transmit_t transmit;
+    void *transmit_arg;
+
+    /*  FIFO of packets waiting to be transmitted, unused when a scheduler
+        is attached. */
+    packet_t queue_head;
+    packet_t queue_tail;
+
+    /*  Scheduler holding the waiting packets instead of the FIFO, if any. */
+    func_port_enqueue_t enqueue;
+    func_port_dequeue_t dequeue;
+    void *scheduler_arg;
+
+    unsigned int queue_packets;
+    unsigned int queue_bytes;
+
+    /*  Active queue management, either hook may be NULL. */
+    func_port_aqm_t admit;
+    func_port_aqm_t release;
+    void *aqm_arg;
+
+    func_port_drop_t drop;
+    void *drop_arg;
+
+    /*  Queueing delays of the packets sent and statistics of the bytes
+        waiting, if wanted. */
+    histogram_t delays;
+    time_weighted_t occupancy;
+
+    /*  Bytes sent and peak bytes waiting per window, kept as the given
+        series of each, if wanted. */
+    time_series_t sent_series;
+    time_series_t queue_series;
+    unsigned int series_index;
+
+    /*  Packet currently being transmitted, NULL when idle, and the time its
+        head left the port. */
+    packet_t transmitting;
+    unsigned int head_departure;
+
+    /*  Time the tail of the last packet left, i.e. the earliest time the
+        output link is free. In cut-through mode this may be earlier than
+        the time at which a late reported arrival is processed. */
+    unsigned int busy_until;
+
+    /*  Fires when the tail of the transmitting packet leaves. */
+    struct sim_event departure;
+
+    /*  Pool of store and forward reception records. */
+    object_pool_t receptions;
+
+    unsigned long packets_sent;
+    unsigned long packets_dropped;
+};
+
+/*  Forward declarations of helper functions. */
+static void port_enqueue(port_t port, simulator_t sim, packet_t packet);
+static void port_start_next(port_t port, simulator_t sim);
+static packet_t port_take(port_t port, simulator_t sim);
+static void port_drop(port_t port, simulator_t sim, packet_t packet);
+static void port_received(simulator_t sim, sim_event_t event);
+static void port_departed(simulator_t sim, sim_event_t event);
+
+/*  Create an idle port. Rates are in bits per thousand ticks. */
+port_t create_port(
+    port_forwarding_mode_t mode,
+    unsigned int in_rate,
+    unsigned int out_rate,
+    unsigned int header_bytes,
+    func_port_transmit_t transmit,
+    void *transmit_arg
+) {
+    assert(in_rate > 0);
+    assert(out_rate > 0);
+    assert(transmit);
+
+    port_t port = malloc(sizeof(struct port));
+    assert(port);
+
+    port->mode = mode;
+    port->in_rate = in_rate;
+    port->out_rate = out_rate;
+    port->header_bytes = header_bytes;
+    port->transmit = transmit;
+    port->transmit_arg = transmit_arg;
+
+    port->queue_head = NULL;
+    port->queue_tail = NULL;
+    port->enqueue = NULL;
+    port->dequeue = NULL;
+    port->scheduler_arg = NULL;
+    port->queue_packets = 0;
+    port->queue_bytes = 0;
+    port->admit = NULL;
+    port->release = NULL;
+    port->aqm_arg = NULL;
+    port->drop = NULL;
+    port->drop_arg = NULL;
+    port->delays = NULL;
+    port->occupancy = NULL;
+    port->sent_series = NULL;
+    port->queue_series = NULL;
+    port->series_index = 0;
+
+    port->transmitting = NULL;
+    port->head_departure = 0;
+    port->busy_until = 0;
+    sim_event_init(&port->departure, port_departed, port);
+
+    port->receptions = create_object_pool(sizeof(struct port_reception), 0);
+    port->packets_sent = 0;
+    port->packets_dropped = 0;
+
+    return port;
+}
+
+/*  Free the port. Packets still held by the port are not freed since their
+    descriptors belong to whoever allocated them. */
+void free_port(port_t port) {
+    assert(port);
+
+    free_object_pool(port->receptions);
+    free(port);
+}
+
+/*  Hand the queue of an empty port over to a scheduler. */
+void port_set_scheduler(port_t port, func_port_enqueue_t enqueue, func_port_dequeue_t dequeue, void *scheduler_arg) {
+    assert(port);
+    assert(enqueue);
+    assert(dequeue);
+    assert(port->queue_packets == 0);
+
+    port->enqueue = enqueue;
+    port->dequeue = dequeue;
+    port->scheduler_arg = scheduler_arg;
+}
+
+/*  Have active queue management decide which packets the port drops. */
+void port_set_aqm(port_t port, func_port_aqm_t admit, func_port_aqm_t release, void *aqm_arg) {
+    assert(port);
+
+    port->admit = admit;
+    port->release = release;
+    port->aqm_arg = aqm_arg;
+}
+
+/*  Be told about dropped packets, so that their descriptors can be freed. */
+void port_set_drop_handler(port_t port, func_port_drop_t drop, void *drop_arg) {
+    assert(port);
+
+    port->drop = drop;
+    port->drop_arg = drop_arg;
+}
+
+/*  Record in a histogram, or stop recording if it is NULL, the time from
+    the head of each packet arriving to it leaving, as the packet leaves. */
+void port_set_delay_histogram(port_t port, histogram_t delays) {
+    assert(port);
+
+    port->delays = delays;
+}
+
+/*  Keep time-weighted statistics of the bytes waiting, updated whenever a
+    packet joins or leaves the queue, or stop if occupancy is NULL. */
+void port_set_queue_statistics(port_t port, time_weighted_t occupancy) {
+    assert(port);
+
+    port->occupancy = occupancy;
+}
+
+/*  Count the bytes sent in series index of sent, a series of sums, and
+    the bytes waiting in series index of queued, a series of peaks. Either
+    may be NULL. */
+void port_set_time_series(port_t port, time_series_t sent, time_series_t queued, unsigned int index) {
+    assert(port);
+
+    port->sent_series = sent;
+    port->queue_series = queued;
+    port->series_index = index;
+}
+
+/*  Report the arrival of a packet whose head reached the port at
+    head_arrival. */
+void port_receive(port_t port, simulator_t sim, packet_t packet, unsigned int head_arrival) {
+    assert(port);
+    assert(packet);
+    assert(head_arrival <= simulator_now(sim));
+
+    packet->arrived = head_arrival;
+
+    if (port->mode == PORT_CUT_THROUGH) {
+        /*  No reception event - the departure computation accounts for the
+            tail still arriving. */
+        port_enqueue(port, sim, packet);
+        return;
+    }
+
+    /*  Store and forward - wait for the tail before queueing. */
+    unsigned int tail_arrival =
+        head_arrival + sim_transmission_time(packet->length, port->in_rate);
+    unsigned int now = simulator_now(sim);
+
+    port_reception_t reception = object_pool_alloc(port->receptions);
+    sim_event_init(&reception->event, port_received, reception);
+    reception->port = port;
+    reception->packet = packet;
+
+    simulator_schedule(sim, &reception->event, tail_arrival > now ? tail_arrival : now);
+}
+
+/*  Start transmitting again after the scheduler returned no packet, if
+    the port is still idle. The scheduler held the packet back until now, so
+    its head cannot have left any earlier. */
+void port_resume(port_t port, simulator_t sim) {
+    if (port->transmitting == NULL) {
+        unsigned int now = simulator_now(sim);
+        if (port->busy_until < now) {
+            port->busy_until = now;
+        }
+        port_start_next(port, sim);
+    }
+}
+
+/*  Number of packets waiting, excluding any being transmitted. */
+unsigned int port_queue_packets(port_t port) {
+    return port->queue_packets;
+}
+
+/*  Bytes waiting, excluding any packet being transmitted. */
+unsigned int port_queue_bytes(port_t port) {
+    return port->queue_bytes;
+}
+
+/*  Whether a packet is currently being transmitted. */
+int port_is_busy(port_t port) {
+    return port->transmitting != NULL;
+}
+
+/*  Number of packets whose tails have left the port. */
+unsigned long port_packets_sent(port_t port) {
+    return port->packets_sent;
+}
+
+/*  Number of packets dropped by active queue management. */
+unsigned long port_packets_dropped(port_t port) {
+    return port->packets_dropped;
+}
+
+/*  Helper functions. */
+
+/*  Append a packet to the FIFO, or give it to the scheduler, and start
+    transmitting if idle. */
+static void port_enqueue(port_t port, simulator_t sim, packet_t packet) {
+    packet->next = NULL;
+
+    if (port->admit && port->admit(port->aqm_arg, packet, port->queue_bytes, simulator_now(sim))) {
+        port_drop(port, sim, packet);
+        return;
+    }
+
+    if (port->enqueue) {
+        port->enqueue(port->scheduler_arg, packet, simulator_now(sim));
+    } else if (port->queue_tail) {
+        port->queue_tail->next = packet;
+        port->queue_tail = packet;
+    } else {
+        port->queue_head = packet;
+        port->queue_tail = packet;
+    }
+
+    port->queue_packets = port->queue_packets + 1;
+    port->queue_bytes = port->queue_bytes + packet->length;
+    if (port->occupancy) {
+        time_weighted_update(port->occupancy, simulator_now(sim), port->queue_bytes);
+    }
+    if (port->queue_series) {
+        time_series_add(port->queue_series, port->series_index, simulator_now(sim), port->queue_bytes);
+    }
+
+    if (port->transmitting == NULL) {
+        port_start_next(port, sim);
+    }
+}
+
+/*  Take the next packet that active queue management lets through and
+    schedule its tail departure. In cut-through mode the head
+    may leave as soon as the header has arrived and the output link is free,
+    which can be earlier than the current time if the arrival was reported
+    late, but the tail can never leave before it has arrived. */
+static void port_start_next(port_t port, simulator_t sim) {
+    unsigned int now = simulator_now(sim);
+    packet_t packet;
+
+    for (;;) {
+        packet = port_take(port, sim);
+        if (packet == NULL) {
+            return;
+        }
+        if (port->release == NULL || !port->release(port->aqm_arg, packet, port->queue_bytes, now)) {
+            break;
+        }
+        port_drop(port, sim, packet);
+    }
+
+    unsigned int start;
+    unsigned int tail;
+
+    if (port->mode == PORT_CUT_THROUGH) {
+        unsigned int header_arrival = packet->arrived +
+            sim_transmission_time(port->header_bytes, port->in_rate);
+        unsigned int tail_arrival = packet->arrived +
+            sim_transmission_time(packet->length, port->in_rate);
+
+        start = header_arrival > port->busy_until ? header_arrival : port->busy_until;
+
+        tail = start + sim_transmission_time(packet->length, port->out_rate);
+        if (tail_arrival > tail) {
+            tail = tail_arrival;
+        }
+        if (now > tail) {
+            tail = now;
+        }
+    } else {
+        start = now;
+        tail = start + sim_transmission_time(packet->length, port->out_rate);
+    }
+
+    port->transmitting = packet;
+    port->head_departure = start;
+    port->busy_until = tail;
+
+    simulator_schedule(sim, &port->departure, tail);
+}
+
+/*  Remove the packet at the front of the FIFO, or the one chosen by the
+    scheduler, from the queue. */
+static packet_t port_take(port_t port, simulator_t sim) {
+    packet_t packet;
+
+    if (port->queue_packets == 0) {
+        return NULL;
+    }
+
+    if (port->dequeue) {
+        packet = port->dequeue(port->scheduler_arg, simulator_now(sim));
+        if (packet == NULL) {
+            return NULL;
+        }
+    } else {
+        packet = port->queue_head;
+        port->queue_head = packet->next;
+        if (port->queue_head == NULL) {
+            port->queue_tail = NULL;
+        }
+    }
+    packet->next = NULL;
+
+    port->queue_packets = port->queue_packets - 1;
+    port->queue_bytes = port->queue_bytes - packet->length;
+    if (port->occupancy) {
+        time_weighted_update(port->occupancy, simulator_now(sim), port->queue_bytes);
+    }
+    if (port->queue_series) {
+        time_series_add(port->queue_series, port->series_index, simulator_now(sim), port->queue_bytes);
+    }
+
+    return packet;
+}
+
+static void port_drop(port_t port, simulator_t sim, packet_t packet) {
+    port->packets_dropped = port->packets_dropped + 1;
+
+    if (port->drop) {
+        port->drop(sim, packet, port->drop_arg);
+    }
+}
+
+/*  Store and forward reception complete - the packet joins the FIFO. */
+static void port_received(simulator_t sim, sim_event_t event) {
+    port_reception_t reception = (port_reception_t) event->arg;
+    port_t port = reception->port;
+    packet_t packet = reception->packet;
+
+    object_pool_release(port->receptions, reception);
+
+    port_enqueue(port, sim, packet);
+}
+
+/*  The tail of the transmitting packet has left. Hand it on and move to the
+    next packet. */
+static void port_departed(simulator_t sim, sim_event_t event) {
+    port_t port = (port_t) event->arg;
+    packet_t packet = port->transmitting;
+    unsigned int head_departure = port->head_departure;
+
+    assert(packet);
+
+    port->transmitting = NULL;
+    port->packets_sent = port->packets_sent + 1;
+    if (port->delays) {
+        histogram_record(port->delays, head_departure - packet->arrived);
+    }
+    if (port->sent_series) {
+        time_series_add(port->sent_series, port->series_index, simulator_now(sim), packet->length);
+    }
+
+    port_start_next(port, sim);
+
+    port->transmit(sim, packet, head_departure, port->transmit_arg);
+}
@@ -0,0 +1,105 @@
+/*  port.h
+
+    Model of a switch egress port: a FIFO of packets waiting for an output
+    link of a given rate.
+
+    Two forwarding modes are supported:
+
+    Store and forward - a packet is only eligible for transmission once it
+    has been completely received. Every packet therefore costs two events per
+    hop, one when its tail has been received and one when its tail has left
+    the port.
+
+    Cut-through - transmission may begin as soon as the header has arrived.
+    The head arrival is folded into the departure computation, so every
+    packet costs a single event per hop, scheduled at the time its tail
+    leaves the port. A packet that finds the port busy simply waits in the
+    queue and still costs only the one event.
+
+    Arrivals are reported with the time at which the head of the packet
+    arrived, which may be earlier than the current simulated time. This is
+    what allows an upstream cut-through hop to hand a packet on at the time
+    its own tail leaves, even though the head reached the next hop earlier.
+    Packets are served in the order in which their arrivals are reported,
+    unless a scheduler is attached to the port with port_set_scheduler, in
+    which case the scheduler holds the waiting packets and chooses which to
+    send next. Active queue management hooks set with port_set_aqm may drop
+    packets as they join or leave the queue. The queueing delay of every
+    packet sent can be recorded with port_set_delay_histogram, and the time
+    average of the bytes waiting kept with port_set_queue_statistics. Bytes
+    sent and bytes waiting over time are kept with port_set_time_series. */
+
+#ifndef PORT_H
+#define PORT_H
+
+#include "../event_simulation/simulator.h"
+#include "packet.h"
+#include "../stats/histogram.h"
+#include "../stats/time_weighted.h"
+#include "../stats/time_series.h"
+
+struct port;
+
+typedef struct port * port_t;
+
+enum port_forwarding_mode {
+    PORT_STORE_AND_FORWARD,
+    PORT_CUT_THROUGH
+};
+
+typedef enum port_forwarding_mode port_forwarding_mode_t;
+
+/*  Called when the tail of a packet leaves the port. The third argument is
+    the time at which the head of the packet left, the last is the
+    transmit_arg given at creation time. */
+typedef void (*func_port_transmit_t)(simulator_t, packet_t, unsigned int, void *);
+
+/*  A scheduler takes over the queue of a port. The enqueue function is
+    given each packet once it is eligible for transmission and the dequeue
+    function is asked for the next packet to transmit whenever the output
+    link becomes free and the scheduler holds packets. The first argument is
+    the scheduler_arg given to port_set_scheduler and the last the current
+    time. A scheduler that holds packets none of which may leave yet, such
+    as a shaper, returns NULL from dequeue and calls port_resume once one
+    may. */
+typedef void (*func_port_enqueue_t)(void *, packet_t, unsigned int);
+typedef packet_t (*func_port_dequeue_t)(void *, unsigned int);
+
+/*  Active queue management is consulted as each packet joins the queue,
+    with the bytes already waiting, and as it is taken for transmission,
+    with the bytes still waiting behind it. The first argument is the
+    aqm_arg given to port_set_aqm and the last the current time. The hook
+    may mark the packet, and returns nonzero to have the port drop it. A
+    packet dropped as it leaves the queue is replaced by the next one
+    straight away, so no extra events are needed. */
+typedef int (*func_port_aqm_t)(void *, packet_t, unsigned int, unsigned int);
+
+/*  Called with each packet the port drops, with the drop_arg given to
+    port_set_drop_handler. */
+typedef void (*func_port_drop_t)(simulator_t, packet_t, void *);
+
+port_t create_port(
+    port_forwarding_mode_t mode,
+    unsigned int in_rate,
+    unsigned int out_rate,
+    unsigned int header_bytes,
+    func_port_transmit_t transmit,
+    void *transmit_arg
+);
+
+void free_port(port_t port);
+void port_set_scheduler(port_t port, func_port_enqueue_t enqueue, func_port_dequeue_t dequeue, void *scheduler_arg);
+void port_set_aqm(port_t port, func_port_aqm_t admit, func_port_aqm_t release, void *aqm_arg);
+void port_set_drop_handler(port_t port, func_port_drop_t drop, void *drop_arg);
+void port_set_delay_histogram(port_t port, histogram_t delays);
+void port_set_queue_statistics(port_t port, time_weighted_t occupancy);
+void port_set_time_series(port_t port, time_series_t sent, time_series_t queued, unsigned int index);
+void port_receive(port_t port, simulator_t sim, packet_t packet, unsigned int head_arrival);
+void port_resume(port_t port, simulator_t sim);
+unsigned int port_queue_packets(port_t port);
+unsigned int port_queue_bytes(port_t port);
+int port_is_busy(port_t port);
+unsigned long port_packets_sent(port_t port);
+unsigned long port_packets_dropped(port_t port);
+
+#endif
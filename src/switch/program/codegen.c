@@ -0,0 +1,357 @@
+/*  codegen.c
+
+    Implementation of the generator of switch programs.
+
+    Headers are reached through one pointer each, set by the parser state
+    that extracts them, and only for headers with a field that the program
+    reads or writes. Parser states that no transition leads to other than
+    by falling through get no label, so that the output compiles cleanly
+    with every warning enabled. */
+
+#include "codegen.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+/*  Forward declarations of helper functions. */
+static uint32_t codegen_used_headers(const program_description_t *description);
+static void codegen_parser(const program_description_t *description, uint32_t used, FILE *out);
+static void codegen_goto(unsigned int next, unsigned int fallthrough, FILE *out);
+static void codegen_table(const program_description_t *description, unsigned int index, FILE *out);
+static void codegen_action(const program_description_t *description, const program_action_t *action, uint32_t guaranteed, FILE *out);
+static void codegen_read(const program_field_t *field, FILE *out);
+static void codegen_write(const program_field_t *field, const char *value, FILE *out);
+static void codegen_operand(const program_op_t *op, FILE *out);
+static uint32_t codegen_mask(unsigned int width);
+
+/*  Write C code for the description, defining a function called name. */
+void program_generate(const program_description_t *description, const char *name, FILE *out) {
+    assert(description);
+    assert(program_description_valid(description));
+    assert(name);
+    assert(out);
+
+    uint32_t used = codegen_used_headers(description);
+    unsigned int i;
+
+    fprintf(out, "/*  Generated by program_generate from a program description. Do not edit. */\n\n");
+    fprintf(out, "#include \"program.h\"\n\n");
+    fprintf(out, "int %s(program_tables_t tables, packet_t packet, unsigned char *frame, unsigned int length) {\n", name);
+    fprintf(out, "    unsigned int offset = 0;\n");
+    fprintf(out, "    uint32_t valid = 0;\n");
+    fprintf(out, "    const program_entry_t *entry;\n");
+    for (i = 0; i < description->num_headers; i++) {
+        if (used & (1u << i)) {
+            fprintf(out, "    unsigned char *h%u = frame; /* %s */\n", i, description->headers[i].name);
+        }
+    }
+    fprintf(out, "\n    (void) tables;\n    (void) packet;\n    (void) entry;\n\n");
+
+    codegen_parser(description, used, out);
+
+    fprintf(out, "accept:\n");
+    for (i = 0; i < description->num_tables; i++) {
+        codegen_table(description, i, out);
+    }
+    fprintf(out, "    return PROGRAM_FORWARD;\n}\n");
+}
+
+/*  Helper functions. */
+
+/*  Bit mask of the headers with a field that is selected on, matched or
+    written. */
+static uint32_t codegen_used_headers(const program_description_t *description) {
+    uint32_t used = 0;
+    unsigned int i, j;
+
+    for (i = 0; i < description->num_states; i++) {
+        if (description->states[i].select != PROGRAM_NONE) {
+            used |= 1u << description->fields[description->states[i].select].header;
+        }
+    }
+    for (i = 0; i < description->num_tables; i++) {
+        const program_table_t *table = &description->tables[i];
+
+        for (j = 0; j < table->num_keys; j++) {
+            used |= 1u << description->fields[table->keys[j]].header;
+        }
+    }
+    for (i = 0; i < description->num_actions; i++) {
+        const program_action_t *action = &description->actions[i];
+
+        for (j = 0; j < action->num_ops; j++) {
+            if (action->ops[j].opcode == PROGRAM_OP_SET || action->ops[j].opcode == PROGRAM_OP_ADD) {
+                used |= 1u << description->fields[action->ops[j].field].header;
+            }
+        }
+    }
+    return used;
+}
+
+static void codegen_parser(const program_description_t *description, uint32_t used, FILE *out) {
+    unsigned int i, j, k;
+
+    for (i = 0; i < description->num_states; i++) {
+        const program_state_t *state = &description->states[i];
+        const program_header_t *header = &description->headers[state->header];
+        int targeted = 0;
+
+        /*  A state needs a label if a transition or the otherwise of a state
+            other than the one just before it leads there. */
+        for (j = 0; j < description->num_states && !targeted; j++) {
+            const program_state_t *from = &description->states[j];
+
+            if (from->otherwise == i && (j + 1 != i || from->select != PROGRAM_NONE)) {
+                targeted = 1;
+            }
+            if (from->select != PROGRAM_NONE) {
+                for (k = 0; k < from->num_transitions; k++) {
+                    targeted = targeted || from->transitions[k].next == i;
+                }
+            }
+        }
+
+        if (targeted) {
+            fprintf(out, "state_%u:\n", i);
+        }
+        fprintf(out, "    /*  Extract %s. */\n", header->name);
+        fprintf(out, "    if (length - offset < %u) {\n        goto accept;\n    }\n", header->length);
+        if (used & (1u << state->header)) {
+            fprintf(out, "    h%u = frame + offset;\n", state->header);
+        }
+        fprintf(out, "    valid |= 0x%xu;\n", 1u << state->header);
+        fprintf(out, "    offset = offset + %u;\n", header->length);
+
+        if (state->select == PROGRAM_NONE) {
+            codegen_goto(state->otherwise, i + 1, out);
+            fprintf(out, "\n");
+            continue;
+        }
+
+        fprintf(out, "    switch (");
+        codegen_read(&description->fields[state->select], out);
+        fprintf(out, ") {\n");
+        for (j = 0; j < state->num_transitions; j++) {
+            /*  Only the first transition for a value counts. */
+            int repeated = 0;
+            for (k = 0; k < j; k++) {
+                repeated = repeated || state->transitions[k].value == state->transitions[j].value;
+            }
+            if (repeated) {
+                continue;
+            }
+
+            fprintf(out, "        case 0x%xu:\n        ", state->transitions[j].value);
+            codegen_goto(state->transitions[j].next, PROGRAM_NONE, out);
+        }
+        fprintf(out, "        default:\n        ");
+        codegen_goto(state->otherwise, PROGRAM_NONE, out);
+        fprintf(out, "    }\n\n");
+    }
+}
+
+/*  Jump to the next state, unless it is the one that follows anyway. */
+static void codegen_goto(unsigned int next, unsigned int fallthrough, FILE *out) {
+    if (next == PROGRAM_ACCEPT) {
+        fprintf(out, "    goto accept;\n");
+    } else if (next != fallthrough) {
+        fprintf(out, "    goto state_%u;\n", next);
+    }
+}
+
+static void codegen_table(const program_description_t *description, unsigned int index, FILE *out) {
+    const program_table_t *table = &description->tables[index];
+    uint32_t needed = 0;
+    unsigned int i;
+
+    for (i = 0; i < table->num_keys; i++) {
+        needed |= 1u << description->fields[table->keys[i]].header;
+    }
+
+    fprintf(out, "    /*  Apply %s. */\n", table->name);
+    fprintf(out, "    if ((valid & 0x%xu) == 0x%xu) {\n", needed, needed);
+
+    if (table->match == PROGRAM_MATCH_LPM) {
+        const program_field_t *field = &description->fields[table->keys[0]];
+
+        fprintf(out, "        entry = program_lookup_lpm(tables, %u, ", index);
+        codegen_read(field, out);
+        if (field->width < 32) {
+            fprintf(out, " << %u", 32 - field->width);
+        }
+        fprintf(out, ");\n");
+    } else {
+        unsigned int position = 0;
+        unsigned int word;
+
+        fprintf(out, "        exact_match_key_t key;\n\n");
+        for (word = 0; word < 2; word++) {
+            int terms = 0;
+
+            fprintf(out, "        key.words[%u] = ", word);
+            position = 0;
+            for (i = 0; i < table->num_keys; i++) {
+                const program_field_t *field = &description->fields[table->keys[i]];
+                unsigned int start = position;
+
+                position = position + field->width;
+                if (position <= word * 64 || start >= (word + 1) * 64) {
+                    continue;
+                }
+
+                fprintf(out, "%s(uint64_t) ", terms > 0 ? " |\n            " : "");
+                codegen_read(field, out);
+                if (start < word * 64) {
+                    fprintf(out, " >> %u", word * 64 - start);
+                } else if (start > word * 64) {
+                    fprintf(out, " << %u", start - word * 64);
+                }
+                terms = terms + 1;
+            }
+            fprintf(out, "%s;\n", terms > 0 ? "" : "0");
+        }
+        fprintf(out, "        entry = program_lookup_exact(tables, %u, key);\n", index);
+    }
+
+    fprintf(out, "        switch (entry->action) {\n");
+    for (i = 0; i < table->num_actions; i++) {
+        unsigned int action = table->actions[i];
+        unsigned int k;
+        int repeated = 0;
+
+        for (k = 0; k < i; k++) {
+            repeated = repeated || table->actions[k] == action;
+        }
+        if (repeated) {
+            continue;
+        }
+
+        fprintf(out, "            case %u: /* %s */\n", action, description->actions[action].name);
+        codegen_action(description, &description->actions[action], needed, out);
+    }
+    fprintf(out, "        }\n    }\n\n");
+}
+
+/*  Inline the primitives of an action. A drop takes effect once the others
+    are done, as it does in the interpreter. */
+static void codegen_action(const program_description_t *description, const program_action_t *action, uint32_t guaranteed, FILE *out) {
+    int drop = 0;
+    unsigned int i;
+
+    for (i = 0; i < action->num_ops; i++) {
+        const program_op_t *op = &action->ops[i];
+        const program_field_t *field;
+
+        switch (op->opcode) {
+            case PROGRAM_OP_SET:
+            case PROGRAM_OP_ADD:
+                field = &description->fields[op->field];
+                if (guaranteed & (1u << field->header)) {
+                    fprintf(out, "                {\n");
+                } else {
+                    fprintf(out, "                if (valid & 0x%xu) {\n", 1u << field->header);
+                }
+                fprintf(out, "                    uint64_t value = (uint64_t) (");
+                codegen_operand(op, out);
+                if (op->opcode == PROGRAM_OP_ADD) {
+                    fprintf(out, " + ");
+                    codegen_read(field, out);
+                }
+                fprintf(out, ");\n\n");
+                codegen_write(field, "value", out);
+                fprintf(out, "                }\n");
+                break;
+            case PROGRAM_OP_EGRESS:
+                fprintf(out, "                packet->egress_port = ");
+                codegen_operand(op, out);
+                fprintf(out, ";\n");
+                break;
+            case PROGRAM_OP_PRIORITY:
+                fprintf(out, "                packet->priority = ");
+                codegen_operand(op, out);
+                fprintf(out, ";\n");
+                break;
+            case PROGRAM_OP_DROP:
+                drop = 1;
+                break;
+        }
+    }
+
+    fprintf(out, drop ? "                return PROGRAM_DROP;\n" : "                break;\n");
+}
+
+/*  Expression for the value of a field, from the bytes it spans. */
+static void codegen_read(const program_field_t *field, FILE *out) {
+    unsigned int first = field->offset / 8;
+    unsigned int last = (field->offset + field->width - 1) / 8;
+    unsigned int shift = (last + 1) * 8 - field->offset - field->width;
+    unsigned int i;
+
+    fprintf(out, "(uint32_t) (");
+    if (shift > 0 || field->width % 8 != 0) {
+        fprintf(out, "(");
+    }
+    if (last > first) {
+        fprintf(out, "(");
+    }
+    for (i = first; i <= last; i++) {
+        fprintf(out, "%s(%s) h%u[%u]", i > first ? " | " : "", last - first == 4 ? "uint64_t" : "uint32_t", field->header, i);
+        if (last > i) {
+            fprintf(out, " << %u", (last - i) * 8);
+        }
+    }
+    if (last > first) {
+        fprintf(out, ")");
+    }
+    if (shift > 0) {
+        fprintf(out, " >> %u", shift);
+    }
+    if (shift > 0 || field->width % 8 != 0) {
+        fprintf(out, ") & 0x%xu", codegen_mask(field->width));
+    }
+    fprintf(out, ")");
+}
+
+/*  Statements storing the low bits of a 64 bit variable in a field, byte by
+    byte, merging with the bits around the field where it only covers part
+    of a byte. */
+static void codegen_write(const program_field_t *field, const char *value, FILE *out) {
+    unsigned int first = field->offset / 8;
+    unsigned int last = (field->offset + field->width - 1) / 8;
+    unsigned int shift = (last + 1) * 8 - field->offset - field->width;
+    uint64_t mask = (uint64_t) codegen_mask(field->width) << shift;
+    unsigned int i;
+
+    for (i = first; i <= last; i++) {
+        unsigned int down = (last - i) * 8;
+        unsigned int byte_mask = (unsigned int) (mask >> down) & 0xff;
+
+        fprintf(out, "                    h%u[%u] = (unsigned char) (", field->header, i);
+        if (byte_mask != 0xff) {
+            fprintf(out, "(h%u[%u] & 0x%xu) | (", field->header, i, ~byte_mask & 0xff);
+        }
+        if (shift > down) {
+            fprintf(out, "%s << %u", value, shift - down);
+        } else if (down > shift) {
+            fprintf(out, "%s >> %u", value, down - shift);
+        } else {
+            fprintf(out, "%s", value);
+        }
+        if (byte_mask != 0xff) {
+            fprintf(out, " & 0x%xu)", byte_mask);
+        }
+        fprintf(out, ");\n");
+    }
+}
+
+static void codegen_operand(const program_op_t *op, FILE *out) {
+    if (op->param == PROGRAM_NONE) {
+        fprintf(out, "0x%xu", op->value);
+    } else {
+        fprintf(out, "entry->params[%u]", op->param);
+    }
+}
+
+static uint32_t codegen_mask(unsigned int width) {
+    return width >= 32 ? UINT32_MAX : (1u << width) - 1;
+}
@@ -0,0 +1,30 @@
+/*  codegen.h
+
+    Generator of specialized C code for switch programs, see program.h.
+
+    program_generate writes a translation unit defining a single function
+    of the func_program_t signature, under the given name, that does
+    exactly what program_interpret does for the description but with all
+    that does not depend on the packet or on the table entries settled in
+    advance. Fields are read and written with constant byte offsets, shifts
+    and masks. The parser is a chain of labelled blocks, one per state,
+    ending in a switch on the select field. Every table becomes a block
+    that builds its key with constant shifts, looks it up in the structure
+    of its match kind, and switches on the action of the entry to the
+    primitives of each action the table may run, inlined. Checks for valid
+    headers that the key of the table already guarantees are left out.
+
+    The generated file includes program.h and is compiled and linked with
+    program.c like any other source. Its function must be given tables
+    created from the same description. */
+
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "program.h"
+
+#include <stdio.h>
+
+void program_generate(const program_description_t *description, const char *name, FILE *out);
+
+#endif
@@ -0,0 +1,466 @@
+/*  program.c
+
+    Implementation of the tables and the interpreter of switch programs.
+
+    The key of an exact match table packs the values of its fields one
+    after the other from the least significant bit of the first word of an
+    exact_match_key_t, in the order the table lists them. The key of a
+    longest prefix match table is the value of its field shifted to the top
+    of 32 bits, so that prefixes of any field width map onto fib4 prefixes.
+    Code emitted by the generator builds keys the same way.
+
+    Every table has size entries plus one more for the default action.
+    Exact match entries are indexed by the index the hash table gives their
+    key, and longest prefix match entries are numbered as they are added,
+    the number being the next hop stored in the fib. */
+
+#include "program.h"
+#include "../tables/fib4.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+
+struct program_table_state {
+    exact_match_t exact;
+    fib4_t lpm;
+    unsigned int num_entries;
+    program_entry_t *entries;
+};
+
+struct program_tables {
+    const program_description_t *description;
+    struct program_table_state *tables;
+};
+
+/*  Forward declarations of helper functions. */
+static int program_table_has_action(const program_table_t *table, unsigned int action);
+static unsigned int program_key_width(const program_description_t *description, const program_table_t *table);
+static uint32_t program_read(const program_field_t *field, const unsigned char *header);
+static void program_write(const program_field_t *field, unsigned char *header, uint32_t value);
+static uint32_t program_mask(unsigned int width);
+static void program_set_entry(program_entry_t *entry, unsigned int action, const uint32_t *params, unsigned int num_params);
+
+/*  Whether the description is consistent: every index in range, fields
+    within their headers, keys and parameters within the limits. */
+int program_description_valid(const program_description_t *description) {
+    unsigned int i, j;
+
+    if (description->num_headers == 0 || description->num_headers > PROGRAM_MAX_HEADERS || description->num_states == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < description->num_headers; i++) {
+        if (description->headers[i].length == 0) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < description->num_fields; i++) {
+        const program_field_t *field = &description->fields[i];
+
+        if (field->header >= description->num_headers ||
+            field->width == 0 || field->width > PROGRAM_MAX_FIELD_WIDTH ||
+            field->offset + field->width > description->headers[field->header].length * 8) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < description->num_states; i++) {
+        const program_state_t *state = &description->states[i];
+
+        if (state->header >= description->num_headers ||
+            (state->otherwise != PROGRAM_ACCEPT && state->otherwise >= description->num_states)) {
+            return 0;
+        }
+        if (state->select == PROGRAM_NONE) {
+            continue;
+        }
+        if (state->select >= description->num_fields || description->fields[state->select].header != state->header) {
+            return 0;
+        }
+        for (j = 0; j < state->num_transitions; j++) {
+            unsigned int next = state->transitions[j].next;
+
+            if (next != PROGRAM_ACCEPT && next >= description->num_states) {
+                return 0;
+            }
+        }
+    }
+
+    for (i = 0; i < description->num_actions; i++) {
+        const program_action_t *action = &description->actions[i];
+
+        if (action->num_params > PROGRAM_MAX_PARAMS) {
+            return 0;
+        }
+        for (j = 0; j < action->num_ops; j++) {
+            const program_op_t *op = &action->ops[j];
+
+            if (op->param != PROGRAM_NONE && op->param >= action->num_params) {
+                return 0;
+            }
+            if ((op->opcode == PROGRAM_OP_SET || op->opcode == PROGRAM_OP_ADD) && op->field >= description->num_fields) {
+                return 0;
+            }
+        }
+    }
+
+    for (i = 0; i < description->num_tables; i++) {
+        const program_table_t *table = &description->tables[i];
+
+        if (table->num_keys == 0 || table->size == 0 || table->size >= FIB4_MAX_NEXT_HOP) {
+            return 0;
+        }
+        for (j = 0; j < table->num_keys; j++) {
+            if (table->keys[j] >= description->num_fields) {
+                return 0;
+            }
+        }
+        if (table->match == PROGRAM_MATCH_LPM ? table->num_keys != 1 : program_key_width(description, table) > PROGRAM_MAX_KEY_WIDTH) {
+            return 0;
+        }
+        for (j = 0; j < table->num_actions; j++) {
+            if (table->actions[j] >= description->num_actions) {
+                return 0;
+            }
+        }
+        if (!program_table_has_action(table, table->default_action)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*  Create empty tables for a program. The description must outlive them. */
+program_tables_t create_program_tables(const program_description_t *description) {
+    assert(description);
+    assert(program_description_valid(description));
+
+    program_tables_t tables = malloc(sizeof(struct program_tables));
+    assert(tables);
+
+    tables->description = description;
+    tables->tables = malloc(sizeof(struct program_table_state) * (description->num_tables + 1));
+    assert(tables->tables);
+
+    unsigned int i;
+    for (i = 0; i < description->num_tables; i++) {
+        const program_table_t *table = &description->tables[i];
+        struct program_table_state *state = &tables->tables[i];
+
+        state->exact = NULL;
+        state->lpm = NULL;
+        if (table->match == PROGRAM_MATCH_EXACT) {
+            state->exact = create_exact_match(table->size);
+        } else {
+            state->lpm = create_fib4();
+        }
+        state->num_entries = 0;
+
+        state->entries = calloc(table->size + 1, sizeof(program_entry_t));
+        assert(state->entries);
+        state->entries[table->size].action = table->default_action;
+    }
+
+    return tables;
+}
+
+void free_program_tables(program_tables_t tables) {
+    assert(tables);
+
+    unsigned int i;
+    for (i = 0; i < tables->description->num_tables; i++) {
+        if (tables->tables[i].exact) {
+            free_exact_match(tables->tables[i].exact);
+        }
+        if (tables->tables[i].lpm) {
+            free_fib4(tables->tables[i].lpm);
+        }
+        free(tables->tables[i].entries);
+    }
+    free(tables->tables);
+    free(tables);
+}
+
+/*  Add an entry to an exact match table, matching the given values of its
+    key fields, or replace the entry with the same key. Returns the index of
+    the entry, or PROGRAM_NONE if the table is full. */
+uint32_t program_add_exact(program_tables_t tables, unsigned int table, const uint32_t *values, unsigned int action, const uint32_t *params) {
+    assert(table < tables->description->num_tables);
+
+    const program_description_t *description = tables->description;
+    const program_table_t *desc = &description->tables[table];
+    struct program_table_state *state = &tables->tables[table];
+    exact_match_key_t key = { { 0, 0 } };
+    unsigned int position = 0;
+    unsigned int i;
+
+    assert(desc->match == PROGRAM_MATCH_EXACT);
+    assert(program_table_has_action(desc, action));
+
+    for (i = 0; i < desc->num_keys; i++) {
+        unsigned int width = description->fields[desc->keys[i]].width;
+        uint64_t value = values[i] & program_mask(width);
+        unsigned int word = position / 64;
+        unsigned int shift = position % 64;
+
+        key.words[word] |= value << shift;
+        if (shift + width > 64) {
+            key.words[word + 1] |= value >> (64 - shift);
+        }
+        position = position + width;
+    }
+
+    uint32_t index = exact_match_insert(state->exact, key);
+    if (index == EXACT_MATCH_NONE) {
+        return PROGRAM_NONE;
+    }
+
+    program_set_entry(&state->entries[index], action, params, description->actions[action].num_params);
+    state->num_entries = exact_match_size(state->exact);
+
+    return index;
+}
+
+/*  Add an entry to a longest prefix match table, matching values of its
+    key field whose depth most significant bits are those of prefix. Each
+    addition takes a new entry, so replacing the entry of a prefix uses up
+    the space of the old one. Returns the index of the entry, or
+    PROGRAM_NONE if the table is full. */
+uint32_t program_add_lpm(program_tables_t tables, unsigned int table, uint32_t prefix, unsigned int depth, unsigned int action, const uint32_t *params) {
+    assert(table < tables->description->num_tables);
+
+    const program_description_t *description = tables->description;
+    const program_table_t *desc = &description->tables[table];
+    struct program_table_state *state = &tables->tables[table];
+    unsigned int width = description->fields[desc->keys[0]].width;
+
+    assert(desc->match == PROGRAM_MATCH_LPM);
+    assert(program_table_has_action(desc, action));
+    assert(depth <= width);
+
+    if (state->num_entries == desc->size) {
+        return PROGRAM_NONE;
+    }
+
+    uint32_t index = state->num_entries;
+    program_set_entry(&state->entries[index], action, params, description->actions[action].num_params);
+    fib4_add(state->lpm, (prefix & program_mask(width)) << (32 - width), depth, index);
+    state->num_entries = state->num_entries + 1;
+
+    return index;
+}
+
+/*  Number of entries in a table, not counting the default. */
+unsigned int program_table_entries(program_tables_t tables, unsigned int table) {
+    assert(table < tables->description->num_tables);
+
+    return tables->tables[table].num_entries;
+}
+
+/*  Entry of an exact match table for a key, or its default entry. */
+const program_entry_t *program_lookup_exact(program_tables_t tables, unsigned int table, exact_match_key_t key) {
+    struct program_table_state *state = &tables->tables[table];
+    uint32_t index = exact_match_lookup(state->exact, key);
+
+    if (index == EXACT_MATCH_NONE) {
+        index = tables->description->tables[table].size;
+    }
+    return &state->entries[index];
+}
+
+/*  Entry of a longest prefix match table for a key, or its default entry. */
+const program_entry_t *program_lookup_lpm(program_tables_t tables, unsigned int table, uint32_t value) {
+    struct program_table_state *state = &tables->tables[table];
+    uint32_t index = fib4_lookup(state->lpm, value);
+
+    if (index == FIB4_NO_ROUTE) {
+        index = tables->description->tables[table].size;
+    }
+    return &state->entries[index];
+}
+
+/*  Run the program on a packet by walking its description. */
+int program_interpret(program_tables_t tables, packet_t packet, unsigned char *frame, unsigned int length) {
+    const program_description_t *description = tables->description;
+    unsigned int offsets[PROGRAM_MAX_HEADERS];
+    uint32_t valid = 0;
+    unsigned int offset = 0;
+    unsigned int state = 0;
+    unsigned int i, j;
+
+    /*  Parse. */
+    while (state != PROGRAM_ACCEPT) {
+        const program_state_t *desc = &description->states[state];
+        unsigned int header = desc->header;
+
+        if (length - offset < description->headers[header].length) {
+            break;
+        }
+        offsets[header] = offset;
+        valid |= 1u << header;
+        offset = offset + description->headers[header].length;
+
+        state = desc->otherwise;
+        if (desc->select != PROGRAM_NONE) {
+            uint32_t value = program_read(&description->fields[desc->select], frame + offsets[header]);
+
+            for (i = 0; i < desc->num_transitions; i++) {
+                if (desc->transitions[i].value == value) {
+                    state = desc->transitions[i].next;
+                    break;
+                }
+            }
+        }
+    }
+
+    /*  Apply the tables. */
+    for (i = 0; i < description->num_tables; i++) {
+        const program_table_t *table = &description->tables[i];
+        const program_entry_t *entry;
+        uint32_t needed = 0;
+
+        for (j = 0; j < table->num_keys; j++) {
+            needed |= 1u << description->fields[table->keys[j]].header;
+        }
+        if ((valid & needed) != needed) {
+            continue;
+        }
+
+        if (table->match == PROGRAM_MATCH_LPM) {
+            const program_field_t *field = &description->fields[table->keys[0]];
+            uint32_t value = program_read(field, frame + offsets[field->header]);
+
+            entry = program_lookup_lpm(tables, i, value << (32 - field->width));
+        } else {
+            exact_match_key_t key = { { 0, 0 } };
+            unsigned int position = 0;
+
+            for (j = 0; j < table->num_keys; j++) {
+                const program_field_t *field = &description->fields[table->keys[j]];
+                uint64_t value = program_read(field, frame + offsets[field->header]);
+                unsigned int word = position / 64;
+                unsigned int shift = position % 64;
+
+                key.words[word] |= value << shift;
+                if (shift + field->width > 64) {
+                    key.words[word + 1] |= value >> (64 - shift);
+                }
+                position = position + field->width;
+            }
+            entry = program_lookup_exact(tables, i, key);
+        }
+
+        const program_action_t *action = &description->actions[entry->action];
+        int drop = 0;
+
+        for (j = 0; j < action->num_ops; j++) {
+            const program_op_t *op = &action->ops[j];
+            uint32_t operand = op->param == PROGRAM_NONE ? op->value : entry->params[op->param];
+            const program_field_t *field;
+
+            switch (op->opcode) {
+                case PROGRAM_OP_SET:
+                case PROGRAM_OP_ADD:
+                    field = &description->fields[op->field];
+                    if (!(valid & (1u << field->header))) {
+                        break;
+                    }
+                    if (op->opcode == PROGRAM_OP_ADD) {
+                        operand = operand + program_read(field, frame + offsets[field->header]);
+                    }
+                    program_write(field, frame + offsets[field->header], operand);
+                    break;
+                case PROGRAM_OP_EGRESS:
+                    packet->egress_port = operand;
+                    break;
+                case PROGRAM_OP_PRIORITY:
+                    packet->priority = operand;
+                    break;
+                case PROGRAM_OP_DROP:
+                    drop = 1;
+                    break;
+            }
+        }
+
+        if (drop) {
+            return PROGRAM_DROP;
+        }
+    }
+
+    return PROGRAM_FORWARD;
+}
+
+/*  Helper functions. */
+
+static int program_table_has_action(const program_table_t *table, unsigned int action) {
+    unsigned int i;
+
+    for (i = 0; i < table->num_actions; i++) {
+        if (table->actions[i] == action) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned int program_key_width(const program_description_t *description, const program_table_t *table) {
+    unsigned int width = 0;
+    unsigned int i;
+
+    for (i = 0; i < table->num_keys; i++) {
+        width = width + description->fields[table->keys[i]].width;
+    }
+    return width;
+}
+
+/*  Value of a field of the header starting at the given byte, read from
+    the at most five bytes it spans. */
+static uint32_t program_read(const program_field_t *field, const unsigned char *header) {
+    unsigned int first = field->offset / 8;
+    unsigned int last = (field->offset + field->width - 1) / 8;
+    uint64_t bits = 0;
+    unsigned int i;
+
+    for (i = first; i <= last; i++) {
+        bits = bits << 8 | header[i];
+    }
+    return (uint32_t) (bits >> ((last + 1) * 8 - field->offset - field->width)) & program_mask(field->width);
+}
+
+/*  Store the low bits of value in a field, leaving the bits around it as
+    they are. */
+static void program_write(const program_field_t *field, unsigned char *header, uint32_t value) {
+    unsigned int first = field->offset / 8;
+    unsigned int last = (field->offset + field->width - 1) / 8;
+    unsigned int shift = (last + 1) * 8 - field->offset - field->width;
+    uint64_t mask = (uint64_t) program_mask(field->width) << shift;
+    uint64_t bits = 0;
+    unsigned int i;
+
+    for (i = first; i <= last; i++) {
+        bits = bits << 8 | header[i];
+    }
+    bits = (bits & ~mask) | (((uint64_t) value << shift) & mask);
+    for (i = last + 1; i-- > first; ) {
+        header[i] = (unsigned char) bits;
+        bits = bits >> 8;
+    }
+}
+
+static uint32_t program_mask(unsigned int width) {
+    return width >= 32 ? UINT32_MAX : (1u << width) - 1;
+}
+
+static void program_set_entry(program_entry_t *entry, unsigned int action, const uint32_t *params, unsigned int num_params) {
+    unsigned int i;
+
+    memset(entry, 0, sizeof(program_entry_t));
+    entry->action = action;
+    for (i = 0; i < num_params; i++) {
+        entry->params[i] = params[i];
+    }
+}
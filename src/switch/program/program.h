@@ -0,0 +1,172 @@
+/*  program.h
+
+    Switch programs in the style of P4: a parser that extracts headers of
+    fixed layout from the front of a frame, followed by a control made of
+    match-action tables applied one after the other, each matching fields
+    of the parsed headers and running the action of the entry found.
+
+    A program is described declaratively by a program_description, a set of
+    constant arrays in which headers, fields, parser states, actions and
+    tables refer to each other by index. The parser starts in state 0. Each
+    state extracts one header, then selects the next state on the value of
+    one of its fields. Actions are short lists of primitives on header
+    fields and on the packet descriptor, whose operands are either
+    constants or parameters given by the table entry.
+
+    The description can be run in two ways that give the same results. The
+    interpreter, program_interpret, walks the description for every packet,
+    reading each field by its bit offset and width and dispatching on every
+    primitive of every action. The generator of codegen.h instead emits a C
+    function specialized to the one description, in which offsets, widths
+    and masks are constants, parser transitions are switches and the
+    actions a table may run are inlined into it. Both have the signature of
+    func_program_t and run against the same program_tables_t, which holds
+    the entries of every table, so a switch model can take either as its
+    packet processing callback.
+
+    Packet descriptors carry no header bytes, so the frame is passed along
+    with the descriptor. Actions may rewrite header fields in the frame and
+    set the egress port and priority of the descriptor.
+
+    Fields are at most 32 bits wide. Tables match either exactly on fields
+    totalling at most 128 bits, kept in the cuckoo hash table of
+    exact_match.h, or on the longest prefix of a single field, kept in the
+    DIR-24-8 table of fib4.h. A table is only applied when every header its
+    key comes from is valid, and primitives on fields of invalid headers do
+    nothing. When no entry matches, the default action of the table runs
+    with all its parameters zero. An action that drops the packet ends the
+    control there. */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "../packet.h"
+#include "../tables/exact_match.h"
+
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define PROGRAM_NONE UINT32_MAX
+#define PROGRAM_ACCEPT UINT32_MAX
+#define PROGRAM_MAX_HEADERS 32
+#define PROGRAM_MAX_FIELD_WIDTH 32
+#define PROGRAM_MAX_KEY_WIDTH 128
+#define PROGRAM_MAX_PARAMS 4
+
+/*  Verdicts returned by a program. */
+#define PROGRAM_FORWARD 0
+#define PROGRAM_DROP 1
+
+struct program_tables;
+
+typedef struct program_tables * program_tables_t;
+
+/*  A header of a fixed number of bytes. */
+typedef struct program_header {
+    const char *name;
+    unsigned int length;
+} program_header_t;
+
+/*  A field of width bits, offset bits from the start of its header, most
+    significant bit first. */
+typedef struct program_field {
+    const char *name;
+    unsigned int header;
+    unsigned int offset;
+    unsigned int width;
+} program_field_t;
+
+typedef struct program_transition {
+    uint32_t value;
+    unsigned int next;
+} program_transition_t;
+
+/*  A parser state, extracting a header then moving to the state of the
+    first transition whose value the select field has, or to otherwise.
+    A select of PROGRAM_NONE always moves to otherwise, and a next state of
+    PROGRAM_ACCEPT ends parsing. Parsing also ends when the frame is too
+    short for the header of a state. */
+typedef struct program_state {
+    unsigned int header;
+    unsigned int select;
+    unsigned int num_transitions;
+    const program_transition_t *transitions;
+    unsigned int otherwise;
+} program_state_t;
+
+typedef enum program_opcode {
+    PROGRAM_OP_SET,         /*  field = operand */
+    PROGRAM_OP_ADD,         /*  field = field + operand, wrapping around */
+    PROGRAM_OP_EGRESS,      /*  egress_port = operand */
+    PROGRAM_OP_PRIORITY,    /*  priority = operand */
+    PROGRAM_OP_DROP
+} program_opcode_t;
+
+/*  A primitive, whose operand is the given parameter of the entry, or the
+    constant value when param is PROGRAM_NONE. */
+typedef struct program_op {
+    program_opcode_t opcode;
+    unsigned int field;
+    unsigned int param;
+    uint32_t value;
+} program_op_t;
+
+typedef struct program_action {
+    const char *name;
+    unsigned int num_params;
+    unsigned int num_ops;
+    const program_op_t *ops;
+} program_action_t;
+
+typedef enum program_match {
+    PROGRAM_MATCH_EXACT,
+    PROGRAM_MATCH_LPM
+} program_match_t;
+
+/*  A table of up to size entries, keyed on the given fields, whose entries
+    may run any of the given actions. */
+typedef struct program_table {
+    const char *name;
+    program_match_t match;
+    unsigned int num_keys;
+    const unsigned int *keys;
+    unsigned int size;
+    unsigned int num_actions;
+    const unsigned int *actions;
+    unsigned int default_action;
+} program_table_t;
+
+typedef struct program_description {
+    unsigned int num_headers;
+    const program_header_t *headers;
+    unsigned int num_fields;
+    const program_field_t *fields;
+    unsigned int num_states;
+    const program_state_t *states;
+    unsigned int num_actions;
+    const program_action_t *actions;
+    unsigned int num_tables;
+    const program_table_t *tables;
+} program_description_t;
+
+/*  An entry of a table, as found by a lookup. */
+typedef struct program_entry {
+    unsigned int action;
+    uint32_t params[PROGRAM_MAX_PARAMS];
+} program_entry_t;
+
+/*  Processes the packet whose first length bytes are in frame, returning
+    PROGRAM_FORWARD or PROGRAM_DROP. */
+typedef int (*func_program_t)(program_tables_t, packet_t, unsigned char *, unsigned int);
+
+int program_description_valid(const program_description_t *description);
+program_tables_t create_program_tables(const program_description_t *description);
+void free_program_tables(program_tables_t tables);
+uint32_t program_add_exact(program_tables_t tables, unsigned int table, const uint32_t *values, unsigned int action, const uint32_t *params);
+uint32_t program_add_lpm(program_tables_t tables, unsigned int table, uint32_t prefix, unsigned int depth, unsigned int action, const uint32_t *params);
+unsigned int program_table_entries(program_tables_t tables, unsigned int table);
+const program_entry_t *program_lookup_exact(program_tables_t tables, unsigned int table, exact_match_key_t key);
+const program_entry_t *program_lookup_lpm(program_tables_t tables, unsigned int table, uint32_t value);
+int program_interpret(program_tables_t tables, packet_t packet, unsigned char *frame, unsigned int length);
+
+#endif
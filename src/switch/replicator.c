@@ -0,0 +1,335 @@
+/*  replicator.c
+
+    Implementation of the replicator.
+
+    A descriptor's reference count is set when it is first replicated and
+    only changes as replicas are made and released. Replicating a replica
+    adds to the count of the descriptor it already shares rather than
+    sharing the replica, and copies its per replica fields so that any
+    marks it picked up carry over.
+
+    Group membership is a bitmap per group, all held in one array. */
+
+#include "replicator.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_GROUP_CAPACITY 8
+
+struct replicator {
+    object_pool_t packet_pool;
+    object_pool_t headers;
+    unsigned int num_ports;
+
+    /*  Group g owns words_per_group words starting at g * words_per_group. */
+    uint64_t *members;
+    unsigned int *group_sizes;
+    unsigned int words_per_group;
+    unsigned int num_groups;
+    unsigned int group_capacity;
+
+    unsigned int *ingress_mirror;
+    unsigned int *egress_mirror;
+
+    /*  Destinations of the packet being replicated. */
+    unsigned int *targets;
+};
+
+/*  Forward declarations of helper functions. */
+static unsigned int replicator_group_targets(replicator_t replicator, unsigned int ingress_port, unsigned int group);
+static unsigned int replicator_emit(replicator_t replicator, packet_t packet, unsigned int num_targets, unsigned int arrived, unsigned int flags, replica_t *out);
+static inline unsigned int replicator_add_target(replicator_t replicator, unsigned int num_targets, unsigned int port);
+
+/*  Create a replicator for a switch with the given number of ports.
+    Shared descriptors are given back to packet_pool when their last
+    replica is released, and expanded replicas are allocated from it. */
+replicator_t create_replicator(object_pool_t packet_pool, unsigned int num_ports) {
+    assert(packet_pool);
+    assert(num_ports > 0);
+
+    replicator_t replicator = malloc(sizeof(struct replicator));
+    assert(replicator);
+
+    replicator->packet_pool = packet_pool;
+    replicator->headers = create_object_pool(sizeof(struct replica), 0);
+    replicator->num_ports = num_ports;
+
+    replicator->words_per_group = (num_ports + 63) / 64;
+    replicator->num_groups = 0;
+    replicator->group_capacity = DEFAULT_GROUP_CAPACITY;
+    replicator->members = malloc(sizeof(uint64_t) * replicator->words_per_group * DEFAULT_GROUP_CAPACITY);
+    assert(replicator->members);
+    replicator->group_sizes = malloc(sizeof(unsigned int) * DEFAULT_GROUP_CAPACITY);
+    assert(replicator->group_sizes);
+
+    replicator->ingress_mirror = malloc(sizeof(unsigned int) * num_ports);
+    assert(replicator->ingress_mirror);
+    replicator->egress_mirror = malloc(sizeof(unsigned int) * num_ports);
+    assert(replicator->egress_mirror);
+
+    unsigned int port;
+    for (port = 0; port < num_ports; port++) {
+        replicator->ingress_mirror[port] = REPLICATOR_NO_MIRROR;
+        replicator->egress_mirror[port] = REPLICATOR_NO_MIRROR;
+    }
+
+    replicator->targets = malloc(sizeof(unsigned int) * (2 * num_ports + 1));
+    assert(replicator->targets);
+
+    return replicator;
+}
+
+/*  Free the replicator and its header pool. Replicas still held elsewhere
+    become invalid. */
+void free_replicator(replicator_t replicator) {
+    assert(replicator);
+
+    free_object_pool(replicator->headers);
+    free(replicator->members);
+    free(replicator->group_sizes);
+    free(replicator->ingress_mirror);
+    free(replicator->egress_mirror);
+    free(replicator->targets);
+    free(replicator);
+}
+
+/*  Create an empty multicast group and return its number. */
+unsigned int replicator_create_group(replicator_t replicator) {
+    unsigned int words = replicator->words_per_group;
+
+    if (replicator->num_groups == replicator->group_capacity) {
+        replicator->group_capacity = replicator->group_capacity * 2;
+        replicator->members = realloc(replicator->members,
+            sizeof(uint64_t) * words * replicator->group_capacity);
+        assert(replicator->members);
+        replicator->group_sizes = realloc(replicator->group_sizes,
+            sizeof(unsigned int) * replicator->group_capacity);
+        assert(replicator->group_sizes);
+    }
+
+    unsigned int group = replicator->num_groups;
+    unsigned int word;
+    for (word = 0; word < words; word++) {
+        replicator->members[group * words + word] = 0;
+    }
+    replicator->group_sizes[group] = 0;
+    replicator->num_groups = group + 1;
+
+    return group;
+}
+
+void replicator_group_add(replicator_t replicator, unsigned int group, unsigned int port) {
+    assert(group < replicator->num_groups);
+    assert(port < replicator->num_ports);
+
+    uint64_t *word = &replicator->members[group * replicator->words_per_group + port / 64];
+    uint64_t bit = (uint64_t) 1 << (port % 64);
+
+    if (!(*word & bit)) {
+        *word = *word | bit;
+        replicator->group_sizes[group] = replicator->group_sizes[group] + 1;
+    }
+}
+
+void replicator_group_remove(replicator_t replicator, unsigned int group, unsigned int port) {
+    assert(group < replicator->num_groups);
+    assert(port < replicator->num_ports);
+
+    uint64_t *word = &replicator->members[group * replicator->words_per_group + port / 64];
+    uint64_t bit = (uint64_t) 1 << (port % 64);
+
+    if (*word & bit) {
+        *word = *word & ~bit;
+        replicator->group_sizes[group] = replicator->group_sizes[group] - 1;
+    }
+}
+
+/*  Number of ports in a group. */
+unsigned int replicator_group_size(replicator_t replicator, unsigned int group) {
+    assert(group < replicator->num_groups);
+
+    return replicator->group_sizes[group];
+}
+
+/*  Copy packets arriving on a port to a mirror port, or stop doing so if
+    the mirror port is REPLICATOR_NO_MIRROR. */
+void replicator_mirror_ingress(replicator_t replicator, unsigned int port, unsigned int mirror_port) {
+    assert(port < replicator->num_ports);
+    assert(mirror_port < replicator->num_ports || mirror_port == REPLICATOR_NO_MIRROR);
+
+    replicator->ingress_mirror[port] = mirror_port;
+}
+
+/*  Copy packets sent to a port to a mirror port, or stop doing so. */
+void replicator_mirror_egress(replicator_t replicator, unsigned int port, unsigned int mirror_port) {
+    assert(port < replicator->num_ports);
+    assert(mirror_port < replicator->num_ports || mirror_port == REPLICATOR_NO_MIRROR);
+
+    replicator->egress_mirror[port] = mirror_port;
+}
+
+/*  Size the output array of replicator_forward and replicator_multicast
+    must have. */
+unsigned int replicator_max_replicas(replicator_t replicator) {
+    return 2 * replicator->num_ports + 1;
+}
+
+/*  Send a packet to a single port, along with any mirror copies. The
+    packet is handed over and the replicas to send are written to out,
+    each with its egress port set. Returns how many there are. */
+unsigned int replicator_forward(replicator_t replicator, packet_t packet, unsigned int egress_port, replica_t *out) {
+    assert(egress_port < replicator->num_ports);
+    assert(packet->references == 0);
+
+    unsigned int num_targets = 0;
+
+    if (packet->ingress_port < replicator->num_ports) {
+        num_targets = replicator_add_target(replicator, num_targets, replicator->ingress_mirror[packet->ingress_port]);
+    }
+    num_targets = replicator_add_target(replicator, num_targets, egress_port);
+    num_targets = replicator_add_target(replicator, num_targets, replicator->egress_mirror[egress_port]);
+
+    return replicator_emit(replicator, packet, num_targets, packet->arrived, packet->flags, out);
+}
+
+/*  Send a packet to every port of a group, as for replicator_forward. A
+    packet sent to an empty group is released. */
+unsigned int replicator_multicast(replicator_t replicator, packet_t packet, unsigned int group, replica_t *out) {
+    assert(packet->references == 0);
+
+    unsigned int num_targets = replicator_group_targets(replicator, packet->ingress_port, group);
+
+    return replicator_emit(replicator, packet, num_targets, packet->arrived, packet->flags, out);
+}
+
+/*  Send a replica on to every port of a group, as at a later hop. The new
+    replicas share the descriptor of the one handed over, which is
+    released, and start out with its per replica fields. */
+unsigned int replicator_multicast_replica(replicator_t replicator, replica_t replica, unsigned int group, replica_t *out) {
+    packet_t packet = replica->packet;
+    unsigned int num_targets = replicator_group_targets(replicator, packet->ingress_port, group);
+    unsigned int count = replicator_emit(replicator, packet, num_targets, replica->arrived, replica->flags, out);
+
+    replicator_release(replica, replicator);
+
+    return count;
+}
+
+/*  Number of replicas sharing the descriptor of a replica. */
+unsigned int replicator_references(replica_t replica) {
+    return replica->packet->references;
+}
+
+/*  Turn a replica into a descriptor of its own, for models that hold
+    packets. The replica is released. The last replica of a packet takes
+    over the shared descriptor, others get a copy from the packet pool. */
+packet_t replicator_expand(replicator_t replicator, replica_t replica) {
+    packet_t shared = replica->packet;
+    packet_t packet = shared;
+
+    if (shared->references > 1) {
+        packet = (packet_t) object_pool_alloc(replicator->packet_pool);
+        *packet = *shared;
+        shared->references = shared->references - 1;
+    }
+
+    packet->next = NULL;
+    packet->egress_port = replica->egress_port;
+    packet->arrived = replica->arrived;
+    packet->flags = replica->flags;
+    packet->references = 0;
+
+    object_pool_release(replicator->headers, replica);
+
+    return packet;
+}
+
+/*  Give back a replica. The shared descriptor goes back to the packet pool
+    with its last replica. */
+void replicator_release(void *replica_ptr, void *replicator_ptr) {
+    replica_t replica = (replica_t) replica_ptr;
+    replicator_t replicator = (replicator_t) replicator_ptr;
+    packet_t packet = replica->packet;
+
+    object_pool_release(replicator->headers, replica);
+
+    assert(packet->references > 0);
+    packet->references = packet->references - 1;
+    if (packet->references == 0) {
+        object_pool_release(replicator->packet_pool, packet);
+    }
+}
+
+/*  Number of replica headers currently handed out. */
+unsigned int replicator_headers_in_use(replicator_t replicator) {
+    return object_pool_in_use(replicator->headers);
+}
+
+/*  Helper functions. */
+
+/*  Fill the target list with the ports of a group and their mirrors, after
+    the mirror of the ingress port. Returns the number of targets. */
+static unsigned int replicator_group_targets(replicator_t replicator, unsigned int ingress_port, unsigned int group) {
+    assert(group < replicator->num_groups);
+
+    unsigned int words = replicator->words_per_group;
+    const uint64_t *members = &replicator->members[group * words];
+    unsigned int num_targets = 0;
+    unsigned int word;
+
+    if (ingress_port < replicator->num_ports) {
+        num_targets = replicator_add_target(replicator, num_targets, replicator->ingress_mirror[ingress_port]);
+    }
+
+    for (word = 0; word < words; word++) {
+        uint64_t bits = members[word];
+        while (bits) {
+            unsigned int port = word * 64 + (unsigned int) __builtin_ctzll(bits);
+            bits = bits & (bits - 1);
+
+            num_targets = replicator_add_target(replicator, num_targets, port);
+            num_targets = replicator_add_target(replicator, num_targets, replicator->egress_mirror[port]);
+        }
+    }
+
+    return num_targets;
+}
+
+/*  Make a replica of a descriptor for each port in the target list, with
+    the given per replica fields. A descriptor left with no replicas at all
+    goes back to the packet pool. */
+static unsigned int replicator_emit(replicator_t replicator, packet_t packet, unsigned int num_targets, unsigned int arrived, unsigned int flags, replica_t *out) {
+    if (num_targets == 0 && packet->references == 0) {
+        object_pool_release(replicator->packet_pool, packet);
+        return 0;
+    }
+
+    unsigned int i;
+    for (i = 0; i < num_targets; i++) {
+        replica_t replica = (replica_t) object_pool_alloc(replicator->headers);
+
+        replica->next = NULL;
+        replica->egress_port = replicator->targets[i];
+        replica->arrived = arrived;
+        replica->flags = flags;
+        replica->packet = packet;
+        out[i] = replica;
+    }
+    packet->references = packet->references + num_targets;
+
+    return num_targets;
+}
+
+/*  Add a port to the target list, unless it is REPLICATOR_NO_MIRROR. */
+static inline unsigned int replicator_add_target(replicator_t replicator, unsigned int num_targets, unsigned int port) {
+    if (port != REPLICATOR_NO_MIRROR) {
+        replicator->targets[num_targets] = port;
+        num_targets = num_targets + 1;
+    }
+
+    return num_targets;
+}
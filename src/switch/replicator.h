@@ -0,0 +1,72 @@
+/*  replicator.h
+
+    Multicast groups and port mirroring with shared packet descriptors.
+
+    Replicating a packet does not copy its descriptor. Each replica is a
+    small header from a pool of the replicator's own, holding only the
+    fields that can differ between replicas - the egress port, the arrival
+    time, the flags and a next pointer for queueing - and a pointer to the
+    descriptor, which every replica of the packet shares and must treat as
+    read only. The descriptor counts the replicas referring to it, and goes
+    back to the packet pool with the last of them.
+
+    Replicas are given back with replicator_release. It has the signature
+    of the free_data function of an event queue, so a queue that holds
+    replicas as its data can be created with the replicator as its free
+    function, and replicas still pending when it is freed are released
+    through the reference counts.
+
+    Models that hold packets, such as ports, need a descriptor of their
+    own. replicator_expand turns a replica into one when it is handed to
+    such a model, reusing the shared descriptor for the last replica of a
+    packet and copying it otherwise.
+
+    Mirroring can copy every packet that arrives on a port (ingress) or
+    that is sent to a port (egress) to a mirror port. Egress mirroring
+    applies to every replica of a multicast. A mirror copy is just another
+    replica. */
+
+#ifndef REPLICATOR_H
+#define REPLICATOR_H
+
+#include "packet.h"
+
+#define REPLICATOR_NO_MIRROR ((unsigned int) -1)
+
+struct replicator;
+
+typedef struct replicator * replicator_t;
+
+struct replica;
+
+typedef struct replica * replica_t;
+
+struct replica {
+    /*  Per replica fields, which whoever holds the replica may change. */
+    replica_t next;
+    unsigned int egress_port;
+    unsigned int arrived;
+    unsigned int flags;
+
+    /*  Descriptor shared by every replica of the packet. */
+    packet_t packet;
+};
+
+replicator_t create_replicator(object_pool_t packet_pool, unsigned int num_ports);
+void free_replicator(replicator_t replicator);
+unsigned int replicator_create_group(replicator_t replicator);
+void replicator_group_add(replicator_t replicator, unsigned int group, unsigned int port);
+void replicator_group_remove(replicator_t replicator, unsigned int group, unsigned int port);
+unsigned int replicator_group_size(replicator_t replicator, unsigned int group);
+void replicator_mirror_ingress(replicator_t replicator, unsigned int port, unsigned int mirror_port);
+void replicator_mirror_egress(replicator_t replicator, unsigned int port, unsigned int mirror_port);
+unsigned int replicator_max_replicas(replicator_t replicator);
+unsigned int replicator_forward(replicator_t replicator, packet_t packet, unsigned int egress_port, replica_t *out);
+unsigned int replicator_multicast(replicator_t replicator, packet_t packet, unsigned int group, replica_t *out);
+unsigned int replicator_multicast_replica(replicator_t replicator, replica_t replica, unsigned int group, replica_t *out);
+unsigned int replicator_references(replica_t replica);
+packet_t replicator_expand(replicator_t replicator, replica_t replica);
+void replicator_release(void *replica, void *replicator);
+unsigned int replicator_headers_in_use(replicator_t replicator);
+
+#endif
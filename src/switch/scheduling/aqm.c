@@ -0,0 +1,452 @@
+/*  aqm.c
+
+    Implementation of RED, WRED, threshold marking and CoDel.
+
+    The RED average is held in bytes shifted left by AVERAGE_SHIFT, and
+    each arrival moves it by a 2^-weight_shift share of the difference to
+    the instantaneous queue. A queue that has been empty for m packet times
+    scales the average by (1 - w)^m, built up from a table of
+    (1 - w)^(2^k). The drop probability for an average between the
+    thresholds is read from a table indexed by the distance above the
+    minimum threshold, shifted down so that the table has at most
+    RED_STEPS entries. As in the original RED, the probability grows with
+    the number of packets accepted since the last drop so that drops are
+    spread out evenly, and the comparison is cross multiplied so that no
+    division is needed.
+
+    CoDel follows RFC 8289. The control law steps interval / sqrt(count)
+    for small counts come from a table, and larger counts, which only
+    happen under sustained overload, fall back to an integer square root. */
+
+#include "aqm.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define AVERAGE_SHIFT 10
+#define RED_STEPS 256
+#define DECAY_BITS 32
+#define CODEL_STEPS 64
+#define CODEL_RESUME_INTERVALS 16
+#define RANDOM_SEED 0x2545f491u
+
+enum aqm_kind {
+    AQM_KIND_RED,
+    AQM_KIND_THRESHOLD,
+    AQM_KIND_CODEL
+};
+
+struct red_profile {
+    unsigned int min_threshold;
+    unsigned int max_threshold;
+
+    /*  Distance above the minimum threshold is shifted down by step_shift
+        to index the probability table. */
+    unsigned int step_shift;
+    unsigned int probability[RED_STEPS];
+
+    /*  Packets accepted since the last drop or mark. */
+    unsigned int count;
+};
+
+struct aqm {
+    enum aqm_kind kind;
+    int ecn;
+
+    /*  RED, one profile per colour. */
+    struct red_profile profiles[AQM_COLORS];
+    unsigned int weight_shift;
+    int64_t average;
+    unsigned int packet_time;
+    int idle;
+    unsigned int idle_since;
+    uint32_t decay[DECAY_BITS];
+    uint32_t random;
+
+    /*  Threshold marking. */
+    unsigned int threshold;
+
+    /*  CoDel. First time at which the sojourn time will have been above
+        target for a whole interval, 0 while it is below, and the time of
+        the next drop while dropping. */
+    unsigned int target;
+    unsigned int interval;
+    unsigned int first_above_time;
+    unsigned int drop_next;
+    unsigned int drops;
+    unsigned int last_drops;
+    int dropping;
+    unsigned int max_packet;
+    unsigned int steps[CODEL_STEPS];
+
+    unsigned long counts[3];
+};
+
+/*  Forward declarations of helper functions. */
+static aqm_t aqm_alloc(enum aqm_kind kind, int ecn);
+static void red_profile_init(struct red_profile *profile, const struct aqm_red_profile *spec);
+static aqm_verdict_t red_enqueue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now);
+static void red_age(aqm_t aqm, unsigned int now);
+static aqm_verdict_t codel_dequeue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now);
+static int codel_ok_to_drop(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now);
+static inline unsigned int codel_control_law(aqm_t aqm, unsigned int t);
+static inline aqm_verdict_t aqm_signal(aqm_t aqm, packet_t packet);
+static inline uint32_t aqm_random(aqm_t aqm);
+static uint64_t isqrt(uint64_t x);
+static int aqm_port_admit(void *arg, packet_t packet, unsigned int queue_bytes, unsigned int now);
+static int aqm_port_release(void *arg, packet_t packet, unsigned int queue_bytes, unsigned int now);
+
+/*  Create RED with a single profile for every packet. The average moves
+    by 2^-weight_shift of the difference to the queue at each arrival.
+    packet_time is the number of ticks taken to send a typical packet, used
+    to age the average across idle periods, or 0 to leave it unchanged
+    while the queue is empty. */
+aqm_t create_red(const struct aqm_red_profile *profile, unsigned int weight_shift, unsigned int packet_time, int ecn) {
+    struct aqm_red_profile profiles[AQM_COLORS] = { *profile, *profile, *profile };
+
+    return create_wred(profiles, weight_shift, packet_time, ecn);
+}
+
+/*  Create WRED with profiles for green, yellow and red packets. */
+aqm_t create_wred(const struct aqm_red_profile profiles[AQM_COLORS], unsigned int weight_shift, unsigned int packet_time, int ecn) {
+    assert(weight_shift > 0 && weight_shift < 32);
+
+    aqm_t aqm = aqm_alloc(AQM_KIND_RED, ecn);
+    unsigned int color;
+
+    for (color = 0; color < AQM_COLORS; color++) {
+        red_profile_init(&aqm->profiles[color], &profiles[color]);
+    }
+    aqm->weight_shift = weight_shift;
+    aqm->packet_time = packet_time;
+
+    /*  Repeated squaring of 1 - w in 32 bit fixed point, which ends in
+        zeros once the product underflows. */
+    uint64_t decay = ((uint64_t) 1 << 32) - ((uint64_t) 1 << (32 - weight_shift));
+    unsigned int bit;
+    for (bit = 0; bit < DECAY_BITS; bit++) {
+        aqm->decay[bit] = (uint32_t) decay;
+        decay = (decay * decay) >> 32;
+    }
+
+    return aqm;
+}
+
+/*  Create a marker setting congestion experienced on ECN capable packets
+    that arrive to find at least threshold bytes queued. */
+aqm_t create_ecn_threshold(unsigned int threshold) {
+    aqm_t aqm = aqm_alloc(AQM_KIND_THRESHOLD, 1);
+
+    aqm->threshold = threshold;
+
+    return aqm;
+}
+
+/*  Create CoDel with the given target sojourn time and interval in ticks. */
+aqm_t create_codel(unsigned int target, unsigned int interval, int ecn) {
+    assert(target > 0);
+    assert(interval > 0);
+
+    aqm_t aqm = aqm_alloc(AQM_KIND_CODEL, ecn);
+    uint64_t square = (uint64_t) interval * interval;
+    unsigned int count;
+
+    aqm->target = target;
+    aqm->interval = interval;
+    aqm->steps[0] = interval;
+    for (count = 1; count < CODEL_STEPS; count++) {
+        aqm->steps[count] = (unsigned int) isqrt(square / count);
+    }
+
+    return aqm;
+}
+
+void free_aqm(aqm_t aqm) {
+    assert(aqm);
+
+    free(aqm);
+}
+
+/*  Decide the fate of a packet joining a queue holding queue_bytes. A
+    marked packet has had congestion experienced set. */
+aqm_verdict_t aqm_enqueue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    aqm_verdict_t verdict = AQM_PASS;
+
+    if (aqm->kind == AQM_KIND_RED) {
+        verdict = red_enqueue(aqm, packet, queue_bytes, now);
+    } else if (aqm->kind == AQM_KIND_THRESHOLD) {
+        if (queue_bytes >= aqm->threshold && (packet->flags & PACKET_FLAG_ECN_CAPABLE)) {
+            packet->flags = packet->flags | PACKET_FLAG_ECN_MARKED;
+            verdict = AQM_MARK;
+        }
+    }
+
+    aqm->counts[verdict]++;
+
+    return verdict;
+}
+
+/*  Decide the fate of a packet leaving a queue with queue_bytes still
+    behind it. */
+aqm_verdict_t aqm_dequeue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    if (aqm->kind == AQM_KIND_CODEL) {
+        aqm_verdict_t verdict = codel_dequeue(aqm, packet, queue_bytes, now);
+        aqm->counts[verdict]++;
+        return verdict;
+    }
+
+    /*  Without a packet time idle periods are not aged, so they need not
+        be timed. */
+    if (aqm->kind == AQM_KIND_RED && queue_bytes == 0 && aqm->packet_time != 0) {
+        aqm->idle = 1;
+        aqm->idle_since = now;
+    }
+
+    return AQM_PASS;
+}
+
+/*  Manage the queue of a port. The port drops whatever the model says to
+    drop. */
+void aqm_attach(aqm_t aqm, port_t port) {
+    func_port_aqm_t admit = aqm_port_admit;
+    func_port_aqm_t release = aqm_port_release;
+
+    if (aqm->kind == AQM_KIND_CODEL) {
+        admit = NULL;
+    } else if (aqm->kind == AQM_KIND_THRESHOLD || aqm->packet_time == 0) {
+        release = NULL;
+    }
+
+    port_set_aqm(port, admit, release, aqm);
+}
+
+/*  Average queue length in bytes as last seen by RED. */
+unsigned int aqm_average(aqm_t aqm) {
+    return (unsigned int) (aqm->average >> AVERAGE_SHIFT);
+}
+
+/*  Number of packets given a verdict so far. */
+unsigned long aqm_count(aqm_t aqm, aqm_verdict_t verdict) {
+    return aqm->counts[verdict];
+}
+
+/*  Helper functions. */
+
+static aqm_t aqm_alloc(enum aqm_kind kind, int ecn) {
+    aqm_t aqm = calloc(1, sizeof(struct aqm));
+    assert(aqm);
+
+    aqm->kind = kind;
+    aqm->ecn = ecn;
+    aqm->random = RANDOM_SEED;
+
+    return aqm;
+}
+
+static void red_profile_init(struct red_profile *profile, const struct aqm_red_profile *spec) {
+    assert(spec->max_threshold > spec->min_threshold);
+    assert(spec->max_probability <= AQM_PROBABILITY_ONE);
+
+    unsigned int range = spec->max_threshold - spec->min_threshold;
+    unsigned int shift = 0;
+    unsigned int step;
+
+    while ((range >> shift) >= RED_STEPS) {
+        shift++;
+    }
+
+    profile->min_threshold = spec->min_threshold;
+    profile->max_threshold = spec->max_threshold;
+    profile->step_shift = shift;
+    profile->count = 0;
+
+    for (step = 0; step < RED_STEPS; step++) {
+        uint64_t above = (uint64_t) step << shift;
+        profile->probability[step] = above >= range ? spec->max_probability :
+            (unsigned int) (above * spec->max_probability / range);
+    }
+}
+
+static aqm_verdict_t red_enqueue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    if (queue_bytes == 0 && aqm->idle) {
+        red_age(aqm, now);
+    } else {
+        int64_t sample = (int64_t) queue_bytes << AVERAGE_SHIFT;
+        aqm->average = aqm->average + ((sample - aqm->average) >> aqm->weight_shift);
+    }
+    aqm->idle = 0;
+
+    unsigned int color = 0;
+    if (packet->flags & PACKET_FLAG_RED) {
+        color = 2;
+    } else if (packet->flags & PACKET_FLAG_YELLOW) {
+        color = 1;
+    }
+
+    struct red_profile *profile = &aqm->profiles[color];
+    unsigned int average = (unsigned int) (aqm->average >> AVERAGE_SHIFT);
+
+    if (average < profile->min_threshold) {
+        profile->count = 0;
+        return AQM_PASS;
+    }
+    if (average >= profile->max_threshold) {
+        profile->count = 0;
+        return AQM_DROP;
+    }
+
+    /*  Drop with probability p / (1 - count * p), i.e. when
+        u * (1 - count * p) < p for u uniform on [0, 1). */
+    uint64_t p = profile->probability[(average - profile->min_threshold) >> profile->step_shift];
+    uint64_t scaled = (uint64_t) profile->count * p;
+    profile->count++;
+
+    if (p == 0) {
+        return AQM_PASS;
+    }
+    if (scaled < AQM_PROBABILITY_ONE &&
+        (uint64_t) (aqm_random(aqm) >> 16) * (AQM_PROBABILITY_ONE - scaled) >= p * AQM_PROBABILITY_ONE) {
+        return AQM_PASS;
+    }
+
+    profile->count = 0;
+    return aqm_signal(aqm, packet);
+}
+
+/*  Scale the average by (1 - w)^m for an idle period of m packet times.
+    The factors keep all 32 bits, since for weights below 2^-16 a factor
+    cut to 16 bits is off by more than w itself. The average is split into
+    its high and low 32 bits so that neither product can overflow. */
+static void red_age(aqm_t aqm, unsigned int now) {
+    unsigned int m = (now - aqm->idle_since) / aqm->packet_time;
+    unsigned int bit;
+
+    for (bit = 0; m != 0 && aqm->average != 0; bit++, m >>= 1) {
+        if (m & 1) {
+            uint64_t average = (uint64_t) aqm->average;
+            uint64_t high = (average >> 32) * aqm->decay[bit];
+            uint64_t low = ((average & 0xffffffffu) * aqm->decay[bit]) >> 32;
+
+            aqm->average = (int64_t) (high + low);
+        }
+    }
+}
+
+static aqm_verdict_t codel_dequeue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    int ok_to_drop = codel_ok_to_drop(aqm, packet, queue_bytes, now);
+
+    if (aqm->dropping) {
+        if (!ok_to_drop) {
+            aqm->dropping = 0;
+            return AQM_PASS;
+        }
+        if ((int) (now - aqm->drop_next) < 0) {
+            return AQM_PASS;
+        }
+        aqm->drops = aqm->drops + 1;
+        aqm->drop_next = codel_control_law(aqm, aqm->drop_next);
+        return aqm_signal(aqm, packet);
+    }
+
+    if (!ok_to_drop) {
+        return AQM_PASS;
+    }
+
+    /*  Start dropping. If dropping stopped only recently, resume at about
+        the rate it had reached rather than starting over. */
+    unsigned int delta = aqm->drops - aqm->last_drops;
+    if (delta > 1 && (int) (now - aqm->drop_next) < (int) (CODEL_RESUME_INTERVALS * aqm->interval)) {
+        aqm->drops = delta;
+    } else {
+        aqm->drops = 1;
+    }
+    aqm->dropping = 1;
+    aqm->last_drops = aqm->drops;
+    aqm->drop_next = codel_control_law(aqm, now);
+
+    return aqm_signal(aqm, packet);
+}
+
+/*  Whether the sojourn time of the packet, counted from the arrival of its
+    head, has stayed above target for at least an interval. A queue holding
+    less than a packet is never considered to be standing. */
+static int codel_ok_to_drop(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    unsigned int sojourn = now - packet->arrived;
+
+    if (packet->length > aqm->max_packet) {
+        aqm->max_packet = packet->length;
+    }
+
+    if (sojourn < aqm->target || queue_bytes <= aqm->max_packet) {
+        aqm->first_above_time = 0;
+        return 0;
+    }
+
+    if (aqm->first_above_time == 0) {
+        aqm->first_above_time = now + aqm->interval;
+        return 0;
+    }
+
+    return (int) (now - aqm->first_above_time) >= 0;
+}
+
+static inline unsigned int codel_control_law(aqm_t aqm, unsigned int t) {
+    if (aqm->drops < CODEL_STEPS) {
+        return t + aqm->steps[aqm->drops];
+    }
+
+    return t + (unsigned int) isqrt((uint64_t) aqm->interval * aqm->interval / aqm->drops);
+}
+
+/*  Mark the packet if it and the model are ECN capable, else drop it. */
+static inline aqm_verdict_t aqm_signal(aqm_t aqm, packet_t packet) {
+    if (aqm->ecn && (packet->flags & PACKET_FLAG_ECN_CAPABLE)) {
+        packet->flags = packet->flags | PACKET_FLAG_ECN_MARKED;
+        return AQM_MARK;
+    }
+
+    return AQM_DROP;
+}
+
+/*  xorshift32, plenty for drop decisions. */
+static inline uint32_t aqm_random(aqm_t aqm) {
+    uint32_t x = aqm->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    aqm->random = x;
+
+    return x;
+}
+
+static uint64_t isqrt(uint64_t x) {
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+static int aqm_port_admit(void *arg, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    return aqm_enqueue((aqm_t) arg, packet, queue_bytes, now) == AQM_DROP;
+}
+
+static int aqm_port_release(void *arg, packet_t packet, unsigned int queue_bytes, unsigned int now) {
+    return aqm_dequeue((aqm_t) arg, packet, queue_bytes, now) == AQM_DROP;
+}
@@ -0,0 +1,68 @@
+/*  aqm.h
+
+    Active queue management for port queues: RED and WRED, ECN threshold
+    marking and CoDel.
+
+    RED keeps an exponentially weighted average of the queue length and
+    drops or marks arriving packets with a probability that rises linearly
+    from 0 at the minimum threshold to the maximum probability at the
+    maximum threshold, above which every packet is dropped. WRED applies a
+    separate profile to each colour given by a policer, against the same
+    average. Threshold marking sets the congestion experienced bit on every
+    ECN capable packet that arrives to find at least the threshold waiting,
+    as DCTCP expects, and never drops. CoDel drops or marks packets as they
+    leave the queue once they have spent longer than the target in it for
+    a whole interval, and then ever more often, at intervals shrinking with
+    the square root of the number of drops.
+
+    Everything on the per packet path is integer arithmetic. The average
+    queue is kept in fixed point, drop probabilities and the decay of the
+    average over idle periods come from tables built at creation, and so do
+    the control law steps of CoDel. CoDel has no timer of its own: its next
+    drop time is only ever compared against the time a packet leaves, so it
+    runs off the departure events of the port.
+
+    Models with ECN enabled mark ECN capable packets rather than dropping
+    them, except when RED finds the average above the maximum threshold.
+    Probabilities are given in units of 1/AQM_PROBABILITY_ONE and queue
+    lengths in bytes. */
+
+#ifndef AQM_H
+#define AQM_H
+
+#include "../packet.h"
+#include "../port.h"
+
+#define AQM_PROBABILITY_ONE 65536
+#define AQM_COLORS 3
+
+struct aqm;
+
+typedef struct aqm * aqm_t;
+
+enum aqm_verdict {
+    AQM_PASS,
+    AQM_MARK,
+    AQM_DROP
+};
+
+typedef enum aqm_verdict aqm_verdict_t;
+
+struct aqm_red_profile {
+    unsigned int min_threshold;
+    unsigned int max_threshold;
+    unsigned int max_probability;
+};
+
+aqm_t create_red(const struct aqm_red_profile *profile, unsigned int weight_shift, unsigned int packet_time, int ecn);
+aqm_t create_wred(const struct aqm_red_profile profiles[AQM_COLORS], unsigned int weight_shift, unsigned int packet_time, int ecn);
+aqm_t create_ecn_threshold(unsigned int threshold);
+aqm_t create_codel(unsigned int target, unsigned int interval, int ecn);
+void free_aqm(aqm_t aqm);
+aqm_verdict_t aqm_enqueue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now);
+aqm_verdict_t aqm_dequeue(aqm_t aqm, packet_t packet, unsigned int queue_bytes, unsigned int now);
+void aqm_attach(aqm_t aqm, port_t port);
+unsigned int aqm_average(aqm_t aqm);
+unsigned long aqm_count(aqm_t aqm, aqm_verdict_t verdict);
+
+#endif
@@ -0,0 +1,265 @@
+/*  class_scheduler.c
+
+    Implementation of the strict priority, deficit round robin and weighted
+    round robin schedulers.
+
+    The round robin disciplines keep the class whose turn it is and whether
+    its turn has started, i.e. whether its quantum or weight has been
+    credited. When a turn ends the next class is the lowest set bit of the
+    mask at or above the following class, or failing that the lowest set
+    bit overall, which wraps the round. */
+
+#include "class_scheduler.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_QUANTUM 1500
+#define DEFAULT_WEIGHT 1
+
+struct class_queue {
+    packet_t head;
+    packet_t tail;
+    unsigned int packets;
+    unsigned int bytes;
+
+    /*  Quantum in bytes for DRR, packets per turn for WRR. */
+    unsigned int weight;
+
+    /*  Bytes (DRR) or packets (WRR) the class may still send this turn. */
+    unsigned int credit;
+};
+
+struct class_scheduler {
+    class_scheduling_mode_t mode;
+    unsigned int num_classes;
+
+    /*  Bit c set if class c holds packets. */
+    uint64_t active;
+
+    /*  Class whose turn it is, and whether its turn has started. */
+    unsigned int current;
+    int in_turn;
+
+    unsigned int size;
+    struct class_queue classes[CLASS_SCHEDULER_MAX_CLASSES];
+
+    /*  Series of peaks of the bytes waiting, class c in first_index + c. */
+    time_series_t queue_series;
+    unsigned int series_index;
+};
+
+/*  Forward declarations of helper functions. */
+static inline unsigned int class_scheduler_class(class_scheduler_t scheduler, packet_t packet);
+static inline packet_t class_scheduler_pop(class_scheduler_t scheduler, unsigned int class);
+static inline unsigned int class_scheduler_next(class_scheduler_t scheduler, unsigned int from);
+static void class_scheduler_port_enqueue(void *arg, packet_t packet, unsigned int now);
+static packet_t class_scheduler_port_dequeue(void *arg, unsigned int now);
+
+/*  Create a scheduler. Weights are the quanta in bytes for DRR and the
+    packets per turn for WRR, one per class; they are ignored for strict
+    priority and may be NULL for a quantum of 1500 bytes or a weight of one
+    packet for every class. */
+class_scheduler_t create_class_scheduler(class_scheduling_mode_t mode, unsigned int num_classes, const unsigned int *weights) {
+    assert(num_classes > 0);
+    assert(num_classes <= CLASS_SCHEDULER_MAX_CLASSES);
+
+    class_scheduler_t scheduler = malloc(sizeof(struct class_scheduler));
+    assert(scheduler);
+
+    scheduler->mode = mode;
+    scheduler->num_classes = num_classes;
+    scheduler->active = 0;
+    scheduler->current = 0;
+    scheduler->in_turn = 0;
+    scheduler->size = 0;
+    scheduler->queue_series = NULL;
+    scheduler->series_index = 0;
+
+    unsigned int class;
+    for (class = 0; class < num_classes; class++) {
+        struct class_queue *queue = &scheduler->classes[class];
+
+        queue->head = NULL;
+        queue->tail = NULL;
+        queue->packets = 0;
+        queue->bytes = 0;
+        queue->credit = 0;
+
+        if (weights) {
+            assert(weights[class] > 0);
+            queue->weight = weights[class];
+        } else {
+            queue->weight = mode == CLASS_SCHEDULE_DRR ? DEFAULT_QUANTUM : DEFAULT_WEIGHT;
+        }
+    }
+
+    return scheduler;
+}
+
+/*  Free the scheduler. Packets still queued are not freed since their
+    descriptors belong to whoever allocated them. */
+void free_class_scheduler(class_scheduler_t scheduler) {
+    assert(scheduler);
+
+    free(scheduler);
+}
+
+void class_scheduler_enqueue(class_scheduler_t scheduler, packet_t packet) {
+    unsigned int class = class_scheduler_class(scheduler, packet);
+    struct class_queue *queue = &scheduler->classes[class];
+
+    packet->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = packet;
+    } else {
+        queue->head = packet;
+    }
+    queue->tail = packet;
+
+    queue->packets = queue->packets + 1;
+    queue->bytes = queue->bytes + packet->length;
+    scheduler->size = scheduler->size + 1;
+    scheduler->active = scheduler->active | ((uint64_t) 1 << class);
+}
+
+/*  Remove and return the next packet to send, or NULL if there is none. */
+packet_t class_scheduler_dequeue(class_scheduler_t scheduler) {
+    if (scheduler->active == 0) {
+        return NULL;
+    }
+
+    if (scheduler->mode == CLASS_SCHEDULE_STRICT) {
+        return class_scheduler_pop(scheduler, __builtin_ctzll(scheduler->active));
+    }
+
+    for (;;) {
+        if (!scheduler->in_turn) {
+            scheduler->current = class_scheduler_next(scheduler, scheduler->current);
+            scheduler->classes[scheduler->current].credit += scheduler->classes[scheduler->current].weight;
+            scheduler->in_turn = 1;
+        }
+
+        unsigned int class = scheduler->current;
+        struct class_queue *queue = &scheduler->classes[class];
+        unsigned int cost = scheduler->mode == CLASS_SCHEDULE_DRR ? queue->head->length : 1;
+
+        if (cost <= queue->credit) {
+            packet_t packet = class_scheduler_pop(scheduler, class);
+
+            queue->credit = queue->credit - cost;
+
+            /*  An emptied class forfeits what is left of its credit, and a
+                WRR class that has used its weight ends its turn. */
+            if (queue->packets == 0 || queue->credit == 0) {
+                if (queue->packets == 0) {
+                    queue->credit = 0;
+                }
+                scheduler->in_turn = 0;
+                scheduler->current = class + 1;
+            }
+
+            return packet;
+        }
+
+        /*  The head packet does not fit in the deficit: carry the deficit
+            over to the next round and move on. */
+        scheduler->in_turn = 0;
+        scheduler->current = class + 1;
+    }
+}
+
+/*  Number of packets queued in a class. */
+unsigned int class_scheduler_packets(class_scheduler_t scheduler, unsigned int class) {
+    assert(class < scheduler->num_classes);
+
+    return scheduler->classes[class].packets;
+}
+
+/*  Bytes queued in a class. */
+unsigned int class_scheduler_bytes(class_scheduler_t scheduler, unsigned int class) {
+    assert(class < scheduler->num_classes);
+
+    return scheduler->classes[class].bytes;
+}
+
+/*  Number of packets queued in all classes. */
+unsigned int class_scheduler_size(class_scheduler_t scheduler) {
+    return scheduler->size;
+}
+
+/*  Let the scheduler hold the waiting packets of a port and choose the
+    order in which they are sent. */
+void class_scheduler_attach(class_scheduler_t scheduler, port_t port) {
+    port_set_scheduler(port, class_scheduler_port_enqueue, class_scheduler_port_dequeue, scheduler);
+}
+
+/*  Keep the bytes waiting in each class in queued, a series of peaks with
+    a series for every class from first_index on, or stop if queued is
+    NULL. Only a port the scheduler is attached to knows the time, so the
+    series are updated as packets the port hands over join and leave. */
+void class_scheduler_set_time_series(class_scheduler_t scheduler, time_series_t queued, unsigned int first_index) {
+    assert(scheduler);
+
+    scheduler->queue_series = queued;
+    scheduler->series_index = first_index;
+}
+
+/*  Helper functions. */
+
+/*  Class of a packet, the last one for priorities beyond it. */
+static inline unsigned int class_scheduler_class(class_scheduler_t scheduler, packet_t packet) {
+    return packet->priority < scheduler->num_classes ? packet->priority : scheduler->num_classes - 1;
+}
+
+static inline packet_t class_scheduler_pop(class_scheduler_t scheduler, unsigned int class) {
+    struct class_queue *queue = &scheduler->classes[class];
+    packet_t packet = queue->head;
+
+    queue->head = packet->next;
+    if (queue->head == NULL) {
+        queue->tail = NULL;
+        scheduler->active = scheduler->active & ~((uint64_t) 1 << class);
+    }
+    packet->next = NULL;
+
+    queue->packets = queue->packets - 1;
+    queue->bytes = queue->bytes - packet->length;
+    scheduler->size = scheduler->size - 1;
+
+    return packet;
+}
+
+/*  The first class holding packets at or after the given one, wrapping
+    round. There must be one. */
+static inline unsigned int class_scheduler_next(class_scheduler_t scheduler, unsigned int from) {
+    uint64_t later = from < CLASS_SCHEDULER_MAX_CLASSES ? scheduler->active & (~(uint64_t) 0 << from) : 0;
+
+    return __builtin_ctzll(later ? later : scheduler->active);
+}
+
+static void class_scheduler_port_enqueue(void *arg, packet_t packet, unsigned int now) {
+    class_scheduler_t scheduler = (class_scheduler_t) arg;
+
+    class_scheduler_enqueue(scheduler, packet);
+
+    if (scheduler->queue_series) {
+        unsigned int class = class_scheduler_class(scheduler, packet);
+        time_series_add(scheduler->queue_series, scheduler->series_index + class, now, scheduler->classes[class].bytes);
+    }
+}
+
+static packet_t class_scheduler_port_dequeue(void *arg, unsigned int now) {
+    class_scheduler_t scheduler = (class_scheduler_t) arg;
+    packet_t packet = class_scheduler_dequeue(scheduler);
+
+    if (packet && scheduler->queue_series) {
+        unsigned int class = class_scheduler_class(scheduler, packet);
+        time_series_add(scheduler->queue_series, scheduler->series_index + class, now, scheduler->classes[class].bytes);
+    }
+
+    return packet;
+}
@@ -0,0 +1,62 @@
+/*  class_scheduler.h
+
+    Egress schedulers over up to 64 traffic classes, each class holding a
+    FIFO of packets chained through their next pointers. A packet belongs to
+    the class given by its priority field, packets of higher priority values
+    than there are classes going to the last class.
+
+    Three disciplines are provided:
+
+    Strict priority - the lowest numbered class holding packets is always
+    served first.
+
+    Deficit round robin - classes take turns, each turn adding the quantum
+    of the class to its deficit and sending packets while the one at its
+    head fits within the deficit. Classes therefore share bandwidth in
+    proportion to their quanta whatever their packet sizes. A turn is only
+    guaranteed to send a packet if the quantum is at least the largest
+    packet size, which keeps every dequeue O(1).
+
+    Weighted round robin - classes take turns sending up to their weight in
+    packets.
+
+    Classes holding packets are tracked in a 64 bit mask, so the next class
+    to serve is found with a count of trailing zeroes rather than by
+    scanning empty classes. A scheduler can be attached to a port, whose
+    departure events then drive it. The bytes waiting in each class of a
+    scheduler driven by a port can be kept over time with
+    class_scheduler_set_time_series. */
+
+#ifndef CLASS_SCHEDULER_H
+#define CLASS_SCHEDULER_H
+
+#include "../packet.h"
+#include "../port.h"
+#include "../../stats/time_series.h"
+
+/*  Constant definitions. */
+#define CLASS_SCHEDULER_MAX_CLASSES 64
+
+struct class_scheduler;
+
+typedef struct class_scheduler * class_scheduler_t;
+
+enum class_scheduling_mode {
+    CLASS_SCHEDULE_STRICT,
+    CLASS_SCHEDULE_DRR,
+    CLASS_SCHEDULE_WRR
+};
+
+typedef enum class_scheduling_mode class_scheduling_mode_t;
+
+class_scheduler_t create_class_scheduler(class_scheduling_mode_t mode, unsigned int num_classes, const unsigned int *weights);
+void free_class_scheduler(class_scheduler_t scheduler);
+void class_scheduler_enqueue(class_scheduler_t scheduler, packet_t packet);
+packet_t class_scheduler_dequeue(class_scheduler_t scheduler);
+unsigned int class_scheduler_packets(class_scheduler_t scheduler, unsigned int class);
+unsigned int class_scheduler_bytes(class_scheduler_t scheduler, unsigned int class);
+unsigned int class_scheduler_size(class_scheduler_t scheduler);
+void class_scheduler_attach(class_scheduler_t scheduler, port_t port);
+void class_scheduler_set_time_series(class_scheduler_t scheduler, time_series_t queued, unsigned int first_index);
+
+#endif
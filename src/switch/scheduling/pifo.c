@@ -0,0 +1,369 @@
+/*  pifo.c
+
+    Implementation of PIFOs and PIFO scheduler trees.
+
+    A PIFO is a binary min heap in the manner of heap.c, specialised to
+    integer ranks so that comparisons are inlined rather than made through
+    a comparator function, and holding its entries by value so that a push
+    allocates nothing. Each entry carries a sequence number taken at the
+    push, which breaks ties between equal ranks in push order. Sequence
+    numbers are compared by their signed difference so that they may wrap.
+
+    Entries of a leaf of a tree hold a packet and entries of other nodes
+    hold the index of a child. */
+
+#include "pifo.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define DEFAULT_PIFO_CAPACITY 64
+#define DEFAULT_TREE_CAPACITY 8
+#define PIFO_TREE_NO_PARENT UINT32_MAX
+
+struct pifo_entry {
+    uint64_t rank;
+    uint32_t seq;
+    uint32_t child;
+    packet_t packet;
+};
+
+struct pifo {
+    struct pifo_entry *entries;
+    unsigned int size;
+    unsigned int capacity;
+    uint32_t next_seq;
+};
+
+struct pifo_tree_node {
+    pifo_t pifo;
+    unsigned int parent;
+    unsigned int num_children;
+    func_pifo_rank_t rank;
+    func_pifo_dequeued_t dequeued;
+    void *rank_arg;
+
+    /*  Bytes of the packets held by a leaf. */
+    unsigned int bytes;
+};
+
+struct pifo_tree {
+    struct pifo_tree_node *nodes;
+    unsigned int num_nodes;
+    unsigned int capacity;
+
+    func_pifo_classify_t classify;
+    void *classify_arg;
+
+    /*  Series of peaks of the bytes waiting, leaf n in first_index + n. */
+    time_series_t queue_series;
+    unsigned int series_index;
+};
+
+/*  Forward declarations of helper functions. */
+static inline int pifo_entry_before(const struct pifo_entry *a, const struct pifo_entry *b);
+static void pifo_push_entry(pifo_t pifo, packet_t packet, uint32_t child, uint64_t rank);
+static struct pifo_entry pifo_pop_entry(pifo_t pifo);
+static void pifo_tree_port_enqueue(void *arg, packet_t packet, unsigned int now);
+static packet_t pifo_tree_port_dequeue(void *arg, unsigned int now);
+
+pifo_t create_pifo(void) {
+    pifo_t pifo = malloc(sizeof(struct pifo));
+    assert(pifo);
+
+    pifo->entries = malloc(sizeof(struct pifo_entry) * DEFAULT_PIFO_CAPACITY);
+    assert(pifo->entries);
+    pifo->size = 0;
+    pifo->capacity = DEFAULT_PIFO_CAPACITY;
+    pifo->next_seq = 0;
+
+    return pifo;
+}
+
+/*  Free the PIFO. Packets still in it are not freed since their
+    descriptors belong to whoever allocated them. */
+void free_pifo(pifo_t pifo) {
+    assert(pifo);
+
+    free(pifo->entries);
+    free(pifo);
+}
+
+void pifo_push(pifo_t pifo, packet_t packet, uint64_t rank) {
+    assert(packet);
+
+    pifo_push_entry(pifo, packet, 0, rank);
+}
+
+/*  Remove and return the packet of lowest rank, NULL if empty. */
+packet_t pifo_pop(pifo_t pifo) {
+    if (pifo->size == 0) {
+        return NULL;
+    }
+
+    return pifo_pop_entry(pifo).packet;
+}
+
+packet_t pifo_peek(pifo_t pifo) {
+    return pifo->size == 0 ? NULL : pifo->entries[0].packet;
+}
+
+/*  Rank of the packet pifo_pop would return. The PIFO must not be empty. */
+uint64_t pifo_peek_rank(pifo_t pifo) {
+    assert(pifo->size > 0);
+
+    return pifo->entries[0].rank;
+}
+
+unsigned int pifo_size(pifo_t pifo) {
+    return pifo->size;
+}
+
+/*  Create a tree holding only its root, node 0, with the rank function and
+    dequeued function (which may be NULL) of the root. */
+pifo_tree_t create_pifo_tree(func_pifo_rank_t rank, func_pifo_dequeued_t dequeued, void *rank_arg) {
+    pifo_tree_t tree = malloc(sizeof(struct pifo_tree));
+    assert(tree);
+
+    tree->nodes = malloc(sizeof(struct pifo_tree_node) * DEFAULT_TREE_CAPACITY);
+    assert(tree->nodes);
+    tree->num_nodes = 0;
+    tree->capacity = DEFAULT_TREE_CAPACITY;
+    tree->classify = NULL;
+    tree->classify_arg = NULL;
+    tree->queue_series = NULL;
+    tree->series_index = 0;
+
+    pifo_tree_add_node(tree, PIFO_TREE_NO_PARENT, rank, dequeued, rank_arg);
+
+    return tree;
+}
+
+void free_pifo_tree(pifo_tree_t tree) {
+    assert(tree);
+
+    unsigned int i;
+    for (i = 0; i < tree->num_nodes; i++) {
+        free_pifo(tree->nodes[i].pifo);
+    }
+    free(tree->nodes);
+    free(tree);
+}
+
+/*  Add a node below an existing one and return its index. Nodes may only be
+    added while the tree is empty. */
+unsigned int pifo_tree_add_node(pifo_tree_t tree, unsigned int parent, func_pifo_rank_t rank, func_pifo_dequeued_t dequeued, void *rank_arg) {
+    assert(rank);
+    assert(parent == PIFO_TREE_NO_PARENT || parent < tree->num_nodes);
+    assert(tree->num_nodes == 0 || pifo_tree_size(tree) == 0);
+
+    if (parent != PIFO_TREE_NO_PARENT) {
+        unsigned int depth = 1;
+        unsigned int ancestor;
+        for (ancestor = parent; tree->nodes[ancestor].parent != PIFO_TREE_NO_PARENT; ancestor = tree->nodes[ancestor].parent) {
+            depth++;
+        }
+        assert(depth < PIFO_TREE_MAX_DEPTH);
+
+        tree->nodes[parent].num_children++;
+    }
+
+    if (tree->num_nodes == tree->capacity) {
+        tree->capacity = 2 * tree->capacity;
+        tree->nodes = realloc(tree->nodes, sizeof(struct pifo_tree_node) * tree->capacity);
+        assert(tree->nodes);
+    }
+
+    struct pifo_tree_node *node = &tree->nodes[tree->num_nodes];
+    node->pifo = create_pifo();
+    node->parent = parent;
+    node->num_children = 0;
+    node->rank = rank;
+    node->dequeued = dequeued;
+    node->rank_arg = rank_arg;
+    node->bytes = 0;
+
+    tree->num_nodes = tree->num_nodes + 1;
+
+    return tree->num_nodes - 1;
+}
+
+/*  Set the function choosing the leaf for each packet. Needed as soon as
+    the root has children. */
+void pifo_tree_set_classifier(pifo_tree_t tree, func_pifo_classify_t classify, void *classify_arg) {
+    tree->classify = classify;
+    tree->classify_arg = classify_arg;
+}
+
+/*  Push a packet to its leaf and a reference to each node on the path to
+    the root into the node above. */
+void pifo_tree_enqueue(pifo_tree_t tree, packet_t packet, unsigned int now) {
+    unsigned int node = 0;
+
+    if (tree->num_nodes > 1) {
+        assert(tree->classify);
+        node = tree->classify(tree->classify_arg, packet);
+        assert(node < tree->num_nodes);
+        assert(tree->nodes[node].num_children == 0);
+    }
+
+    struct pifo_tree_node *leaf = &tree->nodes[node];
+    pifo_push_entry(leaf->pifo, packet, 0, leaf->rank(leaf->rank_arg, packet, now));
+
+    leaf->bytes = leaf->bytes + packet->length;
+    if (tree->queue_series) {
+        time_series_add(tree->queue_series, tree->series_index + node, now, leaf->bytes);
+    }
+
+    while (tree->nodes[node].parent != PIFO_TREE_NO_PARENT) {
+        unsigned int parent = tree->nodes[node].parent;
+        struct pifo_tree_node *above = &tree->nodes[parent];
+
+        pifo_push_entry(above->pifo, NULL, node, above->rank(above->rank_arg, packet, now));
+        node = parent;
+    }
+}
+
+/*  Pop the root and follow the child references it leads to down to a
+    packet, or return NULL if the tree is empty. */
+packet_t pifo_tree_dequeue(pifo_tree_t tree, unsigned int now) {
+    unsigned int path[PIFO_TREE_MAX_DEPTH];
+    uint64_t ranks[PIFO_TREE_MAX_DEPTH];
+    unsigned int depth = 0;
+    unsigned int node = 0;
+
+    if (tree->nodes[0].pifo->size == 0) {
+        return NULL;
+    }
+
+    for (;;) {
+        struct pifo_entry entry = pifo_pop_entry(tree->nodes[node].pifo);
+
+        path[depth] = node;
+        ranks[depth] = entry.rank;
+        depth++;
+
+        if (entry.packet) {
+            struct pifo_tree_node *leaf = &tree->nodes[node];
+            unsigned int i;
+
+            leaf->bytes = leaf->bytes - entry.packet->length;
+            if (tree->queue_series) {
+                time_series_add(tree->queue_series, tree->series_index + node, now, leaf->bytes);
+            }
+
+            for (i = 0; i < depth; i++) {
+                struct pifo_tree_node *visited = &tree->nodes[path[i]];
+                if (visited->dequeued) {
+                    visited->dequeued(visited->rank_arg, entry.packet, ranks[i]);
+                }
+            }
+            return entry.packet;
+        }
+
+        node = entry.child;
+    }
+}
+
+/*  Number of packets held. */
+unsigned int pifo_tree_size(pifo_tree_t tree) {
+    return tree->nodes[0].pifo->size;
+}
+
+/*  Bytes of the packets held by a leaf. */
+unsigned int pifo_tree_bytes(pifo_tree_t tree, unsigned int node) {
+    assert(node < tree->num_nodes);
+
+    return tree->nodes[node].bytes;
+}
+
+/*  Let the tree hold the waiting packets of a port and choose the order in
+    which they are sent. */
+void pifo_tree_attach(pifo_tree_t tree, port_t port) {
+    port_set_scheduler(port, pifo_tree_port_enqueue, pifo_tree_port_dequeue, tree);
+}
+
+/*  Keep the bytes waiting at each leaf in queued, a series of peaks with a
+    series for every node from first_index on, or stop if queued is NULL.
+    The series of nodes that are not leaves stay empty. */
+void pifo_tree_set_time_series(pifo_tree_t tree, time_series_t queued, unsigned int first_index) {
+    assert(tree);
+
+    tree->queue_series = queued;
+    tree->series_index = first_index;
+}
+
+/*  Helper functions. */
+
+static inline int pifo_entry_before(const struct pifo_entry *a, const struct pifo_entry *b) {
+    return a->rank < b->rank || (a->rank == b->rank && (int32_t) (a->seq - b->seq) < 0);
+}
+
+/*  Add an entry at the end of the heap and move the hole it leaves up until
+    its parent ranks before it. */
+static void pifo_push_entry(pifo_t pifo, packet_t packet, uint32_t child, uint64_t rank) {
+    if (pifo->size == pifo->capacity) {
+        pifo->capacity = 2 * pifo->capacity;
+        pifo->entries = realloc(pifo->entries, sizeof(struct pifo_entry) * pifo->capacity);
+        assert(pifo->entries);
+    }
+
+    struct pifo_entry entry;
+    entry.rank = rank;
+    entry.seq = pifo->next_seq;
+    entry.child = child;
+    entry.packet = packet;
+    pifo->next_seq = pifo->next_seq + 1;
+
+    unsigned int index = pifo->size;
+    pifo->size = pifo->size + 1;
+
+    while (index > 0) {
+        unsigned int parent = (index - 1) / 2;
+        if (!pifo_entry_before(&entry, &pifo->entries[parent])) {
+            break;
+        }
+        pifo->entries[index] = pifo->entries[parent];
+        index = parent;
+    }
+    pifo->entries[index] = entry;
+}
+
+/*  Take the top entry, then move the hole it leaves down towards the
+    smaller child until the last entry fits in it. */
+static struct pifo_entry pifo_pop_entry(pifo_t pifo) {
+    assert(pifo->size > 0);
+
+    struct pifo_entry top = pifo->entries[0];
+    pifo->size = pifo->size - 1;
+
+    if (pifo->size > 0) {
+        struct pifo_entry last = pifo->entries[pifo->size];
+        unsigned int index = 0;
+        unsigned int child;
+
+        while ((child = 2 * index + 1) < pifo->size) {
+            if (child + 1 < pifo->size && pifo_entry_before(&pifo->entries[child + 1], &pifo->entries[child])) {
+                child = child + 1;
+            }
+            if (!pifo_entry_before(&pifo->entries[child], &last)) {
+                break;
+            }
+            pifo->entries[index] = pifo->entries[child];
+            index = child;
+        }
+        pifo->entries[index] = last;
+    }
+
+    return top;
+}
+
+static void pifo_tree_port_enqueue(void *arg, packet_t packet, unsigned int now) {
+    pifo_tree_enqueue((pifo_tree_t) arg, packet, now);
+}
+
+static packet_t pifo_tree_port_dequeue(void *arg, unsigned int now) {
+    return pifo_tree_dequeue((pifo_tree_t) arg, now);
+}
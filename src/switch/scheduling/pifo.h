@@ -0,0 +1,179 @@
+/*  pifo.h
+
+    Push-in first-out queues and programmable schedulers built from them.
+
+    A PIFO holds packets ordered by a rank chosen when each is pushed, and
+    always releases the packet of lowest rank, packets of equal rank leaving
+    in the order they were pushed. Scheduling algorithms are then expressed
+    by how ranks are computed: arrival time gives FIFO, a deadline gives EDF,
+    remaining flow size gives SRPT, a virtual start time gives weighted fair
+    queueing. Rank functions for these are defined below as inline
+    functions, so they can either be called directly before pifo_push or be
+    given to a scheduler tree.
+
+    A scheduler tree arranges PIFOs hierarchically, as in the PIFO paper by
+    Sivaraman et al. Packets are classified to a leaf of the tree, where
+    the packet itself is pushed with the rank given by the leaf, and every
+    ancestor pushes a reference to the child on the path with a rank of its
+    own. Dequeueing pops the root and follows the references down to a
+    leaf. A tree of one node is a plain PIFO scheduler, while for example a
+    root ranking by traffic class over leaves ranking by virtual time gives
+    strict priority between classes and fair queueing within them. A tree
+    can be attached to a port to take over its queue, and the bytes waiting
+    at each leaf kept over time with pifo_tree_set_time_series. */
+
+#ifndef PIFO_H
+#define PIFO_H
+
+#include "../packet.h"
+#include "../port.h"
+#include "../../stats/time_series.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define PIFO_TREE_MAX_DEPTH 8
+#define PIFO_STFQ_SCALE 1024
+
+struct pifo;
+
+typedef struct pifo * pifo_t;
+
+struct pifo_tree;
+
+typedef struct pifo_tree * pifo_tree_t;
+
+/*  A rank function gives the rank of a packet pushed at the given time. Its
+    first argument is the rank_arg given with it. */
+typedef uint64_t (*func_pifo_rank_t)(void *, packet_t, unsigned int);
+
+/*  Called when a packet leaves a node of a tree, with the rank it had at
+    that node. Used by rank functions that keep a virtual clock. */
+typedef void (*func_pifo_dequeued_t)(void *, packet_t, uint64_t);
+
+/*  Choose the leaf of a tree a packet is pushed to. */
+typedef unsigned int (*func_pifo_classify_t)(void *, packet_t);
+
+pifo_t create_pifo(void);
+void free_pifo(pifo_t pifo);
+void pifo_push(pifo_t pifo, packet_t packet, uint64_t rank);
+packet_t pifo_pop(pifo_t pifo);
+packet_t pifo_peek(pifo_t pifo);
+uint64_t pifo_peek_rank(pifo_t pifo);
+unsigned int pifo_size(pifo_t pifo);
+
+pifo_tree_t create_pifo_tree(func_pifo_rank_t rank, func_pifo_dequeued_t dequeued, void *rank_arg);
+void free_pifo_tree(pifo_tree_t tree);
+unsigned int pifo_tree_add_node(pifo_tree_t tree, unsigned int parent, func_pifo_rank_t rank, func_pifo_dequeued_t dequeued, void *rank_arg);
+void pifo_tree_set_classifier(pifo_tree_t tree, func_pifo_classify_t classify, void *classify_arg);
+void pifo_tree_enqueue(pifo_tree_t tree, packet_t packet, unsigned int now);
+packet_t pifo_tree_dequeue(pifo_tree_t tree, unsigned int now);
+unsigned int pifo_tree_size(pifo_tree_t tree);
+unsigned int pifo_tree_bytes(pifo_tree_t tree, unsigned int node);
+void pifo_tree_attach(pifo_tree_t tree, port_t port);
+void pifo_tree_set_time_series(pifo_tree_t tree, time_series_t queued, unsigned int first_index);
+
+/*  First in first out: the rank is the time of the push. */
+static inline uint64_t pifo_rank_fifo(void *arg, packet_t packet, unsigned int now) {
+    (void) arg;
+    (void) packet;
+
+    return now;
+}
+
+/*  Earliest deadline first, every packet being due a fixed budget after
+    it was created. The argument points to the budget. */
+static inline uint64_t pifo_rank_edf(void *arg, packet_t packet, unsigned int now) {
+    (void) now;
+
+    return (uint64_t) packet->created + *(const unsigned int *) arg;
+}
+
+/*  Least slack time first. Slack is the time left until the deadline less
+    the time still needed to send the packet, so with both counted from the
+    push the rank is the deadline less the transmission time at the rate
+    of the port. */
+struct pifo_lstf {
+    unsigned int budget;
+    unsigned int rate;
+};
+
+static inline uint64_t pifo_rank_lstf(void *arg, packet_t packet, unsigned int now) {
+    const struct pifo_lstf *lstf = (const struct pifo_lstf *) arg;
+    uint64_t deadline = (uint64_t) packet->created + lstf->budget;
+    uint64_t service = sim_transmission_time(packet->length, lstf->rate);
+
+    (void) now;
+
+    return deadline > service ? deadline - service : 0;
+}
+
+/*  Shortest remaining processing time. The caller keeps the bytes each flow
+    has left to send, indexed by flow identifier, and each packet is ranked
+    by what its flow had left before it. */
+struct pifo_srpt {
+    unsigned int *remaining;
+    unsigned int num_flows;
+};
+
+static inline uint64_t pifo_rank_srpt(void *arg, packet_t packet, unsigned int now) {
+    struct pifo_srpt *srpt = (struct pifo_srpt *) arg;
+    unsigned int *remaining = &srpt->remaining[packet->flow_id % srpt->num_flows];
+    uint64_t rank = *remaining;
+
+    (void) now;
+
+    *remaining = *remaining > packet->length ? *remaining - packet->length : 0;
+
+    return rank;
+}
+
+/*  Start-time fair queueing, the form of weighted fair queueing suited to
+    PIFOs. A packet starts at the later of the virtual time and the finish
+    of the previous packet of its flow, and finishes its length divided by
+    the weight of the flow later. The virtual time is the start of the last
+    packet dequeued, so pifo_stfq_dequeued must be given as the dequeued
+    function. Flows are indexed by flow identifier, and weights, which must
+    all be positive, may be NULL for equal shares. */
+struct pifo_stfq {
+    uint64_t virtual_time;
+    uint64_t *finish;
+    const unsigned int *weights;
+    unsigned int num_flows;
+};
+
+static inline uint64_t pifo_rank_stfq(void *arg, packet_t packet, unsigned int now) {
+    struct pifo_stfq *stfq = (struct pifo_stfq *) arg;
+    unsigned int flow = packet->flow_id % stfq->num_flows;
+    uint64_t start = stfq->finish[flow] > stfq->virtual_time ? stfq->finish[flow] : stfq->virtual_time;
+    unsigned int weight = stfq->weights ? stfq->weights[flow] : 1;
+
+    (void) now;
+
+    assert(weight > 0);
+
+    stfq->finish[flow] = start + (uint64_t) packet->length * PIFO_STFQ_SCALE / weight;
+
+    return start;
+}
+
+static inline void pifo_stfq_dequeued(void *arg, packet_t packet, uint64_t rank) {
+    struct pifo_stfq *stfq = (struct pifo_stfq *) arg;
+
+    (void) packet;
+
+    if (rank > stfq->virtual_time) {
+        stfq->virtual_time = rank;
+    }
+}
+
+/*  Strict priority by traffic class, 0 first. */
+static inline uint64_t pifo_rank_priority(void *arg, packet_t packet, unsigned int now) {
+    (void) arg;
+    (void) now;
+
+    return packet->priority;
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*  shaper.c
+
+    Implementation of token buckets, shapers and policers.
+
+    Bringing a bucket up to date adds rate tokens for every tick since the
+    last update, capped at the depth of the bucket. A packet larger than the
+    bucket could never conform, so instead any packet conforms once the
+    bucket is full, and sending it leaves the bucket in debt. */
+
+#include "shaper.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define TOKENS_PER_BYTE 8000
+
+struct shaper {
+    token_bucket_t bucket;
+
+    /*  FIFO of packets waiting for tokens. */
+    packet_t head;
+    packet_t tail;
+    unsigned int packets;
+
+    port_t port;
+    simulator_t sim;
+
+    /*  Fires when the packet at the head will conform. Only scheduled
+        while the head is blocked, and never more than once at a time. */
+    struct sim_event wakeup;
+    int wakeup_pending;
+    unsigned long wakeups;
+};
+
+struct policer {
+    token_bucket_t committed;
+    token_bucket_t peak;
+    unsigned long counts[3];
+};
+
+/*  Forward declarations of helper functions. */
+static inline void token_bucket_update(token_bucket_t *bucket, unsigned int now);
+static inline int64_t token_bucket_needed(const token_bucket_t *bucket, unsigned int bytes);
+static void shaper_enqueue(void *arg, packet_t packet, unsigned int now);
+static packet_t shaper_dequeue(void *arg, unsigned int now);
+static void shaper_woken(simulator_t sim, sim_event_t event);
+
+/*  Set up a full bucket. */
+void token_bucket_init(token_bucket_t *bucket, unsigned int rate, unsigned int burst, unsigned int now) {
+    assert(rate > 0);
+    assert(burst > 0);
+
+    bucket->depth = (int64_t) burst * TOKENS_PER_BYTE;
+    bucket->tokens = bucket->depth;
+    bucket->rate = rate;
+    bucket->last_update = now;
+}
+
+/*  Whether a packet of the given size may be sent now. */
+int token_bucket_conforms(token_bucket_t *bucket, unsigned int bytes, unsigned int now) {
+    token_bucket_update(bucket, now);
+
+    return bucket->tokens >= token_bucket_needed(bucket, bytes);
+}
+
+/*  Take the tokens for a packet, whether or not it conforms. */
+void token_bucket_consume(token_bucket_t *bucket, unsigned int bytes, unsigned int now) {
+    token_bucket_update(bucket, now);
+
+    bucket->tokens = bucket->tokens - (int64_t) bytes * TOKENS_PER_BYTE;
+}
+
+/*  Ticks until a packet of the given size conforms, 0 if it does now. */
+unsigned int token_bucket_wait(token_bucket_t *bucket, unsigned int bytes, unsigned int now) {
+    token_bucket_update(bucket, now);
+
+    int64_t missing = token_bucket_needed(bucket, bytes) - bucket->tokens;
+    if (missing <= 0) {
+        return 0;
+    }
+
+    return (unsigned int) ((missing + bucket->rate - 1) / bucket->rate);
+}
+
+/*  Whole bytes of tokens in the bucket, 0 while it is in debt. */
+unsigned int token_bucket_level(token_bucket_t *bucket, unsigned int now) {
+    token_bucket_update(bucket, now);
+
+    return bucket->tokens > 0 ? (unsigned int) (bucket->tokens / TOKENS_PER_BYTE) : 0;
+}
+
+/*  Create a shaper limiting a port to the given rate, with bursts of up to
+    burst bytes at the rate of the port itself. */
+shaper_t create_shaper(unsigned int rate, unsigned int burst) {
+    shaper_t shaper = malloc(sizeof(struct shaper));
+    assert(shaper);
+
+    token_bucket_init(&shaper->bucket, rate, burst, 0);
+    shaper->head = NULL;
+    shaper->tail = NULL;
+    shaper->packets = 0;
+    shaper->port = NULL;
+    shaper->sim = NULL;
+    sim_event_init(&shaper->wakeup, shaper_woken, shaper);
+    shaper->wakeup_pending = 0;
+    shaper->wakeups = 0;
+
+    return shaper;
+}
+
+/*  Free the shaper. Packets still queued are not freed since their
+    descriptors belong to whoever allocated them. The shaper must not have
+    a wake-up pending. */
+void free_shaper(shaper_t shaper) {
+    assert(shaper);
+    assert(!shaper->wakeup_pending);
+
+    free(shaper);
+}
+
+/*  Shape a port. The bucket starts full at the current time. */
+void shaper_attach(shaper_t shaper, port_t port, simulator_t sim) {
+    shaper->port = port;
+    shaper->sim = sim;
+    shaper->bucket.last_update = simulator_now(sim);
+
+    port_set_scheduler(port, shaper_enqueue, shaper_dequeue, shaper);
+}
+
+/*  Number of packets held back. */
+unsigned int shaper_packets(shaper_t shaper) {
+    return shaper->packets;
+}
+
+/*  Number of wake-up events the shaper has needed. */
+unsigned long shaper_wakeups(shaper_t shaper) {
+    return shaper->wakeups;
+}
+
+/*  Create a two-rate three-colour marker. Both buckets start full. */
+policer_t create_policer(unsigned int committed_rate, unsigned int committed_burst, unsigned int peak_rate, unsigned int peak_burst) {
+    assert(peak_rate >= committed_rate);
+
+    policer_t policer = malloc(sizeof(struct policer));
+    assert(policer);
+
+    token_bucket_init(&policer->committed, committed_rate, committed_burst, 0);
+    token_bucket_init(&policer->peak, peak_rate, peak_burst, 0);
+    policer->counts[POLICER_GREEN] = 0;
+    policer->counts[POLICER_YELLOW] = 0;
+    policer->counts[POLICER_RED] = 0;
+
+    return policer;
+}
+
+void free_policer(policer_t policer) {
+    assert(policer);
+
+    free(policer);
+}
+
+/*  Colour a packet, colour-blind, recording the colour in its flags. Red
+    packets exceed the peak rate and take no tokens, yellow ones exceed the
+    committed rate and take peak tokens only, and green ones take both. */
+policer_color_t policer_mark(policer_t policer, packet_t packet, unsigned int now) {
+    policer_color_t color;
+
+    if (!token_bucket_conforms(&policer->peak, packet->length, now)) {
+        color = POLICER_RED;
+    } else if (!token_bucket_conforms(&policer->committed, packet->length, now)) {
+        token_bucket_consume(&policer->peak, packet->length, now);
+        color = POLICER_YELLOW;
+    } else {
+        token_bucket_consume(&policer->peak, packet->length, now);
+        token_bucket_consume(&policer->committed, packet->length, now);
+        color = POLICER_GREEN;
+    }
+
+    packet->flags = packet->flags & ~PACKET_FLAG_COLOR_MASK;
+    if (color == POLICER_YELLOW) {
+        packet->flags = packet->flags | PACKET_FLAG_YELLOW;
+    } else if (color == POLICER_RED) {
+        packet->flags = packet->flags | PACKET_FLAG_RED;
+    }
+
+    policer->counts[color]++;
+
+    return color;
+}
+
+/*  Number of packets given a colour so far. */
+unsigned long policer_count(policer_t policer, policer_color_t color) {
+    return policer->counts[color];
+}
+
+/*  Helper functions. */
+
+static inline void token_bucket_update(token_bucket_t *bucket, unsigned int now) {
+    unsigned int elapsed = now - bucket->last_update;
+
+    bucket->last_update = now;
+    if (bucket->tokens >= bucket->depth) {
+        return;
+    }
+
+    /*  Both factors fit in 32 bits, so the product cannot overflow. */
+    uint64_t earned = (uint64_t) elapsed * bucket->rate;
+    uint64_t room = (uint64_t) (bucket->depth - bucket->tokens);
+
+    bucket->tokens = earned >= room ? bucket->depth : bucket->tokens + (int64_t) earned;
+}
+
+static inline int64_t token_bucket_needed(const token_bucket_t *bucket, unsigned int bytes) {
+    int64_t needed = (int64_t) bytes * TOKENS_PER_BYTE;
+
+    return needed < bucket->depth ? needed : bucket->depth;
+}
+
+static void shaper_enqueue(void *arg, packet_t packet, unsigned int now) {
+    shaper_t shaper = (shaper_t) arg;
+
+    (void) now;
+
+    packet->next = NULL;
+    if (shaper->tail) {
+        shaper->tail->next = packet;
+    } else {
+        shaper->head = packet;
+    }
+    shaper->tail = packet;
+    shaper->packets = shaper->packets + 1;
+}
+
+/*  Release the head packet if it conforms. Otherwise make sure the port
+    will be woken when it does. */
+static packet_t shaper_dequeue(void *arg, unsigned int now) {
+    shaper_t shaper = (shaper_t) arg;
+    packet_t packet = shaper->head;
+
+    if (packet == NULL) {
+        return NULL;
+    }
+
+    unsigned int wait = token_bucket_wait(&shaper->bucket, packet->length, now);
+    if (wait > 0) {
+        if (!shaper->wakeup_pending) {
+            shaper->wakeup_pending = 1;
+            shaper->wakeups = shaper->wakeups + 1;
+            simulator_schedule(shaper->sim, &shaper->wakeup, now + wait);
+        }
+        return NULL;
+    }
+
+    token_bucket_consume(&shaper->bucket, packet->length, now);
+
+    shaper->head = packet->next;
+    if (shaper->head == NULL) {
+        shaper->tail = NULL;
+    }
+    packet->next = NULL;
+    shaper->packets = shaper->packets - 1;
+
+    return packet;
+}
+
+static void shaper_woken(simulator_t sim, sim_event_t event) {
+    shaper_t shaper = (shaper_t) event->arg;
+
+    shaper->wakeup_pending = 0;
+    port_resume(shaper->port, sim);
+}
@@ -0,0 +1,74 @@
+/*  shaper.h
+
+    Token bucket shapers and two-rate three-colour policers.
+
+    Token buckets are never refilled by events. A bucket remembers its level
+    and when it was last brought up to date, and works out how many tokens
+    have accumulated since whenever it is asked. Shaping a port therefore
+    costs no events while packets conform, and a single wake-up event,
+    scheduled for the time the packet at the head will conform, while they
+    do not.
+
+    Rates are in bits per thousand ticks as for ports, and bucket sizes in
+    bytes.
+
+    The token bucket is a public structure so that models can embed one
+    wherever they need to meter something. The shaper holds a FIFO of
+    packets and is attached to a port as its scheduler, releasing packets
+    no faster than its rate allows. The policer implements the two-rate
+    three-colour marker of RFC 2698, colouring packets green, yellow or red
+    without delaying them. */
+
+#ifndef SHAPER_H
+#define SHAPER_H
+
+#include "../packet.h"
+#include "../port.h"
+
+#include <stdint.h>
+
+typedef struct token_bucket {
+    /*  Tokens are counted in thousandths of a bit, so that a rate in bits
+        per thousand ticks adds rate tokens per tick and no rounding is
+        ever needed. The level goes negative when a packet larger than the
+        bucket is sent. */
+    int64_t tokens;
+    int64_t depth;
+    unsigned int rate;
+    unsigned int last_update;
+} token_bucket_t;
+
+void token_bucket_init(token_bucket_t *bucket, unsigned int rate, unsigned int burst, unsigned int now);
+int token_bucket_conforms(token_bucket_t *bucket, unsigned int bytes, unsigned int now);
+void token_bucket_consume(token_bucket_t *bucket, unsigned int bytes, unsigned int now);
+unsigned int token_bucket_wait(token_bucket_t *bucket, unsigned int bytes, unsigned int now);
+unsigned int token_bucket_level(token_bucket_t *bucket, unsigned int now);
+
+struct shaper;
+
+typedef struct shaper * shaper_t;
+
+shaper_t create_shaper(unsigned int rate, unsigned int burst);
+void free_shaper(shaper_t shaper);
+void shaper_attach(shaper_t shaper, port_t port, simulator_t sim);
+unsigned int shaper_packets(shaper_t shaper);
+unsigned long shaper_wakeups(shaper_t shaper);
+
+struct policer;
+
+typedef struct policer * policer_t;
+
+enum policer_color {
+    POLICER_GREEN,
+    POLICER_YELLOW,
+    POLICER_RED
+};
+
+typedef enum policer_color policer_color_t;
+
+policer_t create_policer(unsigned int committed_rate, unsigned int committed_burst, unsigned int peak_rate, unsigned int peak_burst);
+void free_policer(policer_t policer);
+policer_color_t policer_mark(policer_t policer, packet_t packet, unsigned int now);
+unsigned long policer_count(policer_t policer, policer_color_t color);
+
+#endif
@@ -0,0 +1,506 @@
+/*  acl.c
+
+    Implementation of the HiCuts packet classifier.
+
+    Every node covers a box of header space whose side along each field is
+    a power of two and aligned to its size, starting from the whole space.
+    Cutting such a box into 2^c pieces along a field of width 2^b makes the
+    piece holding a value (value >> (b - c)) & (2^c - 1), without reference
+    to where the box starts, so nodes store no bounds at all.
+
+    Following the HiCuts heuristics, a node is cut along the field in which
+    its rules have the most distinct ranges, into as many pieces as keeps
+    the number of rule copies in the pieces plus the number of pieces below
+    ACL_SPACE_FACTOR times the number of rules of the node.
+
+    Leaves hold copies of their rules in priority order, as a lower bound
+    and a span per field, so matching a field is one unsigned comparison
+    of (value - low) against the span. */
+
+#include "acl.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define ACL_LEAF_RULES 8
+#define ACL_SPACE_FACTOR 4
+#define ACL_MAX_CUT_BITS 8
+#define ACL_MAX_DEPTH 32
+#define ACL_BATCH 16
+
+#define DEFAULT_NODE_CAPACITY 64
+#define DEFAULT_CHILD_CAPACITY 256
+#define DEFAULT_LEAF_CAPACITY 256
+
+/*  A node of the tree. For internal nodes base is the first of the child
+    indices and mask the number of pieces minus one; leaves are marked by a
+    field of ACL_FIELDS and hold count rules from base on. */
+struct acl_node {
+    uint32_t base;
+    uint32_t mask_or_count;
+    uint8_t field;
+    uint8_t shift;
+};
+
+struct acl_leaf_rule {
+    uint32_t low[ACL_FIELDS];
+    uint32_t span[ACL_FIELDS];
+    uint32_t action;
+};
+
+/*  The part of header space covered by a node. */
+struct acl_box {
+    uint32_t low[ACL_FIELDS];
+    unsigned int bits[ACL_FIELDS];
+};
+
+struct acl {
+    struct acl_node *nodes;
+    unsigned int num_nodes;
+    unsigned int node_capacity;
+
+    uint32_t *children;
+    unsigned int num_children;
+    unsigned int child_capacity;
+
+    struct acl_leaf_rule *leaf_rules;
+    unsigned int num_leaf_rules;
+    unsigned int leaf_capacity;
+
+    /*  Rules in priority order. */
+    acl_rule_t *rules;
+    unsigned int num_rules;
+    unsigned int depth;
+};
+
+/*  Forward declarations of helper functions. */
+static int acl_compare_keys(const void *a, const void *b);
+static unsigned int acl_build(acl_t acl, const struct acl_box *box, uint32_t *rules, unsigned int n, unsigned int depth);
+static unsigned int acl_build_leaf(acl_t acl, const struct acl_box *box, const uint32_t *rules, unsigned int n);
+static int acl_choose_field(acl_t acl, const struct acl_box *box, const uint32_t *rules, unsigned int n);
+static unsigned int acl_choose_cuts(acl_t acl, const struct acl_box *box, const uint32_t *rules, unsigned int n, unsigned int field);
+static inline uint32_t acl_box_high(const struct acl_box *box, unsigned int field);
+static inline int acl_overlaps(const acl_rule_t *rule, const struct acl_box *box);
+static inline int acl_covers(const acl_rule_t *rule, const struct acl_box *box, unsigned int field);
+static unsigned int acl_alloc_nodes(acl_t acl, unsigned int count);
+static unsigned int acl_alloc_children(acl_t acl, unsigned int count);
+static inline uint32_t acl_leaf_match(acl_t acl, const struct acl_node *node, const acl_header_t *header);
+
+/*  Compile a classifier from a set of rules. */
+acl_t create_acl(const acl_rule_t *rules, unsigned int n) {
+    acl_t acl = malloc(sizeof(struct acl));
+    assert(acl);
+
+    acl->node_capacity = DEFAULT_NODE_CAPACITY;
+    acl->nodes = malloc(acl->node_capacity * sizeof(struct acl_node));
+    assert(acl->nodes);
+    acl->num_nodes = 0;
+
+    acl->child_capacity = DEFAULT_CHILD_CAPACITY;
+    acl->children = malloc(acl->child_capacity * sizeof(uint32_t));
+    assert(acl->children);
+    acl->num_children = 0;
+
+    acl->leaf_capacity = DEFAULT_LEAF_CAPACITY;
+    acl->leaf_rules = malloc(acl->leaf_capacity * sizeof(struct acl_leaf_rule));
+    assert(acl->leaf_rules);
+    acl->num_leaf_rules = 0;
+
+    /*  Sort the rules by priority, keeping the given order among equal
+        priorities by sorting indices alongside. */
+    acl->rules = malloc((n > 0 ? n : 1) * sizeof(acl_rule_t));
+    assert(acl->rules);
+    acl->num_rules = n;
+    acl->depth = 0;
+
+    uint64_t *order = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    assert(order);
+    uint32_t *indices = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    assert(indices);
+
+    unsigned int i, field;
+    for (i = 0; i < n; i++) {
+        for (field = 0; field < ACL_FIELDS; field++) {
+            assert(rules[i].low[field] <= rules[i].high[field]);
+            assert(rules[i].high[field] <= acl_field_max((acl_field_t) field));
+        }
+        order[i] = (uint64_t) rules[i].priority << 32 | i;
+    }
+    qsort(order, n, sizeof(uint64_t), acl_compare_keys);
+
+    for (i = 0; i < n; i++) {
+        acl->rules[i] = rules[(uint32_t) order[i]];
+        indices[i] = i;
+    }
+    free(order);
+
+    struct acl_box box;
+    for (field = 0; field < ACL_FIELDS; field++) {
+        box.low[field] = 0;
+        box.bits[field] = 32 - __builtin_clz(acl_field_max((acl_field_t) field));
+    }
+
+    acl_build(acl, &box, indices, n, 0);
+    free(indices);
+
+    return acl;
+}
+
+void free_acl(acl_t acl) {
+    assert(acl);
+
+    free(acl->nodes);
+    free(acl->children);
+    free(acl->leaf_rules);
+    free(acl->rules);
+    free(acl);
+}
+
+/*  Action of the highest priority rule matching a header, or ACL_NO_MATCH
+    if none does. */
+uint32_t acl_classify(acl_t acl, const acl_header_t *header) {
+    const struct acl_node *node = &acl->nodes[0];
+
+    while (node->field < ACL_FIELDS) {
+        uint32_t piece = (header->fields[node->field] >> node->shift) & node->mask_or_count;
+        node = &acl->nodes[acl->children[node->base + piece]];
+    }
+
+    return acl_leaf_match(acl, node, header);
+}
+
+/*  Classify a vector of headers. The headers descend the tree together a
+    level at a time, prefetching the next node of each, and the rules of
+    every leaf reached are prefetched before any is searched. */
+void acl_classify_batch(acl_t acl, const acl_header_t *headers, uint32_t *actions, unsigned int n) {
+    const struct acl_node *nodes[ACL_BATCH];
+    unsigned int active[ACL_BATCH];
+    unsigned int start, i;
+
+    for (start = 0; start < n; start += ACL_BATCH) {
+        unsigned int count = n - start < ACL_BATCH ? n - start : ACL_BATCH;
+        const acl_header_t *batch = headers + start;
+        unsigned int num_active = count;
+
+        for (i = 0; i < count; i++) {
+            nodes[i] = &acl->nodes[0];
+            active[i] = i;
+        }
+
+        while (num_active > 0) {
+            unsigned int still_active = 0;
+            unsigned int a;
+
+            for (a = 0; a < num_active; a++) {
+                i = active[a];
+
+                const struct acl_node *node = nodes[i];
+                if (node->field < ACL_FIELDS) {
+                    uint32_t piece = (batch[i].fields[node->field] >> node->shift) & node->mask_or_count;
+                    nodes[i] = &acl->nodes[acl->children[node->base + piece]];
+                    active[still_active] = i;
+                    still_active = still_active + 1;
+                    __builtin_prefetch(nodes[i]);
+                } else {
+                    __builtin_prefetch(&acl->leaf_rules[node->base]);
+                }
+            }
+
+            num_active = still_active;
+        }
+
+        for (i = 0; i < count; i++) {
+            actions[start + i] = acl_leaf_match(acl, nodes[i], &batch[i]);
+        }
+    }
+}
+
+/*  Number of rules compiled. */
+unsigned int acl_rules(acl_t acl) {
+    return acl->num_rules;
+}
+
+/*  Number of nodes of the tree, internal and leaves. */
+unsigned int acl_nodes(acl_t acl) {
+    return acl->num_nodes;
+}
+
+/*  Number of internal nodes on the longest path from the root to a leaf. */
+unsigned int acl_depth(acl_t acl) {
+    return acl->depth;
+}
+
+/*  Helper functions. */
+
+static int acl_compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*  Build the subtree for a box from the indices of the rules overlapping
+    it, in priority order, and return the index of its root. */
+static unsigned int acl_build(acl_t acl, const struct acl_box *box, uint32_t *rules, unsigned int n, unsigned int depth) {
+    unsigned int i;
+
+    /*  Nothing after a rule covering the whole box can ever match in it. */
+    for (i = 0; i < n; i++) {
+        const acl_rule_t *rule = &acl->rules[rules[i]];
+        unsigned int field;
+
+        for (field = 0; field < ACL_FIELDS && acl_covers(rule, box, field); field++) {
+        }
+        if (field == ACL_FIELDS) {
+            n = i + 1;
+            break;
+        }
+    }
+
+    if (depth > acl->depth) {
+        acl->depth = depth;
+    }
+
+    int cut_field = n <= ACL_LEAF_RULES || depth == ACL_MAX_DEPTH ? -1 : acl_choose_field(acl, box, rules, n);
+    if (cut_field < 0) {
+        return acl_build_leaf(acl, box, rules, n);
+    }
+
+    unsigned int field = (unsigned int) cut_field;
+    unsigned int cut_bits = acl_choose_cuts(acl, box, rules, n, field);
+    unsigned int pieces = 1u << cut_bits;
+    unsigned int node = acl_alloc_nodes(acl, 1);
+    unsigned int base = acl_alloc_children(acl, pieces);
+
+    acl->nodes[node].base = base;
+    acl->nodes[node].mask_or_count = pieces - 1;
+    acl->nodes[node].field = (uint8_t) field;
+    acl->nodes[node].shift = (uint8_t) (box->bits[field] - cut_bits);
+
+    uint32_t *child_rules = malloc(n * sizeof(uint32_t));
+    assert(child_rules);
+    uint32_t *previous_rules = malloc(n * sizeof(uint32_t));
+    assert(previous_rules);
+    unsigned int previous_n = 0;
+    int previous_shareable = 0;
+
+    struct acl_box child_box = *box;
+    child_box.bits[field] = box->bits[field] - cut_bits;
+
+    unsigned int piece;
+    for (piece = 0; piece < pieces; piece++) {
+        unsigned int child_n = 0;
+        int shareable = 1;
+
+        child_box.low[field] = box->low[field] + ((uint32_t) piece << child_box.bits[field]);
+
+        for (i = 0; i < n; i++) {
+            const acl_rule_t *rule = &acl->rules[rules[i]];
+            if (acl_overlaps(rule, &child_box)) {
+                child_rules[child_n] = rules[i];
+                child_n = child_n + 1;
+                shareable = shareable && acl_covers(rule, &child_box, field);
+            }
+        }
+
+        /*  A piece may reuse the subtree of the piece before it if both
+            have the same rules and all of them span both pieces along the
+            cut field, since a subtree never looks at the bits that tell
+            the two apart. */
+        if (piece > 0 && shareable && previous_shareable && child_n == previous_n) {
+            for (i = 0; i < child_n && child_rules[i] == previous_rules[i]; i++) {
+            }
+            if (i == child_n) {
+                acl->children[base + piece] = acl->children[base + piece - 1];
+                continue;
+            }
+        }
+
+        unsigned int child = acl_build(acl, &child_box, child_rules, child_n, depth + 1);
+        acl->children[base + piece] = child;
+
+        for (i = 0; i < child_n; i++) {
+            previous_rules[i] = child_rules[i];
+        }
+        previous_n = child_n;
+        previous_shareable = shareable;
+    }
+
+    free(child_rules);
+    free(previous_rules);
+
+    return node;
+}
+
+static unsigned int acl_build_leaf(acl_t acl, const struct acl_box *box, const uint32_t *rules, unsigned int n) {
+    unsigned int node = acl_alloc_nodes(acl, 1);
+    unsigned int i, field;
+
+    while (acl->num_leaf_rules + n > acl->leaf_capacity) {
+        acl->leaf_capacity = acl->leaf_capacity * 2;
+        acl->leaf_rules = realloc(acl->leaf_rules, acl->leaf_capacity * sizeof(struct acl_leaf_rule));
+        assert(acl->leaf_rules);
+    }
+
+    acl->nodes[node].base = acl->num_leaf_rules;
+    acl->nodes[node].mask_or_count = n;
+    acl->nodes[node].field = ACL_FIELDS;
+    acl->nodes[node].shift = 0;
+
+    /*  Fields the leaf's box lies entirely within need not be checked, so
+        they are given the widest span. */
+    for (i = 0; i < n; i++) {
+        const acl_rule_t *rule = &acl->rules[rules[i]];
+        struct acl_leaf_rule *leaf_rule = &acl->leaf_rules[acl->num_leaf_rules + i];
+
+        for (field = 0; field < ACL_FIELDS; field++) {
+            if (acl_covers(rule, box, field)) {
+                leaf_rule->low[field] = 0;
+                leaf_rule->span[field] = UINT32_MAX;
+            } else {
+                leaf_rule->low[field] = rule->low[field];
+                leaf_rule->span[field] = rule->high[field] - rule->low[field];
+            }
+        }
+        leaf_rule->action = rule->action;
+    }
+    acl->num_leaf_rules = acl->num_leaf_rules + n;
+
+    return node;
+}
+
+/*  The field with the most distinct rule ranges within the box, or -1 if
+    no field can separate the rules. */
+static int acl_choose_field(acl_t acl, const struct acl_box *box, const uint32_t *rules, unsigned int n) {
+    uint64_t *ranges = malloc(n * sizeof(uint64_t));
+    assert(ranges);
+
+    int best_field = -1;
+    unsigned int best_distinct = 1;
+    unsigned int field, i;
+
+    for (field = 0; field < ACL_FIELDS; field++) {
+        if (box->bits[field] == 0) {
+            continue;
+        }
+
+        uint32_t box_low = box->low[field];
+        uint32_t box_high = acl_box_high(box, field);
+        for (i = 0; i < n; i++) {
+            const acl_rule_t *rule = &acl->rules[rules[i]];
+            uint32_t low = rule->low[field] > box_low ? rule->low[field] : box_low;
+            uint32_t high = rule->high[field] < box_high ? rule->high[field] : box_high;
+            ranges[i] = (uint64_t) low << 32 | high;
+        }
+        qsort(ranges, n, sizeof(uint64_t), acl_compare_keys);
+
+        unsigned int distinct = 1;
+        for (i = 1; i < n; i++) {
+            distinct = distinct + (ranges[i] != ranges[i - 1]);
+        }
+
+        if (distinct > best_distinct) {
+            best_distinct = distinct;
+            best_field = (int) field;
+        }
+    }
+
+    free(ranges);
+
+    return best_field;
+}
+
+/*  Number of bits to cut a field by: the most, up to ACL_MAX_CUT_BITS, for
+    which the pieces and the rule copies in them stay within the space
+    factor. At least one bit is always cut. */
+static unsigned int acl_choose_cuts(acl_t acl, const struct acl_box *box, const uint32_t *rules, unsigned int n, unsigned int field) {
+    unsigned int cut_bits = 1;
+    unsigned int i;
+
+    while (cut_bits < ACL_MAX_CUT_BITS && cut_bits < box->bits[field]) {
+        unsigned int shift = box->bits[field] - (cut_bits + 1);
+        uint32_t mask = (2u << cut_bits) - 1;
+        unsigned long space = 2ul << cut_bits;
+
+        for (i = 0; i < n; i++) {
+            const acl_rule_t *rule = &acl->rules[rules[i]];
+            uint32_t low = rule->low[field] > box->low[field] ? rule->low[field] : box->low[field];
+            uint32_t high = rule->high[field] < acl_box_high(box, field) ? rule->high[field] : acl_box_high(box, field);
+            space = space + ((high >> shift) & mask) - ((low >> shift) & mask) + 1;
+        }
+
+        if (space > (unsigned long) ACL_SPACE_FACTOR * n) {
+            break;
+        }
+        cut_bits = cut_bits + 1;
+    }
+
+    return cut_bits;
+}
+
+static inline uint32_t acl_box_high(const struct acl_box *box, unsigned int field) {
+    return box->low[field] + (uint32_t) ((1ull << box->bits[field]) - 1);
+}
+
+static inline int acl_overlaps(const acl_rule_t *rule, const struct acl_box *box) {
+    unsigned int field;
+
+    for (field = 0; field < ACL_FIELDS; field++) {
+        if (rule->high[field] < box->low[field] || rule->low[field] > acl_box_high(box, field)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*  Whether a rule spans the box along a field. */
+static inline int acl_covers(const acl_rule_t *rule, const struct acl_box *box, unsigned int field) {
+    return rule->low[field] <= box->low[field] && rule->high[field] >= acl_box_high(box, field);
+}
+
+static unsigned int acl_alloc_nodes(acl_t acl, unsigned int count) {
+    while (acl->num_nodes + count > acl->node_capacity) {
+        acl->node_capacity = acl->node_capacity * 2;
+        acl->nodes = realloc(acl->nodes, acl->node_capacity * sizeof(struct acl_node));
+        assert(acl->nodes);
+    }
+
+    unsigned int index = acl->num_nodes;
+    acl->num_nodes = acl->num_nodes + count;
+
+    return index;
+}
+
+static unsigned int acl_alloc_children(acl_t acl, unsigned int count) {
+    while (acl->num_children + count > acl->child_capacity) {
+        acl->child_capacity = acl->child_capacity * 2;
+        acl->children = realloc(acl->children, acl->child_capacity * sizeof(uint32_t));
+        assert(acl->children);
+    }
+
+    unsigned int index = acl->num_children;
+    acl->num_children = acl->num_children + count;
+
+    return index;
+}
+
+static inline uint32_t acl_leaf_match(acl_t acl, const struct acl_node *node, const acl_header_t *header) {
+    const struct acl_leaf_rule *rule = &acl->leaf_rules[node->base];
+    const struct acl_leaf_rule *end = rule + node->mask_or_count;
+
+    for (; rule < end; rule++) {
+        if (header->fields[ACL_SRC_ADDR] - rule->low[ACL_SRC_ADDR] <= rule->span[ACL_SRC_ADDR] &&
+            header->fields[ACL_DST_ADDR] - rule->low[ACL_DST_ADDR] <= rule->span[ACL_DST_ADDR] &&
+            header->fields[ACL_SRC_PORT] - rule->low[ACL_SRC_PORT] <= rule->span[ACL_SRC_PORT] &&
+            header->fields[ACL_DST_PORT] - rule->low[ACL_DST_PORT] <= rule->span[ACL_DST_PORT] &&
+            header->fields[ACL_PROTOCOL] - rule->low[ACL_PROTOCOL] <= rule->span[ACL_PROTOCOL]) {
+            return rule->action;
+        }
+    }
+
+    return ACL_NO_MATCH;
+}
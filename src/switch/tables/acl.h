@@ -0,0 +1,95 @@
+/*  acl.h
+
+    Packet classifier for ACL and QoS stages, matching the five fields of
+    an IPv4 header against rules made of one range per field.
+
+    Rule sets are compiled into a HiCuts decision tree. Every internal node
+    cuts the part of the header space it covers into a power of two equal
+    pieces along one field, so choosing a child is a shift and a mask, and
+    rules are copied into every piece they overlap. Once a piece overlaps
+    only a few rules it becomes a leaf, which is searched linearly. Rules
+    hidden in a piece by a higher priority rule covering all of it are
+    dropped, and identical neighbouring pieces share one subtree. The tree
+    is a flat array of nodes and child indices, so classifying a header
+    touches a handful of cache lines whatever the number of rules.
+
+    Among the rules matching a header the one with the lowest priority
+    value wins, and among equal priorities the one given first. A classifier
+    cannot be changed once compiled; a new one is compiled instead. */
+
+#ifndef ACL_H
+#define ACL_H
+
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define ACL_NO_MATCH UINT32_MAX
+
+typedef enum acl_field {
+    ACL_SRC_ADDR,
+    ACL_DST_ADDR,
+    ACL_SRC_PORT,
+    ACL_DST_PORT,
+    ACL_PROTOCOL,
+    ACL_FIELDS
+} acl_field_t;
+
+/*  A header, as the values of its fields. */
+typedef struct acl_header {
+    uint32_t fields[ACL_FIELDS];
+} acl_header_t;
+
+/*  A rule, matching headers whose fields all lie within the inclusive
+    ranges given. */
+typedef struct acl_rule {
+    uint32_t low[ACL_FIELDS];
+    uint32_t high[ACL_FIELDS];
+    uint32_t priority;
+    uint32_t action;
+} acl_rule_t;
+
+struct acl;
+
+typedef struct acl * acl_t;
+
+acl_t create_acl(const acl_rule_t *rules, unsigned int n);
+void free_acl(acl_t acl);
+uint32_t acl_classify(acl_t acl, const acl_header_t *header);
+void acl_classify_batch(acl_t acl, const acl_header_t *headers, uint32_t *actions, unsigned int n);
+unsigned int acl_rules(acl_t acl);
+unsigned int acl_nodes(acl_t acl);
+unsigned int acl_depth(acl_t acl);
+
+/*  Largest value of each field. */
+static inline uint32_t acl_field_max(acl_field_t field) {
+    return field == ACL_PROTOCOL ? 0xff : field >= ACL_SRC_PORT ? 0xffff : 0xffffffff;
+}
+
+/*  Start a rule matching every header. */
+static inline void acl_rule_init(acl_rule_t *rule, uint32_t priority, uint32_t action) {
+    unsigned int field;
+
+    for (field = 0; field < ACL_FIELDS; field++) {
+        rule->low[field] = 0;
+        rule->high[field] = acl_field_max((acl_field_t) field);
+    }
+    rule->priority = priority;
+    rule->action = action;
+}
+
+/*  Restrict an address field of a rule to a prefix. */
+static inline void acl_rule_prefix(acl_rule_t *rule, acl_field_t field, uint32_t prefix, unsigned int depth) {
+    uint32_t mask = depth == 0 ? 0 : 0xffffffffu << (32 - depth);
+
+    rule->low[field] = prefix & mask;
+    rule->high[field] = (prefix & mask) | ~mask;
+}
+
+/*  Restrict a field of a rule to a range, or a single value if low and
+    high are equal. */
+static inline void acl_rule_range(acl_rule_t *rule, acl_field_t field, uint32_t low, uint32_t high) {
+    rule->low[field] = low;
+    rule->high[field] = high;
+}
+
+#endif
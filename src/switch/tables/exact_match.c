@@ -0,0 +1,392 @@
+/*  exact_match.c
+
+    Implementation of the cuckoo hashed exact-match table.
+
+    A bucket is a cache line holding eight signatures followed by eight key
+    indices. Signatures are never zero, so a zero signature marks an empty
+    slot and finding one is the same vector compare as finding a key. The
+    keys themselves are stored once, by index, outside the buckets.
+
+    Both buckets and the signature of a key come from different bits of a
+    single 64 bit hash, which is recomputed from the stored key whenever a
+    key has to move to its other bucket. */
+
+#include "exact_match.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*  Constant definitions. */
+#define EXACT_MATCH_WAYS 8
+#define EXACT_MATCH_BATCH 32
+#define EXACT_MATCH_SEARCH 256
+#define EXACT_MATCH_CACHE_LINE 64
+#define EXACT_MATCH_NO_PARENT (-1)
+
+struct exact_match_bucket {
+    uint8_t signatures[EXACT_MATCH_WAYS];
+    uint32_t indices[EXACT_MATCH_WAYS];
+} __attribute__((aligned(EXACT_MATCH_CACHE_LINE)));
+
+/*  Where a key was hashed to. */
+struct exact_match_position {
+    uint32_t first;
+    uint32_t second;
+    uint8_t signature;
+};
+
+/*  A bucket reached by the search for room, and the slot of the parent
+    bucket whose key would move into it. */
+struct exact_match_step {
+    uint32_t bucket;
+    int parent;
+    unsigned int parent_slot;
+};
+
+struct exact_match {
+    struct exact_match_bucket *buckets;
+    uint32_t bucket_mask;
+
+    /*  Keys by index, and a stack of unused indices. */
+    exact_match_key_t *keys;
+    uint32_t *free_indices;
+    unsigned int num_free;
+    unsigned int capacity;
+};
+
+/*  Forward declarations of helper functions. */
+static inline struct exact_match_position exact_match_position(exact_match_t table, exact_match_key_t key);
+static inline unsigned int exact_match_signatures(const struct exact_match_bucket *bucket, uint8_t signature);
+static inline int exact_match_key_equal(exact_match_key_t a, exact_match_key_t b);
+static inline uint32_t exact_match_find(exact_match_t table, exact_match_key_t key, struct exact_match_position position);
+static uint32_t exact_match_insert_at(exact_match_t table, exact_match_key_t key, struct exact_match_position position);
+static int exact_match_make_room(exact_match_t table, struct exact_match_position position, uint32_t *bucket_out, unsigned int *slot_out);
+static inline uint32_t exact_match_other_bucket(exact_match_t table, uint32_t bucket, uint32_t index);
+
+/*  Create a table that holds up to capacity keys. */
+exact_match_t create_exact_match(unsigned int capacity) {
+    assert(capacity > 0);
+
+    exact_match_t table = malloc(sizeof(struct exact_match));
+    assert(table);
+
+    /*  Aim for buckets at most 80% full. */
+    unsigned int num_buckets = 2;
+    while ((unsigned long) num_buckets * EXACT_MATCH_WAYS * 4 < (unsigned long) capacity * 5) {
+        num_buckets = num_buckets * 2;
+    }
+
+    table->buckets = memalign(EXACT_MATCH_CACHE_LINE, num_buckets * sizeof(struct exact_match_bucket));
+    assert(table->buckets);
+    memset(table->buckets, 0, num_buckets * sizeof(struct exact_match_bucket));
+    table->bucket_mask = num_buckets - 1;
+
+    table->keys = malloc(capacity * sizeof(exact_match_key_t));
+    assert(table->keys);
+    table->free_indices = malloc(capacity * sizeof(uint32_t));
+    assert(table->free_indices);
+
+    /*  Hand out low indices first. */
+    unsigned int i;
+    for (i = 0; i < capacity; i++) {
+        table->free_indices[i] = capacity - 1 - i;
+    }
+    table->num_free = capacity;
+    table->capacity = capacity;
+
+    return table;
+}
+
+void free_exact_match(exact_match_t table) {
+    assert(table);
+
+    free(table->buckets);
+    free(table->keys);
+    free(table->free_indices);
+    free(table);
+}
+
+/*  Insert a key if it is not in the table yet and return its index, or
+    EXACT_MATCH_NONE if the table is full. */
+uint32_t exact_match_insert(exact_match_t table, exact_match_key_t key) {
+    return exact_match_insert_at(table, key, exact_match_position(table, key));
+}
+
+/*  Index of a key, or EXACT_MATCH_NONE if it is not in the table. */
+uint32_t exact_match_lookup(exact_match_t table, exact_match_key_t key) {
+    return exact_match_find(table, key, exact_match_position(table, key));
+}
+
+/*  Remove a key, freeing its index for reuse. Returns 0 if the key was not
+    in the table. */
+int exact_match_delete(exact_match_t table, exact_match_key_t key) {
+    struct exact_match_position position = exact_match_position(table, key);
+    uint32_t buckets[2] = { position.first, position.second };
+    unsigned int i;
+
+    for (i = 0; i < 2; i++) {
+        struct exact_match_bucket *bucket = &table->buckets[buckets[i]];
+        unsigned int matches = exact_match_signatures(bucket, position.signature);
+
+        while (matches) {
+            unsigned int slot = __builtin_ctz(matches);
+            uint32_t index = bucket->indices[slot];
+
+            if (exact_match_key_equal(table->keys[index], key)) {
+                bucket->signatures[slot] = 0;
+                table->free_indices[table->num_free] = index;
+                table->num_free = table->num_free + 1;
+                return 1;
+            }
+            matches = matches & (matches - 1);
+        }
+    }
+
+    return 0;
+}
+
+/*  Insert a vector of keys, storing the index of each or EXACT_MATCH_NONE
+    if it did not fit. The result is the same as inserting them one by one. */
+void exact_match_insert_batch(exact_match_t table, const exact_match_key_t *keys, uint32_t *indices, unsigned int n) {
+    struct exact_match_position positions[EXACT_MATCH_BATCH];
+    unsigned int start, i;
+
+    for (start = 0; start < n; start += EXACT_MATCH_BATCH) {
+        unsigned int count = n - start < EXACT_MATCH_BATCH ? n - start : EXACT_MATCH_BATCH;
+
+        for (i = 0; i < count; i++) {
+            positions[i] = exact_match_position(table, keys[start + i]);
+            __builtin_prefetch(&table->buckets[positions[i].first], 1);
+            __builtin_prefetch(&table->buckets[positions[i].second], 1);
+        }
+
+        for (i = 0; i < count; i++) {
+            indices[start + i] = exact_match_insert_at(table, keys[start + i], positions[i]);
+        }
+    }
+}
+
+/*  Look up a vector of keys. Both buckets of every key are prefetched, then
+    the key behind the first matching signature of each, before any key is
+    compared, so the cache misses of a whole batch overlap. */
+void exact_match_lookup_batch(exact_match_t table, const exact_match_key_t *keys, uint32_t *indices, unsigned int n) {
+    struct exact_match_position positions[EXACT_MATCH_BATCH];
+    unsigned int start, i;
+
+    for (start = 0; start < n; start += EXACT_MATCH_BATCH) {
+        unsigned int count = n - start < EXACT_MATCH_BATCH ? n - start : EXACT_MATCH_BATCH;
+
+        for (i = 0; i < count; i++) {
+            positions[i] = exact_match_position(table, keys[start + i]);
+            __builtin_prefetch(&table->buckets[positions[i].first]);
+            __builtin_prefetch(&table->buckets[positions[i].second]);
+        }
+
+        for (i = 0; i < count; i++) {
+            const struct exact_match_bucket *bucket = &table->buckets[positions[i].first];
+            unsigned int matches = exact_match_signatures(bucket, positions[i].signature);
+
+            if (matches) {
+                __builtin_prefetch(&table->keys[bucket->indices[__builtin_ctz(matches)]]);
+            }
+        }
+
+        for (i = 0; i < count; i++) {
+            indices[start + i] = exact_match_find(table, keys[start + i], positions[i]);
+        }
+    }
+}
+
+/*  Key stored at an index. */
+exact_match_key_t exact_match_key(exact_match_t table, uint32_t index) {
+    assert(index < table->capacity);
+
+    return table->keys[index];
+}
+
+/*  Number of keys in the table. */
+unsigned int exact_match_size(exact_match_t table) {
+    return table->capacity - table->num_free;
+}
+
+unsigned int exact_match_capacity(exact_match_t table) {
+    return table->capacity;
+}
+
+/*  Helper functions. */
+
+/*  Hash a key and split the hash into two buckets and a signature. */
+static inline struct exact_match_position exact_match_position(exact_match_t table, exact_match_key_t key) {
+    struct exact_match_position position;
+    uint64_t hash = key.words[0] * 0x9e3779b97f4a7c15ULL;
+
+    hash = (hash ^ (hash >> 32) ^ key.words[1]) * 0xff51afd7ed558ccdULL;
+    hash = (hash ^ (hash >> 29)) * 0xc4ceb9fe1a85ec53ULL;
+    hash = hash ^ (hash >> 32);
+
+    position.first = (uint32_t) hash & table->bucket_mask;
+    position.second = (uint32_t) (hash >> 24) & table->bucket_mask;
+    if (position.second == position.first) {
+        position.second = position.first ^ 1;
+    }
+    position.signature = (uint8_t) (hash >> 56);
+    if (position.signature == 0) {
+        position.signature = 1;
+    }
+
+    return position;
+}
+
+/*  Mask of the slots of a bucket holding a signature, bit i for slot i. */
+static inline unsigned int exact_match_signatures(const struct exact_match_bucket *bucket, uint8_t signature) {
+#if defined(__SSE2__)
+    __m128i signatures = _mm_loadl_epi64((const __m128i *) bucket->signatures);
+    __m128i equal = _mm_cmpeq_epi8(signatures, _mm_set1_epi8((char) signature));
+
+    return (unsigned int) _mm_movemask_epi8(equal) & 0xff;
+#else
+    /*  The same compare on the eight bytes of a 64 bit word: a byte of x is
+        zero exactly where the signatures match, and its top bit survives
+        the carry-free test below only if it is. */
+    uint64_t x;
+    memcpy(&x, bucket->signatures, sizeof(x));
+    x = x ^ (0x0101010101010101ULL * signature);
+
+    uint64_t zero = ~(((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | x | 0x7f7f7f7f7f7f7f7fULL);
+
+    return (unsigned int) (((zero >> 7) * 0x0102040810204080ULL) >> 56);
+#endif
+}
+
+static inline int exact_match_key_equal(exact_match_key_t a, exact_match_key_t b) {
+    return a.words[0] == b.words[0] && a.words[1] == b.words[1];
+}
+
+static inline uint32_t exact_match_find(exact_match_t table, exact_match_key_t key, struct exact_match_position position) {
+    const struct exact_match_bucket *bucket = &table->buckets[position.first];
+    unsigned int matches = exact_match_signatures(bucket, position.signature);
+
+    while (matches) {
+        uint32_t index = bucket->indices[__builtin_ctz(matches)];
+        if (exact_match_key_equal(table->keys[index], key)) {
+            return index;
+        }
+        matches = matches & (matches - 1);
+    }
+
+    bucket = &table->buckets[position.second];
+    matches = exact_match_signatures(bucket, position.signature);
+
+    while (matches) {
+        uint32_t index = bucket->indices[__builtin_ctz(matches)];
+        if (exact_match_key_equal(table->keys[index], key)) {
+            return index;
+        }
+        matches = matches & (matches - 1);
+    }
+
+    return EXACT_MATCH_NONE;
+}
+
+static uint32_t exact_match_insert_at(exact_match_t table, exact_match_key_t key, struct exact_match_position position) {
+    uint32_t index = exact_match_find(table, key, position);
+    if (index != EXACT_MATCH_NONE) {
+        return index;
+    }
+
+    if (table->num_free == 0) {
+        return EXACT_MATCH_NONE;
+    }
+
+    uint32_t bucket;
+    unsigned int slot;
+    if (!exact_match_make_room(table, position, &bucket, &slot)) {
+        return EXACT_MATCH_NONE;
+    }
+
+    table->num_free = table->num_free - 1;
+    index = table->free_indices[table->num_free];
+    table->keys[index] = key;
+    table->buckets[bucket].signatures[slot] = position.signature;
+    table->buckets[bucket].indices[slot] = index;
+
+    return index;
+}
+
+/*  Find an empty slot in either bucket of a key, moving other keys to their
+    other bucket if needed. The search is breadth first, so the chain of
+    moves is as short as possible, and nothing is moved unless a chain
+    ending in an empty slot is found. */
+static int exact_match_make_room(exact_match_t table, struct exact_match_position position, uint32_t *bucket_out, unsigned int *slot_out) {
+    struct exact_match_step steps[EXACT_MATCH_SEARCH];
+    unsigned int num_steps = 2;
+    unsigned int head;
+
+    steps[0].bucket = position.first;
+    steps[0].parent = EXACT_MATCH_NO_PARENT;
+    steps[1].bucket = position.second;
+    steps[1].parent = EXACT_MATCH_NO_PARENT;
+
+    for (head = 0; head < num_steps; head++) {
+        struct exact_match_bucket *bucket = &table->buckets[steps[head].bucket];
+        unsigned int empty = exact_match_signatures(bucket, 0);
+        unsigned int slot;
+
+        if (!empty) {
+            /*  Queue the other buckets of the keys here, unless they are
+                already on the path to this bucket. */
+            for (slot = 0; slot < EXACT_MATCH_WAYS && num_steps < EXACT_MATCH_SEARCH; slot++) {
+                uint32_t other = exact_match_other_bucket(table, steps[head].bucket, bucket->indices[slot]);
+                int ancestor = head;
+
+                while (ancestor != EXACT_MATCH_NO_PARENT && steps[ancestor].bucket != other) {
+                    ancestor = steps[ancestor].parent;
+                }
+                if (ancestor == EXACT_MATCH_NO_PARENT) {
+                    steps[num_steps].bucket = other;
+                    steps[num_steps].parent = head;
+                    steps[num_steps].parent_slot = slot;
+                    num_steps = num_steps + 1;
+                }
+            }
+            continue;
+        }
+
+        /*  Walk back to the bucket of the new key, moving each key along
+            the path into the slot freed before it. */
+        int step = head;
+        slot = __builtin_ctz(empty);
+
+        while (steps[step].parent != EXACT_MATCH_NO_PARENT) {
+            struct exact_match_bucket *to = &table->buckets[steps[step].bucket];
+            struct exact_match_bucket *from = &table->buckets[steps[steps[step].parent].bucket];
+            unsigned int from_slot = steps[step].parent_slot;
+
+            to->signatures[slot] = from->signatures[from_slot];
+            to->indices[slot] = from->indices[from_slot];
+            from->signatures[from_slot] = 0;
+
+            slot = from_slot;
+            step = steps[step].parent;
+        }
+
+        *bucket_out = steps[step].bucket;
+        *slot_out = slot;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*  The bucket other than the given one that the key at an index hashes to. */
+static inline uint32_t exact_match_other_bucket(exact_match_t table, uint32_t bucket, uint32_t index) {
+    struct exact_match_position position = exact_match_position(table, table->keys[index]);
+
+    return position.first == bucket ? position.second : position.first;
+}
@@ -0,0 +1,76 @@
+/*  exact_match.h
+
+    Exact-match table for MAC addresses, flow 5-tuples and other keys of up
+    to 16 bytes, using bucketized cuckoo hashing.
+
+    Every key has two candidate buckets of eight slots. A slot holds a one
+    byte signature taken from the hash of its key and the index of the key,
+    and the eight signatures of a bucket are compared against the one
+    looked for in a single vector instruction, so the key itself is only
+    read for slots whose signature matches. When both buckets of a new key
+    are full, a breadth first search looks for a chain of keys that can each
+    move to their other bucket to make room.
+
+    Keys are identified by an index below the capacity of the table, which
+    stays the same for as long as the key is in the table, however often it
+    moves between buckets. Switch models can keep per-entry state in arrays
+    of that size and store the index in events instead of the key.
+
+    The table is sized for its capacity when created and never grows;
+    inserting fails with EXACT_MATCH_NONE once it is full. */
+
+#ifndef EXACT_MATCH_H
+#define EXACT_MATCH_H
+
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define EXACT_MATCH_NONE UINT32_MAX
+
+/*  A key, padded with zeroes to 16 bytes. */
+typedef struct exact_match_key {
+    uint64_t words[2];
+} exact_match_key_t;
+
+struct exact_match;
+
+typedef struct exact_match * exact_match_t;
+
+exact_match_t create_exact_match(unsigned int capacity);
+void free_exact_match(exact_match_t table);
+uint32_t exact_match_insert(exact_match_t table, exact_match_key_t key);
+uint32_t exact_match_lookup(exact_match_t table, exact_match_key_t key);
+int exact_match_delete(exact_match_t table, exact_match_key_t key);
+void exact_match_insert_batch(exact_match_t table, const exact_match_key_t *keys, uint32_t *indices, unsigned int n);
+void exact_match_lookup_batch(exact_match_t table, const exact_match_key_t *keys, uint32_t *indices, unsigned int n);
+exact_match_key_t exact_match_key(exact_match_t table, uint32_t index);
+unsigned int exact_match_size(exact_match_t table);
+unsigned int exact_match_capacity(exact_match_t table);
+
+/*  Key of a 48 bit MAC address. */
+static inline exact_match_key_t exact_match_mac_key(uint64_t mac) {
+    exact_match_key_t key;
+
+    key.words[0] = mac & 0xffffffffffffULL;
+    key.words[1] = 0;
+
+    return key;
+}
+
+/*  Key of an IPv4 5-tuple. */
+static inline exact_match_key_t exact_match_flow_key(
+    uint32_t src_addr,
+    uint32_t dst_addr,
+    uint16_t src_port,
+    uint16_t dst_port,
+    uint8_t protocol
+) {
+    exact_match_key_t key;
+
+    key.words[0] = (uint64_t) src_addr << 32 | dst_addr;
+    key.words[1] = (uint64_t) src_port << 32 | (uint64_t) dst_port << 16 | protocol;
+
+    return key;
+}
+
+#endif
@@ -0,0 +1,470 @@
+/*  fib4.c
+
+    Implementation of the DIR-24-8 IPv4 FIB.
+
+    Table entries are laid out as follows:
+
+        bit 31      set if the entry points to a group of 256 entries
+        bits 24-29  length of the prefix the entry was filled from
+        bits 0-23   group index, or the next hop plus one
+
+    Storing the next hop plus one makes an all zero entry mean "no route",
+    so the tables can be allocated zeroed, and turns a lookup into
+    (value - 1) with no test for a missing route.
+
+    Adding a prefix overwrites the entries in its range that came from
+    prefixes no longer than itself. Removing one replaces the entries that
+    came from it with the longest remaining prefix covering it, found in a
+    hash table of the rules keyed by prefix and length. */
+
+#include "fib4.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define FIB4_TBL24_ENTRIES (1 << 24)
+#define FIB4_GROUP_ENTRIES 256
+#define FIB4_EXTENDED 0x80000000
+#define FIB4_VALUE_MASK 0x00ffffff
+#define FIB4_DEPTH_SHIFT 24
+#define FIB4_DEPTH_MASK 0x3f
+#define FIB4_BATCH 16
+
+#define DEFAULT_GROUP_CAPACITY 64
+#define DEFAULT_RULE_CAPACITY 1024
+#define FIB4_RULE_EMPTY UINT64_MAX
+
+/*  A rule, keyed by its length and prefix. */
+struct fib4_rule {
+    uint64_t key;
+    uint32_t next_hop;
+};
+
+struct fib4 {
+    uint32_t *tbl24;
+
+    /*  Groups of 256 entries for /24s holding longer prefixes, and a stack
+        of groups that have been freed. */
+    uint32_t *tbl8;
+    unsigned int num_groups;
+    unsigned int group_capacity;
+    unsigned int *free_groups;
+    unsigned int num_free_groups;
+
+    /*  Open addressing hash table of rules, with linear probing. */
+    struct fib4_rule *rules;
+    unsigned int rule_capacity;
+    unsigned int num_rules;
+};
+
+/*  A rule given to fib4_build. */
+struct fib4_build_rule {
+    uint32_t prefix;
+    unsigned int depth;
+    uint32_t next_hop;
+    unsigned int order;
+};
+
+/*  Forward declarations of helper functions. */
+static inline uint32_t fib4_mask(uint32_t prefix, unsigned int depth);
+static inline uint32_t fib4_entry(unsigned int depth, uint32_t next_hop);
+static inline unsigned int fib4_entry_depth(uint32_t entry);
+static void fib4_set_range(uint32_t *entries, unsigned int count, unsigned int depth, uint32_t entry, int exact);
+static unsigned int fib4_expand(fib4_t fib, unsigned int index);
+static void fib4_collapse(fib4_t fib, unsigned int index);
+static inline unsigned int fib4_rule_slot(fib4_t fib, uint64_t key);
+static void fib4_rule_set(fib4_t fib, uint64_t key, uint32_t next_hop);
+static int fib4_rule_find(fib4_t fib, uint64_t key, uint32_t *next_hop_out);
+static int fib4_rule_remove(fib4_t fib, uint64_t key);
+static int fib4_compare_depth(const void *a, const void *b);
+
+fib4_t create_fib4(void) {
+    fib4_t fib = malloc(sizeof(struct fib4));
+    assert(fib);
+
+    fib->tbl24 = calloc(FIB4_TBL24_ENTRIES, sizeof(uint32_t));
+    assert(fib->tbl24);
+
+    fib->num_groups = 0;
+    fib->group_capacity = DEFAULT_GROUP_CAPACITY;
+    fib->tbl8 = malloc(sizeof(uint32_t) * FIB4_GROUP_ENTRIES * fib->group_capacity);
+    fib->free_groups = malloc(sizeof(unsigned int) * fib->group_capacity);
+    fib->num_free_groups = 0;
+    assert(fib->tbl8 && fib->free_groups);
+
+    fib->rule_capacity = DEFAULT_RULE_CAPACITY;
+    fib->num_rules = 0;
+    fib->rules = malloc(sizeof(struct fib4_rule) * fib->rule_capacity);
+    assert(fib->rules);
+
+    unsigned int i;
+    for (i = 0; i < fib->rule_capacity; i++) {
+        fib->rules[i].key = FIB4_RULE_EMPTY;
+    }
+
+    return fib;
+}
+
+void free_fib4(fib4_t fib) {
+    assert(fib);
+
+    free(fib->tbl24);
+    free(fib->tbl8);
+    free(fib->free_groups);
+    free(fib->rules);
+    free(fib);
+}
+
+/*  Add a route, replacing any existing route for the same prefix. */
+void fib4_add(fib4_t fib, uint32_t prefix, unsigned int depth, uint32_t next_hop) {
+    assert(depth <= 32);
+    assert(next_hop < FIB4_MAX_NEXT_HOP);
+
+    prefix = fib4_mask(prefix, depth);
+    fib4_rule_set(fib, ((uint64_t) depth << 32) | prefix, next_hop);
+
+    uint32_t entry = fib4_entry(depth, next_hop);
+
+    if (depth <= 24) {
+        unsigned int first = prefix >> 8;
+        unsigned int count = 1u << (24 - depth);
+        unsigned int i;
+
+        for (i = first; i < first + count; i++) {
+            uint32_t current = fib->tbl24[i];
+
+            if (current & FIB4_EXTENDED) {
+                uint32_t *group = fib->tbl8 + (size_t) (current & FIB4_VALUE_MASK) * FIB4_GROUP_ENTRIES;
+                fib4_set_range(group, FIB4_GROUP_ENTRIES, depth, entry, 0);
+                fib4_collapse(fib, i);
+            } else if (fib4_entry_depth(current) <= depth) {
+                fib->tbl24[i] = entry;
+            }
+        }
+    } else {
+        unsigned int group = fib4_expand(fib, prefix >> 8);
+        uint32_t *entries = fib->tbl8 + (size_t) group * FIB4_GROUP_ENTRIES + (prefix & 0xff);
+
+        fib4_set_range(entries, 1u << (32 - depth), depth, entry, 0);
+    }
+}
+
+/*  Remove the route for a prefix. Returns 1 if it existed and 0
+    otherwise. */
+int fib4_delete(fib4_t fib, uint32_t prefix, unsigned int depth) {
+    assert(depth <= 32);
+
+    prefix = fib4_mask(prefix, depth);
+    if (!fib4_rule_remove(fib, ((uint64_t) depth << 32) | prefix)) {
+        return 0;
+    }
+
+    /*  Entries filled from the removed prefix fall back to the longest
+        prefix covering it, or to no route. */
+    uint32_t replacement = 0;
+    int d;
+    for (d = (int) depth - 1; d >= 0; d--) {
+        uint32_t next_hop;
+        if (fib4_rule_find(fib, ((uint64_t) d << 32) | fib4_mask(prefix, d), &next_hop)) {
+            replacement = fib4_entry(d, next_hop);
+            break;
+        }
+    }
+
+    if (depth <= 24) {
+        unsigned int first = prefix >> 8;
+        unsigned int count = 1u << (24 - depth);
+        unsigned int i;
+
+        for (i = first; i < first + count; i++) {
+            uint32_t current = fib->tbl24[i];
+
+            if (current & FIB4_EXTENDED) {
+                uint32_t *group = fib->tbl8 + (size_t) (current & FIB4_VALUE_MASK) * FIB4_GROUP_ENTRIES;
+                fib4_set_range(group, FIB4_GROUP_ENTRIES, depth, replacement, 1);
+                fib4_collapse(fib, i);
+            } else if (fib4_entry_depth(current) == depth) {
+                fib->tbl24[i] = replacement;
+            }
+        }
+    } else {
+        uint32_t current = fib->tbl24[prefix >> 8];
+        assert(current & FIB4_EXTENDED);
+
+        uint32_t *entries = fib->tbl8 + (size_t) (current & FIB4_VALUE_MASK) * FIB4_GROUP_ENTRIES + (prefix & 0xff);
+        fib4_set_range(entries, 1u << (32 - depth), depth, replacement, 1);
+        fib4_collapse(fib, prefix >> 8);
+    }
+
+    return 1;
+}
+
+/*  Add many routes at once. Adding them in order of increasing length means
+    that no entry is written more often than necessary. If a prefix appears
+    more than once the last occurrence wins, as with repeated fib4_add. */
+void fib4_build(fib4_t fib, const uint32_t *prefixes, const unsigned int *depths, const uint32_t *next_hops, unsigned int n) {
+    struct fib4_build_rule *sorted = malloc(sizeof(struct fib4_build_rule) * n);
+    assert(n == 0 || sorted);
+
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        sorted[i].prefix = prefixes[i];
+        sorted[i].depth = depths[i];
+        sorted[i].next_hop = next_hops[i];
+        sorted[i].order = i;
+    }
+
+    qsort(sorted, n, sizeof(struct fib4_build_rule), fib4_compare_depth);
+
+    for (i = 0; i < n; i++) {
+        fib4_add(fib, sorted[i].prefix, sorted[i].depth, sorted[i].next_hop);
+    }
+
+    free(sorted);
+}
+
+/*  Longest prefix match for one address. */
+uint32_t fib4_lookup(fib4_t fib, uint32_t address) {
+    uint32_t entry = fib->tbl24[address >> 8];
+
+    if (entry & FIB4_EXTENDED) {
+        entry = fib->tbl8[((size_t) (entry & FIB4_VALUE_MASK) << 8) | (address & 0xff)];
+    }
+
+    return (entry & FIB4_VALUE_MASK) - 1;
+}
+
+/*  Longest prefix match for a vector of addresses. The direct table entries
+    of a batch are all prefetched before any is read, then the group entries
+    that are needed, so that the cache misses of different addresses
+    overlap. */
+void fib4_lookup_batch(fib4_t fib, const uint32_t *addresses, uint32_t *next_hops, unsigned int n) {
+    uint32_t entries[FIB4_BATCH];
+    unsigned int start, i;
+
+    for (start = 0; start < n; start += FIB4_BATCH) {
+        unsigned int count = n - start < FIB4_BATCH ? n - start : FIB4_BATCH;
+        const uint32_t *batch = addresses + start;
+
+        for (i = 0; i < count; i++) {
+            __builtin_prefetch(&fib->tbl24[batch[i] >> 8]);
+        }
+
+        for (i = 0; i < count; i++) {
+            entries[i] = fib->tbl24[batch[i] >> 8];
+            if (entries[i] & FIB4_EXTENDED) {
+                __builtin_prefetch(&fib->tbl8[((size_t) (entries[i] & FIB4_VALUE_MASK) << 8) | (batch[i] & 0xff)]);
+            }
+        }
+
+        for (i = 0; i < count; i++) {
+            uint32_t entry = entries[i];
+            if (entry & FIB4_EXTENDED) {
+                entry = fib->tbl8[((size_t) (entry & FIB4_VALUE_MASK) << 8) | (batch[i] & 0xff)];
+            }
+            next_hops[start + i] = (entry & FIB4_VALUE_MASK) - 1;
+        }
+    }
+}
+
+/*  Number of routes. */
+unsigned int fib4_rules(fib4_t fib) {
+    return fib->num_rules;
+}
+
+/*  Number of 256 entry groups in use. */
+unsigned int fib4_groups_in_use(fib4_t fib) {
+    return fib->num_groups - fib->num_free_groups;
+}
+
+/*  Helper functions. */
+
+static inline uint32_t fib4_mask(uint32_t prefix, unsigned int depth) {
+    return depth == 0 ? 0 : prefix & (0xffffffffu << (32 - depth));
+}
+
+static inline uint32_t fib4_entry(unsigned int depth, uint32_t next_hop) {
+    return ((uint32_t) depth << FIB4_DEPTH_SHIFT) | (next_hop + 1);
+}
+
+static inline unsigned int fib4_entry_depth(uint32_t entry) {
+    return (entry >> FIB4_DEPTH_SHIFT) & FIB4_DEPTH_MASK;
+}
+
+/*  Overwrite entries filled from prefixes no longer than depth, or when
+    exact is set only those filled from prefixes of exactly that length. */
+static void fib4_set_range(uint32_t *entries, unsigned int count, unsigned int depth, uint32_t entry, int exact) {
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        unsigned int current = fib4_entry_depth(entries[i]);
+        if (exact ? current == depth : current <= depth) {
+            entries[i] = entry;
+        }
+    }
+}
+
+/*  Make sure a /24 has a group of its own, filled with its current entry,
+    and return the group index. */
+static unsigned int fib4_expand(fib4_t fib, unsigned int index) {
+    uint32_t current = fib->tbl24[index];
+
+    if (current & FIB4_EXTENDED) {
+        return current & FIB4_VALUE_MASK;
+    }
+
+    unsigned int group;
+    if (fib->num_free_groups > 0) {
+        fib->num_free_groups = fib->num_free_groups - 1;
+        group = fib->free_groups[fib->num_free_groups];
+    } else {
+        if (fib->num_groups == fib->group_capacity) {
+            fib->group_capacity = 2 * fib->group_capacity;
+            fib->tbl8 = realloc(fib->tbl8, sizeof(uint32_t) * FIB4_GROUP_ENTRIES * fib->group_capacity);
+            fib->free_groups = realloc(fib->free_groups, sizeof(unsigned int) * fib->group_capacity);
+            assert(fib->tbl8 && fib->free_groups);
+        }
+
+        group = fib->num_groups;
+        fib->num_groups = fib->num_groups + 1;
+    }
+
+    assert(group <= FIB4_VALUE_MASK);
+
+    uint32_t *entries = fib->tbl8 + (size_t) group * FIB4_GROUP_ENTRIES;
+    unsigned int i;
+    for (i = 0; i < FIB4_GROUP_ENTRIES; i++) {
+        entries[i] = current;
+    }
+
+    fib->tbl24[index] = FIB4_EXTENDED | group;
+
+    return group;
+}
+
+/*  Return the group of a /24 to the free stack if it no longer holds any
+    prefix longer than 24 bits and all its entries are the same. */
+static void fib4_collapse(fib4_t fib, unsigned int index) {
+    unsigned int group = fib->tbl24[index] & FIB4_VALUE_MASK;
+    uint32_t *entries = fib->tbl8 + (size_t) group * FIB4_GROUP_ENTRIES;
+    unsigned int i;
+
+    if (fib4_entry_depth(entries[0]) > 24) {
+        return;
+    }
+    for (i = 1; i < FIB4_GROUP_ENTRIES; i++) {
+        if (entries[i] != entries[0]) {
+            return;
+        }
+    }
+
+    fib->tbl24[index] = entries[0];
+    fib->free_groups[fib->num_free_groups] = group;
+    fib->num_free_groups = fib->num_free_groups + 1;
+}
+
+static inline unsigned int fib4_rule_slot(fib4_t fib, uint64_t key) {
+    return (unsigned int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (fib->rule_capacity - 1);
+}
+
+static void fib4_rule_set(fib4_t fib, uint64_t key, uint32_t next_hop) {
+    unsigned int mask = fib->rule_capacity - 1;
+    unsigned int slot = fib4_rule_slot(fib, key);
+
+    while (fib->rules[slot].key != FIB4_RULE_EMPTY) {
+        if (fib->rules[slot].key == key) {
+            fib->rules[slot].next_hop = next_hop;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    fib->rules[slot].key = key;
+    fib->rules[slot].next_hop = next_hop;
+    fib->num_rules = fib->num_rules + 1;
+
+    /*  Keep the table at most half full. */
+    if (2 * fib->num_rules > fib->rule_capacity) {
+        struct fib4_rule *old = fib->rules;
+        unsigned int old_capacity = fib->rule_capacity;
+        unsigned int i;
+
+        fib->rule_capacity = 2 * old_capacity;
+        fib->rules = malloc(sizeof(struct fib4_rule) * fib->rule_capacity);
+        assert(fib->rules);
+        for (i = 0; i < fib->rule_capacity; i++) {
+            fib->rules[i].key = FIB4_RULE_EMPTY;
+        }
+
+        fib->num_rules = 0;
+        for (i = 0; i < old_capacity; i++) {
+            if (old[i].key != FIB4_RULE_EMPTY) {
+                fib4_rule_set(fib, old[i].key, old[i].next_hop);
+            }
+        }
+
+        free(old);
+    }
+}
+
+static int fib4_rule_find(fib4_t fib, uint64_t key, uint32_t *next_hop_out) {
+    unsigned int mask = fib->rule_capacity - 1;
+    unsigned int slot = fib4_rule_slot(fib, key);
+
+    while (fib->rules[slot].key != FIB4_RULE_EMPTY) {
+        if (fib->rules[slot].key == key) {
+            *next_hop_out = fib->rules[slot].next_hop;
+            return 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return 0;
+}
+
+/*  Remove a rule, shifting back any later rules of the same probe sequence
+    so that no tombstones are needed. */
+static int fib4_rule_remove(fib4_t fib, uint64_t key) {
+    unsigned int mask = fib->rule_capacity - 1;
+    unsigned int slot = fib4_rule_slot(fib, key);
+
+    while (fib->rules[slot].key != key) {
+        if (fib->rules[slot].key == FIB4_RULE_EMPTY) {
+            return 0;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int hole = slot;
+    unsigned int next = (slot + 1) & mask;
+
+    while (fib->rules[next].key != FIB4_RULE_EMPTY) {
+        unsigned int home = fib4_rule_slot(fib, fib->rules[next].key);
+
+        /*  The rule at next may move into the hole unless its home slot
+            lies cyclically after the hole and at or before next. */
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            fib->rules[hole] = fib->rules[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    fib->rules[hole].key = FIB4_RULE_EMPTY;
+    fib->num_rules = fib->num_rules - 1;
+
+    return 1;
+}
+
+static int fib4_compare_depth(const void *a, const void *b) {
+    const struct fib4_build_rule *x = (const struct fib4_build_rule *) a;
+    const struct fib4_build_rule *y = (const struct fib4_build_rule *) b;
+
+    if (x->depth != y->depth) {
+        return (int) x->depth - (int) y->depth;
+    }
+    return x->order < y->order ? -1 : 1;
+}
@@ -0,0 +1,43 @@
+/*  fib4.h
+
+    IPv4 forwarding information base - longest prefix match from addresses
+    to next hops - using the DIR-24-8 layout.
+
+    The first 24 bits of an address index a table of 2^24 entries directly.
+    An entry either holds the answer for the whole /24, or, when longer
+    prefixes fall inside it, points to a group of 256 entries indexed by the
+    last 8 bits. A lookup is therefore one memory access, or two for the few
+    /24s that contain longer prefixes. Entries are 32 bits and record the
+    length of the prefix they came from, which is what allows prefixes to be
+    added and removed one at a time without rebuilding the table.
+
+    The direct table takes 64 MB of address space, but it is allocated zeroed
+    and only the pages covered by routes are ever touched.
+
+    Next hops are arbitrary values below FIB4_MAX_NEXT_HOP. Lookups for
+    addresses with no matching prefix return FIB4_NO_ROUTE. */
+
+#ifndef FIB4_H
+#define FIB4_H
+
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define FIB4_NO_ROUTE UINT32_MAX
+#define FIB4_MAX_NEXT_HOP 0x00ffffff
+
+struct fib4;
+
+typedef struct fib4 * fib4_t;
+
+fib4_t create_fib4(void);
+void free_fib4(fib4_t fib);
+void fib4_add(fib4_t fib, uint32_t prefix, unsigned int depth, uint32_t next_hop);
+int fib4_delete(fib4_t fib, uint32_t prefix, unsigned int depth);
+void fib4_build(fib4_t fib, const uint32_t *prefixes, const unsigned int *depths, const uint32_t *next_hops, unsigned int n);
+uint32_t fib4_lookup(fib4_t fib, uint32_t address);
+void fib4_lookup_batch(fib4_t fib, const uint32_t *addresses, uint32_t *next_hops, unsigned int n);
+unsigned int fib4_rules(fib4_t fib);
+unsigned int fib4_groups_in_use(fib4_t fib);
+
+#endif
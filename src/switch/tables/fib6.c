@@ -0,0 +1,579 @@
+/*  fib6.c
+
+    Implementation of the Poptrie IPv6 FIB.
+
+    The Poptrie is compiled from a binary trie of the routes (the RIB). For a
+    trie node covering the first offset bits of an address, each of its 64
+    children is found by walking 6 more bits down the RIB, remembering the
+    longest route passed on the way. If the RIB continues below that point
+    the child is an internal node, otherwise it is a leaf holding the
+    remembered route. Leaves hold the next hop plus one so that 0 means "no
+    route".
+
+    Nodes and leaves live in two arrays that only ever grow. Recompiling the
+    part of the trie below a node appends a new copy and abandons the old
+    one; the amount abandoned is tracked and the whole trie
+    is recompiled into fresh arrays when it exceeds the amount in use. */
+
+#include "fib6.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define FIB6_DIRECT_BITS 16
+#define FIB6_DIRECT_ENTRIES (1 << FIB6_DIRECT_BITS)
+#define FIB6_STRIDE 6
+#define FIB6_FANOUT 64
+#define FIB6_NODE_FLAG 0x80000000
+#define FIB6_BATCH 16
+
+#define DEFAULT_NODE_CAPACITY 1024
+#define DEFAULT_LEAF_CAPACITY 4096
+#define DEFAULT_RIB_CAPACITY 1024
+#define FIB6_RIB_NONE 0
+
+/*  A compiled trie node. Bit v of vector is set if child v is an internal
+    node, and bit v of leafvec is set if child v is a leaf starting a new run
+    of leaves with the same value. */
+struct poptrie_node {
+    uint64_t vector;
+    uint64_t leafvec;
+    uint32_t base0;
+    uint32_t base1;
+};
+
+/*  A node of the binary trie of routes. The root is node 0, so 0 also
+    marks a missing child. */
+struct fib6_rib_node {
+    uint32_t child[2];
+    uint32_t next_hop;
+};
+
+struct fib6 {
+    /*  Direct table. Entries with FIB6_NODE_FLAG set hold a node index,
+        others a leaf value. */
+    uint32_t *direct;
+
+    struct poptrie_node *nodes;
+    unsigned int num_nodes;
+    unsigned int node_capacity;
+
+    uint32_t *leaves;
+    unsigned int num_leaves;
+    unsigned int leaf_capacity;
+
+    /*  Nodes and leaves abandoned by partial recompiles. */
+    unsigned int garbage_nodes;
+    unsigned int garbage_leaves;
+
+    /*  The RIB, with a free list of nodes threaded through child[0]. */
+    struct fib6_rib_node *rib;
+    unsigned int rib_size;
+    unsigned int rib_capacity;
+    uint32_t rib_free;
+
+    unsigned int num_rules;
+};
+
+/*  Forward declarations of helper functions. */
+static inline unsigned int fib6_bit(fib6_address_t address, unsigned int bit);
+static inline unsigned int fib6_chunk(fib6_address_t address, unsigned int offset);
+static uint32_t fib6_rib_alloc(fib6_t fib);
+static void fib6_compile_all(fib6_t fib);
+static void fib6_compile_slot(fib6_t fib, unsigned int slot);
+static void fib6_compile_node(fib6_t fib, uint32_t rib_node, unsigned int offset, uint32_t inherited, unsigned int index);
+static unsigned int fib6_alloc_nodes(fib6_t fib, unsigned int count);
+static unsigned int fib6_alloc_leaves(fib6_t fib, unsigned int count);
+static void fib6_count_subtree(fib6_t fib, unsigned int index, unsigned int *nodes_out, unsigned int *leaves_out);
+static void fib6_update(fib6_t fib, fib6_address_t prefix, unsigned int depth);
+
+fib6_t create_fib6(void) {
+    fib6_t fib = malloc(sizeof(struct fib6));
+    assert(fib);
+
+    fib->direct = calloc(FIB6_DIRECT_ENTRIES, sizeof(uint32_t));
+    assert(fib->direct);
+
+    fib->num_nodes = 0;
+    fib->node_capacity = DEFAULT_NODE_CAPACITY;
+    fib->nodes = malloc(sizeof(struct poptrie_node) * fib->node_capacity);
+
+    fib->num_leaves = 0;
+    fib->leaf_capacity = DEFAULT_LEAF_CAPACITY;
+    fib->leaves = malloc(sizeof(uint32_t) * fib->leaf_capacity);
+
+    fib->garbage_nodes = 0;
+    fib->garbage_leaves = 0;
+
+    fib->rib_capacity = DEFAULT_RIB_CAPACITY;
+    fib->rib = malloc(sizeof(struct fib6_rib_node) * fib->rib_capacity);
+    assert(fib->nodes && fib->leaves && fib->rib);
+
+    fib->rib_size = 1;
+    fib->rib_free = FIB6_RIB_NONE;
+    fib->rib[0].child[0] = FIB6_RIB_NONE;
+    fib->rib[0].child[1] = FIB6_RIB_NONE;
+    fib->rib[0].next_hop = 0;
+
+    fib->num_rules = 0;
+
+    return fib;
+}
+
+void free_fib6(fib6_t fib) {
+    assert(fib);
+
+    free(fib->direct);
+    free(fib->nodes);
+    free(fib->leaves);
+    free(fib->rib);
+    free(fib);
+}
+
+/*  Add a route, replacing any existing route for the same prefix. */
+void fib6_add(fib6_t fib, fib6_address_t prefix, unsigned int depth, uint32_t next_hop) {
+    assert(depth <= 128);
+    assert(next_hop < FIB6_MAX_NEXT_HOP);
+
+    uint32_t node = 0;
+    unsigned int i;
+    for (i = 0; i < depth; i++) {
+        unsigned int bit = fib6_bit(prefix, i);
+        if (fib->rib[node].child[bit] == FIB6_RIB_NONE) {
+            uint32_t child = fib6_rib_alloc(fib);
+            fib->rib[node].child[bit] = child;
+        }
+        node = fib->rib[node].child[bit];
+    }
+
+    if (fib->rib[node].next_hop == 0) {
+        fib->num_rules = fib->num_rules + 1;
+    }
+    fib->rib[node].next_hop = next_hop + 1;
+
+    fib6_update(fib, prefix, depth);
+}
+
+/*  Remove the route for a prefix. Returns 1 if it existed and 0
+    otherwise. */
+int fib6_delete(fib6_t fib, fib6_address_t prefix, unsigned int depth) {
+    assert(depth <= 128);
+
+    uint32_t path[129];
+    uint32_t node = 0;
+    unsigned int i;
+
+    path[0] = 0;
+    for (i = 0; i < depth; i++) {
+        node = fib->rib[node].child[fib6_bit(prefix, i)];
+        if (node == FIB6_RIB_NONE) {
+            return 0;
+        }
+        path[i + 1] = node;
+    }
+
+    if (fib->rib[node].next_hop == 0) {
+        return 0;
+    }
+
+    fib->rib[node].next_hop = 0;
+    fib->num_rules = fib->num_rules - 1;
+
+    /*  Prune RIB nodes left with neither a route nor children, so that the
+        compiled trie does not grow internal nodes leading nowhere. */
+    for (i = depth; i > 0; i--) {
+        struct fib6_rib_node *current = &fib->rib[path[i]];
+        if (current->next_hop || current->child[0] != FIB6_RIB_NONE || current->child[1] != FIB6_RIB_NONE) {
+            break;
+        }
+
+        fib->rib[path[i - 1]].child[fib6_bit(prefix, i - 1)] = FIB6_RIB_NONE;
+        current->child[0] = fib->rib_free;
+        fib->rib_free = path[i];
+    }
+
+    fib6_update(fib, prefix, depth);
+
+    return 1;
+}
+
+/*  Add many routes and compile the trie once. */
+void fib6_build(fib6_t fib, const fib6_address_t *prefixes, const unsigned int *depths, const uint32_t *next_hops, unsigned int n) {
+    unsigned int r, i;
+
+    for (r = 0; r < n; r++) {
+        assert(depths[r] <= 128);
+        assert(next_hops[r] < FIB6_MAX_NEXT_HOP);
+
+        uint32_t node = 0;
+        for (i = 0; i < depths[r]; i++) {
+            unsigned int bit = fib6_bit(prefixes[r], i);
+            if (fib->rib[node].child[bit] == FIB6_RIB_NONE) {
+                uint32_t child = fib6_rib_alloc(fib);
+                fib->rib[node].child[bit] = child;
+            }
+            node = fib->rib[node].child[bit];
+        }
+
+        if (fib->rib[node].next_hop == 0) {
+            fib->num_rules = fib->num_rules + 1;
+        }
+        fib->rib[node].next_hop = next_hops[r] + 1;
+    }
+
+    fib6_compile_all(fib);
+}
+
+/*  Longest prefix match for one address. */
+uint32_t fib6_lookup(fib6_t fib, fib6_address_t address) {
+    uint32_t entry = fib->direct[address.high >> (64 - FIB6_DIRECT_BITS)];
+
+    if (!(entry & FIB6_NODE_FLAG)) {
+        return entry - 1;
+    }
+
+    const struct poptrie_node *node = &fib->nodes[entry & ~FIB6_NODE_FLAG];
+    unsigned int offset = FIB6_DIRECT_BITS;
+
+    while (1) {
+        unsigned int v = fib6_chunk(address, offset);
+        uint64_t below = ((uint64_t) 2 << v) - 1;
+
+        if (!((node->vector >> v) & 1)) {
+            return fib->leaves[node->base0 + __builtin_popcountll(node->leafvec & below) - 1] - 1;
+        }
+
+        node = &fib->nodes[node->base1 + __builtin_popcountll(node->vector & below) - 1];
+        offset = offset + FIB6_STRIDE;
+    }
+}
+
+/*  Longest prefix match for a vector of addresses. The lookups of a batch
+    advance one level at a time in lock step, prefetching the node each will
+    need at the next level, so that their cache misses overlap. */
+void fib6_lookup_batch(fib6_t fib, const fib6_address_t *addresses, uint32_t *next_hops, unsigned int n) {
+    unsigned int index[FIB6_BATCH];
+    unsigned int active[FIB6_BATCH];
+    unsigned int start, i;
+
+    for (start = 0; start < n; start += FIB6_BATCH) {
+        unsigned int count = n - start < FIB6_BATCH ? n - start : FIB6_BATCH;
+        const fib6_address_t *batch = addresses + start;
+        unsigned int num_active = 0;
+
+        for (i = 0; i < count; i++) {
+            __builtin_prefetch(&fib->direct[batch[i].high >> (64 - FIB6_DIRECT_BITS)]);
+        }
+
+        for (i = 0; i < count; i++) {
+            uint32_t entry = fib->direct[batch[i].high >> (64 - FIB6_DIRECT_BITS)];
+
+            if (entry & FIB6_NODE_FLAG) {
+                index[i] = entry & ~FIB6_NODE_FLAG;
+                active[num_active++] = i;
+                __builtin_prefetch(&fib->nodes[index[i]]);
+            } else {
+                next_hops[start + i] = entry - 1;
+            }
+        }
+
+        unsigned int offset = FIB6_DIRECT_BITS;
+        while (num_active > 0) {
+            unsigned int still_active = 0;
+            unsigned int a;
+
+            for (a = 0; a < num_active; a++) {
+                i = active[a];
+
+                const struct poptrie_node *node = &fib->nodes[index[i]];
+                unsigned int v = fib6_chunk(batch[i], offset);
+                uint64_t below = ((uint64_t) 2 << v) - 1;
+
+                if ((node->vector >> v) & 1) {
+                    index[i] = node->base1 + __builtin_popcountll(node->vector & below) - 1;
+                    active[still_active++] = i;
+                    __builtin_prefetch(&fib->nodes[index[i]]);
+                } else {
+                    next_hops[start + i] = fib->leaves[node->base0 + __builtin_popcountll(node->leafvec & below) - 1] - 1;
+                }
+            }
+
+            num_active = still_active;
+            offset = offset + FIB6_STRIDE;
+        }
+    }
+}
+
+/*  Number of routes. */
+unsigned int fib6_rules(fib6_t fib) {
+    return fib->num_rules;
+}
+
+/*  Number of compiled trie nodes in use, not counting abandoned ones. */
+unsigned int fib6_nodes_in_use(fib6_t fib) {
+    return fib->num_nodes - fib->garbage_nodes;
+}
+
+/*  Helper functions. */
+
+/*  Bit of an address, counting from the most significant. */
+static inline unsigned int fib6_bit(fib6_address_t address, unsigned int bit) {
+    if (bit < 64) {
+        return (unsigned int) (address.high >> (63 - bit)) & 1;
+    }
+    return (unsigned int) (address.low >> (127 - bit)) & 1;
+}
+
+/*  The 6 bits of an address starting at offset, padded with zeros past the
+    end of the address. */
+static inline unsigned int fib6_chunk(fib6_address_t address, unsigned int offset) {
+    if (offset + FIB6_STRIDE <= 64) {
+        return (unsigned int) (address.high >> (64 - FIB6_STRIDE - offset)) & (FIB6_FANOUT - 1);
+    }
+    if (offset < 64) {
+        return (unsigned int) ((address.high << (offset + FIB6_STRIDE - 64)) |
+            (address.low >> (128 - FIB6_STRIDE - offset))) & (FIB6_FANOUT - 1);
+    }
+    if (offset + FIB6_STRIDE <= 128) {
+        return (unsigned int) (address.low >> (128 - FIB6_STRIDE - offset)) & (FIB6_FANOUT - 1);
+    }
+    return (unsigned int) (address.low << (offset + FIB6_STRIDE - 128)) & (FIB6_FANOUT - 1);
+}
+
+static uint32_t fib6_rib_alloc(fib6_t fib) {
+    uint32_t node;
+
+    if (fib->rib_free != FIB6_RIB_NONE) {
+        node = fib->rib_free;
+        fib->rib_free = fib->rib[node].child[0];
+    } else {
+        if (fib->rib_size == fib->rib_capacity) {
+            fib->rib_capacity = 2 * fib->rib_capacity;
+            fib->rib = realloc(fib->rib, sizeof(struct fib6_rib_node) * fib->rib_capacity);
+            assert(fib->rib);
+        }
+        node = fib->rib_size;
+        fib->rib_size = fib->rib_size + 1;
+    }
+
+    fib->rib[node].child[0] = FIB6_RIB_NONE;
+    fib->rib[node].child[1] = FIB6_RIB_NONE;
+    fib->rib[node].next_hop = 0;
+
+    return node;
+}
+
+/*  Recompile the part of the trie affected by a prefix that has just been
+    added or removed. A prefix shorter than the direct table covers several
+    direct entries, each of which is recompiled. Otherwise only the deepest
+    existing node whose bits are all fixed by the prefix needs recompiling -
+    its children are compiled afresh and the node itself is rewritten in
+    place, so its parent is unaffected. */
+static void fib6_update(fib6_t fib, fib6_address_t prefix, unsigned int depth) {
+    unsigned int first = (unsigned int) (prefix.high >> (64 - FIB6_DIRECT_BITS));
+    unsigned int slot;
+
+    if (depth < FIB6_DIRECT_BITS) {
+        unsigned int count = 1u << (FIB6_DIRECT_BITS - depth);
+        first = first & ~(count - 1);
+
+        for (slot = first; slot < first + count; slot++) {
+            if (fib->direct[slot] & FIB6_NODE_FLAG) {
+                unsigned int nodes = 0;
+                unsigned int leaves = 0;
+                fib6_count_subtree(fib, fib->direct[slot] & ~FIB6_NODE_FLAG, &nodes, &leaves);
+                fib->garbage_nodes = fib->garbage_nodes + nodes;
+                fib->garbage_leaves = fib->garbage_leaves + leaves;
+            }
+            fib6_compile_slot(fib, slot);
+        }
+    } else if (!(fib->direct[first] & FIB6_NODE_FLAG)) {
+        fib6_compile_slot(fib, first);
+    } else {
+        unsigned int index = fib->direct[first] & ~FIB6_NODE_FLAG;
+        unsigned int offset = FIB6_DIRECT_BITS;
+
+        while (offset + FIB6_STRIDE <= depth) {
+            const struct poptrie_node *node = &fib->nodes[index];
+            unsigned int v = fib6_chunk(prefix, offset);
+
+            if (!((node->vector >> v) & 1)) {
+                break;
+            }
+
+            index = node->base1 + __builtin_popcountll(node->vector & (((uint64_t) 2 << v) - 1)) - 1;
+            offset = offset + FIB6_STRIDE;
+        }
+
+        /*  Everything below the node is abandoned, but not the node. */
+        unsigned int nodes = 0;
+        unsigned int leaves = 0;
+        fib6_count_subtree(fib, index, &nodes, &leaves);
+        fib->garbage_nodes = fib->garbage_nodes + nodes - 1;
+        fib->garbage_leaves = fib->garbage_leaves + leaves;
+
+        /*  Find the RIB node at the same depth, which may have been pruned,
+            and the longest route on the way to it. */
+        uint32_t rib_node = 0;
+        uint32_t best = fib->rib[0].next_hop;
+        unsigned int i;
+        for (i = 0; i < offset; i++) {
+            rib_node = fib->rib[rib_node].child[fib6_bit(prefix, i)];
+            if (rib_node == FIB6_RIB_NONE) {
+                break;
+            }
+            if (fib->rib[rib_node].next_hop) {
+                best = fib->rib[rib_node].next_hop;
+            }
+        }
+
+        fib6_compile_node(fib, rib_node, offset, best, index);
+    }
+
+    if (fib->garbage_nodes > fib->num_nodes - fib->garbage_nodes ||
+        fib->garbage_leaves > fib->num_leaves - fib->garbage_leaves) {
+        fib6_compile_all(fib);
+    }
+}
+
+/*  Compile the whole trie into empty arrays. */
+static void fib6_compile_all(fib6_t fib) {
+    fib->num_nodes = 0;
+    fib->num_leaves = 0;
+    fib->garbage_nodes = 0;
+    fib->garbage_leaves = 0;
+
+    unsigned int slot;
+    for (slot = 0; slot < FIB6_DIRECT_ENTRIES; slot++) {
+        fib6_compile_slot(fib, slot);
+    }
+}
+
+/*  Compile one direct table entry from the first 16 bits of the RIB. */
+static void fib6_compile_slot(fib6_t fib, unsigned int slot) {
+    uint32_t node = 0;
+    uint32_t best = fib->rib[0].next_hop;
+    unsigned int i;
+
+    for (i = 0; i < FIB6_DIRECT_BITS; i++) {
+        node = fib->rib[node].child[(slot >> (FIB6_DIRECT_BITS - 1 - i)) & 1];
+        if (node == FIB6_RIB_NONE) {
+            fib->direct[slot] = best;
+            return;
+        }
+        if (fib->rib[node].next_hop) {
+            best = fib->rib[node].next_hop;
+        }
+    }
+
+    if (fib->rib[node].child[0] == FIB6_RIB_NONE && fib->rib[node].child[1] == FIB6_RIB_NONE) {
+        fib->direct[slot] = best;
+        return;
+    }
+
+    unsigned int index = fib6_alloc_nodes(fib, 1);
+    fib6_compile_node(fib, node, FIB6_DIRECT_BITS, best, index);
+    fib->direct[slot] = FIB6_NODE_FLAG | index;
+}
+
+/*  Compile the trie node at the given index from the RIB node reached after
+    offset bits, given the longest route on the way there. The RIB node may
+    be missing, in which case every child is a leaf holding that route. */
+static void fib6_compile_node(fib6_t fib, uint32_t rib_node, unsigned int offset, uint32_t inherited, unsigned int index) {
+    uint32_t child_rib[FIB6_FANOUT];
+    uint32_t child_best[FIB6_FANOUT];
+    uint32_t runs[FIB6_FANOUT];
+    uint64_t vector = 0;
+    uint64_t leafvec = 0;
+    unsigned int num_runs = 0;
+    unsigned int v, i;
+
+    for (v = 0; v < FIB6_FANOUT; v++) {
+        uint32_t node = rib_node;
+        uint32_t best = inherited;
+
+        for (i = 0; i < FIB6_STRIDE && node != FIB6_RIB_NONE; i++) {
+            node = fib->rib[node].child[(v >> (FIB6_STRIDE - 1 - i)) & 1];
+            if (node != FIB6_RIB_NONE && fib->rib[node].next_hop) {
+                best = fib->rib[node].next_hop;
+            }
+        }
+
+        /*  Past the end of the address there is nothing left to match, so
+            anything still below becomes a leaf. */
+        if (node != FIB6_RIB_NONE && offset + FIB6_STRIDE < 128 &&
+            (fib->rib[node].child[0] != FIB6_RIB_NONE || fib->rib[node].child[1] != FIB6_RIB_NONE)) {
+            vector = vector | ((uint64_t) 1 << v);
+            child_rib[v] = node;
+            child_best[v] = best;
+        } else if (num_runs == 0 || runs[num_runs - 1] != best) {
+            leafvec = leafvec | ((uint64_t) 1 << v);
+            runs[num_runs++] = best;
+        }
+    }
+
+    unsigned int num_children = __builtin_popcountll(vector);
+    unsigned int base1 = fib6_alloc_nodes(fib, num_children);
+    unsigned int base0 = fib6_alloc_leaves(fib, num_runs);
+
+    for (i = 0; i < num_runs; i++) {
+        fib->leaves[base0 + i] = runs[i];
+    }
+
+    fib->nodes[index].vector = vector;
+    fib->nodes[index].leafvec = leafvec;
+    fib->nodes[index].base0 = base0;
+    fib->nodes[index].base1 = base1;
+
+    unsigned int child = base1;
+    for (v = 0; v < FIB6_FANOUT; v++) {
+        if ((vector >> v) & 1) {
+            fib6_compile_node(fib, child_rib[v], offset + FIB6_STRIDE, child_best[v], child);
+            child = child + 1;
+        }
+    }
+}
+
+static unsigned int fib6_alloc_nodes(fib6_t fib, unsigned int count) {
+    unsigned int first = fib->num_nodes;
+
+    while (fib->num_nodes + count > fib->node_capacity) {
+        fib->node_capacity = 2 * fib->node_capacity;
+        fib->nodes = realloc(fib->nodes, sizeof(struct poptrie_node) * fib->node_capacity);
+        assert(fib->nodes);
+    }
+
+    fib->num_nodes = fib->num_nodes + count;
+    assert(fib->num_nodes < FIB6_NODE_FLAG);
+
+    return first;
+}
+
+static unsigned int fib6_alloc_leaves(fib6_t fib, unsigned int count) {
+    unsigned int first = fib->num_leaves;
+
+    while (fib->num_leaves + count > fib->leaf_capacity) {
+        fib->leaf_capacity = 2 * fib->leaf_capacity;
+        fib->leaves = realloc(fib->leaves, sizeof(uint32_t) * fib->leaf_capacity);
+        assert(fib->leaves);
+    }
+
+    fib->num_leaves = fib->num_leaves + count;
+
+    return first;
+}
+
+static void fib6_count_subtree(fib6_t fib, unsigned int index, unsigned int *nodes_out, unsigned int *leaves_out) {
+    const struct poptrie_node *node = &fib->nodes[index];
+    unsigned int num_children = __builtin_popcountll(node->vector);
+    unsigned int i;
+
+    *nodes_out = *nodes_out + 1;
+    *leaves_out = *leaves_out + __builtin_popcountll(node->leafvec);
+
+    for (i = 0; i < num_children; i++) {
+        fib6_count_subtree(fib, node->base1 + i, nodes_out, leaves_out);
+    }
+}
@@ -0,0 +1,54 @@
+/*  fib6.h
+
+    IPv6 forwarding information base using a Poptrie - a multibit trie whose
+    nodes are compressed with population counts.
+
+    The first 16 bits of an address index a direct table. Below that, each
+    node of the trie consumes 6 bits and holds two 64 bit vectors instead of
+    64 pointers: one marking which of the 64 children are internal nodes and
+    one marking where runs of identical leaves begin. The children of a node
+    are stored contiguously, as are its leaves, so the position of any child
+    or leaf is the base of the node plus a population count of the vector
+    below the 6 bit value. Nodes are 24 bytes and leaves 4, which keeps even
+    large tables mostly in cache.
+
+    Routes are kept in a binary trie on the side from which the Poptrie is
+    compiled. fib6_build compiles the whole table once; fib6_add and
+    fib6_delete recompile only the part of the trie below the deepest node
+    that the prefix covers. Space left behind by recompiled parts is reclaimed by
+    a full recompile once it exceeds the space in use.
+
+    Next hops are arbitrary values below FIB6_MAX_NEXT_HOP. Lookups for
+    addresses with no matching prefix return FIB6_NO_ROUTE. */
+
+#ifndef FIB6_H
+#define FIB6_H
+
+#include <stdint.h>
+
+/*  Constant definitions. */
+#define FIB6_NO_ROUTE UINT32_MAX
+#define FIB6_MAX_NEXT_HOP 0x7fffffff
+
+/*  An IPv6 address as two 64 bit halves in host byte order, the first
+    holding the most significant bits. */
+typedef struct fib6_address {
+    uint64_t high;
+    uint64_t low;
+} fib6_address_t;
+
+struct fib6;
+
+typedef struct fib6 * fib6_t;
+
+fib6_t create_fib6(void);
+void free_fib6(fib6_t fib);
+void fib6_add(fib6_t fib, fib6_address_t prefix, unsigned int depth, uint32_t next_hop);
+int fib6_delete(fib6_t fib, fib6_address_t prefix, unsigned int depth);
+void fib6_build(fib6_t fib, const fib6_address_t *prefixes, const unsigned int *depths, const uint32_t *next_hops, unsigned int n);
+uint32_t fib6_lookup(fib6_t fib, fib6_address_t address);
+void fib6_lookup_batch(fib6_t fib, const fib6_address_t *addresses, uint32_t *next_hops, unsigned int n);
+unsigned int fib6_rules(fib6_t fib);
+unsigned int fib6_nodes_in_use(fib6_t fib);
+
+#endif
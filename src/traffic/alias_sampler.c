@@ -0,0 +1,364 @@
+/*  alias_sampler.c
+
+    Implementation of the alias method sampler.
+
+    The table holds, for every bucket, a 32 bit acceptance threshold and the
+    index of an alias bucket, packed into 8 bytes so that a sample touches a
+    single cache line. A raw 64 bit random value is split in two - the high
+    half chooses a bucket and the low half is compared with its threshold to
+    decide between the bucket and its alias. */
+
+#include "alias_sampler.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+/*  Constant definitions. */
+#define ALIAS_BATCH 256
+#define ALIAS_LINE_LENGTH 512
+#define ALIAS_DEFAULT_CDF_CAPACITY 64
+
+struct alias_entry {
+    uint32_t threshold;
+    uint32_t alias;
+};
+
+struct alias_sampler {
+    unsigned int n;
+    struct alias_entry *table;
+
+    /*  Value range covered by each bucket. NULL for samplers built from
+        weights, whose values are simply the bucket indices. */
+    double *lo;
+    double *hi;
+
+    double mean;
+};
+
+/*  Forward declarations of helper functions. */
+static alias_sampler_t alias_sampler_build(const double *weights, unsigned int n);
+static inline unsigned int alias_sampler_pick(alias_sampler_t sampler, uint64_t x);
+static inline double alias_sampler_value(alias_sampler_t sampler, unsigned int bucket, double u);
+
+/*  Build a sampler over the indices 0 .. n - 1 with probabilities
+    proportional to the given weights. */
+alias_sampler_t create_alias_sampler(const double *weights, unsigned int n) {
+    alias_sampler_t sampler = alias_sampler_build(weights, n);
+
+    double total = 0.0;
+    double weighted = 0.0;
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        total += weights[i];
+        weighted += weights[i] * i;
+    }
+    sampler->mean = weighted / total;
+
+    return sampler;
+}
+
+/*  Build a sampler from the points of an empirical CDF. Values must be
+    increasing and CDF values non-decreasing. The CDF is normalised by its
+    last value, so it need not end at exactly 1. */
+alias_sampler_t create_alias_sampler_from_cdf(const double *values, const double *cdf, unsigned int n) {
+    assert(n > 0);
+    assert(cdf[n - 1] > 0.0);
+
+    double *weights = malloc(sizeof(double) * n);
+    assert(weights);
+
+    unsigned int i;
+    weights[0] = cdf[0];
+    for (i = 1; i < n; i++) {
+        assert(values[i] >= values[i - 1]);
+        assert(cdf[i] >= cdf[i - 1]);
+        weights[i] = cdf[i] - cdf[i - 1];
+    }
+
+    alias_sampler_t sampler = alias_sampler_build(weights, n);
+
+    /*  The first point is a single value, every other bucket spans the gap
+        from the previous point. */
+    sampler->lo = malloc(sizeof(double) * n);
+    sampler->hi = malloc(sizeof(double) * n);
+    assert(sampler->lo && sampler->hi);
+
+    double weighted = 0.0;
+    for (i = 0; i < n; i++) {
+        sampler->lo[i] = i == 0 ? values[0] : values[i - 1];
+        sampler->hi[i] = values[i];
+        weighted += weights[i] * 0.5 * (sampler->lo[i] + sampler->hi[i]);
+    }
+    sampler->mean = weighted / cdf[n - 1];
+
+    free(weights);
+
+    return sampler;
+}
+
+/*  Build a sampler from a CDF file. Each non-empty line not starting with #
+    holds a value as its first number and the cumulative probability as its
+    last, so both "value cdf" and the three column "value count cdf" layouts
+    are accepted. Returns NULL if the file cannot be read or has no
+    points. */
+alias_sampler_t create_alias_sampler_from_cdf_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    unsigned int capacity = ALIAS_DEFAULT_CDF_CAPACITY;
+    unsigned int n = 0;
+    double *values = malloc(sizeof(double) * capacity);
+    double *cdf = malloc(sizeof(double) * capacity);
+    assert(values && cdf);
+
+    char line[ALIAS_LINE_LENGTH];
+    while (fgets(line, sizeof(line), file)) {
+        char *pos = line;
+        char *end;
+        double first = 0.0;
+        double last = 0.0;
+        int count = 0;
+
+        /*  Collect the first and last numbers on the line. */
+        while (1) {
+            double x = strtod(pos, &end);
+            if (end == pos) {
+                break;
+            }
+            if (count == 0) {
+                first = x;
+            }
+            last = x;
+            count = count + 1;
+            pos = end;
+        }
+
+        if (count < 2 || line[0] == '#') {
+            continue;
+        }
+
+        if (n == capacity) {
+            capacity = 2 * capacity;
+            values = realloc(values, sizeof(double) * capacity);
+            cdf = realloc(cdf, sizeof(double) * capacity);
+            assert(values && cdf);
+        }
+
+        values[n] = first;
+        cdf[n] = last;
+        n = n + 1;
+    }
+
+    fclose(file);
+
+    alias_sampler_t sampler = NULL;
+    if (n > 0 && cdf[n - 1] > 0.0) {
+        sampler = create_alias_sampler_from_cdf(values, cdf, n);
+    }
+
+    free(values);
+    free(cdf);
+
+    return sampler;
+}
+
+/*  Deep copy of a sampler, e.g. to give each thread a private table. */
+alias_sampler_t alias_sampler_clone(alias_sampler_t sampler) {
+    alias_sampler_t copy = malloc(sizeof(struct alias_sampler));
+    assert(copy);
+
+    *copy = *sampler;
+
+    copy->table = malloc(sizeof(struct alias_entry) * sampler->n);
+    assert(copy->table);
+    memcpy(copy->table, sampler->table, sizeof(struct alias_entry) * sampler->n);
+
+    if (sampler->lo) {
+        copy->lo = malloc(sizeof(double) * sampler->n);
+        copy->hi = malloc(sizeof(double) * sampler->n);
+        assert(copy->lo && copy->hi);
+        memcpy(copy->lo, sampler->lo, sizeof(double) * sampler->n);
+        memcpy(copy->hi, sampler->hi, sizeof(double) * sampler->n);
+    }
+
+    return copy;
+}
+
+void free_alias_sampler(alias_sampler_t sampler) {
+    assert(sampler);
+
+    free(sampler->table);
+    free(sampler->lo);
+    free(sampler->hi);
+    free(sampler);
+}
+
+/*  Number of buckets. */
+unsigned int alias_sampler_size(alias_sampler_t sampler) {
+    return sampler->n;
+}
+
+/*  Mean of the values produced by alias_sampler_sample_value. */
+double alias_sampler_mean(alias_sampler_t sampler) {
+    return sampler->mean;
+}
+
+/*  Draw a bucket index. */
+unsigned int alias_sampler_sample(alias_sampler_t sampler, rng_t rng) {
+    return alias_sampler_pick(sampler, rng_next_u64(rng));
+}
+
+/*  Draw a value - the bucket index for weight samplers, or a value within
+    the bucket's range for CDF samplers. */
+double alias_sampler_sample_value(alias_sampler_t sampler, rng_t rng) {
+    unsigned int bucket = alias_sampler_sample(sampler, rng);
+
+    if (sampler->lo == NULL) {
+        return (double) bucket;
+    }
+
+    return alias_sampler_value(sampler, bucket, rng_next_uniform(rng));
+}
+
+/*  Draw n bucket indices. */
+void alias_sampler_sample_batch(alias_sampler_t sampler, rng_t rng, unsigned int *out, unsigned int n) {
+    uint64_t raw[ALIAS_BATCH];
+    unsigned int done = 0;
+
+    while (done < n) {
+        unsigned int chunk = n - done < ALIAS_BATCH ? n - done : ALIAS_BATCH;
+        rng_fill_u64(rng, raw, chunk);
+
+        unsigned int i;
+        for (i = 0; i < chunk; i++) {
+            out[done + i] = alias_sampler_pick(sampler, raw[i]);
+        }
+
+        done = done + chunk;
+    }
+}
+
+/*  Draw n values. */
+void alias_sampler_sample_values(alias_sampler_t sampler, rng_t rng, double *out, unsigned int n) {
+    uint64_t raw[ALIAS_BATCH];
+    double u[ALIAS_BATCH];
+    unsigned int done = 0;
+
+    while (done < n) {
+        unsigned int chunk = n - done < ALIAS_BATCH ? n - done : ALIAS_BATCH;
+        rng_fill_u64(rng, raw, chunk);
+
+        unsigned int i;
+        if (sampler->lo == NULL) {
+            for (i = 0; i < chunk; i++) {
+                out[done + i] = (double) alias_sampler_pick(sampler, raw[i]);
+            }
+        } else {
+            rng_fill_uniform(rng, u, chunk);
+            for (i = 0; i < chunk; i++) {
+                unsigned int bucket = alias_sampler_pick(sampler, raw[i]);
+                out[done + i] = alias_sampler_value(sampler, bucket, u[i]);
+            }
+        }
+
+        done = done + chunk;
+    }
+}
+
+/*  Helper functions. */
+
+/*  Vose's algorithm. Weights are scaled so that they average 1, then each
+    under-full bucket is topped up from an over-full one, which becomes its
+    alias. Every bucket ends up with at most one alias. */
+static alias_sampler_t alias_sampler_build(const double *weights, unsigned int n) {
+    assert(weights);
+    assert(n > 0);
+
+    alias_sampler_t sampler = malloc(sizeof(struct alias_sampler));
+    assert(sampler);
+
+    sampler->n = n;
+    sampler->table = malloc(sizeof(struct alias_entry) * n);
+    sampler->lo = NULL;
+    sampler->hi = NULL;
+    sampler->mean = 0.0;
+    assert(sampler->table);
+
+    double total = 0.0;
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        assert(weights[i] >= 0.0);
+        total += weights[i];
+    }
+    assert(total > 0.0);
+
+    double *scaled = malloc(sizeof(double) * n);
+    unsigned int *small = malloc(sizeof(unsigned int) * n);
+    unsigned int *large = malloc(sizeof(unsigned int) * n);
+    assert(scaled && small && large);
+
+    unsigned int num_small = 0;
+    unsigned int num_large = 0;
+
+    for (i = 0; i < n; i++) {
+        scaled[i] = weights[i] * n / total;
+        if (scaled[i] < 1.0) {
+            small[num_small++] = i;
+        } else {
+            large[num_large++] = i;
+        }
+    }
+
+    while (num_small > 0 && num_large > 0) {
+        unsigned int s = small[--num_small];
+        unsigned int l = large[--num_large];
+
+        sampler->table[s].threshold = (uint32_t) (scaled[s] * 4294967296.0);
+        sampler->table[s].alias = l;
+
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0) {
+            small[num_small++] = l;
+        } else {
+            large[num_large++] = l;
+        }
+    }
+
+    /*  Whatever remains is full up to rounding error. Aliasing a bucket to
+        itself makes the threshold irrelevant. */
+    while (num_large > 0) {
+        unsigned int l = large[--num_large];
+        sampler->table[l].threshold = UINT32_MAX;
+        sampler->table[l].alias = l;
+    }
+    while (num_small > 0) {
+        unsigned int s = small[--num_small];
+        sampler->table[s].threshold = UINT32_MAX;
+        sampler->table[s].alias = s;
+    }
+
+    free(scaled);
+    free(small);
+    free(large);
+
+    return sampler;
+}
+
+/*  Map a raw random value to a bucket. */
+static inline unsigned int alias_sampler_pick(alias_sampler_t sampler, uint64_t x) {
+    unsigned int bucket = rng_to_below(x, sampler->n);
+    struct alias_entry entry = sampler->table[bucket];
+
+    return (uint32_t) x < entry.threshold ? bucket : entry.alias;
+}
+
+/*  Interpolate within a CDF bucket given a uniform in (0, 1]. */
+static inline double alias_sampler_value(alias_sampler_t sampler, unsigned int bucket, double u) {
+    return sampler->lo[bucket] + u * (sampler->hi[bucket] - sampler->lo[bucket]);
+}
@@ -0,0 +1,40 @@
+/*  alias_sampler.h
+
+    Constant time sampling from discrete distributions using Walker's alias
+    method (built with Vose's algorithm).
+
+    A sampler has n buckets. Drawing a sample takes one random number and one
+    table lookup regardless of n, compared with a binary search per sample
+    for inverse-CDF sampling. Samplers can be built from a vector of weights,
+    in which case the buckets are the indices 0 .. n - 1, or from an
+    empirical CDF file such as the web-search and data-mining flow size
+    distributions, in which case each bucket covers the range between two
+    adjacent points of the CDF and values are interpolated uniformly within
+    it.
+
+    A sampler is immutable once built, so one table can be shared between
+    threads with each thread supplying its own rng. alias_sampler_clone can
+    be used to give each thread a private copy of the table instead. */
+
+#ifndef ALIAS_SAMPLER_H
+#define ALIAS_SAMPLER_H
+
+#include "rng.h"
+
+struct alias_sampler;
+
+typedef struct alias_sampler * alias_sampler_t;
+
+alias_sampler_t create_alias_sampler(const double *weights, unsigned int n);
+alias_sampler_t create_alias_sampler_from_cdf(const double *values, const double *cdf, unsigned int n);
+alias_sampler_t create_alias_sampler_from_cdf_file(const char *path);
+alias_sampler_t alias_sampler_clone(alias_sampler_t sampler);
+void free_alias_sampler(alias_sampler_t sampler);
+unsigned int alias_sampler_size(alias_sampler_t sampler);
+double alias_sampler_mean(alias_sampler_t sampler);
+unsigned int alias_sampler_sample(alias_sampler_t sampler, rng_t rng);
+double alias_sampler_sample_value(alias_sampler_t sampler, rng_t rng);
+void alias_sampler_sample_batch(alias_sampler_t sampler, rng_t rng, unsigned int *out, unsigned int n);
+void alias_sampler_sample_values(alias_sampler_t sampler, rng_t rng, double *out, unsigned int n);
+
+#endif
@@ -0,0 +1,557 @@
+/*  pcap_source.c
+
+    Implementation of the memory mapped capture reader.
+
+    Both formats are handled by the same read loop. A classic pcap file is a
+    24 byte global header followed by records of a 16 byte header and the
+    frame. A pcapng file is a sequence of blocks, each starting with its type
+    and total length; only section headers, interface descriptions and
+    enhanced and simple packet blocks are interpreted, everything else is
+    skipped by its length. */
+
+#define _DEFAULT_SOURCE
+
+#include "pcap_source.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*  Constant definitions. */
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_GLOBAL_HEADER_LENGTH 24
+#define PCAP_RECORD_HEADER_LENGTH 16
+
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_SPB 0x00000003
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_TSRESOL 9
+
+#define LINKTYPE_ETHERNET 1
+
+/*  Size of the window of the mapping requested ahead of the read position
+    and released behind it. */
+#define PCAP_PREFETCH_WINDOW (4 * 1024 * 1024)
+
+#define DEFAULT_INTERFACE_CAPACITY 4
+
+enum pcap_format {
+    PCAP_CLASSIC,
+    PCAP_NG
+};
+
+/*  Per-interface information from a pcapng interface description block. */
+struct pcap_interface {
+    unsigned int linktype;
+
+    /*  Timestamp resolution - 10^-exponent seconds, or 2^-exponent if
+        binary is set. */
+    int binary;
+    unsigned int exponent;
+};
+
+struct pcap_source {
+    /*  The mapping. */
+    int fd;
+    const unsigned char *base;
+    size_t size;
+    size_t pos;
+
+    enum pcap_format format;
+
+    /*  Whether multi-byte fields are in the opposite byte order to the
+        host. */
+    int swapped;
+
+    /*  Interfaces. Classic pcap files have exactly one. */
+    struct pcap_interface *interfaces;
+    unsigned int num_interfaces;
+    unsigned int interface_capacity;
+
+    /*  Timestamp conversion. */
+    unsigned int ns_per_tick;
+    uint64_t first_ns;
+    int have_first;
+    unsigned int last_time;
+
+    object_pool_t packet_pool;
+
+    /*  Frame of the most recently produced packet, pointing into the
+        mapping. */
+    const unsigned char *frame;
+    unsigned int caplen;
+
+    /*  Bounds of the region currently advised as needed. */
+    size_t prefetched;
+    size_t released;
+
+    unsigned long packets;
+    unsigned long reordered;
+};
+
+/*  Forward declarations of helper functions. */
+static inline uint32_t pcap_read32(pcap_source_t source, size_t offset);
+static inline uint16_t pcap_read16(pcap_source_t source, size_t offset);
+static int pcap_parse_header(pcap_source_t source);
+static void pcap_add_interface(pcap_source_t source, unsigned int linktype, int binary, unsigned int exponent);
+static void pcap_parse_interface(pcap_source_t source, size_t body, size_t body_length);
+static int pcap_next_record(
+    pcap_source_t source,
+    uint64_t *ns_out,
+    unsigned int *length_out,
+    unsigned int *interface_out
+);
+static uint64_t pcap_to_ns(struct pcap_interface *interface, uint64_t ts);
+static void pcap_advise(pcap_source_t source);
+static unsigned int pcap_flow_hash(const unsigned char *frame, unsigned int caplen, unsigned int linktype);
+
+/*  Open and map a capture. Returns NULL if the file cannot be opened or is
+    not a recognised capture format. */
+pcap_source_t open_pcap_source(const char *path, unsigned int ns_per_tick, object_pool_t packet_pool) {
+    assert(ns_per_tick > 0);
+    assert(packet_pool);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < PCAP_GLOBAL_HEADER_LENGTH) {
+        close(fd);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    madvise(base, info.st_size, MADV_SEQUENTIAL);
+
+    pcap_source_t source = malloc(sizeof(struct pcap_source));
+    assert(source);
+
+    source->fd = fd;
+    source->base = (const unsigned char *) base;
+    source->size = info.st_size;
+    source->pos = 0;
+    source->swapped = 0;
+
+    source->interfaces = malloc(sizeof(struct pcap_interface) * DEFAULT_INTERFACE_CAPACITY);
+    assert(source->interfaces);
+    source->num_interfaces = 0;
+    source->interface_capacity = DEFAULT_INTERFACE_CAPACITY;
+
+    source->ns_per_tick = ns_per_tick;
+    source->first_ns = 0;
+    source->have_first = 0;
+    source->last_time = 0;
+
+    source->packet_pool = packet_pool;
+    source->frame = NULL;
+    source->caplen = 0;
+    source->prefetched = 0;
+    source->released = 0;
+    source->packets = 0;
+    source->reordered = 0;
+
+    if (!pcap_parse_header(source)) {
+        free_pcap_source(source);
+        return NULL;
+    }
+
+    pcap_advise(source);
+
+    return source;
+}
+
+/*  Unmap and free. Frames returned by pcap_source_frame become invalid. */
+void free_pcap_source(pcap_source_t source) {
+    assert(source);
+
+    munmap((void *) source->base, source->size);
+    close(source->fd);
+    free(source->interfaces);
+    free(source);
+}
+
+/*  Produce the next packet. Suitable for use as an event source next
+    function. Returns 0 at the end of the capture, on a truncated record or
+    once timestamps no longer fit in an unsigned int of ticks. */
+int pcap_source_next(void *source_ptr, unsigned int *time_out, void **packet_out) {
+    pcap_source_t source = (pcap_source_t) source_ptr;
+    uint64_t ns;
+    unsigned int length;
+    unsigned int interface;
+
+    if (!pcap_next_record(source, &ns, &length, &interface)) {
+        return 0;
+    }
+
+    if (!source->have_first) {
+        source->first_ns = ns;
+        source->have_first = 1;
+    }
+
+    /*  Keep times non-decreasing. */
+    uint64_t ticks = ns >= source->first_ns ?
+        (ns - source->first_ns) / source->ns_per_tick : 0;
+
+    if (ticks > UINT32_MAX) {
+        return 0;
+    }
+
+    unsigned int time = (unsigned int) ticks;
+    if (time < source->last_time) {
+        time = source->last_time;
+        source->reordered = source->reordered + 1;
+    }
+    source->last_time = time;
+
+    packet_t packet = packet_pool_alloc(source->packet_pool);
+    packet->id = (unsigned int) source->packets;
+    packet->length = length;
+    packet->ingress_port = interface;
+    packet->flow_id = pcap_flow_hash(
+        source->frame,
+        source->caplen,
+        source->interfaces[interface].linktype
+    );
+    packet->created = time;
+
+    source->packets = source->packets + 1;
+
+    pcap_advise(source);
+
+    *time_out = time;
+    *packet_out = packet;
+
+    return 1;
+}
+
+/*  Captured bytes of the most recently produced packet, pointing directly
+    into the mapping. */
+const unsigned char * pcap_source_frame(pcap_source_t source, unsigned int *caplen_out) {
+    *caplen_out = source->caplen;
+    return source->frame;
+}
+
+/*  Number of packets produced. */
+unsigned long pcap_source_packets(pcap_source_t source) {
+    return source->packets;
+}
+
+/*  Number of packets whose timestamps went backwards. */
+unsigned long pcap_source_reordered(pcap_source_t source) {
+    return source->reordered;
+}
+
+/*  Helper functions. */
+
+/*  Read little or big endian fields according to the file's byte order.
+    memcpy avoids unaligned accesses. */
+static inline uint32_t pcap_read32(pcap_source_t source, size_t offset) {
+    uint32_t x;
+    memcpy(&x, source->base + offset, sizeof(x));
+    return source->swapped ? __builtin_bswap32(x) : x;
+}
+
+static inline uint16_t pcap_read16(pcap_source_t source, size_t offset) {
+    uint16_t x;
+    memcpy(&x, source->base + offset, sizeof(x));
+    return source->swapped ? __builtin_bswap16(x) : x;
+}
+
+/*  Identify the format and byte order, and for classic pcap read the global
+    header. pcapng section headers are handled by the record loop. */
+static int pcap_parse_header(pcap_source_t source) {
+    uint32_t magic;
+    memcpy(&magic, source->base, sizeof(magic));
+
+    if (magic == PCAPNG_SHB) {
+        /*  The section header's type is a palindrome, so the byte order is
+            taken from the byte order magic that follows the length. */
+        uint32_t bom;
+        memcpy(&bom, source->base + 8, sizeof(bom));
+
+        if (bom == PCAPNG_BYTE_ORDER_MAGIC) {
+            source->swapped = 0;
+        } else if (__builtin_bswap32(bom) == PCAPNG_BYTE_ORDER_MAGIC) {
+            source->swapped = 1;
+        } else {
+            return 0;
+        }
+
+        source->format = PCAP_NG;
+        return 1;
+    }
+
+    int nanosecond;
+    if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC) {
+        source->swapped = 0;
+        nanosecond = magic == PCAP_MAGIC_NSEC;
+    } else if (__builtin_bswap32(magic) == PCAP_MAGIC_USEC ||
+        __builtin_bswap32(magic) == PCAP_MAGIC_NSEC) {
+        source->swapped = 1;
+        nanosecond = __builtin_bswap32(magic) == PCAP_MAGIC_NSEC;
+    } else {
+        return 0;
+    }
+
+    source->format = PCAP_CLASSIC;
+    pcap_add_interface(source, pcap_read32(source, 20) & 0xffff, 0, nanosecond ? 9 : 6);
+    source->pos = PCAP_GLOBAL_HEADER_LENGTH;
+
+    return 1;
+}
+
+static void pcap_add_interface(pcap_source_t source, unsigned int linktype, int binary, unsigned int exponent) {
+    if (source->num_interfaces == source->interface_capacity) {
+        source->interface_capacity = 2 * source->interface_capacity;
+        source->interfaces = realloc(
+            source->interfaces,
+            sizeof(struct pcap_interface) * source->interface_capacity
+        );
+        assert(source->interfaces);
+    }
+
+    struct pcap_interface *interface = &source->interfaces[source->num_interfaces];
+    interface->linktype = linktype;
+    interface->binary = binary;
+    interface->exponent = exponent;
+
+    source->num_interfaces = source->num_interfaces + 1;
+}
+
+/*  Parse an interface description block body, looking for a timestamp
+    resolution option. The default resolution is microseconds. */
+static void pcap_parse_interface(pcap_source_t source, size_t body, size_t body_length) {
+    unsigned int linktype = pcap_read16(source, body);
+    int binary = 0;
+    unsigned int exponent = 6;
+
+    size_t opt = body + 8;
+    size_t end = body + body_length;
+
+    while (opt + 4 <= end) {
+        unsigned int code = pcap_read16(source, opt);
+        unsigned int length = pcap_read16(source, opt + 2);
+
+        if (code == PCAPNG_OPT_END) {
+            break;
+        }
+
+        if (code == PCAPNG_OPT_TSRESOL && length >= 1 && opt + 5 <= end) {
+            unsigned char resol = source->base[opt + 4];
+            binary = (resol & 0x80) != 0;
+            exponent = resol & 0x7f;
+        }
+
+        opt = opt + 4 + ((length + 3) & ~3u);
+    }
+
+    pcap_add_interface(source, linktype, binary, exponent);
+}
+
+/*  Advance to the next packet record, setting the frame pointer and
+    returning its timestamp in nanoseconds, original length and interface.
+    Returns 0 at the end of the file or if a record is truncated. */
+static int pcap_next_record(
+    pcap_source_t source,
+    uint64_t *ns_out,
+    unsigned int *length_out,
+    unsigned int *interface_out
+) {
+    if (source->format == PCAP_CLASSIC) {
+        if (source->pos + PCAP_RECORD_HEADER_LENGTH > source->size) {
+            return 0;
+        }
+
+        uint32_t ts_sec = pcap_read32(source, source->pos);
+        uint32_t ts_frac = pcap_read32(source, source->pos + 4);
+        uint32_t caplen = pcap_read32(source, source->pos + 8);
+        uint32_t origlen = pcap_read32(source, source->pos + 12);
+        size_t data = source->pos + PCAP_RECORD_HEADER_LENGTH;
+
+        if (data + caplen > source->size) {
+            return 0;
+        }
+
+        struct pcap_interface *interface = &source->interfaces[0];
+        *ns_out = (uint64_t) ts_sec * 1000000000ULL +
+            (interface->exponent == 9 ? ts_frac : (uint64_t) ts_frac * 1000);
+        *length_out = origlen;
+        *interface_out = 0;
+
+        source->frame = source->base + data;
+        source->caplen = caplen;
+        source->pos = data + caplen;
+
+        return 1;
+    }
+
+    /*  pcapng - walk blocks until a packet block is found. */
+    while (source->pos + 12 <= source->size) {
+        size_t block = source->pos;
+        uint32_t type = pcap_read32(source, block);
+        uint32_t total = pcap_read32(source, block + 4);
+
+        if (type == PCAPNG_SHB) {
+            /*  A new section may switch byte order and resets the
+                interfaces. */
+            uint32_t bom;
+            memcpy(&bom, source->base + block + 8, sizeof(bom));
+            source->swapped = bom != PCAPNG_BYTE_ORDER_MAGIC;
+            source->num_interfaces = 0;
+            total = pcap_read32(source, block + 4);
+        }
+
+        if (total < 12 || (total & 3) || block + total > source->size) {
+            return 0;
+        }
+
+        source->pos = block + total;
+        size_t body = block + 8;
+        size_t body_length = total - 12;
+
+        if (type == PCAPNG_IDB && body_length >= 8) {
+            pcap_parse_interface(source, body, body_length);
+        } else if (type == PCAPNG_EPB && body_length >= 20) {
+            uint32_t interface = pcap_read32(source, body);
+            uint64_t ts = ((uint64_t) pcap_read32(source, body + 4) << 32) |
+                pcap_read32(source, body + 8);
+            uint32_t caplen = pcap_read32(source, body + 12);
+            uint32_t origlen = pcap_read32(source, body + 16);
+
+            if (interface >= source->num_interfaces || 20 + (size_t) caplen > body_length) {
+                return 0;
+            }
+
+            *ns_out = pcap_to_ns(&source->interfaces[interface], ts);
+            *length_out = origlen;
+            *interface_out = interface;
+
+            source->frame = source->base + body + 20;
+            source->caplen = caplen;
+
+            return 1;
+        } else if (type == PCAPNG_SPB && body_length >= 4 && source->num_interfaces > 0) {
+            /*  Simple packet blocks carry no timestamp, so they are given
+                the time of the previous packet. */
+            uint32_t origlen = pcap_read32(source, body);
+            uint32_t caplen = body_length - 4 < origlen ? body_length - 4 : origlen;
+
+            *ns_out = source->first_ns +
+                (uint64_t) source->last_time * source->ns_per_tick;
+            *length_out = origlen;
+            *interface_out = 0;
+
+            source->frame = source->base + body + 4;
+            source->caplen = caplen;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*  Convert a pcapng timestamp in interface units to nanoseconds. */
+static uint64_t pcap_to_ns(struct pcap_interface *interface, uint64_t ts) {
+    if (interface->binary) {
+        unsigned int e = interface->exponent > 32 ? 32 : interface->exponent;
+        uint64_t seconds = ts >> e;
+        uint64_t fraction = ts & ((1ULL << e) - 1);
+        return seconds * 1000000000ULL + ((fraction * 1000000000ULL) >> e);
+    }
+
+    uint64_t x = ts;
+    unsigned int e;
+    if (interface->exponent <= 9) {
+        for (e = interface->exponent; e < 9; e++) {
+            x = x * 10;
+        }
+    } else {
+        for (e = 9; e < interface->exponent; e++) {
+            x = x / 10;
+        }
+    }
+
+    return x;
+}
+
+/*  Keep the window ahead of the read position requested and release what
+    has been read, one window at a time. */
+static void pcap_advise(pcap_source_t source) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    if (source->pos + PCAP_PREFETCH_WINDOW / 2 >= source->prefetched &&
+        source->prefetched < source->size) {
+        size_t start = source->prefetched & ~(page - 1);
+        size_t length = PCAP_PREFETCH_WINDOW;
+        if (start + length > source->size) {
+            length = source->size - start;
+        }
+
+        madvise((void *) (source->base + start), length, MADV_WILLNEED);
+        source->prefetched = start + length;
+    }
+
+    if (source->pos >= source->released + 2 * PCAP_PREFETCH_WINDOW) {
+        madvise((void *) (source->base + source->released), PCAP_PREFETCH_WINDOW, MADV_DONTNEED);
+        source->released = source->released + PCAP_PREFETCH_WINDOW;
+    }
+}
+
+/*  FNV-1a hash of the IPv4 5-tuple of an Ethernet frame, skipping a single
+    VLAN tag. Returns 0 for anything else. */
+static unsigned int pcap_flow_hash(const unsigned char *frame, unsigned int caplen, unsigned int linktype) {
+    if (linktype != LINKTYPE_ETHERNET || caplen < 14) {
+        return 0;
+    }
+
+    unsigned int offset = 12;
+    unsigned int ethertype = (frame[offset] << 8) | frame[offset + 1];
+    if (ethertype == 0x8100 && caplen >= 18) {
+        offset = offset + 4;
+        ethertype = (frame[offset] << 8) | frame[offset + 1];
+    }
+    offset = offset + 2;
+
+    if (ethertype != 0x0800 || caplen < offset + 20) {
+        return 0;
+    }
+
+    const unsigned char *ip = frame + offset;
+    unsigned int ihl = (ip[0] & 0x0f) * 4;
+    unsigned int protocol = ip[9];
+
+    unsigned char key[13];
+    memcpy(key, ip + 12, 8);
+    key[8] = (unsigned char) protocol;
+    memset(key + 9, 0, 4);
+
+    if ((protocol == 6 || protocol == 17) && caplen >= offset + ihl + 4) {
+        memcpy(key + 9, ip + ihl, 4);
+    }
+
+    uint32_t hash = 2166136261u;
+    unsigned int i;
+    for (i = 0; i < sizeof(key); i++) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+
+    return hash;
+}
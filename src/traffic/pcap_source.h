@@ -0,0 +1,41 @@
+/*  pcap_source.h
+
+    Streaming reader for packet captures in the classic pcap and the pcapng
+    formats, used to drive simulations from recorded traffic.
+
+    The capture is memory mapped and parsed in place - record headers are
+    decoded straight out of the mapping and the frame bytes are never copied.
+    Packets are produced one at a time through pcap_source_next, which has
+    the signature of an event source next function, so only the next packet
+    of a trace is ever waiting in the event queue no matter how large the
+    capture is. The kernel is told that the mapping is read sequentially,
+    pages ahead of the read position are requested in advance and pages
+    behind it are released, so memory use stays bounded.
+
+    Each packet descriptor takes its length from the original (wire) length
+    of the frame and its time from the capture timestamp, relative to the
+    first packet and converted to ticks. For Ethernet captures carrying IPv4
+    the flow identifier is a hash of the 5-tuple. The ingress port is the
+    pcapng interface the packet was captured on (0 for classic pcap).
+
+    Timestamps are expected to be in order. A packet whose timestamp goes
+    backwards is emitted at the time of its predecessor and counted by
+    pcap_source_reordered. */
+
+#ifndef PCAP_SOURCE_H
+#define PCAP_SOURCE_H
+
+#include "../switch/packet.h"
+
+struct pcap_source;
+
+typedef struct pcap_source * pcap_source_t;
+
+pcap_source_t open_pcap_source(const char *path, unsigned int ns_per_tick, object_pool_t packet_pool);
+void free_pcap_source(pcap_source_t source);
+int pcap_source_next(void *source_ptr, unsigned int *time_out, void **packet_out);
+const unsigned char * pcap_source_frame(pcap_source_t source, unsigned int *caplen_out);
+unsigned long pcap_source_packets(pcap_source_t source);
+unsigned long pcap_source_reordered(pcap_source_t source);
+
+#endif
@@ -0,0 +1,182 @@
+/*  rng.c
+
+    Implementation of the batched xoshiro256** generator. */
+
+#include "rng.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+#include <math.h>
+
+/*  Constant definitions. Lanes are advanced together, so a batch is always
+    produced in multiples of RNG_LANES. */
+#define RNG_LANES 8
+#define RNG_BUFFER_SIZE 256
+
+struct rng {
+    /*  Lane-major state, s[word][lane]. */
+    uint64_t s[4][RNG_LANES];
+
+    /*  Buffer backing the single value functions. */
+    uint64_t buffer[RNG_BUFFER_SIZE];
+    unsigned int buffer_pos;
+};
+
+/*  Forward declarations of helper functions. */
+static inline uint64_t rng_rotl(uint64_t x, int k);
+static uint64_t rng_splitmix64(uint64_t *state);
+static void rng_fill_blocks(rng_t rng, uint64_t *out, unsigned int blocks);
+
+/*  Create a generator. Every lane is seeded from a single splitmix64 stream
+    as recommended by the xoshiro authors, so lanes are uncorrelated. */
+rng_t create_rng(uint64_t seed) {
+    rng_t rng = malloc(sizeof(struct rng));
+    assert(rng);
+
+    uint64_t sm = seed;
+    int word, lane;
+    for (lane = 0; lane < RNG_LANES; lane++) {
+        for (word = 0; word < 4; word++) {
+            rng->s[word][lane] = rng_splitmix64(&sm);
+        }
+    }
+
+    /*  Buffer starts empty. */
+    rng->buffer_pos = RNG_BUFFER_SIZE;
+
+    return rng;
+}
+
+void free_rng(rng_t rng) {
+    assert(rng);
+    free(rng);
+}
+
+/*  Fill an array with raw 64 bit values. Whole blocks are written in place
+    and any remainder goes through a temporary block. */
+void rng_fill_u64(rng_t rng, uint64_t *out, unsigned int n) {
+    unsigned int blocks = n / RNG_LANES;
+    rng_fill_blocks(rng, out, blocks);
+
+    unsigned int done = blocks * RNG_LANES;
+    if (done < n) {
+        uint64_t tail[RNG_LANES];
+        rng_fill_blocks(rng, tail, 1);
+
+        unsigned int i;
+        for (i = 0; done + i < n; i++) {
+            out[done + i] = tail[i];
+        }
+    }
+}
+
+/*  Fill an array with uniform doubles in (0, 1]. Raw values are generated a
+    chunk at a time into a local buffer and converted from there. */
+void rng_fill_uniform(rng_t rng, double *out, unsigned int n) {
+    uint64_t raw[RNG_BUFFER_SIZE];
+    unsigned int done = 0;
+
+    while (done < n) {
+        unsigned int chunk = n - done;
+        if (chunk > RNG_BUFFER_SIZE) {
+            chunk = RNG_BUFFER_SIZE;
+        }
+
+        rng_fill_u64(rng, raw, chunk);
+
+        unsigned int i;
+        for (i = 0; i < chunk; i++) {
+            out[done + i] = rng_to_uniform(raw[i]);
+        }
+
+        done = done + chunk;
+    }
+}
+
+/*  Fill an array with exponential variates of the given mean by inversion. */
+void rng_fill_exponential(rng_t rng, double *out, unsigned int n, double mean) {
+    rng_fill_uniform(rng, out, n);
+
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        out[i] = -mean * log(out[i]);
+    }
+}
+
+/*  Single raw value from the internal buffer. */
+uint64_t rng_next_u64(rng_t rng) {
+    if (rng->buffer_pos == RNG_BUFFER_SIZE) {
+        rng_fill_blocks(rng, rng->buffer, RNG_BUFFER_SIZE / RNG_LANES);
+        rng->buffer_pos = 0;
+    }
+
+    uint64_t x = rng->buffer[rng->buffer_pos];
+    rng->buffer_pos = rng->buffer_pos + 1;
+
+    return x;
+}
+
+/*  Single uniform double in (0, 1]. */
+double rng_next_uniform(rng_t rng) {
+    return rng_to_uniform(rng_next_u64(rng));
+}
+
+/*  Single integer in [0, bound). */
+unsigned int rng_next_below(rng_t rng, unsigned int bound) {
+    return rng_to_below(rng_next_u64(rng), bound);
+}
+
+/*  Helper functions. */
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/*  splitmix64, used only for seeding. */
+static uint64_t rng_splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*  Produce blocks of RNG_LANES values, one from each lane. The state is
+    copied into locals for the duration of the loop so the compiler can keep
+    it in vector registers. */
+static void rng_fill_blocks(rng_t rng, uint64_t *out, unsigned int blocks) {
+    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+    unsigned int lane, block;
+
+    for (lane = 0; lane < RNG_LANES; lane++) {
+        s0[lane] = rng->s[0][lane];
+        s1[lane] = rng->s[1][lane];
+        s2[lane] = rng->s[2][lane];
+        s3[lane] = rng->s[3][lane];
+    }
+
+    for (block = 0; block < blocks; block++) {
+        uint64_t *dst = out + (size_t) block * RNG_LANES;
+
+        for (lane = 0; lane < RNG_LANES; lane++) {
+            uint64_t result = rng_rotl(s1[lane] * 5, 7) * 9;
+            uint64_t t = s1[lane] << 17;
+
+            s2[lane] ^= s0[lane];
+            s3[lane] ^= s1[lane];
+            s1[lane] ^= s2[lane];
+            s0[lane] ^= s3[lane];
+            s2[lane] ^= t;
+            s3[lane] = rng_rotl(s3[lane], 45);
+
+            dst[lane] = result;
+        }
+    }
+
+    for (lane = 0; lane < RNG_LANES; lane++) {
+        rng->s[0][lane] = s0[lane];
+        rng->s[1][lane] = s1[lane];
+        rng->s[2][lane] = s2[lane];
+        rng->s[3][lane] = s3[lane];
+    }
+}
@@ -0,0 +1,43 @@
+/*  rng.h
+
+    Batched pseudo-random number generator for traffic generation.
+
+    The generator is xoshiro256** run as several independent lanes side by
+    side. The state is stored lane-major (each of the four state words is an
+    array with one entry per lane) so that the batch fill functions below
+    advance every lane with the same straight-line code, which the compiler
+    can vectorise. Callers that need many variates should ask for them a
+    batch at a time rather than one by one. The single value functions draw
+    from an internal buffer that is itself refilled in batches. */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+struct rng;
+
+typedef struct rng * rng_t;
+
+rng_t create_rng(uint64_t seed);
+void free_rng(rng_t rng);
+void rng_fill_u64(rng_t rng, uint64_t *out, unsigned int n);
+void rng_fill_uniform(rng_t rng, double *out, unsigned int n);
+void rng_fill_exponential(rng_t rng, double *out, unsigned int n, double mean);
+uint64_t rng_next_u64(rng_t rng);
+double rng_next_uniform(rng_t rng);
+unsigned int rng_next_below(rng_t rng, unsigned int bound);
+
+/*  Convert a raw 64 bit value to a double in (0, 1]. The interval excludes 0
+    so that the result can be passed straight to log. */
+static inline double rng_to_uniform(uint64_t x) {
+    return ((double) (x >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+}
+
+/*  Map a raw 64 bit value onto [0, bound) using the high bits of a
+    multiplication rather than a modulo. */
+static inline unsigned int rng_to_below(uint64_t x, unsigned int bound) {
+    return (unsigned int) (((x >> 32) * (uint64_t) bound) >> 32);
+}
+
+#endif
@@ -0,0 +1,264 @@
+/*  traffic_generator.c
+
+    Implementation of the synthetic traffic generators.
+
+    Each generator keeps buffers of precomputed values: the gaps between
+    successive arrivals, raw random values used to choose destinations and,
+    when sampled, packet lengths. When a buffer runs dry it is refilled in
+    one go - the random numbers come from rng_fill_* and the transformation
+    into gaps is a simple loop over the whole buffer. */
+
+#include "traffic_generator.h"
+#include "rng.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <malloc.h>
+#include <math.h>
+
+/*  Constant definitions. */
+#define TRAFFIC_BATCH 256
+
+struct traffic_generator {
+    traffic_config_t config;
+    unsigned int input_port;
+
+    rng_t rng;
+    object_pool_t packet_pool;
+
+    /*  Time of the last arrival, kept as a double so that fractional gaps
+        accumulate correctly. */
+    double clock;
+
+    /*  Precomputed gaps. */
+    double gaps[TRAFFIC_BATCH];
+    unsigned int gap_pos;
+
+    /*  Precomputed raw values for destination selection. */
+    uint64_t raw[TRAFFIC_BATCH];
+    unsigned int raw_pos;
+
+    /*  Precomputed packet lengths, only used with a size sampler. */
+    double sizes[TRAFFIC_BATCH];
+    unsigned int size_pos;
+
+    unsigned long generated;
+};
+
+/*  Forward declarations of helper functions. */
+static void traffic_refill_gaps(traffic_generator_t gen);
+static double traffic_next_gap(traffic_generator_t gen);
+static uint64_t traffic_next_raw(traffic_generator_t gen);
+static unsigned int traffic_destination(traffic_generator_t gen);
+static unsigned int traffic_length(traffic_generator_t gen);
+
+/*  Create a generator for one input port. The configuration is copied. */
+traffic_generator_t create_traffic_generator(
+    const traffic_config_t *config,
+    unsigned int input_port,
+    uint64_t seed,
+    object_pool_t packet_pool
+) {
+    assert(config);
+    assert(packet_pool);
+    assert(config->num_ports > 0);
+    assert(input_port < config->num_ports);
+    assert(config->process != TRAFFIC_PARETO || config->pareto_shape > 1.0);
+    assert(config->process != TRAFFIC_BERNOULLI ||
+        (config->probability > 0.0 && config->probability <= 1.0));
+    assert(config->process != TRAFFIC_ON_OFF || config->mean_burst >= 1.0);
+    assert(config->pattern != TRAFFIC_MATRIX || config->destination_samplers);
+
+    traffic_generator_t gen = malloc(sizeof(struct traffic_generator));
+    assert(gen);
+
+    gen->config = *config;
+    gen->input_port = input_port;
+    gen->rng = create_rng(seed);
+    gen->packet_pool = packet_pool;
+    gen->clock = 0.0;
+    gen->gap_pos = TRAFFIC_BATCH;
+    gen->raw_pos = TRAFFIC_BATCH;
+    gen->size_pos = TRAFFIC_BATCH;
+    gen->generated = 0;
+
+    return gen;
+}
+
+void free_traffic_generator(traffic_generator_t gen) {
+    assert(gen);
+
+    free_rng(gen->rng);
+    free(gen);
+}
+
+/*  Generate the next arrival. Suitable for use as an event source next
+    function. */
+int traffic_generator_next(void *gen_ptr, unsigned int *time_out, void **packet_out) {
+    traffic_generator_t gen = (traffic_generator_t) gen_ptr;
+
+    gen->clock = gen->clock + traffic_next_gap(gen);
+
+    if (gen->clock >= (double) gen->config.end_time) {
+        return 0;
+    }
+
+    unsigned int time = (unsigned int) gen->clock;
+
+    packet_t packet = packet_pool_alloc(gen->packet_pool);
+    packet->id = (unsigned int) gen->generated;
+    packet->length = traffic_length(gen);
+    packet->ingress_port = gen->input_port;
+    packet->egress_port = traffic_destination(gen);
+    packet->priority = gen->config.priority;
+    packet->created = time;
+
+    gen->generated = gen->generated + 1;
+
+    *time_out = time;
+    *packet_out = packet;
+
+    return 1;
+}
+
+/*  Number of packets generated so far. */
+unsigned long traffic_generator_generated(traffic_generator_t gen) {
+    return gen->generated;
+}
+
+/*  Helper functions. */
+
+/*  Refill the gap buffer for the configured arrival process. */
+static void traffic_refill_gaps(traffic_generator_t gen) {
+    traffic_config_t *config = &gen->config;
+    double *gaps = gen->gaps;
+    unsigned int i;
+
+    switch (config->process) {
+        case TRAFFIC_BERNOULLI: {
+            /*  The number of slots up to and including the next arrival is
+                geometric, which can be sampled directly by inversion. */
+            rng_fill_uniform(gen->rng, gaps, TRAFFIC_BATCH);
+
+            if (config->probability >= 1.0) {
+                for (i = 0; i < TRAFFIC_BATCH; i++) {
+                    gaps[i] = config->slot_time;
+                }
+                break;
+            }
+
+            double scale = 1.0 / log1p(-config->probability);
+            for (i = 0; i < TRAFFIC_BATCH; i++) {
+                gaps[i] = (floor(log(gaps[i]) * scale) + 1.0) * config->slot_time;
+            }
+            break;
+        }
+
+        case TRAFFIC_POISSON:
+            rng_fill_exponential(gen->rng, gaps, TRAFFIC_BATCH, config->mean_gap);
+            break;
+
+        case TRAFFIC_ON_OFF: {
+            /*  After each packet the burst ends with probability
+                1 / mean_burst, in which case an exponential idle period is
+                added to the gap. Two uniforms are used per gap. */
+            double decide[TRAFFIC_BATCH];
+            double idle[TRAFFIC_BATCH];
+            double end_prob = 1.0 / config->mean_burst;
+
+            rng_fill_uniform(gen->rng, decide, TRAFFIC_BATCH);
+            rng_fill_exponential(gen->rng, idle, TRAFFIC_BATCH, config->mean_off);
+
+            for (i = 0; i < TRAFFIC_BATCH; i++) {
+                gaps[i] = config->burst_gap + (decide[i] <= end_prob ? idle[i] : 0.0);
+            }
+            break;
+        }
+
+        case TRAFFIC_PARETO: {
+            /*  Scale chosen so that the mean gap matches mean_gap. */
+            double alpha = config->pareto_shape;
+            double x_m = config->mean_gap * (alpha - 1.0) / alpha;
+            double exponent = -1.0 / alpha;
+
+            rng_fill_uniform(gen->rng, gaps, TRAFFIC_BATCH);
+            for (i = 0; i < TRAFFIC_BATCH; i++) {
+                gaps[i] = x_m * pow(gaps[i], exponent);
+            }
+            break;
+        }
+    }
+
+    gen->gap_pos = 0;
+}
+
+static double traffic_next_gap(traffic_generator_t gen) {
+    if (gen->gap_pos == TRAFFIC_BATCH) {
+        traffic_refill_gaps(gen);
+    }
+
+    double gap = gen->gaps[gen->gap_pos];
+    gen->gap_pos = gen->gap_pos + 1;
+
+    return gap;
+}
+
+static uint64_t traffic_next_raw(traffic_generator_t gen) {
+    if (gen->raw_pos == TRAFFIC_BATCH) {
+        rng_fill_u64(gen->rng, gen->raw, TRAFFIC_BATCH);
+        gen->raw_pos = 0;
+    }
+
+    uint64_t raw = gen->raw[gen->raw_pos];
+    gen->raw_pos = gen->raw_pos + 1;
+
+    return raw;
+}
+
+/*  Choose an output according to the configured traffic pattern. */
+static unsigned int traffic_destination(traffic_generator_t gen) {
+    traffic_config_t *config = &gen->config;
+    unsigned int n = config->num_ports;
+
+    switch (config->pattern) {
+        case TRAFFIC_UNIFORM:
+            return rng_to_below(traffic_next_raw(gen), n);
+
+        case TRAFFIC_HOTSPOT:
+            if (rng_to_uniform(traffic_next_raw(gen)) <= config->hotspot_fraction) {
+                return config->hotspot_port;
+            }
+            return rng_to_below(traffic_next_raw(gen), n);
+
+        case TRAFFIC_DIAGONAL:
+            if (rng_to_uniform(traffic_next_raw(gen)) <= config->diagonal_fraction) {
+                return gen->input_port;
+            }
+            return (gen->input_port + 1) % n;
+
+        case TRAFFIC_MATRIX:
+            return alias_sampler_sample(
+                config->destination_samplers[gen->input_port],
+                gen->rng
+            );
+    }
+
+    return 0;
+}
+
+/*  Choose a packet length, either fixed or sampled a batch at a time. */
+static unsigned int traffic_length(traffic_generator_t gen) {
+    if (gen->config.size_sampler == NULL) {
+        return gen->config.packet_length;
+    }
+
+    if (gen->size_pos == TRAFFIC_BATCH) {
+        alias_sampler_sample_values(gen->config.size_sampler, gen->rng, gen->sizes, TRAFFIC_BATCH);
+        gen->size_pos = 0;
+    }
+
+    double size = gen->sizes[gen->size_pos];
+    gen->size_pos = gen->size_pos + 1;
+
+    return (unsigned int) (size + 0.5);
+}
@@ -0,0 +1,127 @@
+/*  traffic_generator.h
+
+    Synthetic traffic generators for switch experiments.
+
+    A generator produces the packets offered at one input port. The arrival
+    process decides when packets arrive and the traffic pattern (a row of the
+    traffic matrix) decides which output each packet is destined for.
+
+    Arrival processes:
+        TRAFFIC_BERNOULLI - time is divided into slots and a packet arrives
+                            in each slot with a fixed probability.
+        TRAFFIC_POISSON   - exponentially distributed gaps.
+        TRAFFIC_ON_OFF    - bursts of back to back packets with a
+                            geometrically distributed length, separated by
+                            exponentially distributed idle periods.
+        TRAFFIC_PARETO    - Pareto distributed (heavy-tailed) gaps.
+
+    Traffic patterns:
+        TRAFFIC_UNIFORM   - every output equally likely.
+        TRAFFIC_HOTSPOT   - a fixed fraction of packets go to one output,
+                            the rest are spread uniformly.
+        TRAFFIC_DIAGONAL  - a fixed fraction of packets from input i go to
+                            output i, the rest to output i + 1.
+        TRAFFIC_MATRIX    - an arbitrary (e.g. skewed) traffic matrix, given
+                            as one alias sampler over outputs per input.
+
+    Packet lengths are either fixed or drawn from an alias sampler built
+    from an empirical size distribution.
+
+    Generators are lazy - they are driven through an event source by passing
+    traffic_generator_next as its next function, so only one arrival per
+    input port is ever waiting in the event queue. Random variates are drawn
+    a batch at a time and transformed in tight loops rather than calling log
+    on a fresh random number for every arrival. */
+
+#ifndef TRAFFIC_GENERATOR_H
+#define TRAFFIC_GENERATOR_H
+
+#include "../switch/packet.h"
+#include "alias_sampler.h"
+
+#include <stdint.h>
+
+struct traffic_generator;
+
+typedef struct traffic_generator * traffic_generator_t;
+
+enum traffic_process {
+    TRAFFIC_BERNOULLI,
+    TRAFFIC_POISSON,
+    TRAFFIC_ON_OFF,
+    TRAFFIC_PARETO
+};
+
+typedef enum traffic_process traffic_process_t;
+
+enum traffic_pattern {
+    TRAFFIC_UNIFORM,
+    TRAFFIC_HOTSPOT,
+    TRAFFIC_DIAGONAL,
+    TRAFFIC_MATRIX
+};
+
+typedef enum traffic_pattern traffic_pattern_t;
+
+/*  Parameters shared by every input port of an experiment. Only the fields
+    relevant to the selected process and pattern are read. Times are in
+    ticks. */
+struct traffic_config {
+    traffic_process_t process;
+
+    /*  Mean gap between arrivals for TRAFFIC_POISSON and TRAFFIC_PARETO. */
+    double mean_gap;
+
+    /*  Slot length and per-slot arrival probability for
+        TRAFFIC_BERNOULLI. */
+    double slot_time;
+    double probability;
+
+    /*  Shape parameter for TRAFFIC_PARETO, must be greater than 1. */
+    double pareto_shape;
+
+    /*  Mean packets per burst, gap between packets within a burst and mean
+        idle period for TRAFFIC_ON_OFF. */
+    double mean_burst;
+    double burst_gap;
+    double mean_off;
+
+    traffic_pattern_t pattern;
+    unsigned int num_ports;
+
+    /*  Hotspot output and the fraction of traffic sent to it. */
+    unsigned int hotspot_port;
+    double hotspot_fraction;
+
+    /*  Fraction of traffic sent to the output on the diagonal. */
+    double diagonal_fraction;
+
+    /*  Row samplers for TRAFFIC_MATRIX, indexed by input port. Samplers are
+        not owned by the generator. */
+    alias_sampler_t *destination_samplers;
+
+    /*  Length and traffic class of generated packets. If size_sampler is
+        not NULL lengths are drawn from it instead and packet_length is
+        ignored. */
+    unsigned int packet_length;
+    alias_sampler_t size_sampler;
+    unsigned int priority;
+
+    /*  No arrivals are generated at or after this time. */
+    unsigned int end_time;
+};
+
+typedef struct traffic_config traffic_config_t;
+
+traffic_generator_t create_traffic_generator(
+    const traffic_config_t *config,
+    unsigned int input_port,
+    uint64_t seed,
+    object_pool_t packet_pool
+);
+
+void free_traffic_generator(traffic_generator_t gen);
+int traffic_generator_next(void *gen_ptr, unsigned int *time_out, void **packet_out);
+unsigned long traffic_generator_generated(traffic_generator_t gen);
+
+#endif
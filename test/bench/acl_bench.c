@@ -0,0 +1,101 @@
+#include "bench.h"
+#include "acl.h"
+
+#define NUM_HEADERS (1 << 14)
+#define ROUNDS 32
+#define BATCH 64
+
+/*  Firewall-like rule sets of growing size, classifying headers drawn from
+    inside the rules so that most searches end in a populated leaf. */
+static acl_header_t headers[NUM_HEADERS];
+static uint32_t actions[NUM_HEADERS];
+
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state ^ (*state >> 16);
+}
+
+static acl_rule_t *random_rules(unsigned int n, uint32_t *state) {
+    static const uint32_t ports[] = { 22, 53, 80, 443, 8080 };
+    acl_rule_t *rules = malloc(n * sizeof(acl_rule_t));
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        acl_rule_t *rule = &rules[i];
+
+        acl_rule_init(rule, i, i);
+        acl_rule_prefix(rule, ACL_SRC_ADDR, (10 + next_random(state) % 4) << 24 | next_random(state), next_random(state) % 33);
+        acl_rule_prefix(rule, ACL_DST_ADDR, (10 + next_random(state) % 4) << 24 | next_random(state), 8 + next_random(state) % 25);
+        if (next_random(state) % 2) {
+            uint32_t port = ports[next_random(state) % 5];
+            acl_rule_range(rule, ACL_DST_PORT, port, port);
+        } else if (next_random(state) % 2) {
+            acl_rule_range(rule, ACL_SRC_PORT, 1024, 65535);
+        }
+        if (next_random(state) % 2) {
+            acl_rule_range(rule, ACL_PROTOCOL, 6, 6);
+        }
+    }
+
+    for (i = 0; i < NUM_HEADERS; i++) {
+        const acl_rule_t *rule = &rules[next_random(state) % n];
+        unsigned int field;
+
+        for (field = 0; field < ACL_FIELDS; field++) {
+            uint32_t span = rule->high[field] - rule->low[field];
+            headers[i].fields[field] = rule->low[field] + (span == UINT32_MAX ? next_random(state) : next_random(state) % (span + 1));
+        }
+    }
+
+    return rules;
+}
+
+static void bench_rules(unsigned int n) {
+    uint32_t state = 99;
+    acl_rule_t *rules = random_rules(n, &state);
+    char label[64];
+    unsigned long sum = 0;
+    unsigned int round, i;
+
+    double start = bench_seconds();
+    acl_t acl = create_acl(rules, n);
+    double elapsed = bench_seconds() - start;
+    printf("    %u rules: %u nodes, depth %u, compiled in %.1f ms\n", n, acl_nodes(acl), acl_depth(acl), elapsed * 1e3);
+
+    start = bench_seconds();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_HEADERS; i++) {
+            sum += acl_classify(acl, &headers[i]);
+        }
+    }
+    elapsed = bench_seconds() - start;
+
+    bench_sink = sum;
+    snprintf(label, sizeof(label), "classify, %u rules", n);
+    BENCH_REPORT(label, elapsed, (double) ROUNDS * NUM_HEADERS)
+
+    start = bench_seconds();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_HEADERS; i += BATCH) {
+            acl_classify_batch(acl, headers + i, actions + i, BATCH);
+        }
+    }
+    elapsed = bench_seconds() - start;
+
+    bench_sink = actions[NUM_HEADERS - 1];
+    snprintf(label, sizeof(label), "classify batches of 64, %u rules", n);
+    BENCH_REPORT(label, elapsed, (double) ROUNDS * NUM_HEADERS)
+
+    free_acl(acl);
+    free(rules);
+}
+
+DEFINE_BENCH(bench_classify)
+    bench_rules(100);
+    bench_rules(1000);
+    bench_rules(5000);
+END_BENCH
+
+REGISTER_BENCHES(
+    bench_classify
+)
@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*  Results are folded into this so that the compiler cannot discard the work
+    being timed. */
+static volatile unsigned long bench_sink;
+
+static inline double bench_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+#define BENCH_REPORT(label, seconds, ops) \
+    printf("    %-40s %10.2f ns/op\n", (label), (seconds) * 1e9 / (double) (ops));
+
+#define DEFINE_BENCH(name) void name() { \
+    printf("Running benchmark %s...\n", #name);
+
+#define END_BENCH }
+
+#define REGISTER_BENCHES(args...) int main() { \
+    printf("Running benchmarks: %s...\n", __FILE__); \
+    void (*bench_funcs[])(void) = {args, NULL}; \
+    int index = 0; \
+    while (bench_funcs[index] != NULL) { \
+        bench_funcs[index](); \
+        index += 1; \
+    } \
+    return 0; \
+}
+
+#endif
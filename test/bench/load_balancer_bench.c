@@ -0,0 +1,117 @@
+#include "bench.h"
+#include "load_balancer.h"
+
+#define NUM_PACKETS (1 << 14)
+#define ROUNDS 64
+#define NUM_FLOWS 65536
+#define BATCH 64
+
+/*  Packets with random flows heading for random remote destinations of a
+    k = 16 fat-tree, balanced at the first edge switch. The packets fit in
+    cache and are run through ROUNDS times, so that the cost measured is
+    that of the decisions rather than of streaming descriptors from
+    memory. */
+static topology_t topology;
+static routing_t routing;
+static unsigned int edge;
+static struct packet *packets;
+static packet_t *vector;
+static unsigned int *destinations;
+
+static void bench_setup(void) {
+    if (topology) {
+        return;
+    }
+
+    topology = create_fat_tree(16);
+    routing = create_routing(topology, 0);
+    edge = topology_host_switch(topology, 0);
+
+    packets = calloc(NUM_PACKETS, sizeof(struct packet));
+    vector = malloc(sizeof(packet_t) * NUM_PACKETS);
+    destinations = malloc(sizeof(unsigned int) * NUM_PACKETS);
+
+    unsigned int local = routing_destination(routing, 0);
+    unsigned int x = 12345;
+    unsigned int i;
+    for (i = 0; i < NUM_PACKETS; i++) {
+        x = x * 1103515245 + 12345;
+        packets[i].flow_id = (x >> 8) % NUM_FLOWS;
+        x = x * 1103515245 + 12345;
+        destinations[i] = (x >> 8) % routing_num_destinations(routing);
+        if (destinations[i] == local) {
+            destinations[i] = local + 1;
+        }
+        vector[i] = &packets[i];
+    }
+}
+
+static void bench_mode(const char *label, load_balancing_mode_t mode) {
+    load_balancer_t balancer = create_load_balancer(mode, routing, edge, 500, 0);
+    unsigned long sum = 0;
+    unsigned int round, i;
+
+    double start = bench_seconds();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_PACKETS; i++) {
+            sum += load_balancer_select(balancer, &packets[i], destinations[i], round * NUM_PACKETS + i);
+        }
+    }
+    double elapsed = bench_seconds() - start;
+
+    bench_sink = sum;
+    BENCH_REPORT(label, elapsed, (double) ROUNDS * NUM_PACKETS)
+
+    free_load_balancer(balancer);
+}
+
+static void bench_mode_batch(const char *label, load_balancing_mode_t mode) {
+    load_balancer_t balancer = create_load_balancer(mode, routing, edge, 500, 0);
+    unsigned int round, i;
+
+    double start = bench_seconds();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_PACKETS; i += BATCH) {
+            load_balancer_select_batch(balancer, vector + i, destinations + i, BATCH, round * NUM_PACKETS + i);
+        }
+    }
+    double elapsed = bench_seconds() - start;
+
+    bench_sink = packets[NUM_PACKETS - 1].egress_port;
+    BENCH_REPORT(label, elapsed, (double) ROUNDS * NUM_PACKETS)
+
+    free_load_balancer(balancer);
+}
+
+DEFINE_BENCH(bench_crc32c)
+    bench_setup();
+
+    uint32_t hash = 0;
+    unsigned int round, i;
+
+    double start = bench_seconds();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < NUM_PACKETS; i++) {
+            hash = hash ^ load_balancer_hash(round, packets[i].flow_id);
+        }
+    }
+    double elapsed = bench_seconds() - start;
+
+    bench_sink = hash;
+    BENCH_REPORT("crc32c flow hash", elapsed, (double) ROUNDS * NUM_PACKETS)
+END_BENCH
+
+DEFINE_BENCH(bench_select)
+    bench_setup();
+
+    bench_mode("ecmp", LOAD_BALANCE_ECMP);
+    bench_mode("flowlet", LOAD_BALANCE_FLOWLET);
+    bench_mode("spray", LOAD_BALANCE_SPRAY);
+    bench_mode_batch("ecmp, batches of 64", LOAD_BALANCE_ECMP);
+    bench_mode_batch("flowlet, batches of 64", LOAD_BALANCE_FLOWLET);
+END_BENCH
+
+REGISTER_BENCHES(
+    bench_crc32c,
+    bench_select
+)
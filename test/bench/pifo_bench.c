@@ -0,0 +1,110 @@
+#include "bench.h"
+#include "pifo.h"
+
+#define NUM_FLOWS 256
+#define NUM_CLASSES 8
+#define BACKLOG 1024
+#define OPS (1 << 22)
+
+/*  A port kept at a steady backlog: every dequeued packet is enqueued
+    again straight away, so each operation is one enqueue and one dequeue
+    against a queue of BACKLOG packets. */
+static struct packet packets[BACKLOG];
+static uint64_t finish[NUM_CLASSES][NUM_FLOWS];
+static struct pifo_stfq stfq[NUM_CLASSES];
+static unsigned int leaves[NUM_CLASSES];
+
+static void bench_setup(void) {
+    unsigned int x = 12345;
+    unsigned int i;
+
+    for (i = 0; i < BACKLOG; i++) {
+        x = x * 1103515245 + 12345;
+        packets[i].id = i;
+        packets[i].flow_id = (x >> 8) % NUM_FLOWS;
+        packets[i].length = 64 + (x >> 20) % 1437;
+        packets[i].priority = (x >> 4) % NUM_CLASSES;
+        packets[i].created = i;
+    }
+
+    for (i = 0; i < NUM_CLASSES; i++) {
+        stfq[i].virtual_time = 0;
+        stfq[i].finish = finish[i];
+        stfq[i].weights = NULL;
+        stfq[i].num_flows = NUM_FLOWS;
+    }
+}
+
+static unsigned int classify(void *arg, packet_t packet) {
+    (void) arg;
+    return leaves[packet->priority];
+}
+
+static void bench_tree(const char *label, pifo_tree_t tree) {
+    unsigned int i;
+
+    for (i = 0; i < BACKLOG; i++) {
+        pifo_tree_enqueue(tree, &packets[i], 0);
+    }
+
+    double start = bench_seconds();
+    for (i = 0; i < OPS; i++) {
+        packet_t packet = pifo_tree_dequeue(tree, i);
+        pifo_tree_enqueue(tree, packet, i);
+    }
+    double elapsed = bench_seconds() - start;
+
+    bench_sink = pifo_tree_size(tree);
+    BENCH_REPORT(label, elapsed, (double) OPS)
+}
+
+DEFINE_BENCH(bench_pifo)
+    bench_setup();
+
+    pifo_t pifo = create_pifo();
+    unsigned int i;
+    uint64_t rank = 0;
+
+    for (i = 0; i < BACKLOG; i++) {
+        pifo_push(pifo, &packets[i], (uint64_t) packets[i].flow_id * 4096 + i);
+    }
+
+    double start = bench_seconds();
+    for (i = 0; i < OPS; i++) {
+        rank = pifo_peek_rank(pifo) + packets[i % BACKLOG].length;
+        pifo_push(pifo, pifo_pop(pifo), rank);
+    }
+    double elapsed = bench_seconds() - start;
+
+    bench_sink = rank;
+    BENCH_REPORT("pifo pop and push, inline ranks", elapsed, (double) OPS)
+
+    free_pifo(pifo);
+END_BENCH
+
+DEFINE_BENCH(bench_schedulers)
+    bench_setup();
+
+    pifo_tree_t tree = create_pifo_tree(pifo_rank_fifo, NULL, NULL);
+    bench_tree("fifo", tree);
+    free_pifo_tree(tree);
+
+    tree = create_pifo_tree(pifo_rank_stfq, pifo_stfq_dequeued, &stfq[0]);
+    bench_tree("wfq, 256 flows", tree);
+    free_pifo_tree(tree);
+
+    /*  Strict priority over eight classes, fair queueing within each. */
+    tree = create_pifo_tree(pifo_rank_priority, NULL, NULL);
+    unsigned int i;
+    for (i = 0; i < NUM_CLASSES; i++) {
+        leaves[i] = pifo_tree_add_node(tree, 0, pifo_rank_stfq, pifo_stfq_dequeued, &stfq[i]);
+    }
+    pifo_tree_set_classifier(tree, classify, NULL);
+    bench_tree("priority over wfq, 8 classes", tree);
+    free_pifo_tree(tree);
+END_BENCH
+
+REGISTER_BENCHES(
+    bench_pifo,
+    bench_schedulers
+)
@@ -0,0 +1,72 @@
+#include "test.h"
+#include "object_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct node {
+    int value;
+    int other;
+};
+
+typedef struct node * node_t;
+
+DEFINE_TEST(object_pool_create_empty)
+    object_pool_t pool = create_object_pool(sizeof(struct node), 0);
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(object_pool_alloc_distinct)
+    object_pool_t pool = create_object_pool(sizeof(struct node), 4);
+
+    node_t first = object_pool_alloc(pool);
+    node_t second = object_pool_alloc(pool);
+    ASSERT_TRUE(first != second)
+    ASSERT_EQ(object_pool_in_use(pool), 2)
+
+    first->value = 1;
+    second->value = 2;
+    ASSERT_EQ(first->value, 1)
+    ASSERT_EQ(second->value, 2)
+
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(object_pool_release_reuses)
+    object_pool_t pool = create_object_pool(sizeof(struct node), 4);
+
+    node_t first = object_pool_alloc(pool);
+    object_pool_release(pool, first);
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+
+    node_t second = object_pool_alloc(pool);
+    ASSERT_TRUE(first == second)
+
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(object_pool_grows)
+    object_pool_t pool = create_object_pool(sizeof(struct node), 2);
+    node_t nodes[9];
+
+    int i;
+    for (i = 0; i < 9; i++) {
+        nodes[i] = object_pool_alloc(pool);
+        nodes[i]->value = i;
+    }
+    ASSERT_EQ(object_pool_in_use(pool), 9)
+
+    for (i = 0; i < 9; i++) {
+        ASSERT_EQ(nodes[i]->value, i)
+    }
+
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    object_pool_create_empty,
+    object_pool_alloc_distinct,
+    object_pool_release_reuses,
+    object_pool_grows
+)
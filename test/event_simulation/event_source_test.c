@@ -0,0 +1,89 @@
+#include "test.h"
+#include "event_source.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/*  Generates the values 0 .. limit - 1 at times 0, step, 2 * step ... */
+struct counter {
+    unsigned int values[16];
+    unsigned int next;
+    unsigned int limit;
+    unsigned int step;
+};
+
+static int counter_next(void *state, unsigned int *time_out, void **item_out) {
+    struct counter *counter = (struct counter *) state;
+
+    if (counter->next == counter->limit) {
+        return 0;
+    }
+
+    counter->values[counter->next] = counter->next;
+    *time_out = counter->next * counter->step;
+    *item_out = &counter->values[counter->next];
+    counter->next = counter->next + 1;
+
+    return 1;
+}
+
+struct emit_log {
+    unsigned int values[16];
+    unsigned int times[16];
+    unsigned int max_pending;
+    int count;
+};
+
+static void log_emit(simulator_t sim, void *item, void *arg) {
+    struct emit_log *log = (struct emit_log *) arg;
+    log->values[log->count] = *((unsigned int *) item);
+    log->times[log->count] = simulator_now(sim);
+    log->count = log->count + 1;
+
+    if (simulator_pending(sim) > log->max_pending) {
+        log->max_pending = simulator_pending(sim);
+    }
+}
+
+DEFINE_TEST(event_source_empty)
+    simulator_t sim = create_simulator();
+    struct counter counter = { .next = 0, .limit = 0, .step = 1 };
+    struct emit_log log = { .count = 0, .max_pending = 0 };
+    event_source_t source = create_event_source(counter_next, &counter, log_emit, &log);
+
+    ASSERT_EQ(event_source_start(source, sim), 0)
+    ASSERT_FALSE(event_source_is_active(source))
+    ASSERT_EQ(simulator_pending(sim), 0)
+
+    free_event_source(source);
+    free_simulator(sim);
+END_TEST
+
+DEFINE_TEST(event_source_emits_in_order)
+    simulator_t sim = create_simulator();
+    struct counter counter = { .next = 0, .limit = 10, .step = 5 };
+    struct emit_log log = { .count = 0, .max_pending = 0 };
+    event_source_t source = create_event_source(counter_next, &counter, log_emit, &log);
+
+    ASSERT_EQ(event_source_start(source, sim), 1)
+    ASSERT_EQ(simulator_pending(sim), 1)
+
+    simulator_run_until(sim, 1000);
+
+    ASSERT_EQ(log.count, 10)
+    ASSERT_EQ(log.values[9], 9)
+    ASSERT_EQ(log.times[9], 45)
+    ASSERT_EQ(event_source_emitted(source), 10)
+    ASSERT_FALSE(event_source_is_active(source))
+
+    /*  Only the next item was ever waiting in the queue. */
+    ASSERT_EQ(log.max_pending, 1)
+
+    free_event_source(source);
+    free_simulator(sim);
+END_TEST
+
+REGISTER_TESTS(
+    event_source_empty,
+    event_source_emits_in_order
+)
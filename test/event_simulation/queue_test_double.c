@@ -238,6 +238,23 @@ DEFINE_TEST(queue_double_size_2)
     free_event_queue(queue);
 END_TEST
 
+DEFINE_TEST(queue_double_dequeue_fraction)
+    event_queue_t queue = create_queue_double_time(
+        free_data_elem,
+        NULL
+    );
+
+    data_elem_t elem_1 = create_data_elem(10);
+    event_queue_enqueue_double_time(queue, (void *) elem_1, 2.75);
+
+    void * elem_1_ptr;
+    double elem_1_time = event_queue_dequeue_double_time(queue, &elem_1_ptr);
+    ASSERT_EQ(elem_1_time, 2.75)
+    free(elem_1_ptr);
+
+    free_event_queue(queue);
+END_TEST
+
 REGISTER_TESTS(
     queue_double_create_and_destroy,
     queue_double_enqueue_1,
@@ -245,5 +262,6 @@ REGISTER_TESTS(
     queue_double_size_1,
     queue_double_dequeue_1,
     queue_double_dequeue_2,
-    queue_double_size_2
+    queue_double_size_2,
+    queue_double_dequeue_fraction
 )
\ No newline at end of file
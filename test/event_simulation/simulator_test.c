@@ -0,0 +1,137 @@
+#include "test.h"
+#include "simulator.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/*  Records the times at which it fires. */
+struct recorder {
+    struct sim_event event;
+    unsigned int times[8];
+    int count;
+};
+
+static void record(simulator_t sim, sim_event_t event) {
+    struct recorder *rec = (struct recorder *) event->arg;
+    rec->times[rec->count] = simulator_now(sim);
+    rec->count = rec->count + 1;
+}
+
+/*  Reschedules itself every 10 ticks until it has fired three times. */
+static void record_and_repeat(simulator_t sim, sim_event_t event) {
+    struct recorder *rec = (struct recorder *) event->arg;
+    record(sim, event);
+
+    if (rec->count < 3) {
+        simulator_schedule_after(sim, event, 10);
+    }
+}
+
+static int freed_events = 0;
+
+static void count_free(void *event, void *arg) {
+    (void) event;
+    (void) arg;
+
+    freed_events = freed_events + 1;
+}
+
+DEFINE_TEST(simulator_create_and_destroy)
+    simulator_t sim = create_simulator();
+    ASSERT_EQ(simulator_now(sim), 0)
+    ASSERT_EQ(simulator_pending(sim), 0)
+    ASSERT_EQ(simulator_step(sim), 0)
+    free_simulator(sim);
+END_TEST
+
+DEFINE_TEST(simulator_dispatch_order)
+    simulator_t sim = create_simulator();
+
+    struct recorder a = { .count = 0 };
+    struct recorder b = { .count = 0 };
+    sim_event_init(&a.event, record, &a);
+    sim_event_init(&b.event, record, &b);
+
+    simulator_schedule(sim, &a.event, 20);
+    simulator_schedule(sim, &b.event, 5);
+    ASSERT_EQ(simulator_pending(sim), 2)
+
+    unsigned int next;
+    ASSERT_EQ(simulator_next_time(sim, &next), 1)
+    ASSERT_EQ(next, 5)
+
+    ASSERT_EQ(simulator_step(sim), 1)
+    ASSERT_EQ(simulator_now(sim), 5)
+    ASSERT_EQ(b.count, 1)
+    ASSERT_EQ(a.count, 0)
+
+    ASSERT_EQ(simulator_step(sim), 1)
+    ASSERT_EQ(simulator_now(sim), 20)
+    ASSERT_EQ(a.count, 1)
+    ASSERT_EQ(simulator_events_dispatched(sim), 2)
+
+    free_simulator(sim);
+END_TEST
+
+DEFINE_TEST(simulator_reschedule_same_event)
+    simulator_t sim = create_simulator();
+
+    struct recorder rec = { .count = 0 };
+    sim_event_init(&rec.event, record_and_repeat, &rec);
+    simulator_schedule(sim, &rec.event, 1);
+
+    ASSERT_EQ(simulator_run_until(sim, 100), 3)
+    ASSERT_EQ(rec.times[0], 1)
+    ASSERT_EQ(rec.times[1], 11)
+    ASSERT_EQ(rec.times[2], 21)
+
+    free_simulator(sim);
+END_TEST
+
+DEFINE_TEST(simulator_run_until_stops)
+    simulator_t sim = create_simulator();
+
+    struct recorder rec = { .count = 0 };
+    sim_event_init(&rec.event, record_and_repeat, &rec);
+    simulator_schedule(sim, &rec.event, 0);
+
+    ASSERT_EQ(simulator_run_until(sim, 15), 2)
+    ASSERT_EQ(simulator_pending(sim), 1)
+    ASSERT_EQ(simulator_now(sim), 10)
+
+    free_simulator(sim);
+END_TEST
+
+DEFINE_TEST(simulator_free_pending)
+    simulator_t sim = create_simulator();
+
+    struct recorder a = { .count = 0 };
+    struct recorder b = { .count = 0 };
+    sim_event_init(&a.event, record, &a);
+    sim_event_init(&b.event, record, &b);
+    a.event.free_event = count_free;
+
+    simulator_schedule(sim, &a.event, 3);
+    simulator_schedule(sim, &b.event, 4);
+
+    freed_events = 0;
+    free_simulator(sim);
+    ASSERT_EQ(freed_events, 1)
+END_TEST
+
+DEFINE_TEST(simulator_transmission_time)
+    /*  1500 bytes at 10 Gbit/s with 1 ns ticks. */
+    ASSERT_EQ(sim_transmission_time(1500, 10000), 1200)
+
+    /*  Rounds up to a whole tick. */
+    ASSERT_EQ(sim_transmission_time(1, 3000), 3)
+END_TEST
+
+REGISTER_TESTS(
+    simulator_create_and_destroy,
+    simulator_dispatch_order,
+    simulator_reschedule_same_event,
+    simulator_run_until_stops,
+    simulator_free_pending,
+    simulator_transmission_time
+)
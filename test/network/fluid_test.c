@@ -0,0 +1,207 @@
+#include "test.h"
+#include "fluid.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RANDOM_LINKS 30
+#define RANDOM_FLOWS 300
+#define EPSILON 1e-9
+
+static unsigned int lcg_next(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/*  Whether the rates of the active flows are max-min fair: no link is over
+    capacity, and every flow crosses a full link on which no flow gets more
+    than it does. */
+static int is_max_min_fair(fluid_t fluid, const double *capacities, unsigned int num_links, unsigned int (*paths)[4], const unsigned int *lengths) {
+    unsigned int flow, link, hop, other;
+
+    for (link = 0; link < num_links; link++) {
+        if (fluid_link_load(fluid, link) > capacities[link] * (1 + EPSILON)) {
+            return 0;
+        }
+    }
+
+    for (flow = 0; flow < fluid_flows(fluid); flow++) {
+        if (fluid_flow_rate(fluid, flow) == 0) {
+            continue;
+        }
+
+        int bottlenecked = 0;
+        for (hop = 0; hop < lengths[flow] && !bottlenecked; hop++) {
+            link = paths[flow][hop];
+            if (fluid_link_load(fluid, link) < capacities[link] * (1 - EPSILON)) {
+                continue;
+            }
+
+            bottlenecked = 1;
+            for (other = 0; other < fluid_flows(fluid); other++) {
+                unsigned int k;
+                for (k = 0; k < lengths[other]; k++) {
+                    if (paths[other][k] == link &&
+                        fluid_flow_rate(fluid, other) > fluid_flow_rate(fluid, flow) * (1 + EPSILON)) {
+                        bottlenecked = 0;
+                    }
+                }
+            }
+        }
+
+        if (!bottlenecked) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+DEFINE_TEST(shared_link_fair_split)
+    double capacities[1] = { 1.0 };
+    unsigned int path[1] = { 0 };
+    fluid_t fluid = create_fluid(1, capacities);
+
+    unsigned int a = fluid_add_flow(fluid, 0, 1000, path, 1);
+    unsigned int b = fluid_add_flow(fluid, 0, 500, path, 1);
+
+    fluid_run_until(fluid, 500);
+    ASSERT_EQ(fluid_active_flows(fluid), 2)
+    ASSERT_EQ(fluid_flow_rate(fluid, a), 0.5)
+    ASSERT_EQ(fluid_flow_remaining(fluid, a), 750)
+    ASSERT_EQ(fluid_link_load(fluid, 0), 1.0)
+
+    /*  Once b is done a has the link to itself. Its completion has moved
+        twice, once as b joined and once as b left, leaving two stale
+        events. */
+    fluid_run(fluid);
+    ASSERT_TRUE(fluid_flow_done(fluid, b))
+    ASSERT_EQ(fluid_flow_completion_time(fluid, b), 1000)
+    ASSERT_EQ(fluid_flow_completion_time(fluid, a), 1500)
+    ASSERT_EQ(fluid_now(fluid), 1500)
+    ASSERT_EQ(fluid_events(fluid), 4)
+    ASSERT_EQ(fluid_stale_events(fluid), 2)
+    ASSERT_EQ(fluid_active_flows(fluid), 0)
+
+    free_fluid(fluid);
+END_TEST
+
+DEFINE_TEST(bottlenecks_differ)
+    double capacities[2] = { 1.0, 2.0 };
+    unsigned int path_a[1] = { 0 };
+    unsigned int path_b[2] = { 0, 1 };
+    unsigned int path_c[1] = { 1 };
+    fluid_t fluid = create_fluid(2, capacities);
+
+    /*  a and b split link 0, and c takes what b leaves of link 1. */
+    unsigned int a = fluid_add_flow(fluid, 0, 1e6, path_a, 1);
+    unsigned int b = fluid_add_flow(fluid, 0, 1e6, path_b, 2);
+    unsigned int c = fluid_add_flow(fluid, 0, 1e6, path_c, 1);
+
+    fluid_run_until(fluid, 0);
+    ASSERT_EQ(fluid_flow_rate(fluid, a), 0.5)
+    ASSERT_EQ(fluid_flow_rate(fluid, b), 0.5)
+    ASSERT_EQ(fluid_flow_rate(fluid, c), 1.5)
+    ASSERT_EQ(fluid_link_load(fluid, 1), 2.0)
+
+    free_fluid(fluid);
+END_TEST
+
+DEFINE_TEST(unconnected_flows_untouched)
+    double capacities[2] = { 1.0, 1.0 };
+    unsigned int path_x[1] = { 0 };
+    unsigned int path_y[1] = { 1 };
+    fluid_t fluid = create_fluid(2, capacities);
+
+    /*  y shares nothing with x, so x keeps its rate and its event. */
+    unsigned int x = fluid_add_flow(fluid, 0, 1000, path_x, 1);
+    fluid_add_flow(fluid, 10, 100, path_y, 1);
+    fluid_add_flow(fluid, 20, 100, path_y, 1);
+
+    fluid_run(fluid);
+    ASSERT_EQ(fluid_flow_completion_time(fluid, x), 1000)
+    ASSERT_EQ(fluid_rate_changes(fluid), 5)
+    ASSERT_EQ(fluid_stale_events(fluid), 2)
+    ASSERT_EQ(fluid_events(fluid), 6)
+
+    free_fluid(fluid);
+END_TEST
+
+/*  Starts a new flow on link 0 each time one finishes, until ten have. */
+static void chain_next(fluid_t fluid, unsigned int flow, void *arg) {
+    unsigned int *path = (unsigned int *) arg;
+
+    if (flow < 9) {
+        fluid_add_flow(fluid, fluid_now(fluid), 100, path, 1);
+    }
+}
+
+DEFINE_TEST(completion_adds_flows)
+    double capacities[1] = { 2.0 };
+    unsigned int path[1] = { 0 };
+    fluid_t fluid = create_fluid(1, capacities);
+
+    fluid_set_completion(fluid, chain_next, path);
+    fluid_add_flow(fluid, 0, 100, path, 1);
+    fluid_run(fluid);
+
+    ASSERT_EQ(fluid_flows(fluid), 10)
+    ASSERT_TRUE(fluid_flow_done(fluid, 9))
+    ASSERT_EQ(fluid_now(fluid), 500)
+
+    free_fluid(fluid);
+END_TEST
+
+DEFINE_TEST(random_flows_stay_max_min_fair)
+    double capacities[RANDOM_LINKS];
+    unsigned int paths[RANDOM_FLOWS][4];
+    unsigned int lengths[RANDOM_FLOWS];
+    unsigned int state = 7;
+    unsigned int link, flow, hop, other;
+
+    for (link = 0; link < RANDOM_LINKS; link++) {
+        capacities[link] = 1 + lcg_next(&state) % 10;
+    }
+    fluid_t fluid = create_fluid(RANDOM_LINKS, capacities);
+
+    for (flow = 0; flow < RANDOM_FLOWS; flow++) {
+        lengths[flow] = 1 + lcg_next(&state) % 4;
+        for (hop = 0; hop < lengths[flow]; hop++) {
+            int repeated;
+            do {
+                paths[flow][hop] = lcg_next(&state) % RANDOM_LINKS;
+                repeated = 0;
+                for (other = 0; other < hop; other++) {
+                    repeated = repeated || paths[flow][other] == paths[flow][hop];
+                }
+            } while (repeated);
+        }
+
+        double start = (double) (lcg_next(&state) % 100000);
+        double bytes = (double) (1000 + lcg_next(&state) % 100000);
+        fluid_add_flow(fluid, start, bytes, paths[flow], lengths[flow]);
+    }
+
+    double t;
+    for (t = 0; t < 200000; t = t + 5000) {
+        fluid_run_until(fluid, t);
+        ASSERT_TRUE(is_max_min_fair(fluid, capacities, RANDOM_LINKS, paths, lengths))
+    }
+
+    fluid_run(fluid);
+    for (flow = 0; flow < RANDOM_FLOWS; flow++) {
+        ASSERT_TRUE(fluid_flow_done(fluid, flow))
+    }
+    ASSERT_EQ(fluid_events(fluid), 2 * RANDOM_FLOWS)
+    ASSERT_EQ(fluid_events(fluid) + fluid_stale_events(fluid), RANDOM_FLOWS + fluid_rate_changes(fluid))
+
+    free_fluid(fluid);
+END_TEST
+
+REGISTER_TESTS(
+    shared_link_fair_split,
+    bottlenecks_differ,
+    unconnected_flows_untouched,
+    completion_adds_flows,
+    random_flows_stay_max_min_fair
+)
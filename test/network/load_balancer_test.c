@@ -0,0 +1,156 @@
+#include "test.h"
+#include "load_balancer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/*  Edge switch 16 of a k = 4 fat-tree reaches other pods through ports 2
+    and 3. */
+#define EDGE 16
+#define REMOTE_HOST 15
+
+struct lb_fixture {
+    topology_t topology;
+    routing_t routing;
+    unsigned int destination;
+};
+
+static void lb_setup(struct lb_fixture *fixture) {
+    fixture->topology = create_fat_tree(4);
+    fixture->routing = create_routing(fixture->topology, 1);
+    fixture->destination = routing_destination(fixture->routing, REMOTE_HOST);
+}
+
+static void lb_teardown(struct lb_fixture *fixture) {
+    free_routing(fixture->routing);
+    free_topology(fixture->topology);
+}
+
+DEFINE_TEST(load_balancer_crc32c)
+    /*  Standard CRC32C of the bytes "1234" and of 0x12345678 stored little
+        endian. */
+    ASSERT_EQ(load_balancer_hash(0, 0x34333231), 0xf63af4ee)
+    ASSERT_EQ(load_balancer_hash(0, 0x12345678), 0xb2131df3)
+    ASSERT_TRUE(load_balancer_hash(1, 0x12345678) != 0xb2131df3)
+    ASSERT_TRUE(load_balancer_hash_tuple(0, 1, 2, 3, 4, 6) != load_balancer_hash_tuple(0, 1, 2, 4, 3, 6))
+END_TEST
+
+DEFINE_TEST(load_balancer_ecmp)
+    struct lb_fixture fixture;
+    lb_setup(&fixture);
+    load_balancer_t balancer = create_load_balancer(LOAD_BALANCE_ECMP, fixture.routing, EDGE, 0, 0);
+
+    struct packet packet = { .flow_id = 0 };
+    unsigned int per_port[4] = { 0 };
+    unsigned int flow, i;
+
+    for (flow = 0; flow < 10000; flow++) {
+        packet.flow_id = flow;
+        unsigned int port = load_balancer_select(balancer, &packet, fixture.destination, flow);
+        ASSERT_EQ(packet.egress_port, port)
+        per_port[port] += 1;
+
+        /*  Every packet of a flow takes the same port. */
+        for (i = 0; i < 3; i++) {
+            ASSERT_EQ(load_balancer_select(balancer, &packet, fixture.destination, flow + i * 1000), port)
+        }
+    }
+
+    ASSERT_EQ(per_port[0] + per_port[1], 0)
+    ASSERT_TRUE(per_port[2] > 4800 && per_port[2] < 5200)
+
+    free_load_balancer(balancer);
+    lb_teardown(&fixture);
+END_TEST
+
+DEFINE_TEST(load_balancer_flowlet)
+    struct lb_fixture fixture;
+    lb_setup(&fixture);
+    load_balancer_t balancer = create_load_balancer(LOAD_BALANCE_FLOWLET, fixture.routing, EDGE, 100, 0);
+
+    struct packet packet = { .flow_id = 42 };
+    unsigned int port = load_balancer_select(balancer, &packet, fixture.destination, 0);
+    ASSERT_EQ(load_balancer_flowlets(balancer), 1)
+
+    /*  Packets closer together than the gap stay on the same port. */
+    unsigned int now;
+    for (now = 50; now < 1000; now += 50) {
+        ASSERT_EQ(load_balancer_select(balancer, &packet, fixture.destination, now), port)
+    }
+    ASSERT_EQ(load_balancer_flowlets(balancer), 1)
+
+    /*  Every pause of at least the gap starts a new flowlet, which lands on
+        each port about half the time. */
+    unsigned int moved = 0;
+    unsigned int i;
+    for (i = 0; i < 1000; i++) {
+        now = now + 100;
+        unsigned int next = load_balancer_select(balancer, &packet, fixture.destination, now);
+        ASSERT_TRUE(next == 2 || next == 3)
+        moved += next != port;
+        port = next;
+    }
+    ASSERT_EQ(load_balancer_flowlets(balancer), 1001)
+    ASSERT_TRUE(moved > 400 && moved < 600)
+
+    free_load_balancer(balancer);
+    lb_teardown(&fixture);
+END_TEST
+
+DEFINE_TEST(load_balancer_spray)
+    struct lb_fixture fixture;
+    lb_setup(&fixture);
+    load_balancer_t balancer = create_load_balancer(LOAD_BALANCE_SPRAY, fixture.routing, EDGE, 0, 0);
+
+    struct packet packet = { .flow_id = 7 };
+    ASSERT_EQ(load_balancer_select(balancer, &packet, fixture.destination, 0), 2)
+    ASSERT_EQ(load_balancer_select(balancer, &packet, fixture.destination, 0), 3)
+    ASSERT_EQ(load_balancer_select(balancer, &packet, fixture.destination, 0), 2)
+
+    free_load_balancer(balancer);
+    lb_teardown(&fixture);
+END_TEST
+
+DEFINE_TEST(load_balancer_batch)
+    struct lb_fixture fixture;
+    lb_setup(&fixture);
+    load_balancer_t single = create_load_balancer(LOAD_BALANCE_FLOWLET, fixture.routing, 24, 10, 64);
+    load_balancer_t batched = create_load_balancer(LOAD_BALANCE_FLOWLET, fixture.routing, 24, 10, 64);
+
+    /*  Aggregation switch 24, towards every edge switch. */
+    struct packet packets[200];
+    packet_t vector[200];
+    unsigned int destinations[200];
+    unsigned int expected[200];
+    unsigned int round, i;
+
+    for (round = 0; round < 5; round++) {
+        for (i = 0; i < 200; i++) {
+            packets[i].flow_id = i % 37;
+            vector[i] = &packets[i];
+            destinations[i] = i % 8;
+            expected[i] = load_balancer_select(single, &packets[i], destinations[i], round * 7);
+            packets[i].egress_port = 99;
+        }
+
+        load_balancer_select_batch(batched, vector, destinations, 200, round * 7);
+
+        for (i = 0; i < 200; i++) {
+            ASSERT_EQ(packets[i].egress_port, expected[i])
+        }
+    }
+
+    ASSERT_EQ(load_balancer_flowlets(batched), load_balancer_flowlets(single))
+
+    free_load_balancer(single);
+    free_load_balancer(batched);
+    lb_teardown(&fixture);
+END_TEST
+
+REGISTER_TESTS(
+    load_balancer_crc32c,
+    load_balancer_ecmp,
+    load_balancer_flowlet,
+    load_balancer_spray,
+    load_balancer_batch
+)
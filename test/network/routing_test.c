@@ -0,0 +1,157 @@
+#include "test.h"
+#include "routing.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*  Whether two sets of tables for the same topology hold the same routes. */
+static int routing_equal(routing_t a, routing_t b, topology_t topology) {
+    unsigned int n, d;
+
+    for (n = topology->num_hosts; n < topology->num_nodes; n++) {
+        for (d = 0; d < routing_num_destinations(a); d++) {
+            if (memcmp(routing_next_hops(a, n, d), routing_next_hops(b, n, d), routing_words(a) * sizeof(uint64_t)) != 0) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static void make_path(char *path) {
+    strcpy(path, "/tmp/routing_testXXXXXX");
+    int fd = mkstemp(path);
+    close(fd);
+    unlink(path);
+}
+
+DEFINE_TEST(routing_fat_tree)
+    topology_t topology = create_fat_tree(4);
+    routing_t routing = create_routing(topology, 1);
+
+    /*  One destination per edge switch. */
+    ASSERT_EQ(routing_num_destinations(routing), 8)
+    ASSERT_EQ(routing_words(routing), 1)
+
+    /*  Host 0 is under edge 16 in pod 0, host 15 under edge 23 in pod 3. */
+    unsigned int local = routing_destination(routing, 0);
+    unsigned int remote = routing_destination(routing, 15);
+    ASSERT_EQ(routing_destination(routing, 1), local)
+
+    /*  At the edge switch both upward ports lead to a remote pod, and
+        nothing is needed for the local destination. */
+    ASSERT_EQ(routing_next_hops(routing, 16, remote)[0], 0xc)
+    ASSERT_EQ(routing_next_hop_count(routing, 16, local), 0)
+
+    /*  Aggregation switches go up to either core, or straight down within
+        the pod. */
+    ASSERT_EQ(routing_next_hop_count(routing, 24, remote), 2)
+    ASSERT_EQ(routing_next_hops(routing, 24, local)[0], 0x1)
+
+    /*  Core switches have a single path to every pod. */
+    unsigned int d;
+    for (d = 0; d < 8; d++) {
+        ASSERT_EQ(routing_next_hop_count(routing, 32, d), 1)
+    }
+
+    free_routing(routing);
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(routing_leaf_spine)
+    topology_t topology = create_leaf_spine(4, 5, 2);
+    routing_t routing = create_routing(topology, 2);
+
+    /*  Leaves spread over all spines, spines go straight down. */
+    ASSERT_EQ(routing_next_hop_count(routing, 8, 3), 5)
+    ASSERT_EQ(routing_next_hops(routing, 12, 3)[0], 0x8)
+
+    free_routing(routing);
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(routing_dragonfly_minimal)
+    topology_t topology = create_dragonfly(1, 4, 2);
+    routing_t routing = create_routing(topology, 3);
+
+    /*  Every router is a destination and minimal routes are at most
+        local, global, local. */
+    ASSERT_EQ(routing_num_destinations(routing), 36)
+
+    unsigned int n, d;
+    for (n = topology->num_hosts; n < topology->num_nodes; n++) {
+        for (d = 0; d < 36; d++) {
+            if (n - topology->num_hosts == d) {
+                ASSERT_EQ(routing_next_hop_count(routing, n, d), 0)
+            } else {
+                ASSERT_TRUE(routing_next_hop_count(routing, n, d) >= 1)
+            }
+        }
+    }
+
+    free_routing(routing);
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(routing_parallel_matches_serial)
+    topology_t topology = create_fat_tree(16);
+    routing_t serial = create_routing(topology, 1);
+    routing_t parallel = create_routing(topology, 0);
+
+    ASSERT_TRUE(routing_equal(serial, parallel, topology))
+
+    free_routing(serial);
+    free_routing(parallel);
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(routing_cache)
+    char path[64];
+    make_path(path);
+
+    topology_t topology = create_fat_tree(8);
+
+    /*  The first run computes and saves, the second maps the file. */
+    routing_t computed = create_routing_cached(topology, 0, path);
+    ASSERT_FALSE(routing_is_mapped(computed))
+
+    routing_t loaded = create_routing_cached(topology, 0, path);
+    ASSERT_TRUE(routing_is_mapped(loaded))
+    ASSERT_TRUE(routing_equal(computed, loaded, topology))
+
+    /*  Saving again replaces the file rather than rewriting the one still
+        mapped. */
+    struct stat before, after;
+    ASSERT_EQ(stat(path, &before), 0)
+    ASSERT_TRUE(save_routing(computed, path))
+    ASSERT_EQ(stat(path, &after), 0)
+    ASSERT_TRUE(before.st_ino != after.st_ino)
+    ASSERT_TRUE(routing_equal(computed, loaded, topology))
+    routing_t reloaded = load_routing(topology, path);
+    ASSERT_TRUE(reloaded != NULL)
+    ASSERT_TRUE(routing_equal(computed, reloaded, topology))
+    free_routing(reloaded);
+
+    /*  A file saved for another topology is rejected. */
+    topology_t other = create_leaf_spine(4, 4, 4);
+    ASSERT_TRUE(load_routing(other, path) == NULL)
+    ASSERT_TRUE(load_routing(topology, "/tmp/no_such_routing_cache") == NULL)
+
+    free_routing(computed);
+    free_routing(loaded);
+    free_topology(other);
+    free_topology(topology);
+    unlink(path);
+END_TEST
+
+REGISTER_TESTS(
+    routing_fat_tree,
+    routing_leaf_spine,
+    routing_dragonfly_minimal,
+    routing_parallel_matches_serial,
+    routing_cache
+)
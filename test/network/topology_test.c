@@ -0,0 +1,133 @@
+#include "test.h"
+#include "topology.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/*  Check the invariants every topology must satisfy. */
+static int topology_consistent(topology_t topology) {
+    unsigned int n, p;
+
+    if (topology->port_offset[topology->num_nodes] != topology->num_ports) {
+        return 0;
+    }
+
+    for (n = 0; n < topology->num_nodes; n++) {
+        if (n < topology->num_hosts && topology_degree(topology, n) != 1) {
+            return 0;
+        }
+        for (p = topology->port_offset[n]; p < topology->port_offset[n + 1]; p++) {
+            unsigned int q = topology->peer[p];
+            if (topology->port_node[p] != n || topology->peer[q] != p || topology->port_node[q] == n) {
+                return 0;
+            }
+            if (topology->link_type[p] != topology->link_type[q]) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+DEFINE_TEST(topology_fat_tree)
+    topology_t topology = create_fat_tree(4);
+
+    ASSERT_EQ(topology->num_hosts, 16)
+    ASSERT_EQ(topology->num_switches, 20)
+    ASSERT_EQ(topology->num_ports, 2 * (16 + 16 + 16))
+    ASSERT_TRUE(topology_consistent(topology))
+
+    /*  Every switch has k ports. */
+    unsigned int n;
+    for (n = topology->num_hosts; n < topology->num_nodes; n++) {
+        ASSERT_EQ(topology_degree(topology, n), 4)
+    }
+
+    /*  Hosts 0 and 1 share the first edge switch, whose ports go down to
+        the hosts before going up to the aggregation switches. */
+    unsigned int edge = topology_host_switch(topology, 0);
+    ASSERT_EQ(edge, 16)
+    ASSERT_EQ(topology_host_switch(topology, 1), edge)
+    ASSERT_EQ(topology->level[edge], 1)
+    ASSERT_EQ(topology_peer_node(topology, topology->port_offset[edge] + 1), 1)
+    ASSERT_EQ(topology->level[topology_peer_node(topology, topology->port_offset[edge] + 2)], 2)
+
+    /*  Port i of a core switch leads to pod i. */
+    unsigned int core = topology->num_nodes - 1;
+    ASSERT_EQ(topology->level[core], 3)
+    ASSERT_EQ(topology_peer_node(topology, topology->port_offset[core] + 3), 24 + 3 * 2 + 1)
+
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(topology_large_fat_tree)
+    clock_t start = clock();
+    topology_t topology = create_fat_tree(64);
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    printf("k = 64 fat-tree with %u nodes built in %.3f s\n", topology->num_nodes, seconds);
+
+    ASSERT_EQ(topology->num_hosts, 65536)
+    ASSERT_EQ(topology->num_switches, 5120)
+    ASSERT_TRUE(topology_consistent(topology))
+
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(topology_leaf_spine)
+    topology_t topology = create_leaf_spine(6, 3, 10);
+
+    ASSERT_EQ(topology->num_hosts, 60)
+    ASSERT_EQ(topology->num_switches, 9)
+    ASSERT_TRUE(topology_consistent(topology))
+
+    ASSERT_EQ(topology_degree(topology, 60), 13)
+    ASSERT_EQ(topology_degree(topology, 66), 6)
+    ASSERT_EQ(topology->level[66], 2)
+    ASSERT_EQ(topology_host_switch(topology, 59), 65)
+
+    free_topology(topology);
+END_TEST
+
+DEFINE_TEST(topology_dragonfly)
+    /*  a = 4, h = 2 gives 9 groups of 4 routers, with 2 hosts each. */
+    topology_t topology = create_dragonfly(2, 4, 2);
+
+    ASSERT_EQ(topology->num_switches, 36)
+    ASSERT_EQ(topology->num_hosts, 72)
+    ASSERT_TRUE(topology_consistent(topology))
+
+    /*  Every router has p + (a - 1) + h ports, and every pair of groups is
+        joined by exactly one global link. */
+    unsigned int links[9][9] = { { 0 } };
+    unsigned int n, p;
+    for (n = topology->num_hosts; n < topology->num_nodes; n++) {
+        ASSERT_EQ(topology_degree(topology, n), 2 + 3 + 2)
+
+        for (p = topology->port_offset[n]; p < topology->port_offset[n + 1]; p++) {
+            if (topology->link_type[p] == TOPOLOGY_GLOBAL_LINK) {
+                unsigned int from = (n - topology->num_hosts) / 4;
+                unsigned int to = (topology_peer_node(topology, p) - topology->num_hosts) / 4;
+                links[from][to] += 1;
+            }
+        }
+    }
+
+    unsigned int g, h;
+    for (g = 0; g < 9; g++) {
+        for (h = 0; h < 9; h++) {
+            ASSERT_EQ(links[g][h], g == h ? 0 : 1)
+        }
+    }
+
+    free_topology(topology);
+END_TEST
+
+REGISTER_TESTS(
+    topology_fat_tree,
+    topology_large_fat_tree,
+    topology_leaf_spine,
+    topology_dragonfly
+)
@@ -0,0 +1,268 @@
+#include "test.h"
+#include "transport.h"
+#include "link.h"
+#include "port.h"
+#include "aqm.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RATE_10G 10000
+#define MSS 1500
+#define MIN_RTO 1000
+#define NO_DROP ((unsigned int) -1)
+#define MAX_HOSTS 9
+
+/*  Data either goes straight down a link or leaves its host through a
+    port of its own and then a shared bottleneck port, and acknowledgements
+    come back over a link of their own. A chosen segment of a chosen flow
+    can be lost once. */
+struct network {
+    object_pool_t pool;
+    transport_t transport;
+    port_t hosts[MAX_HOSTS];
+    port_t bottleneck;
+    link_t data_link;
+    link_t ack_link;
+
+    unsigned int drop_flow;
+    unsigned int drop_seq;
+    unsigned int completed;
+    unsigned int max_queue;
+    unsigned int num_hosts;
+};
+
+static void network_send(simulator_t sim, packet_t packet, void *arg) {
+    struct network *network = (struct network *) arg;
+
+    if (packet->flags & PACKET_FLAG_ACK) {
+        link_send(network->ack_link, sim, packet, simulator_now(sim));
+        return;
+    }
+
+    if (packet->flow_id == network->drop_flow && packet->seq == network->drop_seq) {
+        network->drop_seq = NO_DROP;
+        object_pool_release(network->pool, packet);
+        return;
+    }
+
+    if (network->bottleneck) {
+        unsigned int host = transport_flow_source(network->transport, packet->flow_id);
+        port_receive(network->hosts[host], sim, packet, simulator_now(sim));
+    } else {
+        link_send(network->data_link, sim, packet, simulator_now(sim));
+    }
+}
+
+static void host_to_bottleneck(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct network *network = (struct network *) arg;
+
+    port_receive(network->bottleneck, sim, packet, head_departure);
+    if (port_queue_bytes(network->bottleneck) > network->max_queue) {
+        network->max_queue = port_queue_bytes(network->bottleneck);
+    }
+}
+
+static void bottleneck_to_link(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    link_send(((struct network *) arg)->data_link, sim, packet, head_departure);
+}
+
+static void link_to_host(simulator_t sim, packet_t packet, unsigned int head_arrival, void *arg) {
+    (void) head_arrival;
+
+    transport_receive(((struct network *) arg)->transport, sim, packet);
+}
+
+static void flow_complete(simulator_t sim, unsigned int flow, void *arg) {
+    (void) sim;
+    (void) flow;
+
+    ((struct network *) arg)->completed++;
+}
+
+static void network_init(struct network *network, transport_mode_t mode, unsigned int num_hosts, unsigned int delay, unsigned int min_rto, int bottleneck) {
+    unsigned int host;
+
+    network->pool = create_packet_pool();
+    network->transport = create_transport(mode, network->pool, num_hosts, MSS, min_rto, network_send, network);
+    transport_set_completion(network->transport, flow_complete, network);
+    network->bottleneck = NULL;
+    if (bottleneck) {
+        for (host = 0; host < num_hosts; host++) {
+            network->hosts[host] = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, host_to_bottleneck, network);
+        }
+        network->bottleneck = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, bottleneck_to_link, network);
+    }
+    network->num_hosts = num_hosts;
+    network->data_link = create_link(delay, link_to_host, network);
+    network->ack_link = create_link(delay, link_to_host, network);
+    network->drop_flow = 0;
+    network->drop_seq = NO_DROP;
+    network->completed = 0;
+    network->max_queue = 0;
+}
+
+/*  The simulator goes first, as events embedded in the models may still be
+    pending. */
+static void network_free(struct network *network, simulator_t sim) {
+    unsigned int host;
+
+    free_simulator(sim);
+    if (network->bottleneck) {
+        for (host = 0; host < network->num_hosts; host++) {
+            free_port(network->hosts[host]);
+        }
+        free_port(network->bottleneck);
+    }
+    free_link(network->data_link);
+    free_link(network->ack_link);
+    free_transport(network->transport);
+    free_object_pool(network->pool);
+}
+
+DEFINE_TEST(slow_start_rounds)
+    simulator_t sim = create_simulator();
+    struct network network;
+
+    network_init(&network, TRANSPORT_RENO, 2, 2000, MIN_RTO, 0);
+
+    /*  Windows of 10, 20, 40 and the last 30 segments, one round trip each
+        plus the tick acknowledgements wait to be batched. */
+    unsigned int flow = transport_add_flow(network.transport, sim, 0, 1, 100 * MSS - 100);
+    ASSERT_EQ(flow, 0)
+    ASSERT_EQ(transport_cwnd(network.transport, flow), 10 * MSS)
+
+    simulator_run_until(sim, 1000000);
+
+    ASSERT_TRUE(transport_flow_done(network.transport, flow))
+    ASSERT_EQ(network.completed, 1)
+    ASSERT_EQ(transport_flow_completion_time(network.transport, flow), 4 * 4001)
+    ASSERT_EQ(transport_cwnd(network.transport, flow), 110 * MSS)
+    ASSERT_EQ(transport_acks(network.transport), 100)
+    ASSERT_EQ(transport_retransmits(network.transport), 0)
+    ASSERT_EQ(object_pool_in_use(network.pool), 0)
+
+    network_free(&network, sim);
+END_TEST
+
+DEFINE_TEST(acks_batched_per_host)
+    simulator_t sim = create_simulator();
+    struct network network;
+    unsigned int i;
+
+    histogram_t latencies = create_histogram(UINT32_MAX, 8);
+    histogram_t completions = create_histogram(UINT32_MAX, 8);
+
+    network_init(&network, TRANSPORT_DCTCP, 9, 2000, MIN_RTO, 0);
+    transport_set_histograms(network.transport, latencies, completions);
+
+    /*  Eight flows from host 0 take the same rounds, so every round of
+        acknowledgements is one batch however many flows it covers. */
+    for (i = 0; i < 8; i++) {
+        transport_add_flow(network.transport, sim, 0, i + 1, 100 * MSS);
+    }
+    ASSERT_EQ(transport_flows(network.transport), 8)
+    ASSERT_EQ(transport_flow_destination(network.transport, 7), 8)
+
+    simulator_run_until(sim, 1000000);
+
+    ASSERT_EQ(network.completed, 8)
+    ASSERT_EQ(transport_acks(network.transport), 800)
+    ASSERT_EQ(transport_ack_batches(network.transport), 4)
+
+    ASSERT_EQ(histogram_count(latencies), 800)
+    ASSERT_EQ(histogram_percentile(latencies, 99), 2000)
+    ASSERT_EQ(histogram_count(completions), 8)
+    ASSERT_EQ(histogram_percentile(completions, 50), 4 * 4001)
+
+    network_free(&network, sim);
+    free_histogram(latencies);
+    free_histogram(completions);
+END_TEST
+
+DEFINE_TEST(fast_retransmit)
+    simulator_t sim = create_simulator();
+    struct network network;
+
+    network_init(&network, TRANSPORT_RENO, 2, 2000, MIN_RTO, 0);
+
+    /*  Losing segment 3 of the first window leaves six duplicates behind
+        it, enough to go back without waiting for the timer. */
+    network.drop_seq = 3;
+    unsigned int flow = transport_add_flow(network.transport, sim, 0, 1, 50 * MSS);
+
+    simulator_run_until(sim, 1000000);
+
+    ASSERT_TRUE(transport_flow_done(network.transport, flow))
+    ASSERT_EQ(transport_retransmits(network.transport), 1)
+    ASSERT_EQ(transport_timeouts(network.transport), 0)
+    ASSERT_EQ(object_pool_in_use(network.pool), 0)
+
+    network_free(&network, sim);
+END_TEST
+
+DEFINE_TEST(timeout_recovers_tail_loss)
+    simulator_t sim = create_simulator();
+    struct network network;
+
+    network_init(&network, TRANSPORT_RENO, 2, 2000, MIN_RTO, 0);
+
+    /*  Nothing follows the last segment, so only the timer can recover it.
+        Two round trips of 4000 give a timeout of 10000, counted from the
+        acknowledgements of segments 0 and 1. */
+    network.drop_seq = 2;
+    unsigned int flow = transport_add_flow(network.transport, sim, 0, 1, 3 * MSS);
+
+    simulator_run_until(sim, 1000000);
+
+    ASSERT_TRUE(transport_flow_done(network.transport, flow))
+    ASSERT_EQ(transport_timeouts(network.transport), 1)
+    ASSERT_EQ(transport_retransmits(network.transport), 1)
+    ASSERT_TRUE(transport_flow_completion_time(network.transport, flow) >= 4001 + 10000 + 4001)
+    ASSERT_TRUE(transport_flow_completion_time(network.transport, flow) <= 4001 + 10000 + 4001 + MIN_RTO / 16)
+    ASSERT_EQ(transport_cwnd(network.transport, flow), 2 * MSS)
+    ASSERT_EQ(object_pool_in_use(network.pool), 0)
+
+    network_free(&network, sim);
+END_TEST
+
+DEFINE_TEST(dctcp_keeps_queue_near_threshold)
+    simulator_t sim = create_simulator();
+    struct network network;
+    unsigned int threshold = 30 * MSS;
+
+    network_init(&network, TRANSPORT_DCTCP, 3, 20000, 200000, 1);
+    aqm_t aqm = create_ecn_threshold(threshold);
+    aqm_attach(aqm, network.bottleneck);
+
+    unsigned int a = transport_add_flow(network.transport, sim, 0, 2, 4000 * MSS);
+    unsigned int b = transport_add_flow(network.transport, sim, 1, 2, 4000 * MSS);
+
+    /*  Past slow start the queue should hover around the threshold. */
+    simulator_run_until(sim, 1000000);
+    ASSERT_TRUE(aqm_count(aqm, AQM_MARK) > 0)
+    ASSERT_TRUE(transport_alpha(network.transport, a) > 0)
+    ASSERT_TRUE(transport_alpha(network.transport, a) < TRANSPORT_ALPHA_ONE)
+    network.max_queue = 0;
+
+    simulator_run_until(sim, 100000000);
+
+    ASSERT_EQ(network.completed, 2)
+    ASSERT_EQ(transport_timeouts(network.transport), 0)
+    ASSERT_TRUE(network.max_queue < 2 * threshold)
+
+    /*  8000 segments at 1.25 bytes per tick take 9600000 ticks. */
+    ASSERT_TRUE(transport_flow_completion_time(network.transport, a) < 11000000)
+    ASSERT_TRUE(transport_flow_completion_time(network.transport, b) < 11000000)
+
+    network_free(&network, sim);
+    free_aqm(aqm);
+END_TEST
+
+REGISTER_TESTS(
+    slow_start_rounds,
+    acks_batched_per_host,
+    fast_retransmit,
+    timeout_recovers_tail_loss,
+    dctcp_keeps_queue_near_threshold
+)
@@ -0,0 +1,146 @@
+#include "test.h"
+#include "histogram.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RANDOM_VALUES 10000
+#define MAX_POINTS 4096
+
+static unsigned int lcg_next(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+static int compare_values(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*  Values spread over many orders of magnitude. */
+static uint64_t random_value(unsigned int *state) {
+    return (uint64_t) (lcg_next(state) % 1000 + 1) << (lcg_next(state) % 20);
+}
+
+DEFINE_TEST(small_values_exact)
+    histogram_t histogram = create_histogram(1000, 4);
+    unsigned int i;
+
+    for (i = 0; i < 16; i++) {
+        histogram_record(histogram, i);
+    }
+
+    ASSERT_EQ(histogram_count(histogram), 16)
+    ASSERT_EQ(histogram_percentile(histogram, 0), 0)
+    ASSERT_EQ(histogram_percentile(histogram, 50), 7)
+    ASSERT_EQ(histogram_percentile(histogram, 100), 15)
+    ASSERT_EQ(histogram_cdf(histogram, 7), 0.5)
+    ASSERT_EQ(histogram_mean(histogram), 7.5)
+
+    free_histogram(histogram);
+END_TEST
+
+DEFINE_TEST(percentiles_within_relative_error)
+    static uint64_t values[RANDOM_VALUES];
+    static const double percentiles[] = { 1, 10, 50, 90, 99, 99.9 };
+    histogram_t histogram = create_histogram(UINT32_MAX, 8);
+    unsigned int state = 3;
+    unsigned int i;
+
+    ASSERT_EQ(histogram_buckets(histogram), 3328)
+
+    for (i = 0; i < RANDOM_VALUES; i++) {
+        values[i] = random_value(&state);
+        histogram_record(histogram, values[i]);
+    }
+    qsort(values, RANDOM_VALUES, sizeof(uint64_t), compare_values);
+
+    /*  A percentile is the top of the bucket holding the value of that
+        rank, never below it and less than 1/128 above. */
+    for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        double target = percentiles[i] / 100 * RANDOM_VALUES;
+        unsigned int rank = (unsigned int) target + ((unsigned int) target < target);
+        uint64_t exact = values[rank - 1];
+        uint64_t estimate = histogram_percentile(histogram, percentiles[i]);
+
+        ASSERT_TRUE(estimate >= exact)
+        ASSERT_TRUE(estimate <= exact + exact / 128)
+    }
+    ASSERT_EQ(histogram_min(histogram), values[0])
+    ASSERT_EQ(histogram_percentile(histogram, 100), values[RANDOM_VALUES - 1])
+
+    free_histogram(histogram);
+END_TEST
+
+DEFINE_TEST(merged_equals_combined)
+    static uint64_t merged_values[MAX_POINTS], combined_values[MAX_POINTS];
+    static double merged_fractions[MAX_POINTS], combined_fractions[MAX_POINTS];
+    histogram_t parts[2] = { create_histogram(UINT32_MAX, 8), create_histogram(UINT32_MAX, 8) };
+    histogram_t combined = create_histogram(UINT32_MAX, 8);
+    unsigned int state = 5;
+    unsigned int i;
+
+    /*  As if two threads had each recorded half of the values. */
+    for (i = 0; i < RANDOM_VALUES; i++) {
+        uint64_t value = random_value(&state);
+
+        histogram_record(parts[i % 2], value);
+        histogram_record(combined, value);
+    }
+    histogram_merge(parts[0], parts[1]);
+
+    ASSERT_EQ(histogram_count(parts[0]), RANDOM_VALUES)
+    ASSERT_EQ(histogram_min(parts[0]), histogram_min(combined))
+    ASSERT_EQ(histogram_max(parts[0]), histogram_max(combined))
+    ASSERT_EQ(histogram_percentile(parts[0], 99), histogram_percentile(combined, 99))
+
+    unsigned int points = histogram_export_cdf(parts[0], merged_values, merged_fractions, MAX_POINTS);
+    ASSERT_EQ(histogram_export_cdf(combined, combined_values, combined_fractions, MAX_POINTS), points)
+    for (i = 0; i < points; i++) {
+        ASSERT_EQ(merged_values[i], combined_values[i])
+        ASSERT_EQ(merged_fractions[i], combined_fractions[i])
+        if (i > 0) {
+            ASSERT_TRUE(merged_values[i] > merged_values[i - 1])
+        }
+    }
+    ASSERT_EQ(merged_fractions[points - 1], 1.0)
+
+    /*  Merging an empty histogram changes nothing. */
+    histogram_reset(parts[1]);
+    histogram_merge(parts[0], parts[1]);
+    ASSERT_EQ(histogram_min(parts[0]), histogram_min(combined))
+
+    free_histogram(parts[0]);
+    free_histogram(parts[1]);
+    free_histogram(combined);
+END_TEST
+
+DEFINE_TEST(overflows_clamped)
+    histogram_t histogram = create_histogram(1000, 8);
+
+    histogram_record_count(histogram, 10, 3);
+    histogram_record(histogram, 5000);
+
+    ASSERT_EQ(histogram_count(histogram), 4)
+    ASSERT_EQ(histogram_overflows(histogram), 1)
+    ASSERT_EQ(histogram_max(histogram), 5000)
+    ASSERT_EQ(histogram_mean(histogram), (3 * 10 + 5000) / 4.0)
+    ASSERT_EQ(histogram_percentile(histogram, 75), 10)
+    ASSERT_EQ(histogram_cdf(histogram, 999), 0.75)
+    ASSERT_EQ(histogram_cdf(histogram, 5000), 1.0)
+
+    /*  Above the maximum only the bucket of the maximum is known. */
+    uint64_t top = histogram_percentile(histogram, 100);
+    ASSERT_TRUE(top >= 1000 && top < 1008)
+
+    free_histogram(histogram);
+END_TEST
+
+REGISTER_TESTS(
+    small_values_exact,
+    percentiles_within_relative_error,
+    merged_equals_combined,
+    overflows_clamped
+)
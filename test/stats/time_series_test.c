@@ -0,0 +1,118 @@
+#include "test.h"
+#include "time_series.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define MAX_WINDOWS 16
+
+DEFINE_TEST(sums_binned_by_window)
+    time_series_t series = create_time_series(TIME_SERIES_SUM, 2, 10, 8, 0);
+    unsigned int starts[MAX_WINDOWS];
+    uint64_t values[MAX_WINDOWS * 2];
+
+    time_series_add(series, 0, 3, 100);
+    time_series_add(series, 0, 7, 50);
+    time_series_add(series, 1, 9, 1);
+    time_series_add(series, 0, 25, 10);
+
+    ASSERT_EQ(time_series_last(series), 2)
+    ASSERT_EQ(time_series_export(series, starts, values, MAX_WINDOWS), 3)
+    ASSERT_EQ(starts[2], 20)
+    ASSERT_EQ(values[0], 150)
+    ASSERT_EQ(values[1], 1)
+    ASSERT_EQ(values[2], 0)
+    ASSERT_EQ(values[3], 0)
+    ASSERT_EQ(values[4], 10)
+    ASSERT_EQ(values[5], 0)
+
+    /*  Advancing only extends the export with empty windows. */
+    time_series_advance(series, 45);
+    ASSERT_EQ(time_series_export(series, starts, values, MAX_WINDOWS), 5)
+    ASSERT_EQ(values[8], 0)
+
+    free_time_series(series);
+END_TEST
+
+DEFINE_TEST(ring_keeps_latest_windows)
+    time_series_t series = create_time_series(TIME_SERIES_SUM, 1, 10, 4, 0);
+    unsigned int starts[MAX_WINDOWS];
+    uint64_t values[MAX_WINDOWS];
+    unsigned int t;
+
+    for (t = 0; t < 100; t++) {
+        time_series_add(series, 0, t, t / 10);
+    }
+
+    ASSERT_EQ(time_series_first(series), 6)
+    ASSERT_EQ(time_series_last(series), 9)
+    ASSERT_EQ(time_series_get(series, 0, 6), 60)
+    ASSERT_EQ(time_series_export(series, starts, values, MAX_WINDOWS), 4)
+    ASSERT_EQ(starts[0], 60)
+    ASSERT_EQ(values[3], 90)
+
+    /*  A long gap leaves only empty windows. */
+    time_series_add(series, 0, 1000, 7);
+    ASSERT_EQ(time_series_first(series), 97)
+    ASSERT_EQ(time_series_get(series, 0, 97), 0)
+    ASSERT_EQ(time_series_get(series, 0, 100), 7)
+
+    free_time_series(series);
+END_TEST
+
+DEFINE_TEST(peaks_carry_levels)
+    time_series_t series = create_time_series(TIME_SERIES_PEAK, 1, 10, 8, 0);
+
+    time_series_add(series, 0, 5, 5);
+    time_series_add(series, 0, 12, 2);
+    time_series_advance(series, 40);
+
+    /*  A window with no update still holds the level set before it. */
+    ASSERT_EQ(time_series_get(series, 0, 0), 5)
+    ASSERT_EQ(time_series_get(series, 0, 1), 5)
+    ASSERT_EQ(time_series_get(series, 0, 2), 2)
+    ASSERT_EQ(time_series_get(series, 0, 4), 2)
+
+    time_series_add(series, 0, 70, 9);
+    ASSERT_EQ(time_series_get(series, 0, 6), 2)
+    ASSERT_EQ(time_series_get(series, 0, 7), 9)
+
+    free_time_series(series);
+END_TEST
+
+DEFINE_TEST(downsampling_keeps_whole_run)
+    time_series_t sums = create_time_series(TIME_SERIES_SUM, 1, 1, 4, 1);
+    time_series_t peaks = create_time_series(TIME_SERIES_PEAK, 1, 1, 4, 1);
+    unsigned int starts[MAX_WINDOWS];
+    uint64_t values[MAX_WINDOWS];
+    unsigned int t;
+
+    for (t = 0; t < 100; t++) {
+        time_series_add(sums, 0, t, 1);
+        time_series_add(peaks, 0, t, t == 40 ? 1000 : t % 7);
+    }
+
+    /*  From windows of 1 up to 32, so that the 100 ticks fit in four. */
+    ASSERT_EQ(time_series_window(sums), 32)
+    ASSERT_EQ(time_series_downsamples(sums), 5)
+    ASSERT_EQ(time_series_export(sums, starts, values, MAX_WINDOWS), 4)
+    ASSERT_EQ(starts[3], 96)
+    ASSERT_EQ(values[0], 32)
+    ASSERT_EQ(values[1], 32)
+    ASSERT_EQ(values[2], 32)
+    ASSERT_EQ(values[3], 4)
+
+    ASSERT_EQ(time_series_get(peaks, 0, 0), 6)
+    ASSERT_EQ(time_series_get(peaks, 0, 1), 1000)
+    ASSERT_EQ(time_series_get(peaks, 0, 3), 6)
+
+    free_time_series(sums);
+    free_time_series(peaks);
+END_TEST
+
+REGISTER_TESTS(
+    sums_binned_by_window,
+    ring_keeps_latest_windows,
+    peaks_carry_levels,
+    downsampling_keeps_whole_run
+)
@@ -0,0 +1,104 @@
+#include "test.h"
+#include "time_weighted.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+static unsigned int lcg_next(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+DEFINE_TEST(mean_of_steps)
+    time_weighted_t stats = create_time_weighted(0, 0, 0, 0);
+
+    time_weighted_update(stats, 10, 4);
+    time_weighted_update(stats, 30, 0);
+
+    ASSERT_EQ(time_weighted_area(stats, 40), 80)
+    ASSERT_EQ(time_weighted_mean(stats, 40), 2.0)
+    ASSERT_EQ(time_weighted_min(stats), 0)
+    ASSERT_EQ(time_weighted_max(stats), 4)
+    ASSERT_EQ(time_weighted_updates(stats), 2)
+
+    /*  The current value counts for the time since the last update. */
+    time_weighted_update(stats, 40, 8);
+    ASSERT_EQ(time_weighted_mean(stats, 60), (80 + 8 * 20) / 60.0)
+
+    free_time_weighted(stats);
+END_TEST
+
+DEFINE_TEST(peaks_at_one_instant)
+    time_weighted_t stats = create_time_weighted(100, 5, 0, 0);
+
+    /*  A burst that arrives and drains at the same time adds nothing to
+        the area, but still sets the maximum. */
+    time_weighted_update(stats, 200, 50);
+    time_weighted_update(stats, 200, 5);
+
+    ASSERT_EQ(time_weighted_max(stats), 50)
+    ASSERT_EQ(time_weighted_mean(stats, 300), 5.0)
+    ASSERT_EQ(time_weighted_mean(stats, 100), 5.0)
+
+    free_time_weighted(stats);
+END_TEST
+
+DEFINE_TEST(time_in_bins)
+    time_weighted_t stats = create_time_weighted(0, 1, 3, 2);
+
+    /*  Bins of 0-1, 2-3 and 4 upwards. */
+    time_weighted_update(stats, 10, 3);
+    time_weighted_update(stats, 15, 100);
+    time_weighted_update(stats, 20, 0);
+
+    ASSERT_EQ(time_weighted_bins(stats), 3)
+    ASSERT_EQ(time_weighted_time_in(stats, 0, 40), 10 + 20)
+    ASSERT_EQ(time_weighted_time_in(stats, 1, 40), 5)
+    ASSERT_EQ(time_weighted_time_in(stats, 2, 40), 5)
+    ASSERT_EQ(time_weighted_fraction_in(stats, 0, 40), 0.75)
+
+    free_time_weighted(stats);
+END_TEST
+
+DEFINE_TEST(matches_fine_sampling)
+    time_weighted_t stats = create_time_weighted(0, 0, 8, 16);
+    unsigned int state = 9;
+    unsigned int value = 0;
+    unsigned int now = 0;
+    unsigned int t;
+    uint64_t sampled = 0;
+    uint64_t sampled_in[8] = { 0 };
+    unsigned int bin;
+
+    /*  A random walk of changes, against sampling every tick. */
+    for (t = 0; t < 100000; t++) {
+        if (lcg_next(&state) % 10 == 0) {
+            value = lcg_next(&state) % 150;
+            time_weighted_update(stats, t, value);
+        }
+        sampled = sampled + value;
+        bin = value / 16 < 8 ? value / 16 : 7;
+        sampled_in[bin] = sampled_in[bin] + 1;
+        now = t + 1;
+    }
+
+    ASSERT_EQ(time_weighted_area(stats, now), sampled)
+    for (bin = 0; bin < 8; bin++) {
+        ASSERT_EQ(time_weighted_time_in(stats, bin, now), sampled_in[bin])
+    }
+
+    /*  A reset starts over from the current value. */
+    time_weighted_reset(stats, now);
+    ASSERT_EQ(time_weighted_area(stats, now + 10), 10 * (uint64_t) value)
+    ASSERT_EQ(time_weighted_max(stats), value)
+    ASSERT_EQ(time_weighted_updates(stats), 0)
+
+    free_time_weighted(stats);
+END_TEST
+
+REGISTER_TESTS(
+    mean_of_steps,
+    peaks_at_one_instant,
+    time_in_bins,
+    matches_fine_sampling
+)
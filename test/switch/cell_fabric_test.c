@@ -0,0 +1,132 @@
+#include "test.h"
+#include "cell_fabric.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/*  Records packets as they are reassembled. */
+struct delivery_log {
+    unsigned int ids[8];
+    unsigned int times[8];
+    int count;
+};
+
+static void log_delivery(simulator_t sim, packet_t packet, void *arg) {
+    struct delivery_log *log = (struct delivery_log *) arg;
+    log->ids[log->count] = packet->id;
+    log->times[log->count] = simulator_now(sim);
+    log->count = log->count + 1;
+}
+
+static packet_t make_packet(
+    object_pool_t pool,
+    unsigned int id,
+    unsigned int length,
+    unsigned int ingress,
+    unsigned int egress
+) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->length = length;
+    packet->ingress_port = ingress;
+    packet->egress_port = egress;
+    return packet;
+}
+
+DEFINE_TEST(cell_fabric_cells_for_length)
+    struct delivery_log log = { .count = 0 };
+    cell_fabric_t fabric = create_cell_fabric(4, 64, 1, log_delivery, &log);
+
+    ASSERT_EQ(cell_fabric_cells_for(fabric, 0), 1)
+    ASSERT_EQ(cell_fabric_cells_for(fabric, 64), 1)
+    ASSERT_EQ(cell_fabric_cells_for(fabric, 65), 2)
+    ASSERT_EQ(cell_fabric_cells_for(fabric, 1500), 24)
+    ASSERT_EQ(cell_fabric_cells_for(fabric, 9000), 141)
+
+    free_cell_fabric(fabric);
+END_TEST
+
+DEFINE_TEST(cell_fabric_segment_runs)
+    object_pool_t pool = create_packet_pool();
+    struct delivery_log log = { .count = 0 };
+    cell_fabric_t fabric = create_cell_fabric(4, 64, 1, log_delivery, &log);
+
+    packet_t first = make_packet(pool, 1, 100, 0, 1);
+    packet_t second = make_packet(pool, 2, 64, 0, 2);
+    packet_t other = make_packet(pool, 3, 64, 1, 2);
+
+    cell_run_t run = cell_fabric_segment(fabric, first);
+    ASSERT_EQ(run.first_cell, 0)
+    ASSERT_EQ(run.count, 2)
+
+    run = cell_fabric_segment(fabric, second);
+    ASSERT_EQ(run.first_cell, 2)
+    ASSERT_EQ(run.count, 1)
+
+    /*  Cell indices are allocated per ingress port. */
+    run = cell_fabric_segment(fabric, other);
+    ASSERT_EQ(run.first_cell, 0)
+
+    ASSERT_EQ(cell_fabric_padding_bytes(fabric), 28)
+
+    free_cell_fabric(fabric);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(cell_fabric_jumbo_single_event)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct delivery_log log = { .count = 0 };
+    cell_fabric_t fabric = create_cell_fabric(4, 64, 2, log_delivery, &log);
+
+    packet_t jumbo = make_packet(pool, 7, 9000, 0, 3);
+    cell_fabric_send(fabric, sim, jumbo);
+
+    ASSERT_EQ(simulator_pending(sim), 1)
+    ASSERT_EQ(cell_fabric_cells_in_flight(fabric, 3), 141)
+
+    simulator_run_until(sim, 1000);
+    ASSERT_EQ(simulator_events_dispatched(sim), 1)
+    ASSERT_EQ(log.count, 1)
+    ASSERT_EQ(log.ids[0], 7)
+    ASSERT_EQ(log.times[0], 282)
+    ASSERT_EQ(cell_fabric_cells_in_flight(fabric, 3), 0)
+    ASSERT_EQ(cell_fabric_packets_reassembled(fabric, 3), 1)
+
+    free_cell_fabric(fabric);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(cell_fabric_egress_serialises_runs)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct delivery_log log = { .count = 0 };
+    cell_fabric_t fabric = create_cell_fabric(4, 64, 1, log_delivery, &log);
+
+    /*  Two packets from different ingresses to the same egress share the
+        egress fabric link, while a third to another egress does not. */
+    cell_fabric_send(fabric, sim, make_packet(pool, 1, 640, 0, 2));
+    cell_fabric_send(fabric, sim, make_packet(pool, 2, 320, 1, 2));
+    cell_fabric_send(fabric, sim, make_packet(pool, 3, 320, 3, 1));
+
+    simulator_run_until(sim, 1000);
+    ASSERT_EQ(log.count, 3)
+    ASSERT_EQ(log.ids[0], 3)
+    ASSERT_EQ(log.times[0], 5)
+    ASSERT_EQ(log.ids[1], 1)
+    ASSERT_EQ(log.times[1], 10)
+    ASSERT_EQ(log.ids[2], 2)
+    ASSERT_EQ(log.times[2], 15)
+
+    free_cell_fabric(fabric);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    cell_fabric_cells_for_length,
+    cell_fabric_segment_runs,
+    cell_fabric_jumbo_single_event,
+    cell_fabric_egress_serialises_runs
+)
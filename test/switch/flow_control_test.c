@@ -0,0 +1,304 @@
+#include "test.h"
+#include "flow_control.h"
+#include "link.h"
+#include "port.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RATE_10G 10000
+#define RATE_2_5G 2500
+#define DELAY 2000
+#define NUM_PACKETS 400
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int priority, unsigned int length) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->priority = priority;
+    packet->length = length;
+    return packet;
+}
+
+/*  A fast sender feeding a slow receiver over a link, with PFC or credits
+    between them. */
+struct fabric {
+    port_t sender;
+    link_t link;
+    port_t receiver;
+    pfc_t pfc;
+    credit_fc_t credit_fc;
+    int drain;
+
+    unsigned int received[FLOW_CONTROL_PRIORITIES];
+    unsigned int delivered;
+    unsigned int dropped;
+    unsigned int last_delivery;
+};
+
+static void sender_to_link(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    link_send(((struct fabric *) arg)->link, sim, packet, head_departure);
+}
+
+static void link_to_receiver(simulator_t sim, packet_t packet, unsigned int head_arrival, void *arg) {
+    struct fabric *fabric = (struct fabric *) arg;
+
+    if (fabric->pfc) {
+        if (!pfc_receive(fabric->pfc, sim, packet)) {
+            fabric->dropped = fabric->dropped + 1;
+            return;
+        }
+    } else {
+        credit_fc_receive(fabric->credit_fc, sim, packet);
+    }
+
+    fabric->received[packet->priority] = fabric->received[packet->priority] + 1;
+    if (fabric->drain) {
+        port_receive(fabric->receiver, sim, packet, head_arrival);
+    }
+}
+
+static void receiver_done(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct fabric *fabric = (struct fabric *) arg;
+
+    (void) head_departure;
+
+    if (fabric->pfc) {
+        pfc_release(fabric->pfc, sim, packet);
+    } else {
+        credit_fc_release(fabric->credit_fc, sim, packet);
+    }
+
+    fabric->delivered = fabric->delivered + 1;
+    fabric->last_delivery = simulator_now(sim);
+}
+
+static void fabric_init(struct fabric *fabric, simulator_t sim, pfc_t pfc, credit_fc_t credit_fc) {
+    unsigned int p;
+
+    fabric->sender = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, sender_to_link, fabric);
+    fabric->link = create_link(DELAY, link_to_receiver, fabric);
+    fabric->receiver = create_port(PORT_STORE_AND_FORWARD, RATE_10G, RATE_2_5G, 64, receiver_done, fabric);
+    fabric->pfc = pfc;
+    fabric->credit_fc = credit_fc;
+    fabric->drain = 1;
+    for (p = 0; p < FLOW_CONTROL_PRIORITIES; p++) {
+        fabric->received[p] = 0;
+    }
+    fabric->delivered = 0;
+    fabric->dropped = 0;
+    fabric->last_delivery = 0;
+
+    if (pfc) {
+        pfc_attach(pfc, fabric->sender, sim);
+    } else {
+        credit_fc_attach(credit_fc, fabric->sender, sim);
+    }
+}
+
+static void fabric_free(struct fabric *fabric) {
+    free_port(fabric->sender);
+    free_link(fabric->link);
+    free_port(fabric->receiver);
+}
+
+/*  Flips the receiving end of a PFC model between above XOFF and below XON
+    every 'gap' ticks. */
+struct storm {
+    struct sim_event event;
+    pfc_t pfc;
+    packet_t packet;
+    unsigned int remaining;
+    unsigned int gap;
+    int holding;
+};
+
+static void storm_flip(simulator_t sim, sim_event_t event) {
+    struct storm *storm = (struct storm *) event->arg;
+
+    if (storm->holding) {
+        pfc_release(storm->pfc, sim, storm->packet);
+    } else {
+        pfc_receive(storm->pfc, sim, storm->packet);
+    }
+    storm->holding = !storm->holding;
+
+    storm->remaining = storm->remaining - 1;
+    if (storm->remaining > 0) {
+        simulator_schedule_after(sim, event, storm->gap);
+    }
+}
+
+DEFINE_TEST(pfc_lossless_with_headroom)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    pfc_t pfc = create_pfc(DELAY, 100000, 30000, 20000, 9000);
+    struct fabric fabric;
+    unsigned int i;
+
+    fabric_init(&fabric, sim, pfc, NULL);
+    for (i = 0; i < NUM_PACKETS; i++) {
+        port_receive(fabric.sender, sim, make_packet(pool, i, 3, 1500), 0);
+    }
+    simulator_run_until(sim, 10000000);
+
+    /*  Everything arrives, the pauses kept the buffer within the XOFF
+        threshold plus headroom, and the pauses are a handful of frames. */
+    ASSERT_EQ(fabric.delivered, NUM_PACKETS)
+    ASSERT_EQ(fabric.dropped, 0)
+    ASSERT_EQ(pfc_headroom_drops(pfc), 0)
+    ASSERT_TRUE(pfc_max_buffered(pfc, 3) > 30000)
+    ASSERT_TRUE(pfc_max_buffered(pfc, 3) <= 39000)
+    ASSERT_EQ(pfc_buffered(pfc, 3), 0)
+    ASSERT_TRUE(pfc_frames_sent(pfc) >= 2)
+    ASSERT_TRUE(pfc_frames_delivered(pfc) <= pfc_frames_sent(pfc))
+    ASSERT_FALSE(pfc_is_paused(pfc, 3, simulator_now(sim)))
+
+    /*  The receiver drains at a quarter of the line rate and is never left
+        idle by the pauses. */
+    ASSERT_TRUE(fabric.last_delivery < NUM_PACKETS * 4800 + 10000)
+
+    fabric_free(&fabric);
+    free_pfc(pfc);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(pfc_headroom_too_small)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    pfc_t pfc = create_pfc(DELAY, 100000, 30000, 20000, 1500);
+    struct fabric fabric;
+    unsigned int i;
+
+    fabric_init(&fabric, sim, pfc, NULL);
+    for (i = 0; i < NUM_PACKETS; i++) {
+        port_receive(fabric.sender, sim, make_packet(pool, i, 3, 1500), 0);
+    }
+    simulator_run_until(sim, 10000000);
+
+    /*  The packets in flight when the pause was sent overflow it. */
+    ASSERT_TRUE(fabric.dropped > 0)
+    ASSERT_EQ(fabric.dropped, pfc_headroom_drops(pfc))
+    ASSERT_EQ(fabric.delivered + fabric.dropped, NUM_PACKETS)
+
+    fabric_free(&fabric);
+    free_pfc(pfc);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(pfc_pause_expiry_per_priority)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    pfc_t pfc = create_pfc(DELAY, 20000, 3000, 1500, 100000);
+    struct fabric fabric;
+    unsigned int i;
+
+    /*  The receiver never drains, so no resume is ever sent and the sender
+        only moves on when its pauses expire. */
+    fabric_init(&fabric, sim, pfc, NULL);
+    fabric.drain = 0;
+    for (i = 0; i < 20; i++) {
+        port_receive(fabric.sender, sim, make_packet(pool, i, 0, 1500), 0);
+    }
+    port_receive(fabric.sender, sim, make_packet(pool, 20, 1, 1500), 0);
+    port_receive(fabric.sender, sim, make_packet(pool, 21, 1, 1500), 0);
+
+    /*  The pause reaches the sender at about 2 * DELAY, after a few
+        packets of priority 0. Priority 1 is not paused and goes. */
+    simulator_run_until(sim, 12000);
+    ASSERT_TRUE(pfc_is_paused(pfc, 0, 12000))
+    ASSERT_FALSE(pfc_is_paused(pfc, 1, 12000))
+    ASSERT_EQ(fabric.received[1], 2)
+    unsigned int first = fabric.received[0];
+    ASSERT_TRUE(first >= 3 && first < 20)
+
+    /*  After the pause expires a few more go, their arrival refreshes the
+        pause, and so on. */
+    simulator_run_until(sim, 30000);
+    ASSERT_TRUE(fabric.received[0] > first)
+    simulator_run_until(sim, 1000000);
+    ASSERT_EQ(fabric.received[0], 20)
+    ASSERT_TRUE(pfc_frames_sent(pfc) >= 3)
+    ASSERT_EQ(pfc_headroom_drops(pfc), 0)
+
+    free_simulator(sim);
+    fabric_free(&fabric);
+    free_pfc(pfc);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(pfc_storm_coalesced)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    pfc_t pfc = create_pfc(5000, 100000, 15000, 5000, 10000);
+    struct storm storm = { .pfc = pfc, .remaining = 100, .gap = 10, .holding = 0 };
+
+    storm.packet = make_packet(pool, 0, 2, 20000);
+    sim_event_init(&storm.event, storm_flip, &storm);
+    simulator_schedule(sim, &storm.event, 0);
+
+    /*  Fifty pauses and fifty resumes within one propagation delay. Only
+        one frame is ever in flight, with the rest merged behind it. */
+    simulator_run_until(sim, 4999);
+    ASSERT_EQ(pfc_frames_sent(pfc), 100)
+    ASSERT_EQ(simulator_pending(sim), 1)
+
+    /*  The first pause lands at 5000, and the merged frame at 5010, holding
+        the pause until the last resume lands at 5990. */
+    simulator_run_until(sim, 5000);
+    ASSERT_TRUE(pfc_is_paused(pfc, 2, 5000))
+    simulator_run_until(sim, 100000);
+    ASSERT_EQ(pfc_frames_delivered(pfc), 2)
+    ASSERT_TRUE(pfc_is_paused(pfc, 2, 5989))
+    ASSERT_FALSE(pfc_is_paused(pfc, 2, 5990))
+    ASSERT_EQ(simulator_pending(sim), 0)
+
+    free_pfc(pfc);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(credit_flow_control)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    credit_fc_t credit_fc = create_credit_fc(DELAY, 6000);
+    struct fabric fabric;
+    unsigned int i;
+
+    fabric_init(&fabric, sim, NULL, credit_fc);
+    for (i = 0; i < NUM_PACKETS; i++) {
+        port_receive(fabric.sender, sim, make_packet(pool, i, i % 2, 1500), 0);
+    }
+
+    /*  Only the buffer's worth of each priority can be sent before the
+        first credits come back. */
+    simulator_run_until(sim, 9000);
+    ASSERT_EQ(credit_fc_credits(credit_fc, 0), 0)
+    ASSERT_EQ(credit_fc_credits(credit_fc, 1), 0)
+
+    simulator_run_until(sim, 10000000);
+
+    /*  Nothing is lost, the buffer never overflowed, all credit is back,
+        and credit returns were merged. */
+    ASSERT_EQ(fabric.delivered, NUM_PACKETS)
+    ASSERT_EQ(credit_fc_credits(credit_fc, 0), 6000)
+    ASSERT_EQ(credit_fc_credits(credit_fc, 1), 6000)
+    ASSERT_EQ(credit_fc_buffered(credit_fc, 0), 0)
+    ASSERT_EQ(credit_fc_returns_sent(credit_fc), NUM_PACKETS)
+    ASSERT_TRUE(credit_fc_returns_delivered(credit_fc) <= NUM_PACKETS)
+    ASSERT_TRUE(fabric.last_delivery < NUM_PACKETS * 4800 + 10000)
+
+    fabric_free(&fabric);
+    free_credit_fc(credit_fc);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    pfc_lossless_with_headroom,
+    pfc_headroom_too_small,
+    pfc_pause_expiry_per_priority,
+    pfc_storm_coalesced,
+    credit_flow_control
+)
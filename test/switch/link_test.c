@@ -0,0 +1,153 @@
+#include "test.h"
+#include "link.h"
+#include "port.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define TRAIN_LENGTH 1000
+
+struct delivery_log {
+    unsigned int count;
+    unsigned int last_id;
+    unsigned int last_time;
+    unsigned int last_head;
+    int in_order;
+};
+
+static void log_delivery(simulator_t sim, packet_t packet, unsigned int head_arrival, void *arg) {
+    struct delivery_log *log = (struct delivery_log *) arg;
+
+    if (log->count > 0 && packet->id != log->last_id + 1) {
+        log->in_order = 0;
+    }
+
+    log->count = log->count + 1;
+    log->last_id = packet->id;
+    log->last_time = simulator_now(sim);
+    log->last_head = head_arrival;
+}
+
+/*  Sends a packet every 'gap' ticks until 'remaining' reaches zero. */
+struct sender {
+    struct sim_event event;
+    link_t link;
+    object_pool_t pool;
+    unsigned int next_id;
+    unsigned int remaining;
+    unsigned int gap;
+};
+
+static void send_next(simulator_t sim, sim_event_t event) {
+    struct sender *sender = (struct sender *) event->arg;
+
+    packet_t packet = packet_pool_alloc(sender->pool);
+    packet->id = sender->next_id;
+    sender->next_id = sender->next_id + 1;
+    link_send(sender->link, sim, packet, simulator_now(sim));
+
+    sender->remaining = sender->remaining - 1;
+    if (sender->remaining > 0) {
+        simulator_schedule_after(sim, event, sender->gap);
+    }
+}
+
+static void port_to_link(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    link_send((link_t) arg, sim, packet, head_departure);
+}
+
+static void link_to_port(simulator_t sim, packet_t packet, unsigned int head_arrival, void *arg) {
+    port_receive((port_t) arg, sim, packet, head_arrival);
+}
+
+static void port_to_log(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    log_delivery(sim, packet, head_departure, arg);
+}
+
+DEFINE_TEST(link_single_packet)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct delivery_log log = { .count = 0, .in_order = 1 };
+    link_t link = create_link(500, log_delivery, &log);
+
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = 1;
+    link_send(link, sim, packet, 0);
+    ASSERT_EQ(link_in_flight(link), 1)
+
+    simulator_run_until(sim, 10000);
+    ASSERT_EQ(log.count, 1)
+    ASSERT_EQ(log.last_time, 500)
+    ASSERT_EQ(log.last_head, 500)
+    ASSERT_EQ(link_in_flight(link), 0)
+
+    free_link(link);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(link_one_event_in_heap)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct delivery_log log = { .count = 0, .in_order = 1 };
+    link_t link = create_link(1000000, log_delivery, &log);
+
+    struct sender sender = {
+        .link = link,
+        .pool = pool,
+        .next_id = 0,
+        .remaining = TRAIN_LENGTH,
+        .gap = 30
+    };
+    sim_event_init(&sender.event, send_next, &sender);
+    simulator_schedule(sim, &sender.event, 0);
+
+    /*  Once the sender has finished every packet is still in flight, but
+        only the link's own event is pending. */
+    simulator_run_until(sim, 30 * TRAIN_LENGTH);
+    ASSERT_EQ(link_in_flight(link), TRAIN_LENGTH)
+    ASSERT_EQ(simulator_pending(sim), 1)
+
+    simulator_run_until(sim, 2000000);
+    ASSERT_EQ(log.count, TRAIN_LENGTH)
+    ASSERT_TRUE(log.in_order)
+    ASSERT_EQ(log.last_time, 1000000 + 30 * (TRAIN_LENGTH - 1))
+
+    free_link(link);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(link_between_ports)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct delivery_log log = { .count = 0, .in_order = 1 };
+
+    port_t far = create_port(PORT_CUT_THROUGH, 10000, 10000, 64, port_to_log, &log);
+    link_t link = create_link(1000, link_to_port, far);
+    port_t near = create_port(PORT_CUT_THROUGH, 10000, 10000, 64, port_to_link, link);
+
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = 1;
+    packet->length = 1500;
+    port_receive(near, sim, packet, 0);
+
+    simulator_run_until(sim, 100000);
+
+    /*  Header time at each port plus the propagation delay. */
+    ASSERT_EQ(log.count, 1)
+    ASSERT_EQ(log.last_time, 1200 + 52 + 1000 + 52)
+    ASSERT_EQ(simulator_events_dispatched(sim), 3)
+
+    free_port(near);
+    free_link(link);
+    free_port(far);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    link_single_packet,
+    link_one_event_in_heap,
+    link_between_ports
+)
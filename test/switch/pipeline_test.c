@@ -0,0 +1,180 @@
+#include "test.h"
+#include "pipeline.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define CYCLE 10
+#define MAX_OUTPUTS 16
+
+/*  Records when packets leave the pipeline and gives them back. */
+struct sink {
+    object_pool_t pool;
+    unsigned int count;
+    unsigned int times[MAX_OUTPUTS];
+    unsigned int ids[MAX_OUTPUTS];
+};
+
+static void sink_output(simulator_t sim, packet_t packet, void *arg) {
+    struct sink *sink = (struct sink *) arg;
+
+    if (sink->count < MAX_OUTPUTS) {
+        sink->times[sink->count] = simulator_now(sim);
+        sink->ids[sink->count] = packet->id;
+    }
+    sink->count = sink->count + 1;
+    object_pool_release(sink->pool, packet);
+}
+
+static packet_t make_packet(object_pool_t pool, unsigned int id) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->length = 64;
+    return packet;
+}
+
+static void count_action(void *arg, packet_t packet) {
+    (void) packet;
+
+    *(unsigned int *) arg = *(unsigned int *) arg + 1;
+}
+
+/*  Feeds one packet into the pipeline when it fires. */
+struct injection {
+    struct sim_event event;
+    pipeline_t pipeline;
+    packet_t packet;
+};
+
+static void inject(simulator_t sim, sim_event_t event) {
+    struct injection *injection = (struct injection *) event->arg;
+
+    pipeline_receive(injection->pipeline, sim, injection->packet);
+}
+
+DEFINE_TEST(single_packet_latency)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sink sink = { pool, 0, { 0 }, { 0 } };
+    unsigned int stages[3] = { 1, 3, 2 };
+    unsigned int parsed = 0;
+    pipeline_t pipeline = create_pipeline(3, stages, CYCLE, sink_output, &sink);
+    struct injection injection = { .pipeline = pipeline, .packet = make_packet(pool, 1) };
+
+    pipeline_set_action(pipeline, 0, count_action, &parsed);
+
+    /*  Taken at cycle 10, then 1 + 3 + 2 cycles through the stages. */
+    sim_event_init(&injection.event, inject, &injection);
+    simulator_schedule(sim, &injection.event, 5);
+    simulator_run_until(sim, 5);
+    ASSERT_EQ(pipeline_packets(pipeline), 1)
+
+    simulator_run_until(sim, 1000);
+
+    ASSERT_EQ(sink.count, 1)
+    ASSERT_EQ(sink.times[0], 70)
+    ASSERT_EQ(parsed, 1)
+    ASSERT_EQ(pipeline_packets(pipeline), 0)
+    ASSERT_EQ(pipeline_cycles(pipeline), 7)
+    ASSERT_EQ(pipeline_events(pipeline), 2)
+    ASSERT_EQ(pipeline_stage_busy(pipeline, 1), 3)
+
+    free_pipeline(pipeline);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(slow_stage_stalls)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sink sink = { pool, 0, { 0 }, { 0 } };
+    unsigned int stages[2] = { 1, 4 };
+    pipeline_t pipeline = create_pipeline(2, stages, CYCLE, sink_output, &sink);
+    unsigned int i;
+
+    for (i = 0; i < 10; i++) {
+        pipeline_receive(pipeline, sim, make_packet(pool, i));
+    }
+    simulator_run_until(sim, 10000);
+
+    /*  One packet every four cycles once the first is through, each
+        waiting three cycles in the first stage behind the one ahead. */
+    ASSERT_EQ(sink.count, 10)
+    ASSERT_EQ(sink.times[0], 60)
+    ASSERT_EQ(sink.times[9], 420)
+    ASSERT_EQ(sink.ids[9], 9)
+    ASSERT_EQ(pipeline_stage_busy(pipeline, 0), 10)
+    ASSERT_EQ(pipeline_stage_busy(pipeline, 1), 40)
+    ASSERT_EQ(pipeline_stage_stalls(pipeline, 0), 27)
+    ASSERT_EQ(pipeline_stage_stalls(pipeline, 1), 0)
+
+    /*  The loop only hands back to the kernel for each output. */
+    ASSERT_EQ(pipeline_events(pipeline), 11)
+
+    free_pipeline(pipeline);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(idle_cycles_skipped)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sink sink = { pool, 0, { 0 }, { 0 } };
+    unsigned int stages[2] = { 2, 2 };
+    pipeline_t pipeline = create_pipeline(2, stages, CYCLE, sink_output, &sink);
+    struct injection later = { .pipeline = pipeline, .packet = make_packet(pool, 2) };
+
+    sim_event_init(&later.event, inject, &later);
+    simulator_schedule(sim, &later.event, 1000000);
+    pipeline_receive(pipeline, sim, make_packet(pool, 1));
+
+    simulator_run_until(sim, 2000000);
+
+    ASSERT_EQ(sink.count, 2)
+    ASSERT_EQ(sink.times[0], 50)
+    ASSERT_EQ(sink.times[1], 1000050)
+    ASSERT_EQ(pipeline_cycles(pipeline), 10)
+    ASSERT_EQ(pipeline_idle_cycles_skipped(pipeline), 1 + 99995)
+    ASSERT_EQ(pipeline_events(pipeline), 4)
+
+    free_pipeline(pipeline);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(arrivals_at_cycle_boundaries)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sink sink = { pool, 0, { 0 }, { 0 } };
+    unsigned int stages[1] = { 1 };
+    pipeline_t pipeline = create_pipeline(1, stages, CYCLE, sink_output, &sink);
+    struct injection injections[4];
+    unsigned int i;
+
+    /*  Arrivals at the same time as a cycle of the running pipeline are
+        taken at the next cycle, whichever event fires first. */
+    for (i = 0; i < 4; i++) {
+        injections[i].pipeline = pipeline;
+        injections[i].packet = make_packet(pool, i);
+        sim_event_init(&injections[i].event, inject, &injections[i]);
+        simulator_schedule(sim, &injections[i].event, i * CYCLE);
+    }
+
+    simulator_run_until(sim, 1000);
+
+    ASSERT_EQ(sink.count, 4)
+    for (i = 0; i < 4; i++) {
+        ASSERT_EQ(sink.times[i], (i + 2) * CYCLE)
+    }
+
+    free_pipeline(pipeline);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    single_packet_latency,
+    slow_stage_stalls,
+    idle_cycles_skipped,
+    arrivals_at_cycle_boundaries
+)
@@ -0,0 +1,190 @@
+#include "test.h"
+#include "port.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define HOPS 3
+#define RATE_10G 10000
+
+/*  A chain of ports, each handing packets to the next with no propagation
+    delay. The last port records what it sends. */
+struct chain {
+    port_t ports[HOPS];
+    unsigned int sent_ids[4];
+    unsigned int sent_times[4];
+    int sent;
+};
+
+struct hop {
+    struct chain *chain;
+    int index;
+};
+
+static void forward(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct hop *hop = (struct hop *) arg;
+    struct chain *chain = hop->chain;
+
+    if (hop->index + 1 < HOPS) {
+        port_receive(chain->ports[hop->index + 1], sim, packet, head_departure);
+    } else {
+        chain->sent_ids[chain->sent] = packet->id;
+        chain->sent_times[chain->sent] = simulator_now(sim);
+        chain->sent = chain->sent + 1;
+    }
+}
+
+static void build_chain(struct chain *chain, struct hop *hops, port_forwarding_mode_t mode) {
+    chain->sent = 0;
+
+    int i;
+    for (i = 0; i < HOPS; i++) {
+        hops[i].chain = chain;
+        hops[i].index = i;
+        chain->ports[i] = create_port(mode, RATE_10G, RATE_10G, 64, forward, &hops[i]);
+    }
+}
+
+static void free_chain(struct chain *chain) {
+    int i;
+    for (i = 0; i < HOPS; i++) {
+        free_port(chain->ports[i]);
+    }
+}
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int length) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->length = length;
+    return packet;
+}
+
+DEFINE_TEST(port_store_and_forward_events)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct chain chain;
+    struct hop hops[HOPS];
+    build_chain(&chain, hops, PORT_STORE_AND_FORWARD);
+
+    port_receive(chain.ports[0], sim, make_packet(pool, 1, 1500), 0);
+    simulator_run_until(sim, 100000);
+
+    /*  A reception and a departure per hop, each taking a full packet
+        time of 1200 ticks. */
+    ASSERT_EQ(simulator_events_dispatched(sim), 2 * HOPS)
+    ASSERT_EQ(chain.sent, 1)
+    ASSERT_EQ(chain.sent_times[0], 4800)
+
+    free_chain(&chain);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(port_cut_through_events)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct chain chain;
+    struct hop hops[HOPS];
+    build_chain(&chain, hops, PORT_CUT_THROUGH);
+
+    port_receive(chain.ports[0], sim, make_packet(pool, 1, 1500), 0);
+    simulator_run_until(sim, 100000);
+
+    /*  One event per hop, each hop adding only the 52 tick header time. */
+    ASSERT_EQ(simulator_events_dispatched(sim), HOPS)
+    ASSERT_EQ(chain.sent, 1)
+    ASSERT_EQ(chain.sent_times[0], 1200 + HOPS * 52)
+
+    free_chain(&chain);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(port_cut_through_congested)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct chain chain;
+    struct hop hops[HOPS];
+    histogram_t delays = create_histogram(UINT32_MAX, 8);
+    time_weighted_t occupancy = create_time_weighted(0, 0, 0, 0);
+    time_series_t sent = create_time_series(TIME_SERIES_SUM, HOPS, 1000, 16, 0);
+    time_series_t queued = create_time_series(TIME_SERIES_PEAK, HOPS, 1000, 16, 0);
+    build_chain(&chain, hops, PORT_CUT_THROUGH);
+    port_set_delay_histogram(chain.ports[0], delays);
+    port_set_queue_statistics(chain.ports[0], occupancy);
+    port_set_time_series(chain.ports[0], sent, queued, 0);
+
+    port_receive(chain.ports[0], sim, make_packet(pool, 1, 1500), 0);
+    port_receive(chain.ports[0], sim, make_packet(pool, 2, 1500), 0);
+    ASSERT_EQ(port_queue_packets(chain.ports[0]), 1)
+    ASSERT_EQ(port_queue_bytes(chain.ports[0]), 1500)
+    ASSERT_TRUE(port_is_busy(chain.ports[0]))
+
+    simulator_run_until(sim, 100000);
+
+    /*  The second packet waits behind the first but still costs one event
+        per hop. */
+    ASSERT_EQ(simulator_events_dispatched(sim), 2 * HOPS)
+    ASSERT_EQ(chain.sent, 2)
+    ASSERT_EQ(chain.sent_ids[0], 1)
+    ASSERT_EQ(chain.sent_ids[1], 2)
+    ASSERT_EQ(chain.sent_times[1], chain.sent_times[0] + 1200)
+    ASSERT_EQ(port_packets_sent(chain.ports[0]), 2)
+
+    /*  The first head leaves once the header is in, the second once the
+        first tail has gone. */
+    ASSERT_EQ(histogram_count(delays), 2)
+    ASSERT_EQ(histogram_min(delays), 52)
+    ASSERT_EQ(histogram_max(delays), 52 + 1200)
+
+    /*  The second packet waits alone until the first tail has gone. */
+    ASSERT_EQ(time_weighted_max(occupancy), 1500)
+    ASSERT_EQ(time_weighted_area(occupancy, 2504), 1500 * 1252)
+    ASSERT_EQ(time_weighted_mean(occupancy, 2504), 750)
+
+    /*  The tails leave at 1252 and 2452, and the queue empties at 1252. */
+    ASSERT_EQ(time_series_last(sent), 2)
+    ASSERT_EQ(time_series_get(sent, 0, 0), 0)
+    ASSERT_EQ(time_series_get(sent, 0, 1), 1500)
+    ASSERT_EQ(time_series_get(sent, 0, 2), 1500)
+    time_series_advance(queued, 2452);
+    ASSERT_EQ(time_series_get(queued, 0, 1), 1500)
+    ASSERT_EQ(time_series_get(queued, 0, 2), 0)
+
+    free_histogram(delays);
+    free_time_weighted(occupancy);
+    free_time_series(sent);
+    free_time_series(queued);
+    free_chain(&chain);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(port_cut_through_slow_input)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct chain chain;
+    struct hop hops[HOPS];
+    build_chain(&chain, hops, PORT_CUT_THROUGH);
+
+    /*  A port fed at half the output rate cannot send the tail before it
+        has arrived. */
+    port_t port = create_port(PORT_CUT_THROUGH, RATE_10G / 2, RATE_10G, 64, forward, &hops[HOPS - 1]);
+    port_receive(port, sim, make_packet(pool, 1, 1500), 0);
+    simulator_run_until(sim, 100000);
+
+    ASSERT_EQ(chain.sent, 1)
+    ASSERT_EQ(chain.sent_times[0], 2400)
+
+    free_port(port);
+    free_chain(&chain);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    port_store_and_forward_events,
+    port_cut_through_events,
+    port_cut_through_congested,
+    port_cut_through_slow_input
+)
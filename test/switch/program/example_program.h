@@ -0,0 +1,165 @@
+/*  example_program.h
+
+    A small switch program used by the tests and benchmarks of program.h:
+    Ethernet with an optional VLAN tag, then IPv4 carrying TCP or UDP,
+    going through an L2 table, an ACL, an IPv4 routing table, a UDP port
+    classifier and a VLAN rewrite table. example_program_process is
+    generated from it at build time. */
+
+#ifndef EXAMPLE_PROGRAM_H
+#define EXAMPLE_PROGRAM_H
+
+#include "program.h"
+
+enum example_header {
+    ETHERNET,
+    VLAN,
+    IPV4,
+    TCP,
+    UDP
+};
+
+enum example_field {
+    ETH_DST_HIGH,
+    ETH_DST_LOW,
+    ETH_TYPE,
+    VLAN_PCP,
+    VLAN_VID,
+    VLAN_TYPE,
+    IPV4_DSCP,
+    IPV4_ECN,
+    IPV4_TTL,
+    IPV4_PROTOCOL,
+    IPV4_SRC,
+    IPV4_DST,
+    TCP_SPORT,
+    TCP_DPORT,
+    UDP_SPORT,
+    UDP_DPORT
+};
+
+enum example_action {
+    NOP,
+    DROP,
+    L2_FORWARD,
+    ROUTE,
+    SET_CLASS,
+    MARK_CE,
+    SET_VLAN
+};
+
+enum example_table {
+    L2_TABLE,
+    ACL_TABLE,
+    ROUTE_TABLE,
+    UDP_TABLE,
+    VLAN_TABLE
+};
+
+static const program_header_t example_headers[] = {
+    { "ethernet", 14 },
+    { "vlan", 4 },
+    { "ipv4", 20 },
+    { "tcp", 20 },
+    { "udp", 8 }
+};
+
+static const program_field_t example_fields[] = {
+    { "eth_dst_high", ETHERNET, 0, 16 },
+    { "eth_dst_low", ETHERNET, 16, 32 },
+    { "eth_type", ETHERNET, 96, 16 },
+    { "vlan_pcp", VLAN, 0, 3 },
+    { "vlan_vid", VLAN, 4, 12 },
+    { "vlan_type", VLAN, 16, 16 },
+    { "ipv4_dscp", IPV4, 8, 6 },
+    { "ipv4_ecn", IPV4, 14, 2 },
+    { "ipv4_ttl", IPV4, 64, 8 },
+    { "ipv4_protocol", IPV4, 72, 8 },
+    { "ipv4_src", IPV4, 96, 32 },
+    { "ipv4_dst", IPV4, 128, 32 },
+    { "tcp_sport", TCP, 0, 16 },
+    { "tcp_dport", TCP, 16, 16 },
+    { "udp_sport", UDP, 0, 16 },
+    { "udp_dport", UDP, 16, 16 }
+};
+
+static const program_transition_t example_ethernet_next[] = { { 0x8100, 1 }, { 0x0800, 2 } };
+static const program_transition_t example_vlan_next[] = { { 0x0800, 2 } };
+static const program_transition_t example_ipv4_next[] = { { 6, 3 }, { 17, 4 } };
+
+static const program_state_t example_states[] = {
+    { ETHERNET, ETH_TYPE, 2, example_ethernet_next, PROGRAM_ACCEPT },
+    { VLAN, VLAN_TYPE, 1, example_vlan_next, PROGRAM_ACCEPT },
+    { IPV4, IPV4_PROTOCOL, 2, example_ipv4_next, PROGRAM_ACCEPT },
+    { TCP, PROGRAM_NONE, 0, NULL, PROGRAM_ACCEPT },
+    { UDP, PROGRAM_NONE, 0, NULL, PROGRAM_ACCEPT }
+};
+
+static const program_op_t example_drop_ops[] = {
+    { PROGRAM_OP_DROP, 0, PROGRAM_NONE, 0 }
+};
+static const program_op_t example_l2_forward_ops[] = {
+    { PROGRAM_OP_EGRESS, 0, 0, 0 }
+};
+static const program_op_t example_route_ops[] = {
+    { PROGRAM_OP_EGRESS, 0, 0, 0 },
+    { PROGRAM_OP_ADD, IPV4_TTL, PROGRAM_NONE, 0xff }
+};
+static const program_op_t example_set_class_ops[] = {
+    { PROGRAM_OP_PRIORITY, 0, 0, 0 },
+    { PROGRAM_OP_SET, IPV4_DSCP, 1, 0 }
+};
+static const program_op_t example_mark_ce_ops[] = {
+    { PROGRAM_OP_SET, IPV4_ECN, PROGRAM_NONE, 3 }
+};
+static const program_op_t example_set_vlan_ops[] = {
+    { PROGRAM_OP_SET, VLAN_VID, 0, 0 },
+    { PROGRAM_OP_SET, VLAN_PCP, 1, 0 }
+};
+
+static const program_action_t example_actions[] = {
+    { "nop", 0, 0, NULL },
+    { "drop", 0, 1, example_drop_ops },
+    { "l2_forward", 1, 1, example_l2_forward_ops },
+    { "route", 1, 2, example_route_ops },
+    { "set_class", 2, 2, example_set_class_ops },
+    { "mark_ce", 0, 1, example_mark_ce_ops },
+    { "set_vlan", 2, 2, example_set_vlan_ops }
+};
+
+static const unsigned int example_l2_keys[] = { ETH_DST_HIGH, ETH_DST_LOW };
+static const unsigned int example_l2_actions[] = { L2_FORWARD, MARK_CE, NOP };
+
+/*  The protocol comes first so that the destination address straddles the
+    two words of the key. */
+static const unsigned int example_acl_keys[] = { IPV4_PROTOCOL, IPV4_SRC, IPV4_DST, TCP_SPORT, TCP_DPORT };
+static const unsigned int example_acl_actions[] = { NOP, DROP, SET_CLASS, MARK_CE };
+
+static const unsigned int example_route_keys[] = { IPV4_DST };
+static const unsigned int example_route_actions[] = { ROUTE, DROP };
+
+static const unsigned int example_udp_keys[] = { UDP_DPORT };
+static const unsigned int example_udp_actions[] = { SET_CLASS, NOP };
+
+static const unsigned int example_vlan_keys[] = { VLAN_VID };
+static const unsigned int example_vlan_actions[] = { SET_VLAN, NOP };
+
+static const program_table_t example_tables[] = {
+    { "l2", PROGRAM_MATCH_EXACT, 2, example_l2_keys, 1024, 3, example_l2_actions, NOP },
+    { "acl", PROGRAM_MATCH_EXACT, 5, example_acl_keys, 1024, 4, example_acl_actions, NOP },
+    { "route", PROGRAM_MATCH_LPM, 1, example_route_keys, 1024, 2, example_route_actions, DROP },
+    { "udp", PROGRAM_MATCH_LPM, 1, example_udp_keys, 64, 2, example_udp_actions, NOP },
+    { "vlan", PROGRAM_MATCH_EXACT, 1, example_vlan_keys, 256, 2, example_vlan_actions, NOP }
+};
+
+static const program_description_t example_program = {
+    5, example_headers,
+    16, example_fields,
+    5, example_states,
+    7, example_actions,
+    5, example_tables
+};
+
+int example_program_process(program_tables_t tables, packet_t packet, unsigned char *frame, unsigned int length);
+
+#endif
@@ -0,0 +1,19 @@
+/*  Writes the code generated for the example program to the file named on
+    the command line, or to the standard output. */
+
+#include "codegen.h"
+#include "example_program.h"
+
+#include <assert.h>
+
+int main(int argc, char **argv) {
+    FILE *out = argc > 1 ? fopen(argv[1], "w") : stdout;
+    assert(out);
+
+    program_generate(&example_program, "example_program_process", out);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include "test.h"
+#include "example_program.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FRAME_BYTES 128
+#define RANDOM_FRAMES 20000
+
+static unsigned int lcg_next(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/*  Write a frame with an optional VLAN tag, an IPv4 header and a TCP or UDP
+    header, returning its length. */
+static unsigned int make_frame(unsigned char *frame, int vlan, unsigned int vid, uint32_t src, uint32_t dst, unsigned int protocol, unsigned int sport, unsigned int dport) {
+    unsigned int offset = 12;
+
+    memset(frame, 0, FRAME_BYTES);
+    frame[0] = 0x02;
+    frame[5] = 0x01;
+    if (vlan) {
+        frame[offset] = 0x81;
+        frame[offset + 2] = (unsigned char) (vid >> 8);
+        frame[offset + 3] = (unsigned char) vid;
+        offset = offset + 4;
+    }
+    frame[offset] = 0x08;
+    offset = offset + 2;
+
+    frame[offset] = 0x45;
+    frame[offset + 1] = 0x02;
+    frame[offset + 8] = 64;
+    frame[offset + 9] = (unsigned char) protocol;
+    frame[offset + 12] = (unsigned char) (src >> 24);
+    frame[offset + 13] = (unsigned char) (src >> 16);
+    frame[offset + 14] = (unsigned char) (src >> 8);
+    frame[offset + 15] = (unsigned char) src;
+    frame[offset + 16] = (unsigned char) (dst >> 24);
+    frame[offset + 17] = (unsigned char) (dst >> 16);
+    frame[offset + 18] = (unsigned char) (dst >> 8);
+    frame[offset + 19] = (unsigned char) dst;
+    offset = offset + 20;
+
+    frame[offset] = (unsigned char) (sport >> 8);
+    frame[offset + 1] = (unsigned char) sport;
+    frame[offset + 2] = (unsigned char) (dport >> 8);
+    frame[offset + 3] = (unsigned char) dport;
+
+    return offset + (protocol == 6 ? 20 : 8);
+}
+
+DEFINE_TEST(descriptions_checked)
+    program_field_t fields[16];
+    program_description_t description = example_program;
+
+    ASSERT_TRUE(program_description_valid(&example_program))
+
+    /*  A field running past the end of its header. */
+    memcpy(fields, example_fields, sizeof(fields));
+    fields[TCP_DPORT].offset = 150;
+    description.fields = fields;
+    ASSERT_FALSE(program_description_valid(&description))
+
+    fields[TCP_DPORT].offset = 16;
+    fields[TCP_DPORT].width = 33;
+    ASSERT_FALSE(program_description_valid(&description))
+
+    fields[TCP_DPORT].width = 16;
+    ASSERT_TRUE(program_description_valid(&description))
+END_TEST
+
+DEFINE_TEST(interpreter_routes)
+    program_tables_t tables = create_program_tables(&example_program);
+    struct packet packet;
+    unsigned char frame[FRAME_BYTES];
+    uint32_t port[1] = { 7 };
+    uint32_t wide[1] = { 3 };
+
+    program_add_lpm(tables, ROUTE_TABLE, 0x0a000000, 8, ROUTE, wide);
+    program_add_lpm(tables, ROUTE_TABLE, 0x0a010200, 24, ROUTE, port);
+    ASSERT_EQ(program_table_entries(tables, ROUTE_TABLE), 2)
+
+    unsigned int length = make_frame(frame, 0, 0, 0xc0a80001, 0x0a010203, 6, 1000, 80);
+    memset(&packet, 0, sizeof(packet));
+    ASSERT_EQ(program_interpret(tables, &packet, frame, length), PROGRAM_FORWARD)
+    ASSERT_EQ(packet.egress_port, 7)
+    ASSERT_EQ(frame[14 + 8], 63)
+
+    length = make_frame(frame, 0, 0, 0xc0a80001, 0x0a7f0000, 6, 1000, 80);
+    ASSERT_EQ(program_interpret(tables, &packet, frame, length), PROGRAM_FORWARD)
+    ASSERT_EQ(packet.egress_port, 3)
+
+    /*  No route takes the default action of the table. */
+    length = make_frame(frame, 0, 0, 0xc0a80001, 0x0b000001, 6, 1000, 80);
+    ASSERT_EQ(program_interpret(tables, &packet, frame, length), PROGRAM_DROP)
+
+    free_program_tables(tables);
+END_TEST
+
+DEFINE_TEST(interpreter_rewrites_fields)
+    program_tables_t tables = create_program_tables(&example_program);
+    struct packet packet;
+    unsigned char frame[FRAME_BYTES];
+    uint32_t port[1] = { 1 };
+    uint32_t vlan[2] = { 0xabc, 5 };
+    uint32_t class[2] = { 2, 0x2e };
+    uint32_t acl_key[5] = { 17, 0xc0a80001, 0x0a000001, 1000, 53 };
+    uint32_t vlan_key[1] = { 0x123 };
+
+    program_add_lpm(tables, ROUTE_TABLE, 0, 0, ROUTE, port);
+    program_add_exact(tables, VLAN_TABLE, vlan_key, SET_VLAN, vlan);
+    program_add_lpm(tables, UDP_TABLE, 53, 16, SET_CLASS, class);
+
+    /*  The ACL keys on TCP ports, so it is skipped for UDP. */
+    program_add_exact(tables, ACL_TABLE, acl_key, DROP, NULL);
+
+    unsigned int length = make_frame(frame, 1, 0x123, 0xc0a80001, 0x0a000001, 17, 1000, 53);
+    memset(&packet, 0, sizeof(packet));
+    ASSERT_EQ(program_interpret(tables, &packet, frame, length), PROGRAM_FORWARD)
+
+    /*  The 3 bit priority and 12 bit VLAN ID share the first two bytes of
+        the tag, and DSCP and ECN the second byte of the IPv4 header. */
+    ASSERT_EQ(frame[14], 0xaa)
+    ASSERT_EQ(frame[15], 0xbc)
+    ASSERT_EQ(frame[18 + 1], 0x2e << 2 | 0x02)
+    ASSERT_EQ(packet.priority, 2)
+
+    free_program_tables(tables);
+END_TEST
+
+DEFINE_TEST(short_frames_stop_parsing)
+    program_tables_t tables = create_program_tables(&example_program);
+    struct packet packet;
+    unsigned char frame[FRAME_BYTES];
+    uint32_t port[1] = { 1 };
+    uint32_t acl_key[5] = { 6, 0xc0a80001, 0x0a000001, 1000, 80 };
+
+    program_add_lpm(tables, ROUTE_TABLE, 0, 0, ROUTE, port);
+    program_add_exact(tables, ACL_TABLE, acl_key, DROP, NULL);
+
+    unsigned int length = make_frame(frame, 0, 0, 0xc0a80001, 0x0a000001, 6, 1000, 80);
+    memset(&packet, 0, sizeof(packet));
+    ASSERT_EQ(program_interpret(tables, &packet, frame, length), PROGRAM_DROP)
+    ASSERT_EQ(example_program_process(tables, &packet, frame, length), PROGRAM_DROP)
+
+    /*  Without the TCP header the ACL does not apply. */
+    ASSERT_EQ(program_interpret(tables, &packet, frame, length - 1), PROGRAM_FORWARD)
+    ASSERT_EQ(example_program_process(tables, &packet, frame, length - 1), PROGRAM_FORWARD)
+    ASSERT_EQ(frame[14 + 8], 62)
+
+    free_program_tables(tables);
+END_TEST
+
+DEFINE_TEST(generated_code_matches_interpreter)
+    program_tables_t tables = create_program_tables(&example_program);
+    unsigned char interpreted[FRAME_BYTES];
+    unsigned char generated[FRAME_BYTES];
+    unsigned int state = 11;
+    unsigned int i;
+
+    /*  Random entries in every table, over small pools of addresses, ports
+        and VLANs so that frames drawn from the same pools often match. */
+    for (i = 0; i < 200; i++) {
+        uint32_t params[2] = { lcg_next(&state) % 64, lcg_next(&state) % 64 };
+        uint32_t mac[2] = { 0x0200, 0x00000001 + lcg_next(&state) % 4 };
+        uint32_t acl_key[5] = { lcg_next(&state) % 2 ? 6 : 17, 0xc0a80000 + lcg_next(&state) % 16, 0x0a000000 + lcg_next(&state) % 16, 1000 + lcg_next(&state) % 4, 80 + lcg_next(&state) % 4 };
+        uint32_t vid[1] = { lcg_next(&state) % 32 };
+        unsigned int acl_actions[4] = { NOP, DROP, SET_CLASS, MARK_CE };
+
+        program_add_exact(tables, L2_TABLE, mac, lcg_next(&state) % 2 ? L2_FORWARD : MARK_CE, params);
+        program_add_exact(tables, ACL_TABLE, acl_key, acl_actions[lcg_next(&state) % 4], params);
+        program_add_lpm(tables, ROUTE_TABLE, 0x0a000000 + (lcg_next(&state) % 16 << 4), 24 + lcg_next(&state) % 9, lcg_next(&state) % 8 ? ROUTE : DROP, params);
+        program_add_lpm(tables, UDP_TABLE, 50 + lcg_next(&state) % 8, 12 + lcg_next(&state) % 5, SET_CLASS, params);
+        program_add_exact(tables, VLAN_TABLE, vid, SET_VLAN, params);
+    }
+
+    for (i = 0; i < RANDOM_FRAMES; i++) {
+        struct packet first, second;
+        unsigned int protocol = lcg_next(&state) % 2 ? 6 : 17;
+        unsigned int length = make_frame(interpreted, lcg_next(&state) % 2, lcg_next(&state) % 32,
+            0xc0a80000 + lcg_next(&state) % 16, 0x0a000000 + lcg_next(&state) % 256, protocol,
+            1000 + lcg_next(&state) % 4, (protocol == 6 ? 80 : 48) + lcg_next(&state) % 16);
+
+        interpreted[5] = (unsigned char) (1 + lcg_next(&state) % 4);
+        if (lcg_next(&state) % 4 == 0) {
+            length = lcg_next(&state) % (length + 1);
+        }
+        memcpy(generated, interpreted, FRAME_BYTES);
+        memset(&first, 0, sizeof(first));
+        memset(&second, 0, sizeof(second));
+
+        ASSERT_EQ(program_interpret(tables, &first, interpreted, length), example_program_process(tables, &second, generated, length))
+        ASSERT_EQ(first.egress_port, second.egress_port)
+        ASSERT_EQ(first.priority, second.priority)
+        ASSERT_EQ(memcmp(interpreted, generated, FRAME_BYTES), 0)
+    }
+
+    free_program_tables(tables);
+END_TEST
+
+REGISTER_TESTS(
+    descriptions_checked,
+    interpreter_routes,
+    interpreter_rewrites_fields,
+    short_frames_stop_parsing,
+    generated_code_matches_interpreter
+)
@@ -0,0 +1,340 @@
+#include "test.h"
+#include "replicator.h"
+#include "port.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_PORTS 70
+#define RATE_10G 10000
+#define NUM_PACKETS 20
+#define GROUP_SIZE 10
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int ingress_port) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->length = 1500;
+    packet->ingress_port = ingress_port;
+    return packet;
+}
+
+static unsigned int lcg_next(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/*  Gives packets back to their pool as ports finish sending them. */
+struct sink {
+    object_pool_t pool;
+    unsigned int count;
+};
+
+static void release_sent(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct sink *sink = (struct sink *) arg;
+
+    (void) sim;
+    (void) head_departure;
+
+    sink->count = sink->count + 1;
+    object_pool_release(sink->pool, packet);
+}
+
+DEFINE_TEST(multicast_shares_descriptor)
+    object_pool_t pool = create_packet_pool();
+    replicator_t replicator = create_replicator(pool, NUM_PORTS);
+    replica_t out[2 * NUM_PORTS + 1];
+
+    unsigned int group = replicator_create_group(replicator);
+    replicator_group_add(replicator, group, 3);
+    replicator_group_add(replicator, group, 65);
+    replicator_group_add(replicator, group, 7);
+    replicator_group_add(replicator, group, 7);
+    ASSERT_EQ(replicator_group_size(replicator, group), 3)
+
+    packet_t packet = make_packet(pool, 42, 0);
+    ASSERT_EQ(replicator_multicast(replicator, packet, group, out), 3)
+
+    /*  Three headers share the one descriptor, in port order. */
+    ASSERT_EQ(object_pool_in_use(pool), 1)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 3)
+    ASSERT_EQ(out[0]->egress_port, 3)
+    ASSERT_EQ(out[1]->egress_port, 7)
+    ASSERT_EQ(out[2]->egress_port, 65)
+    ASSERT_TRUE(out[1]->packet == packet)
+    ASSERT_EQ(out[2]->packet->id, 42)
+    ASSERT_EQ(replicator_references(out[0]), 3)
+
+    /*  Replicas are marked independently. */
+    out[1]->flags = out[1]->flags | PACKET_FLAG_ECN_MARKED;
+    ASSERT_FALSE(out[0]->flags & PACKET_FLAG_ECN_MARKED)
+    ASSERT_FALSE(packet->flags & PACKET_FLAG_ECN_MARKED)
+
+    /*  The descriptor goes back with the last replica. */
+    replicator_release(out[0], replicator);
+    replicator_release(out[2], replicator);
+    ASSERT_EQ(object_pool_in_use(pool), 1)
+    replicator_release(out[1], replicator);
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 0)
+
+    /*  An empty group drops the packet. */
+    unsigned int empty = replicator_create_group(replicator);
+    ASSERT_EQ(replicator_multicast(replicator, make_packet(pool, 1, 0), empty, out), 0)
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+
+    free_replicator(replicator);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(release_in_any_order)
+    object_pool_t pool = create_packet_pool();
+    replicator_t replicator = create_replicator(pool, NUM_PORTS);
+    replica_t replicas[NUM_PACKETS * GROUP_SIZE];
+    unsigned int remaining[NUM_PACKETS];
+    unsigned int live = NUM_PACKETS;
+    unsigned int state = 11;
+    unsigned int i;
+
+    unsigned int group = replicator_create_group(replicator);
+    for (i = 0; i < GROUP_SIZE; i++) {
+        replicator_group_add(replicator, group, 2 * i);
+    }
+
+    for (i = 0; i < NUM_PACKETS; i++) {
+        ASSERT_EQ(replicator_multicast(replicator, make_packet(pool, i, 1), group, &replicas[i * GROUP_SIZE]), GROUP_SIZE)
+        remaining[i] = GROUP_SIZE;
+    }
+    ASSERT_EQ(object_pool_in_use(pool), NUM_PACKETS)
+    ASSERT_EQ(replicator_headers_in_use(replicator), NUM_PACKETS * GROUP_SIZE)
+
+    /*  Shuffle the replicas of all packets together. */
+    for (i = NUM_PACKETS * GROUP_SIZE - 1; i > 0; i--) {
+        unsigned int j = lcg_next(&state) % (i + 1);
+        replica_t swap = replicas[i];
+        replicas[i] = replicas[j];
+        replicas[j] = swap;
+    }
+
+    /*  A descriptor stays in the pool until its last replica goes. */
+    for (i = 0; i < NUM_PACKETS * GROUP_SIZE; i++) {
+        unsigned int id = replicas[i]->packet->id;
+
+        replicator_release(replicas[i], replicator);
+        remaining[id] = remaining[id] - 1;
+        if (remaining[id] == 0) {
+            live = live - 1;
+        }
+        ASSERT_EQ(object_pool_in_use(pool), live)
+        ASSERT_EQ(replicator_headers_in_use(replicator), NUM_PACKETS * GROUP_SIZE - i - 1)
+    }
+
+    free_replicator(replicator);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(forward_and_mirror)
+    object_pool_t pool = create_packet_pool();
+    replicator_t replicator = create_replicator(pool, NUM_PORTS);
+    replica_t out[2 * NUM_PORTS + 1];
+
+    /*  Unicast without mirrors makes a single replica. */
+    packet_t packet = make_packet(pool, 1, 0);
+    ASSERT_EQ(replicator_forward(replicator, packet, 5, out), 1)
+    ASSERT_TRUE(out[0]->packet == packet)
+    ASSERT_EQ(out[0]->egress_port, 5)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 1)
+    replicator_release(out[0], replicator);
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+
+    /*  Ingress mirror of port 2 and egress mirror of port 5, both to 9. */
+    replicator_mirror_ingress(replicator, 2, 9);
+    replicator_mirror_egress(replicator, 5, 9);
+    ASSERT_EQ(replicator_forward(replicator, make_packet(pool, 2, 2), 5, out), 3)
+    ASSERT_EQ(out[0]->egress_port, 9)
+    ASSERT_EQ(out[1]->egress_port, 5)
+    ASSERT_EQ(out[2]->egress_port, 9)
+    ASSERT_EQ(object_pool_in_use(pool), 1)
+
+    /*  Egress mirroring applies to multicast replicas as well. */
+    unsigned int group = replicator_create_group(replicator);
+    replicator_group_add(replicator, group, 4);
+    replicator_group_add(replicator, group, 5);
+    ASSERT_EQ(replicator_multicast(replicator, make_packet(pool, 3, 0), group, out + 3), 3)
+    ASSERT_EQ(out[3]->egress_port, 4)
+    ASSERT_EQ(out[4]->egress_port, 5)
+    ASSERT_EQ(out[5]->egress_port, 9)
+
+    unsigned int i;
+    for (i = 0; i < 6; i++) {
+        replicator_release(out[i], replicator);
+    }
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+
+    /*  Turning the mirror off restores the single replica. */
+    replicator_mirror_egress(replicator, 5, REPLICATOR_NO_MIRROR);
+    ASSERT_EQ(replicator_forward(replicator, make_packet(pool, 4, 0), 5, out), 1)
+    replicator_release(out[0], replicator);
+
+    free_replicator(replicator);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(replicas_of_replicas)
+    object_pool_t pool = create_packet_pool();
+    replicator_t replicator = create_replicator(pool, NUM_PORTS);
+    replica_t first[2 * NUM_PORTS + 1];
+    replica_t second[2 * NUM_PORTS + 1];
+
+    unsigned int group = replicator_create_group(replicator);
+    replicator_group_add(replicator, group, 1);
+    replicator_group_add(replicator, group, 2);
+
+    packet_t packet = make_packet(pool, 7, 0);
+    replicator_multicast(replicator, packet, group, first);
+    first[0]->flags = first[0]->flags | PACKET_FLAG_ECN_MARKED;
+
+    /*  Replicating a replica at the next hop shares the same descriptor
+        and keeps the marks it picked up. */
+    ASSERT_EQ(replicator_multicast_replica(replicator, first[0], group, second), 2)
+    ASSERT_EQ(replicator_references(second[0]), 3)
+    ASSERT_TRUE(second[1]->packet == packet)
+    ASSERT_TRUE(second[1]->flags & PACKET_FLAG_ECN_MARKED)
+    ASSERT_FALSE(first[1]->flags & PACKET_FLAG_ECN_MARKED)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 3)
+
+    /*  A replica sent on to an empty group is only released. */
+    unsigned int empty = replicator_create_group(replicator);
+    ASSERT_EQ(replicator_multicast_replica(replicator, second[0], empty, second + 2), 0)
+    ASSERT_EQ(replicator_references(first[1]), 2)
+
+    replicator_release(first[1], replicator);
+    replicator_release(second[1], replicator);
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 0)
+
+    free_replicator(replicator);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(expand_last_takes_descriptor)
+    object_pool_t pool = create_packet_pool();
+    replicator_t replicator = create_replicator(pool, NUM_PORTS);
+    replica_t out[2 * NUM_PORTS + 1];
+    packet_t expanded[3];
+    unsigned int i;
+
+    unsigned int group = replicator_create_group(replicator);
+    for (i = 0; i < 3; i++) {
+        replicator_group_add(replicator, group, i);
+    }
+
+    packet_t packet = make_packet(pool, 9, 0);
+    replicator_multicast(replicator, packet, group, out);
+    out[2]->arrived = 100;
+    out[2]->flags = PACKET_FLAG_ECN_MARKED;
+
+    /*  The first two get copies, the last the shared descriptor itself. */
+    for (i = 0; i < 3; i++) {
+        expanded[i] = replicator_expand(replicator, out[i]);
+        ASSERT_EQ(expanded[i]->egress_port, i)
+        ASSERT_EQ(expanded[i]->id, 9)
+        ASSERT_EQ(expanded[i]->references, 0)
+    }
+    ASSERT_FALSE(expanded[0] == packet)
+    ASSERT_TRUE(expanded[2] == packet)
+    ASSERT_EQ(expanded[2]->arrived, 100)
+    ASSERT_TRUE(expanded[2]->flags & PACKET_FLAG_ECN_MARKED)
+    ASSERT_EQ(object_pool_in_use(pool), 3)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 0)
+
+    for (i = 0; i < 3; i++) {
+        object_pool_release(pool, expanded[i]);
+    }
+
+    free_replicator(replicator);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(event_queue_free_data_releases)
+    object_pool_t pool = create_packet_pool();
+    replicator_t replicator = create_replicator(pool, NUM_PORTS);
+    event_queue_t queue = create_queue_uint_time(replicator_release, replicator);
+    replica_t out[2 * NUM_PORTS + 1];
+    unsigned int i;
+
+    unsigned int group = replicator_create_group(replicator);
+    for (i = 0; i < GROUP_SIZE; i++) {
+        replicator_group_add(replicator, group, i);
+    }
+
+    /*  Replicas of two multicasts and one unicast are left pending. */
+    ASSERT_EQ(replicator_multicast(replicator, make_packet(pool, 1, 0), group, out), GROUP_SIZE)
+    for (i = 0; i < GROUP_SIZE; i++) {
+        event_queue_enqueue_uint_time(queue, out[i], 100 + i);
+    }
+    ASSERT_EQ(replicator_multicast(replicator, make_packet(pool, 2, 0), group, out), GROUP_SIZE)
+    for (i = 0; i < GROUP_SIZE; i++) {
+        event_queue_enqueue_uint_time(queue, out[i], 200 + i);
+    }
+    ASSERT_EQ(replicator_forward(replicator, make_packet(pool, 3, 0), 1, out), 1)
+    event_queue_enqueue_uint_time(queue, out[0], 300);
+    ASSERT_EQ(object_pool_in_use(pool), 3)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 2 * GROUP_SIZE + 1)
+
+    free_event_queue(queue);
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 0)
+
+    free_replicator(replicator);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(replicas_through_ports)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    replicator_t replicator = create_replicator(pool, 4);
+    struct sink sink = { pool, 0 };
+    replica_t out[9];
+    port_t ports[4];
+    unsigned int i;
+    unsigned int j;
+
+    unsigned int group = replicator_create_group(replicator);
+    for (i = 0; i < 4; i++) {
+        ports[i] = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, release_sent, &sink);
+        replicator_group_add(replicator, group, i);
+    }
+
+    /*  Ports hold packets, so replicas are expanded as they reach them. */
+    for (i = 0; i < 100; i++) {
+        unsigned int n = replicator_multicast(replicator, make_packet(pool, i, 0), group, out);
+        for (j = 0; j < n; j++) {
+            port_t port = ports[out[j]->egress_port];
+            port_receive(port, sim, replicator_expand(replicator, out[j]), 0);
+        }
+    }
+    ASSERT_EQ(object_pool_in_use(pool), 400)
+    ASSERT_EQ(replicator_headers_in_use(replicator), 0)
+
+    simulator_run_until(sim, 10000000);
+
+    ASSERT_EQ(sink.count, 400)
+    ASSERT_EQ(object_pool_in_use(pool), 0)
+
+    for (i = 0; i < 4; i++) {
+        free_port(ports[i]);
+    }
+    free_replicator(replicator);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    multicast_shares_descriptor,
+    release_in_any_order,
+    forward_and_mirror,
+    replicas_of_replicas,
+    expand_last_takes_descriptor,
+    event_queue_free_data_releases,
+    replicas_through_ports
+)
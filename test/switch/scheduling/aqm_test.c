@@ -0,0 +1,325 @@
+#include "test.h"
+#include "aqm.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RATE_10G 10000
+#define NUM_PACKETS 200
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int flags, unsigned int length) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->flags = flags;
+    packet->length = length;
+    return packet;
+}
+
+static void count_packet(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    (void) sim;
+    (void) packet;
+    (void) head_departure;
+
+    *(unsigned int *) arg = *(unsigned int *) arg + 1;
+}
+
+static void count_drop(simulator_t sim, packet_t packet, void *arg) {
+    (void) sim;
+    (void) packet;
+
+    *(unsigned int *) arg = *(unsigned int *) arg + 1;
+}
+
+DEFINE_TEST(red_drop_probability)
+    object_pool_t pool = create_packet_pool();
+    struct aqm_red_profile profile = { 10000, 30000, AQM_PROBABILITY_ONE / 10 };
+    aqm_t aqm = create_red(&profile, 1, 0, 0);
+    packet_t packet = make_packet(pool, 0, 0, 1500);
+    unsigned int drops = 0;
+    unsigned int gap = 0;
+    unsigned int max_gap = 0;
+    unsigned int i;
+
+    /*  Below the minimum threshold nothing is dropped, and above the
+        maximum everything is. */
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQ(aqm_enqueue(aqm, packet, 5000, 0), AQM_PASS)
+    }
+    for (i = 0; i < 100; i++) {
+        aqm_enqueue(aqm, packet, 50000, 0);
+    }
+    ASSERT_TRUE(aqm_average(aqm) >= 49990)
+    ASSERT_EQ(aqm_enqueue(aqm, packet, 50000, 0), AQM_DROP)
+
+    /*  Half way between the thresholds the base probability is just under
+        5%, and with drops spread out evenly there is one every 1 to 21
+        packets, about 10.5 on average. */
+    for (i = 0; i < 100; i++) {
+        aqm_enqueue(aqm, packet, 20000, 0);
+    }
+    for (i = 0; i < 10000; i++) {
+        gap++;
+        if (aqm_enqueue(aqm, packet, 20000, 0) == AQM_DROP) {
+            drops++;
+            max_gap = gap > max_gap ? gap : max_gap;
+            gap = 0;
+        }
+    }
+    ASSERT_TRUE(drops > 850 && drops < 1050)
+    ASSERT_TRUE(max_gap <= 21)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(wred_colors_and_ecn)
+    object_pool_t pool = create_packet_pool();
+    struct aqm_red_profile profiles[AQM_COLORS] = {
+        { 20000, 40000, AQM_PROBABILITY_ONE / 10 },
+        { 10000, 20000, AQM_PROBABILITY_ONE },
+        { 1000, 5000, AQM_PROBABILITY_ONE }
+    };
+    aqm_t aqm = create_wred(profiles, 1, 0, 1);
+    packet_t green = make_packet(pool, 0, PACKET_FLAG_ECN_CAPABLE, 1500);
+    packet_t yellow = make_packet(pool, 1, PACKET_FLAG_YELLOW, 1500);
+    packet_t red = make_packet(pool, 2, PACKET_FLAG_RED | PACKET_FLAG_ECN_CAPABLE, 1500);
+    unsigned int yellow_drops = 0;
+    unsigned int i;
+
+    for (i = 0; i < 100; i++) {
+        aqm_enqueue(aqm, green, 15000, 0);
+    }
+
+    /*  A queue of 15000 is nothing to green packets, half way up the
+        yellow profile and beyond the red one, where even ECN capable
+        packets are dropped. */
+    for (i = 0; i < 1000; i++) {
+        ASSERT_EQ(aqm_enqueue(aqm, green, 15000, 0), AQM_PASS)
+        ASSERT_EQ(aqm_enqueue(aqm, red, 15000, 0), AQM_DROP)
+        yellow_drops += aqm_enqueue(aqm, yellow, 15000, 0) == AQM_DROP;
+    }
+    ASSERT_TRUE(yellow_drops > 500 && yellow_drops < 800)
+    ASSERT_EQ(green->flags & PACKET_FLAG_ECN_MARKED, 0)
+
+    /*  Between the green thresholds ECN capable packets are marked
+        instead. */
+    for (i = 0; i < 100; i++) {
+        aqm_enqueue(aqm, green, 35000, 0);
+    }
+    unsigned long marks = aqm_count(aqm, AQM_MARK);
+    for (i = 0; i < 100; i++) {
+        ASSERT_TRUE(aqm_enqueue(aqm, green, 35000, 0) != AQM_DROP)
+    }
+    ASSERT_TRUE(aqm_count(aqm, AQM_MARK) > marks)
+    ASSERT_TRUE(green->flags & PACKET_FLAG_ECN_MARKED)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(red_idle_ageing)
+    object_pool_t pool = create_packet_pool();
+    struct aqm_red_profile profile = { 100000, 200000, AQM_PROBABILITY_ONE / 10 };
+    aqm_t aqm = create_red(&profile, 2, 1000, 0);
+    packet_t packet = make_packet(pool, 0, 0, 1500);
+    unsigned int i;
+
+    for (i = 0; i < 200; i++) {
+        aqm_enqueue(aqm, packet, 40000, 0);
+    }
+    ASSERT_TRUE(aqm_average(aqm) >= 39990)
+
+    /*  Empty for four packet times: the average is scaled by 0.75^4. */
+    unsigned int before = aqm_average(aqm);
+    aqm_dequeue(aqm, packet, 0, 10000);
+    aqm_enqueue(aqm, packet, 0, 14000);
+    ASSERT_TRUE(aqm_average(aqm) >= before * 316 / 1000 - 1)
+    ASSERT_TRUE(aqm_average(aqm) <= before * 317 / 1000)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(red_idle_ageing_small_weight)
+    object_pool_t pool = create_packet_pool();
+    struct aqm_red_profile profile = { 100000000, 200000000, AQM_PROBABILITY_ONE / 10 };
+    aqm_t aqm = create_red(&profile, 20, 1000, 0);
+    packet_t packet = make_packet(pool, 0, 0, 1500);
+    unsigned int i;
+
+    for (i = 0; i < (1u << 22); i++) {
+        aqm_enqueue(aqm, packet, 4000000, 0);
+    }
+    ASSERT_TRUE(aqm_average(aqm) >= 3900000)
+
+    /*  One packet time scales the average by 1 - 2^-20, about 4 bytes. */
+    unsigned int before = aqm_average(aqm);
+    aqm_dequeue(aqm, packet, 0, 10000);
+    aqm_enqueue(aqm, packet, 0, 11000);
+    ASSERT_TRUE(aqm_average(aqm) < before)
+    ASSERT_TRUE(aqm_average(aqm) >= before - 5)
+
+    /*  2^20 packet times scale it by about 1 / e. */
+    before = aqm_average(aqm);
+    aqm_dequeue(aqm, packet, 0, 20000);
+    aqm_enqueue(aqm, packet, 0, 20000 + (1000u << 20));
+    ASSERT_TRUE(aqm_average(aqm) >= (uint64_t) before * 3678 / 10000)
+    ASSERT_TRUE(aqm_average(aqm) <= (uint64_t) before * 3680 / 10000)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(red_without_idle_ageing)
+    object_pool_t pool = create_packet_pool();
+    struct aqm_red_profile profile = { 100000, 200000, AQM_PROBABILITY_ONE / 10 };
+    aqm_t aqm = create_red(&profile, 2, 0, 0);
+    packet_t packet = make_packet(pool, 0, 0, 1500);
+    unsigned int i;
+
+    for (i = 0; i < 200; i++) {
+        aqm_enqueue(aqm, packet, 40000, 0);
+    }
+
+    /*  An arrival after the queue empties counts as an ordinary sample of
+        an empty queue, however long it stayed empty. */
+    unsigned int before = aqm_average(aqm);
+    ASSERT_EQ(aqm_dequeue(aqm, packet, 0, 10000), AQM_PASS)
+    aqm_enqueue(aqm, packet, 0, 1000000);
+    ASSERT_TRUE(aqm_average(aqm) >= before * 3 / 4 - 1)
+    ASSERT_TRUE(aqm_average(aqm) <= before * 3 / 4 + 1)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(ecn_threshold_marking)
+    object_pool_t pool = create_packet_pool();
+    aqm_t aqm = create_ecn_threshold(30000);
+    packet_t capable = make_packet(pool, 0, PACKET_FLAG_ECN_CAPABLE, 1500);
+    packet_t legacy = make_packet(pool, 1, 0, 1500);
+
+    ASSERT_EQ(aqm_enqueue(aqm, capable, 29999, 0), AQM_PASS)
+    ASSERT_FALSE(capable->flags & PACKET_FLAG_ECN_MARKED)
+    ASSERT_EQ(aqm_enqueue(aqm, capable, 30000, 0), AQM_MARK)
+    ASSERT_TRUE(capable->flags & PACKET_FLAG_ECN_MARKED)
+
+    /*  Packets that cannot be marked are let through. */
+    ASSERT_EQ(aqm_enqueue(aqm, legacy, 100000, 0), AQM_PASS)
+    ASSERT_EQ(aqm_count(aqm, AQM_MARK), 1)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(codel_control_law)
+    object_pool_t pool = create_packet_pool();
+    aqm_t aqm = create_codel(5000, 100000, 0);
+    packet_t packet = make_packet(pool, 0, 0, 1500);
+    unsigned int drop_times[4];
+    unsigned int drops = 0;
+    unsigned int now;
+
+    /*  Every packet leaves having waited 10000 ticks with a standing queue
+        behind it. */
+    for (now = 0; now < 330000; now += 1000) {
+        packet->arrived = now - 10000;
+        if (aqm_dequeue(aqm, packet, 100000, now) == AQM_DROP) {
+            drop_times[drops] = now;
+            drops++;
+        }
+    }
+
+    /*  The first drop comes an interval after the queue went bad, then at
+        intervals of 100000 / sqrt(n). */
+    ASSERT_EQ(drops, 4)
+    ASSERT_EQ(drop_times[0], 100000)
+    ASSERT_EQ(drop_times[1], 200000)
+    ASSERT_EQ(drop_times[2], 271000)
+    ASSERT_EQ(drop_times[3], 329000)
+
+    /*  Dropping stops as soon as the sojourn time is back below target. */
+    packet->arrived = now - 1000;
+    ASSERT_EQ(aqm_dequeue(aqm, packet, 100000, now), AQM_PASS)
+    packet->arrived = now - 10000;
+    ASSERT_EQ(aqm_dequeue(aqm, packet, 100000, now + 100000), AQM_PASS)
+
+    free_aqm(aqm);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(red_port)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct aqm_red_profile profile = { 15000, 45000, AQM_PROBABILITY_ONE / 10 };
+    aqm_t aqm = create_red(&profile, 2, 1200, 0);
+    port_t port;
+    unsigned int sent = 0;
+    unsigned int dropped = 0;
+    unsigned int i;
+
+    port = create_port(PORT_STORE_AND_FORWARD, RATE_10G, RATE_10G, 64, count_packet, &sent);
+    aqm_attach(aqm, port);
+    port_set_drop_handler(port, count_drop, &dropped);
+
+    /*  A burst far bigger than the thresholds. */
+    for (i = 0; i < NUM_PACKETS; i++) {
+        port_receive(port, sim, make_packet(pool, i, 0, 1500), 0);
+    }
+    simulator_run_until(sim, 10000000);
+
+    ASSERT_TRUE(dropped > 0)
+    ASSERT_EQ(dropped, port_packets_dropped(port))
+    ASSERT_EQ(sent + dropped, NUM_PACKETS)
+    ASSERT_EQ(port_queue_packets(port), 0)
+    ASSERT_EQ(port_queue_bytes(port), 0)
+
+    free_port(port);
+    free_aqm(aqm);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(codel_port_without_timers)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    aqm_t aqm = create_codel(5000, 50000, 0);
+    port_t port;
+    unsigned int sent = 0;
+    unsigned int dropped = 0;
+    unsigned int i;
+
+    port = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, count_packet, &sent);
+    aqm_attach(aqm, port);
+    port_set_drop_handler(port, count_drop, &dropped);
+
+    for (i = 0; i < NUM_PACKETS; i++) {
+        port_receive(port, sim, make_packet(pool, i, 0, 1500), 0);
+    }
+    simulator_run_until(sim, 10000000);
+
+    /*  Drops happen as packets are taken for transmission, so the only
+        events are the departures of the packets actually sent. */
+    ASSERT_TRUE(dropped > 0)
+    ASSERT_EQ(aqm_count(aqm, AQM_DROP), dropped)
+    ASSERT_EQ(sent + dropped, NUM_PACKETS)
+    ASSERT_EQ(simulator_events_dispatched(sim), sent)
+    ASSERT_EQ(port_queue_packets(port), 0)
+
+    free_port(port);
+    free_aqm(aqm);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    red_drop_probability,
+    wred_colors_and_ecn,
+    red_idle_ageing,
+    red_idle_ageing_small_weight,
+    red_without_idle_ageing,
+    ecn_threshold_marking,
+    codel_control_law,
+    red_port,
+    codel_port_without_timers
+)
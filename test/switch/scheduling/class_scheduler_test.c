@@ -0,0 +1,198 @@
+#include "test.h"
+#include "class_scheduler.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RATE_10G 10000
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int priority, unsigned int length) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->priority = priority;
+    packet->length = length;
+    return packet;
+}
+
+/*  Records the order in which a port sends packets. */
+struct sent_log {
+    unsigned int ids[8];
+    unsigned int count;
+};
+
+static void record(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct sent_log *log = (struct sent_log *) arg;
+
+    (void) sim;
+    (void) head_departure;
+
+    log->ids[log->count] = packet->id;
+    log->count = log->count + 1;
+}
+
+DEFINE_TEST(class_scheduler_strict)
+    object_pool_t pool = create_packet_pool();
+    class_scheduler_t scheduler = create_class_scheduler(CLASS_SCHEDULE_STRICT, 8, NULL);
+    unsigned int priorities[] = { 5, 2, 7, 2, 0, 9 };
+    unsigned int expected[] = { 4, 1, 3, 0, 2, 5 };
+    unsigned int i;
+
+    ASSERT_TRUE(class_scheduler_dequeue(scheduler) == NULL)
+
+    for (i = 0; i < 6; i++) {
+        class_scheduler_enqueue(scheduler, make_packet(pool, i, priorities[i], 100 + i));
+    }
+
+    /*  Priority 9 is beyond the last class and joins it. */
+    ASSERT_EQ(class_scheduler_packets(scheduler, 7), 2)
+    ASSERT_EQ(class_scheduler_bytes(scheduler, 2), 204)
+    ASSERT_EQ(class_scheduler_size(scheduler), 6)
+
+    for (i = 0; i < 6; i++) {
+        ASSERT_EQ(class_scheduler_dequeue(scheduler)->id, expected[i])
+    }
+    ASSERT_TRUE(class_scheduler_dequeue(scheduler) == NULL)
+
+    free_class_scheduler(scheduler);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(class_scheduler_drr)
+    object_pool_t pool = create_packet_pool();
+    unsigned int quanta[4] = { 1500, 3000, 1500, 1500 };
+    class_scheduler_t scheduler = create_class_scheduler(CLASS_SCHEDULE_DRR, 4, quanta);
+    unsigned int bytes[4] = { 0, 0, 0, 0 };
+    unsigned int i;
+
+    /*  Class 0 sends large packets, class 1 small ones with twice the
+        quantum, class 3 mid sized ones; class 2 is idle. */
+    for (i = 0; i < 1000; i++) {
+        class_scheduler_enqueue(scheduler, make_packet(pool, i, 0, 1500));
+        class_scheduler_enqueue(scheduler, make_packet(pool, i, 1, 64));
+        class_scheduler_enqueue(scheduler, make_packet(pool, i, 1, 64));
+        class_scheduler_enqueue(scheduler, make_packet(pool, i, 3, 700));
+    }
+
+    /*  Serve 200 kB and check bytes follow the quanta, 1:2:1, to within
+        a packet per round. */
+    unsigned int total = 0;
+    while (total < 200000) {
+        packet_t packet = class_scheduler_dequeue(scheduler);
+        bytes[packet->priority] += packet->length;
+        total += packet->length;
+    }
+    ASSERT_TRUE(bytes[0] >= 48000 && bytes[0] <= 52000)
+    ASSERT_TRUE(bytes[1] >= 98000 && bytes[1] <= 102000)
+    ASSERT_EQ(bytes[2], 0)
+    ASSERT_TRUE(bytes[3] >= 48000 && bytes[3] <= 52000)
+
+    /*  Everything drains in the end. */
+    while (class_scheduler_dequeue(scheduler)) {
+    }
+    ASSERT_EQ(class_scheduler_size(scheduler), 0)
+
+    free_class_scheduler(scheduler);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(class_scheduler_wrr)
+    object_pool_t pool = create_packet_pool();
+    unsigned int weights[3] = { 1, 3, 2 };
+    class_scheduler_t scheduler = create_class_scheduler(CLASS_SCHEDULE_WRR, 3, weights);
+    unsigned int i;
+
+    for (i = 0; i < 10; i++) {
+        class_scheduler_enqueue(scheduler, make_packet(pool, i, 0, 1500));
+        class_scheduler_enqueue(scheduler, make_packet(pool, 10 + i, 1, 64));
+    }
+    class_scheduler_enqueue(scheduler, make_packet(pool, 20, 2, 64));
+
+    /*  One from class 0, three from class 1, the only packet of class 2,
+        then round again without it. */
+    unsigned int expected[] = { 0, 10, 11, 12, 20, 1, 13, 14, 15, 2 };
+    for (i = 0; i < 10; i++) {
+        ASSERT_EQ(class_scheduler_dequeue(scheduler)->id, expected[i])
+    }
+
+    free_class_scheduler(scheduler);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(class_scheduler_port)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sent_log log = { { 0 }, 0 };
+    class_scheduler_t scheduler = create_class_scheduler(CLASS_SCHEDULE_STRICT, 4, NULL);
+    port_t port = create_port(PORT_STORE_AND_FORWARD, RATE_10G, RATE_10G, 64, record, &log);
+    class_scheduler_attach(scheduler, port);
+
+    /*  All four arrive together; the port picks them up in priority order
+        as each departure frees the link. */
+    port_receive(port, sim, make_packet(pool, 0, 3, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 1, 2, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 2, 0, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 3, 1, 1500), 0);
+    simulator_run_until(sim, 100000);
+
+    ASSERT_EQ(log.count, 4)
+    ASSERT_EQ(log.ids[0], 0)
+    ASSERT_EQ(log.ids[1], 2)
+    ASSERT_EQ(log.ids[2], 3)
+    ASSERT_EQ(log.ids[3], 1)
+    ASSERT_EQ(port_queue_packets(port), 0)
+
+    free_port(port);
+    free_class_scheduler(scheduler);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(class_scheduler_time_series)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sent_log log = { { 0 }, 0 };
+    class_scheduler_t scheduler = create_class_scheduler(CLASS_SCHEDULE_STRICT, 3, NULL);
+    port_t port = create_port(PORT_STORE_AND_FORWARD, RATE_10G, RATE_10G, 64, record, &log);
+    time_series_t queued = create_time_series(TIME_SERIES_PEAK, 4, 1000, 16, 0);
+    class_scheduler_attach(scheduler, port);
+
+    /*  Series 0 is left for the port as a whole. */
+    class_scheduler_set_time_series(scheduler, queued, 1);
+
+    port_receive(port, sim, make_packet(pool, 0, 2, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 1, 2, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 2, 2, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 3, 0, 1000), 0);
+    simulator_run_until(sim, 100000);
+    time_series_advance(queued, 6000);
+
+    ASSERT_EQ(log.count, 4)
+
+    /*  Tails arrive at 800 and 1200 ticks, the high priority packet going
+        straight out. The low priority ones wait behind it and leave one
+        every 1200 ticks from 1600. */
+    ASSERT_EQ(time_series_get(queued, 1, 0), 1000)
+    ASSERT_EQ(time_series_get(queued, 1, 1), 0)
+    ASSERT_EQ(time_series_get(queued, 3, 0), 0)
+    ASSERT_EQ(time_series_get(queued, 3, 1), 4500)
+    ASSERT_EQ(time_series_get(queued, 3, 2), 3000)
+    ASSERT_EQ(time_series_get(queued, 3, 3), 1500)
+    ASSERT_EQ(time_series_get(queued, 3, 4), 1500)
+    ASSERT_EQ(time_series_get(queued, 3, 5), 0)
+    ASSERT_EQ(time_series_get(queued, 0, 1), 0)
+    ASSERT_EQ(time_series_get(queued, 2, 1), 0)
+
+    free_time_series(queued);
+    free_port(port);
+    free_class_scheduler(scheduler);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    class_scheduler_strict,
+    class_scheduler_drr,
+    class_scheduler_wrr,
+    class_scheduler_port,
+    class_scheduler_time_series
+)
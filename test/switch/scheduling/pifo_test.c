@@ -0,0 +1,183 @@
+#include "test.h"
+#include "pifo.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RATE_10G 10000
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int flow_id, unsigned int length) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->flow_id = flow_id;
+    packet->length = length;
+    return packet;
+}
+
+static unsigned int classify_by_priority(void *arg, packet_t packet) {
+    const unsigned int *leaves = (const unsigned int *) arg;
+    return leaves[packet->priority];
+}
+
+/*  Records the order in which a port sends packets. */
+struct sent_log {
+    unsigned int ids[8];
+    unsigned int count;
+};
+
+static void record(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct sent_log *log = (struct sent_log *) arg;
+
+    (void) sim;
+    (void) head_departure;
+
+    log->ids[log->count] = packet->id;
+    log->count = log->count + 1;
+}
+
+DEFINE_TEST(pifo_order)
+    object_pool_t pool = create_packet_pool();
+    pifo_t pifo = create_pifo();
+    unsigned int ranks[] = { 5, 3, 9, 3, 1, 5, 3 };
+    unsigned int expected[] = { 4, 1, 3, 6, 0, 5, 2 };
+    unsigned int i;
+
+    ASSERT_TRUE(pifo_pop(pifo) == NULL)
+
+    for (i = 0; i < 7; i++) {
+        pifo_push(pifo, make_packet(pool, i, 0, 100), ranks[i]);
+    }
+    ASSERT_EQ(pifo_size(pifo), 7)
+    ASSERT_EQ(pifo_peek_rank(pifo), 1)
+
+    /*  Lowest rank first, equal ranks in push order. */
+    for (i = 0; i < 7; i++) {
+        ASSERT_EQ(pifo_pop(pifo)->id, expected[i])
+    }
+    ASSERT_EQ(pifo_size(pifo), 0)
+
+    free_pifo(pifo);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(pifo_weighted_fair_queueing)
+    object_pool_t pool = create_packet_pool();
+    uint64_t finish[2] = { 0, 0 };
+    unsigned int weights[2] = { 1, 3 };
+    struct pifo_stfq stfq = { 0, finish, weights, 2 };
+    pifo_tree_t tree = create_pifo_tree(pifo_rank_stfq, pifo_stfq_dequeued, &stfq);
+    unsigned int served[2] = { 0, 0 };
+    unsigned int i;
+
+    /*  Two backlogged flows: the second gets three times the service. */
+    for (i = 0; i < 400; i++) {
+        pifo_tree_enqueue(tree, make_packet(pool, i, 0, 1000), 0);
+        pifo_tree_enqueue(tree, make_packet(pool, i, 1, 1000), 0);
+    }
+    for (i = 0; i < 400; i++) {
+        served[pifo_tree_dequeue(tree, i)->flow_id]++;
+    }
+    ASSERT_EQ(served[0], 100)
+    ASSERT_EQ(served[1], 300)
+
+    /*  Once drained, the second flow has been idle while the first was
+        still sending. It restarts at the virtual time rather than catching
+        up on the service it missed. */
+    while (pifo_tree_size(tree) > 0) {
+        pifo_tree_dequeue(tree, 0);
+    }
+    for (i = 0; i < 40; i++) {
+        pifo_tree_enqueue(tree, make_packet(pool, 1000 + i, 0, 1000), 0);
+        pifo_tree_enqueue(tree, make_packet(pool, 1000 + i, 1, 1000), 0);
+    }
+    served[0] = served[1] = 0;
+    for (i = 0; i < 40; i++) {
+        served[pifo_tree_dequeue(tree, i)->flow_id]++;
+    }
+    ASSERT_TRUE(served[0] >= 9 && served[0] <= 11)
+
+    free_pifo_tree(tree);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(pifo_tree_hierarchy)
+    object_pool_t pool = create_packet_pool();
+    pifo_tree_t tree = create_pifo_tree(pifo_rank_priority, NULL, NULL);
+    time_series_t queued = create_time_series(TIME_SERIES_PEAK, 3, 10, 4, 0);
+    unsigned int deadline = 1000;
+    unsigned int leaves[2];
+    unsigned int i;
+
+    /*  Strict priority between two classes: FIFO in class 0, EDF in
+        class 1. */
+    leaves[0] = pifo_tree_add_node(tree, 0, pifo_rank_fifo, NULL, NULL);
+    leaves[1] = pifo_tree_add_node(tree, 0, pifo_rank_edf, NULL, &deadline);
+    pifo_tree_set_classifier(tree, classify_by_priority, leaves);
+    pifo_tree_set_time_series(tree, queued, 0);
+
+    for (i = 0; i < 6; i++) {
+        packet_t packet = make_packet(pool, i, i, 100);
+        packet->priority = i % 2;
+        packet->created = 100 - i;
+        pifo_tree_enqueue(tree, packet, i);
+    }
+    ASSERT_EQ(pifo_tree_size(tree), 6)
+    ASSERT_EQ(pifo_tree_bytes(tree, leaves[0]), 300)
+
+    unsigned int expected[] = { 0, 2, 4, 5, 3, 1 };
+    for (i = 0; i < 6; i++) {
+        ASSERT_EQ(pifo_tree_dequeue(tree, 10)->id, expected[i])
+    }
+    ASSERT_TRUE(pifo_tree_dequeue(tree, 10) == NULL)
+    ASSERT_EQ(pifo_tree_bytes(tree, leaves[1]), 0)
+
+    /*  Each leaf peaked at 300 bytes. The root holds no packets itself. */
+    time_series_advance(queued, 20);
+    ASSERT_EQ(time_series_get(queued, leaves[0], 0), 300)
+    ASSERT_EQ(time_series_get(queued, leaves[1], 0), 300)
+    ASSERT_EQ(time_series_get(queued, leaves[1], 2), 0)
+    ASSERT_EQ(time_series_get(queued, 0, 0), 0)
+
+    free_time_series(queued);
+    free_pifo_tree(tree);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(pifo_port_srpt)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sent_log log = { { 0 }, 0 };
+    unsigned int remaining[4] = { 0, 90000, 3000, 20000 };
+    struct pifo_srpt srpt = { remaining, 4 };
+    pifo_tree_t tree = create_pifo_tree(pifo_rank_srpt, NULL, &srpt);
+    port_t port = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, record, &log);
+    pifo_tree_attach(tree, port);
+
+    /*  The first packet finds the port idle. The others queue behind it and
+        leave shortest remaining flow first. */
+    port_receive(port, sim, make_packet(pool, 0, 0, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 1, 1, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 2, 2, 1500), 0);
+    port_receive(port, sim, make_packet(pool, 3, 3, 1500), 0);
+    ASSERT_EQ(port_queue_packets(port), 3)
+    simulator_run_until(sim, 100000);
+
+    ASSERT_EQ(log.count, 4)
+    ASSERT_EQ(log.ids[0], 0)
+    ASSERT_EQ(log.ids[1], 2)
+    ASSERT_EQ(log.ids[2], 3)
+    ASSERT_EQ(log.ids[3], 1)
+    ASSERT_EQ(remaining[2], 1500)
+
+    free_port(port);
+    free_pifo_tree(tree);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    pifo_order,
+    pifo_weighted_fair_queueing,
+    pifo_tree_hierarchy,
+    pifo_port_srpt
+)
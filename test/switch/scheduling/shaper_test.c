@@ -0,0 +1,131 @@
+#include "test.h"
+#include "shaper.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define RATE_1G 1000
+#define RATE_2G 2000
+#define RATE_10G 10000
+#define NUM_PACKETS 10
+
+static packet_t make_packet(object_pool_t pool, unsigned int id, unsigned int length) {
+    packet_t packet = packet_pool_alloc(pool);
+    packet->id = id;
+    packet->length = length;
+    return packet;
+}
+
+/*  Records when a port sends packets. */
+struct sent_log {
+    unsigned int times[NUM_PACKETS];
+    unsigned int count;
+};
+
+static void record(simulator_t sim, packet_t packet, unsigned int head_departure, void *arg) {
+    struct sent_log *log = (struct sent_log *) arg;
+
+    (void) packet;
+    (void) head_departure;
+
+    log->times[log->count] = simulator_now(sim);
+    log->count = log->count + 1;
+}
+
+DEFINE_TEST(token_bucket_lazy_refill)
+    token_bucket_t bucket;
+    token_bucket_init(&bucket, RATE_1G, 1500, 0);
+
+    ASSERT_EQ(token_bucket_level(&bucket, 0), 1500)
+    ASSERT_TRUE(token_bucket_conforms(&bucket, 1500, 0))
+    token_bucket_consume(&bucket, 1500, 0);
+    ASSERT_EQ(token_bucket_level(&bucket, 0), 0)
+
+    /*  At 1 Gbit/s a byte takes 8 ticks to earn. */
+    ASSERT_EQ(token_bucket_wait(&bucket, 1000, 0), 8000)
+    ASSERT_EQ(token_bucket_level(&bucket, 4000), 500)
+    ASSERT_FALSE(token_bucket_conforms(&bucket, 1000, 4000))
+    ASSERT_EQ(token_bucket_wait(&bucket, 1000, 4000), 4000)
+    ASSERT_TRUE(token_bucket_conforms(&bucket, 1000, 8000))
+
+    /*  The level never exceeds the burst, however long the bucket is left
+        alone. */
+    ASSERT_EQ(token_bucket_level(&bucket, 4000000000u), 1500)
+
+    /*  A packet larger than the bucket goes once it is full and leaves the
+        bucket in debt. */
+    ASSERT_TRUE(token_bucket_conforms(&bucket, 9000, 4000000000u))
+    token_bucket_consume(&bucket, 9000, 4000000000u);
+    ASSERT_EQ(token_bucket_level(&bucket, 4000000000u), 0)
+    ASSERT_EQ(token_bucket_wait(&bucket, 1500, 4000000000u), 72000)
+END_TEST
+
+DEFINE_TEST(policer_two_rate_three_color)
+    object_pool_t pool = create_packet_pool();
+    policer_t policer = create_policer(RATE_1G, 3000, RATE_2G, 6000);
+    policer_color_t expected[] = { POLICER_GREEN, POLICER_GREEN, POLICER_YELLOW, POLICER_YELLOW, POLICER_RED };
+    unsigned int i;
+
+    /*  A burst exhausts the committed bucket after two packets and the peak
+        bucket after four. */
+    for (i = 0; i < 5; i++) {
+        packet_t packet = make_packet(pool, i, 1500);
+        ASSERT_EQ(policer_mark(policer, packet, 0), expected[i])
+    }
+    ASSERT_EQ(policer_count(policer, POLICER_YELLOW), 2)
+
+    packet_t packet = make_packet(pool, 5, 1500);
+    ASSERT_EQ(policer_mark(policer, packet, 0), POLICER_RED)
+    ASSERT_EQ(packet->flags & PACKET_FLAG_COLOR_MASK, PACKET_FLAG_RED)
+
+    /*  12000 ticks later the committed bucket holds 1500 bytes again. */
+    ASSERT_EQ(policer_mark(policer, packet, 12000), POLICER_GREEN)
+    ASSERT_EQ(packet->flags & PACKET_FLAG_COLOR_MASK, 0)
+    ASSERT_EQ(policer_mark(policer, make_packet(pool, 6, 1500), 12000), POLICER_YELLOW)
+
+    free_policer(policer);
+    free_object_pool(pool);
+END_TEST
+
+DEFINE_TEST(shaper_port_without_refill_events)
+    object_pool_t pool = create_packet_pool();
+    simulator_t sim = create_simulator();
+    struct sent_log log = { { 0 }, 0 };
+    shaper_t shaper = create_shaper(RATE_1G, 3000);
+    port_t port = create_port(PORT_CUT_THROUGH, RATE_10G, RATE_10G, 64, record, &log);
+    unsigned int i;
+
+    shaper_attach(shaper, port, sim);
+
+    for (i = 0; i < NUM_PACKETS; i++) {
+        port_receive(port, sim, make_packet(pool, i, 1500), 0);
+    }
+    simulator_run_until(sim, 1000000);
+
+    /*  Two packets go at line rate on the burst, the first once its header
+        has arrived. After that each waits for 1500 bytes of tokens, i.e.
+        one packet every 12000 ticks, and starts when the port wakes. */
+    ASSERT_EQ(log.count, NUM_PACKETS)
+    ASSERT_EQ(log.times[0], 1252)
+    ASSERT_EQ(log.times[1], 2452)
+    for (i = 2; i < NUM_PACKETS; i++) {
+        ASSERT_EQ(log.times[i], 12000 * (i - 1) + 1200)
+    }
+
+    /*  One departure per packet and one wake-up per blocked packet, and
+        nothing else. */
+    ASSERT_EQ(shaper_wakeups(shaper), NUM_PACKETS - 2)
+    ASSERT_EQ(simulator_events_dispatched(sim), NUM_PACKETS + NUM_PACKETS - 2)
+    ASSERT_EQ(shaper_packets(shaper), 0)
+
+    free_port(port);
+    free_shaper(shaper);
+    free_simulator(sim);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    token_bucket_lazy_refill,
+    policer_two_rate_three_color,
+    shaper_port_without_refill_events
+)
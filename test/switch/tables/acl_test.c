@@ -0,0 +1,161 @@
+#include "test.h"
+#include "acl.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_RULES 2000
+#define NUM_HEADERS 20000
+
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state ^ (*state >> 16);
+}
+
+/*  Reference classification by linear scan. */
+static uint32_t reference_classify(const acl_rule_t *rules, unsigned int n, const acl_header_t *header) {
+    uint32_t action = ACL_NO_MATCH;
+    uint32_t best = UINT32_MAX;
+    unsigned int i, field;
+
+    for (i = 0; i < n; i++) {
+        for (field = 0; field < ACL_FIELDS; field++) {
+            if (header->fields[field] < rules[i].low[field] || header->fields[field] > rules[i].high[field]) {
+                break;
+            }
+        }
+        if (field == ACL_FIELDS && (action == ACL_NO_MATCH || rules[i].priority < best)) {
+            best = rules[i].priority;
+            action = rules[i].action;
+        }
+    }
+
+    return action;
+}
+
+/*  Rules shaped like firewall rule sets: address prefixes of mixed length
+    under a few /8s, ports that are wildcards, well known values or ranges,
+    and TCP, UDP or any protocol. */
+static void random_rule(acl_rule_t *rule, unsigned int i, uint32_t *state) {
+    static const uint32_t ports[] = { 22, 53, 80, 443, 8080 };
+
+    acl_rule_init(rule, next_random(state) % 64, i);
+    acl_rule_prefix(rule, ACL_SRC_ADDR, (10 + next_random(state) % 4) << 24 | next_random(state), next_random(state) % 33);
+    acl_rule_prefix(rule, ACL_DST_ADDR, (10 + next_random(state) % 4) << 24 | next_random(state), 8 + next_random(state) % 25);
+
+    switch (next_random(state) % 4) {
+        case 0:
+            acl_rule_range(rule, ACL_DST_PORT, ports[next_random(state) % 5], ports[next_random(state) % 5]);
+            if (rule->low[ACL_DST_PORT] > rule->high[ACL_DST_PORT]) {
+                acl_rule_range(rule, ACL_DST_PORT, rule->high[ACL_DST_PORT], rule->low[ACL_DST_PORT]);
+            }
+            break;
+        case 1:
+            acl_rule_range(rule, ACL_SRC_PORT, 1024, 65535);
+            break;
+        case 2:
+            acl_rule_range(rule, ACL_DST_PORT, next_random(state) % 65536, next_random(state) % 65536);
+            if (rule->low[ACL_DST_PORT] > rule->high[ACL_DST_PORT]) {
+                rule->high[ACL_DST_PORT] = rule->low[ACL_DST_PORT];
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (next_random(state) % 2) {
+        uint32_t protocol = next_random(state) % 2 ? 6 : 17;
+        acl_rule_range(rule, ACL_PROTOCOL, protocol, protocol);
+    }
+}
+
+/*  Headers inside a random rule, so that most match something. */
+static void random_header(const acl_rule_t *rules, unsigned int n, acl_header_t *header, uint32_t *state) {
+    const acl_rule_t *rule = &rules[next_random(state) % n];
+    unsigned int field;
+
+    for (field = 0; field < ACL_FIELDS; field++) {
+        uint32_t span = rule->high[field] - rule->low[field];
+        header->fields[field] = rule->low[field] + (span == UINT32_MAX ? next_random(state) : next_random(state) % (span + 1));
+    }
+}
+
+DEFINE_TEST(acl_basic)
+    acl_rule_t rules[4];
+    acl_header_t header = { { 0x0a000001, 0x0a000102, 40000, 80, 6 } };
+
+    acl_t acl = create_acl(rules, 0);
+    ASSERT_EQ(acl_classify(acl, &header), ACL_NO_MATCH)
+    free_acl(acl);
+
+    /*  Allow web traffic to 10.0.1.0/24, deny the rest of 10.0.0.0/16 and
+        let everything else through. */
+    acl_rule_init(&rules[0], 1, 100);
+    acl_rule_prefix(&rules[0], ACL_DST_ADDR, 0x0a000100, 24);
+    acl_rule_range(&rules[0], ACL_DST_PORT, 80, 80);
+    acl_rule_range(&rules[0], ACL_PROTOCOL, 6, 6);
+
+    acl_rule_init(&rules[1], 2, 200);
+    acl_rule_prefix(&rules[1], ACL_DST_ADDR, 0x0a000000, 16);
+
+    acl_rule_init(&rules[2], 3, 300);
+
+    /*  Same priority as the first rule but given later, so it loses. */
+    acl_rule_init(&rules[3], 1, 400);
+    acl_rule_prefix(&rules[3], ACL_SRC_ADDR, 0x0a000001, 32);
+
+    acl = create_acl(rules, 4);
+    ASSERT_EQ(acl_rules(acl), 4)
+
+    ASSERT_EQ(acl_classify(acl, &header), 100)
+    header.fields[ACL_SRC_ADDR] = 0x0a000002;
+    header.fields[ACL_PROTOCOL] = 17;
+    ASSERT_EQ(acl_classify(acl, &header), 200)
+    header.fields[ACL_SRC_ADDR] = 0x0a000001;
+    ASSERT_EQ(acl_classify(acl, &header), 400)
+    header.fields[ACL_SRC_ADDR] = 0x0b000001;
+    header.fields[ACL_DST_ADDR] = 0x0b000001;
+    ASSERT_EQ(acl_classify(acl, &header), 300)
+
+    free_acl(acl);
+END_TEST
+
+DEFINE_TEST(acl_random_against_reference)
+    static acl_rule_t rules[NUM_RULES];
+    static acl_header_t headers[NUM_HEADERS];
+    static uint32_t actions[NUM_HEADERS];
+    uint32_t state = 17;
+    unsigned int i;
+
+    for (i = 0; i < NUM_RULES; i++) {
+        random_rule(&rules[i], i, &state);
+    }
+
+    acl_t acl = create_acl(rules, NUM_RULES);
+    ASSERT_TRUE(acl_depth(acl) > 0)
+
+    for (i = 0; i < NUM_HEADERS; i++) {
+        if (i % 8 == 0) {
+            unsigned int field;
+            for (field = 0; field < ACL_FIELDS; field++) {
+                headers[i].fields[field] = next_random(&state) & acl_field_max((acl_field_t) field);
+            }
+        } else {
+            random_header(rules, NUM_RULES, &headers[i], &state);
+        }
+    }
+
+    acl_classify_batch(acl, headers, actions, NUM_HEADERS);
+    for (i = 0; i < NUM_HEADERS; i++) {
+        uint32_t expected = reference_classify(rules, NUM_RULES, &headers[i]);
+        ASSERT_EQ(acl_classify(acl, &headers[i]), expected)
+        ASSERT_EQ(actions[i], expected)
+    }
+
+    free_acl(acl);
+END_TEST
+
+REGISTER_TESTS(
+    acl_basic,
+    acl_random_against_reference
+)
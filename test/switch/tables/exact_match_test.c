@@ -0,0 +1,115 @@
+#include "test.h"
+#include "exact_match.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_KEYS 20000
+
+static uint64_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state ^ (*state >> 29);
+}
+
+DEFINE_TEST(exact_match_basic)
+    exact_match_t table = create_exact_match(16);
+
+    ASSERT_EQ(exact_match_lookup(table, exact_match_mac_key(0x0a0b0c0d0e0fULL)), EXACT_MATCH_NONE)
+
+    uint32_t first = exact_match_insert(table, exact_match_mac_key(0x0a0b0c0d0e0fULL));
+    uint32_t second = exact_match_insert(table, exact_match_flow_key(0x0a000001, 0x0a000002, 1234, 80, 6));
+    ASSERT_TRUE(first != EXACT_MATCH_NONE)
+    ASSERT_TRUE(second != EXACT_MATCH_NONE)
+    ASSERT_TRUE(first != second)
+
+    /*  Inserting again returns the same index. */
+    ASSERT_EQ(exact_match_insert(table, exact_match_mac_key(0x0a0b0c0d0e0fULL)), first)
+    ASSERT_EQ(exact_match_lookup(table, exact_match_flow_key(0x0a000001, 0x0a000002, 1234, 80, 6)), second)
+    ASSERT_EQ(exact_match_lookup(table, exact_match_flow_key(0x0a000001, 0x0a000002, 1234, 80, 17)), EXACT_MATCH_NONE)
+    ASSERT_EQ(exact_match_key(table, first).words[0], 0x0a0b0c0d0e0fULL)
+    ASSERT_EQ(exact_match_size(table), 2)
+
+    ASSERT_TRUE(exact_match_delete(table, exact_match_mac_key(0x0a0b0c0d0e0fULL)))
+    ASSERT_FALSE(exact_match_delete(table, exact_match_mac_key(0x0a0b0c0d0e0fULL)))
+    ASSERT_EQ(exact_match_lookup(table, exact_match_mac_key(0x0a0b0c0d0e0fULL)), EXACT_MATCH_NONE)
+    ASSERT_EQ(exact_match_lookup(table, exact_match_flow_key(0x0a000001, 0x0a000002, 1234, 80, 6)), second)
+    ASSERT_EQ(exact_match_size(table), 1)
+
+    free_exact_match(table);
+END_TEST
+
+DEFINE_TEST(exact_match_full_table)
+    static exact_match_key_t keys[NUM_KEYS];
+    static uint32_t indices[NUM_KEYS];
+    static int seen[NUM_KEYS];
+    uint64_t state = 3;
+    unsigned int i;
+
+    exact_match_t table = create_exact_match(NUM_KEYS);
+
+    /*  Fill the table completely. Keys move between buckets on the way,
+        but keep their index. */
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = exact_match_mac_key(next_random(&state));
+        indices[i] = exact_match_insert(table, keys[i]);
+        ASSERT_TRUE(indices[i] < NUM_KEYS)
+        ASSERT_FALSE(seen[indices[i]])
+        seen[indices[i]] = 1;
+    }
+    ASSERT_EQ(exact_match_size(table), NUM_KEYS)
+    ASSERT_EQ(exact_match_insert(table, exact_match_mac_key(next_random(&state))), EXACT_MATCH_NONE)
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        ASSERT_EQ(exact_match_lookup(table, keys[i]), indices[i])
+    }
+
+    /*  Deleted indices are reused by later keys. */
+    for (i = 0; i < NUM_KEYS; i += 2) {
+        ASSERT_TRUE(exact_match_delete(table, keys[i]))
+    }
+    for (i = 0; i < NUM_KEYS; i += 2) {
+        keys[i] = exact_match_flow_key(next_random(&state), next_random(&state), i, i >> 16, 17);
+        uint32_t index = exact_match_insert(table, keys[i]);
+        ASSERT_TRUE(index < NUM_KEYS)
+        indices[i] = index;
+    }
+    for (i = 0; i < NUM_KEYS; i++) {
+        ASSERT_EQ(exact_match_lookup(table, keys[i]), indices[i])
+    }
+
+    free_exact_match(table);
+END_TEST
+
+DEFINE_TEST(exact_match_batch)
+    static exact_match_key_t keys[NUM_KEYS];
+    static uint32_t indices[NUM_KEYS];
+    static uint32_t results[NUM_KEYS];
+    uint64_t state = 11;
+    unsigned int i;
+
+    exact_match_t table = create_exact_match(NUM_KEYS);
+
+    /*  Half of the keys are inserted, with a few duplicates in the batch. */
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = exact_match_flow_key(next_random(&state), next_random(&state), 1000, 443, 6);
+    }
+    keys[7] = keys[3];
+    exact_match_insert_batch(table, keys, indices, NUM_KEYS / 2);
+    ASSERT_EQ(indices[7], indices[3])
+    ASSERT_EQ(exact_match_size(table), NUM_KEYS / 2 - 1)
+
+    exact_match_lookup_batch(table, keys, results, NUM_KEYS);
+    for (i = 0; i < NUM_KEYS; i++) {
+        uint32_t expected = i < NUM_KEYS / 2 ? indices[i] : EXACT_MATCH_NONE;
+        ASSERT_EQ(results[i], expected)
+        ASSERT_EQ(exact_match_lookup(table, keys[i]), expected)
+    }
+
+    free_exact_match(table);
+END_TEST
+
+REGISTER_TESTS(
+    exact_match_basic,
+    exact_match_full_table,
+    exact_match_batch
+)
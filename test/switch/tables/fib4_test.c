@@ -0,0 +1,153 @@
+#include "test.h"
+#include "fib4.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_RULES 2000
+#define NUM_LOOKUPS 100000
+
+/*  Reference longest prefix match by linear scan. */
+struct reference_rule {
+    uint32_t prefix;
+    unsigned int depth;
+    uint32_t next_hop;
+    int present;
+};
+
+static uint32_t mask(uint32_t prefix, unsigned int depth) {
+    return depth == 0 ? 0 : prefix & (0xffffffffu << (32 - depth));
+}
+
+static uint32_t reference_lookup(struct reference_rule *rules, unsigned int n, uint32_t address) {
+    uint32_t result = FIB4_NO_ROUTE;
+    int best = -1;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        if (rules[i].present && (int) rules[i].depth > best && mask(address, rules[i].depth) == rules[i].prefix) {
+            best = rules[i].depth;
+            result = rules[i].next_hop;
+        }
+    }
+
+    return result;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+/*  Addresses drawn close to existing prefixes, so that lookups exercise
+    nested and neighbouring routes rather than empty space. */
+static uint32_t random_address(struct reference_rule *rules, unsigned int n, uint32_t *state) {
+    uint32_t base = rules[next_random(state) % n].prefix;
+    return base ^ (next_random(state) >> (next_random(state) % 32));
+}
+
+DEFINE_TEST(fib4_basic)
+    fib4_t fib = create_fib4();
+
+    ASSERT_EQ(fib4_lookup(fib, 0x0a000001), FIB4_NO_ROUTE)
+
+    fib4_add(fib, 0x0a000000, 8, 1);
+    fib4_add(fib, 0x0a010000, 16, 2);
+    fib4_add(fib, 0x0a010100, 24, 3);
+    fib4_add(fib, 0x0a010180, 25, 4);
+    fib4_add(fib, 0x0a010181, 32, 5);
+
+    ASSERT_EQ(fib4_lookup(fib, 0x0a020304), 1)
+    ASSERT_EQ(fib4_lookup(fib, 0x0a01ff00), 2)
+    ASSERT_EQ(fib4_lookup(fib, 0x0a010105), 3)
+    ASSERT_EQ(fib4_lookup(fib, 0x0a0101f0), 4)
+    ASSERT_EQ(fib4_lookup(fib, 0x0a010181), 5)
+    ASSERT_EQ(fib4_lookup(fib, 0x0b000000), FIB4_NO_ROUTE)
+    ASSERT_EQ(fib4_groups_in_use(fib), 1)
+
+    /*  A default route catches everything else. */
+    fib4_add(fib, 0, 0, 9);
+    ASSERT_EQ(fib4_lookup(fib, 0x0b000000), 9)
+    ASSERT_EQ(fib4_lookup(fib, 0x0a010181), 5)
+
+    /*  Removing the longer prefixes falls back to the shorter ones, and
+        frees the group once nothing longer than /24 is left. */
+    ASSERT_TRUE(fib4_delete(fib, 0x0a010181, 32))
+    ASSERT_EQ(fib4_lookup(fib, 0x0a010181), 4)
+    ASSERT_TRUE(fib4_delete(fib, 0x0a010180, 25))
+    ASSERT_EQ(fib4_lookup(fib, 0x0a010181), 3)
+    ASSERT_EQ(fib4_groups_in_use(fib), 0)
+    ASSERT_TRUE(fib4_delete(fib, 0x0a010100, 24))
+    ASSERT_EQ(fib4_lookup(fib, 0x0a010181), 2)
+    ASSERT_FALSE(fib4_delete(fib, 0x0a010100, 24))
+    ASSERT_TRUE(fib4_delete(fib, 0, 0))
+    ASSERT_EQ(fib4_lookup(fib, 0x0b000000), FIB4_NO_ROUTE)
+    ASSERT_EQ(fib4_rules(fib), 2)
+
+    free_fib4(fib);
+END_TEST
+
+DEFINE_TEST(fib4_random_against_reference)
+    static struct reference_rule rules[NUM_RULES];
+    uint32_t state = 42;
+    unsigned int i;
+
+    uint32_t prefixes[NUM_RULES];
+    unsigned int depths[NUM_RULES];
+    uint32_t next_hops[NUM_RULES];
+
+    for (i = 0; i < NUM_RULES; i++) {
+        /*  Prefixes clustered under a few /8s so that they nest. */
+        rules[i].depth = 8 + next_random(&state) % 25;
+        rules[i].prefix = mask((next_random(&state) % 4) << 24 | (next_random(&state) & 0x00ffffff), rules[i].depth);
+        rules[i].next_hop = i;
+        rules[i].present = 1;
+
+        prefixes[i] = rules[i].prefix;
+        depths[i] = rules[i].depth;
+        next_hops[i] = i;
+    }
+
+    /*  Duplicate prefixes keep the last next hop in both. */
+    for (i = 0; i < NUM_RULES; i++) {
+        unsigned int j;
+        for (j = i + 1; j < NUM_RULES; j++) {
+            if (rules[j].prefix == rules[i].prefix && rules[j].depth == rules[i].depth) {
+                rules[i].present = 0;
+            }
+        }
+    }
+
+    fib4_t fib = create_fib4();
+    fib4_build(fib, prefixes, depths, next_hops, NUM_RULES);
+
+    uint32_t addresses[1000];
+    uint32_t results[1000];
+    for (i = 0; i < NUM_LOOKUPS; i++) {
+        uint32_t address = random_address(rules, NUM_RULES, &state);
+        ASSERT_EQ(fib4_lookup(fib, address), reference_lookup(rules, NUM_RULES, address))
+    }
+
+    /*  Delete half the rules at random and check again, in batches. */
+    for (i = 0; i < NUM_RULES; i++) {
+        if (rules[i].present && next_random(&state) % 2) {
+            ASSERT_TRUE(fib4_delete(fib, rules[i].prefix, rules[i].depth))
+            rules[i].present = 0;
+        }
+    }
+
+    for (i = 0; i < 1000; i++) {
+        addresses[i] = random_address(rules, NUM_RULES, &state);
+    }
+    fib4_lookup_batch(fib, addresses, results, 1000);
+    for (i = 0; i < 1000; i++) {
+        ASSERT_EQ(results[i], reference_lookup(rules, NUM_RULES, addresses[i]))
+    }
+
+    free_fib4(fib);
+END_TEST
+
+REGISTER_TESTS(
+    fib4_basic,
+    fib4_random_against_reference
+)
@@ -0,0 +1,192 @@
+#include "test.h"
+#include "fib6.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_RULES 2000
+#define NUM_LOOKUPS 50000
+
+/*  Reference longest prefix match by linear scan. */
+struct reference_rule {
+    fib6_address_t prefix;
+    unsigned int depth;
+    uint32_t next_hop;
+    int present;
+};
+
+static fib6_address_t mask(fib6_address_t address, unsigned int depth) {
+    fib6_address_t result;
+
+    result.high = depth == 0 ? 0 : depth >= 64 ? address.high : address.high & (~0ULL << (64 - depth));
+    result.low = depth <= 64 ? 0 : depth == 128 ? address.low : address.low & (~0ULL << (128 - depth));
+
+    return result;
+}
+
+static int matches(struct reference_rule *rule, fib6_address_t address) {
+    fib6_address_t masked = mask(address, rule->depth);
+    return masked.high == rule->prefix.high && masked.low == rule->prefix.low;
+}
+
+static uint32_t reference_lookup(struct reference_rule *rules, unsigned int n, fib6_address_t address) {
+    uint32_t result = FIB6_NO_ROUTE;
+    int best = -1;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        if (rules[i].present && (int) rules[i].depth > best && matches(&rules[i], address)) {
+            best = rules[i].depth;
+            result = rules[i].next_hop;
+        }
+    }
+
+    return result;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state ^ (*state >> 29);
+}
+
+/*  Addresses close to existing prefixes, flipping bits from a random
+    position onwards. */
+static fib6_address_t random_address(struct reference_rule *rules, unsigned int n, uint64_t *state) {
+    fib6_address_t address = rules[next_random(state) % n].prefix;
+    unsigned int from = next_random(state) % 128;
+    uint64_t noise_high = next_random(state);
+    uint64_t noise_low = next_random(state);
+
+    if (from < 64) {
+        address.high ^= noise_high >> from;
+        address.low ^= noise_low;
+    } else {
+        address.low ^= noise_low >> (from - 64);
+    }
+
+    return address;
+}
+
+static fib6_address_t address_of(uint64_t high, uint64_t low) {
+    fib6_address_t address = { high, low };
+    return address;
+}
+
+DEFINE_TEST(fib6_basic)
+    fib6_t fib = create_fib6();
+
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db800000000ULL, 1)), FIB6_NO_ROUTE)
+
+    fib6_add(fib, address_of(0x2000000000000000ULL, 0), 3, 1);
+    fib6_add(fib, address_of(0x20010db800000000ULL, 0), 32, 2);
+    fib6_add(fib, address_of(0x20010db800010000ULL, 0), 48, 3);
+    fib6_add(fib, address_of(0x20010db800010000ULL, 0x10), 124, 4);
+    fib6_add(fib, address_of(0x20010db800010000ULL, 0x11), 128, 5);
+
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x3fff000000000000ULL, 0)), 1)
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db8ffff0000ULL, 0)), 2)
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db80001ffffULL, 0)), 3)
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db800010000ULL, 0x1f)), 4)
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db800010000ULL, 0x11)), 5)
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x4000000000000000ULL, 0)), FIB6_NO_ROUTE)
+
+    fib6_add(fib, address_of(0, 0), 0, 9);
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x4000000000000000ULL, 0)), 9)
+
+    ASSERT_TRUE(fib6_delete(fib, address_of(0x20010db800010000ULL, 0x11), 128))
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db800010000ULL, 0x11)), 4)
+    ASSERT_TRUE(fib6_delete(fib, address_of(0x20010db800010000ULL, 0x10), 124))
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x20010db800010000ULL, 0x11)), 3)
+    ASSERT_FALSE(fib6_delete(fib, address_of(0x20010db800010000ULL, 0x10), 124))
+    ASSERT_TRUE(fib6_delete(fib, address_of(0x2000000000000000ULL, 0), 3))
+    ASSERT_EQ(fib6_lookup(fib, address_of(0x3fff000000000000ULL, 0)), 9)
+    ASSERT_EQ(fib6_rules(fib), 3)
+
+    free_fib6(fib);
+END_TEST
+
+DEFINE_TEST(fib6_random_against_reference)
+    static struct reference_rule rules[NUM_RULES];
+    static fib6_address_t prefixes[NUM_RULES];
+    unsigned int depths[NUM_RULES];
+    uint32_t next_hops[NUM_RULES];
+    uint64_t state = 7;
+    unsigned int i, j;
+
+    for (i = 0; i < NUM_RULES; i++) {
+        /*  Mostly /16 to /64 as in real tables, some longer, clustered
+            under a handful of /16s. */
+        unsigned int depth = next_random(&state) % 8 == 0 ? 65 + next_random(&state) % 64 : 16 + next_random(&state) % 49;
+        fib6_address_t prefix = address_of(
+            (0x2001ULL + next_random(&state) % 4) << 48 | (next_random(&state) & 0xffffffffffffULL),
+            next_random(&state)
+        );
+
+        rules[i].depth = depth;
+        rules[i].prefix = mask(prefix, depth);
+        rules[i].next_hop = i;
+        rules[i].present = 1;
+
+        prefixes[i] = rules[i].prefix;
+        depths[i] = depth;
+        next_hops[i] = i;
+    }
+
+    for (i = 0; i < NUM_RULES; i++) {
+        for (j = i + 1; j < NUM_RULES; j++) {
+            if (rules[j].depth == rules[i].depth &&
+                rules[j].prefix.high == rules[i].prefix.high &&
+                rules[j].prefix.low == rules[i].prefix.low) {
+                rules[i].present = 0;
+            }
+        }
+    }
+
+    fib6_t fib = create_fib6();
+    fib6_build(fib, prefixes, depths, next_hops, NUM_RULES);
+
+    for (i = 0; i < NUM_LOOKUPS; i++) {
+        fib6_address_t address = random_address(rules, NUM_RULES, &state);
+        ASSERT_EQ(fib6_lookup(fib, address), reference_lookup(rules, NUM_RULES, address))
+    }
+
+    /*  Incremental updates: delete half the rules and add some new ones,
+        then check in batches. */
+    for (i = 0; i < NUM_RULES; i++) {
+        if (rules[i].present && next_random(&state) % 2) {
+            ASSERT_TRUE(fib6_delete(fib, rules[i].prefix, rules[i].depth))
+            rules[i].present = 0;
+        } else if (!rules[i].present && next_random(&state) % 2) {
+            rules[i].depth = 40 + next_random(&state) % 89;
+            rules[i].prefix = mask(address_of(rules[i].prefix.high, next_random(&state)), rules[i].depth);
+            rules[i].next_hop = NUM_RULES + i;
+            rules[i].present = 1;
+            fib6_add(fib, rules[i].prefix, rules[i].depth, rules[i].next_hop);
+
+            for (j = 0; j < NUM_RULES; j++) {
+                if (j != i && rules[j].present && rules[j].depth == rules[i].depth &&
+                    rules[j].prefix.high == rules[i].prefix.high && rules[j].prefix.low == rules[i].prefix.low) {
+                    rules[j].present = 0;
+                }
+            }
+        }
+    }
+
+    fib6_address_t addresses[1000];
+    uint32_t results[1000];
+    for (i = 0; i < 1000; i++) {
+        addresses[i] = random_address(rules, NUM_RULES, &state);
+    }
+    fib6_lookup_batch(fib, addresses, results, 1000);
+    for (i = 0; i < 1000; i++) {
+        ASSERT_EQ(results[i], reference_lookup(rules, NUM_RULES, addresses[i]))
+        ASSERT_EQ(results[i], fib6_lookup(fib, addresses[i]))
+    }
+
+    free_fib6(fib);
+END_TEST
+
+REGISTER_TESTS(
+    fib6_basic,
+    fib6_random_against_reference
+)
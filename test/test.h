@@ -11,19 +11,19 @@ enum test_result {
 
 typedef enum test_result test_result_t;
 
-#define ASSERT_TRUE(expr) if (!expr) { \
+#define ASSERT_TRUE(expr) if (!(expr)) { \
     fprintf(stderr, "Test failed: ASSERT_TRUE failed on expression %s," \
         "file: %s, line: %d. \n", #expr, __FILE__, __LINE__); \
     return FAIL; \
 }
 
-#define ASSERT_FALSE(expr) if (expr) { \
+#define ASSERT_FALSE(expr) if ((expr)) { \
     fprintf(stderr, "Test failed: ASSERT_FALSE failed on expression %s," \
         "file: %s, line: %d. \n", #expr, __FILE__, __LINE__); \
     return FAIL; \
 }
 
-#define ASSERT_EQ(expected, val) if (expected != val) { \
+#define ASSERT_EQ(expected, val) if ((expected) != (val)) { \
     fprintf(stderr, "Test failed: ASSERT_EQ failed on expressions %s and %s," \
         "file %s, line %d. \n", #expected, #val, __FILE__, __LINE__); \
     return FAIL; \
@@ -0,0 +1,110 @@
+#include "test.h"
+#include "alias_sampler.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SAMPLES 200000
+
+DEFINE_TEST(alias_sampler_weights)
+    double weights[4] = { 1.0, 0.0, 2.0, 5.0 };
+    alias_sampler_t sampler = create_alias_sampler(weights, 4);
+    rng_t rng = create_rng(7);
+
+    unsigned int counts[4] = { 0 };
+    int i;
+    for (i = 0; i < SAMPLES; i++) {
+        unsigned int x = alias_sampler_sample(sampler, rng);
+        ASSERT_TRUE(x < 4)
+        counts[x] = counts[x] + 1;
+    }
+
+    ASSERT_EQ(counts[1], 0)
+    ASSERT_TRUE(counts[0] > SAMPLES / 8 - 2000 && counts[0] < SAMPLES / 8 + 2000)
+    ASSERT_TRUE(counts[2] > SAMPLES / 4 - 2000 && counts[2] < SAMPLES / 4 + 2000)
+    ASSERT_TRUE(counts[3] > SAMPLES * 5 / 8 - 2000 && counts[3] < SAMPLES * 5 / 8 + 2000)
+    ASSERT_EQ(alias_sampler_mean(sampler), (0.0 * 1 + 2.0 * 2 + 3.0 * 5) / 8)
+
+    free_rng(rng);
+    free_alias_sampler(sampler);
+END_TEST
+
+DEFINE_TEST(alias_sampler_batch_matches_distribution)
+    double weights[3] = { 3.0, 1.0, 0.0 };
+    alias_sampler_t sampler = create_alias_sampler(weights, 3);
+    rng_t rng = create_rng(8);
+
+    unsigned int *out = malloc(sizeof(unsigned int) * SAMPLES);
+    alias_sampler_sample_batch(sampler, rng, out, SAMPLES);
+
+    unsigned int zeros = 0;
+    int i;
+    for (i = 0; i < SAMPLES; i++) {
+        ASSERT_TRUE(out[i] < 2)
+        zeros += out[i] == 0;
+    }
+    ASSERT_TRUE(zeros > SAMPLES * 3 / 4 - 2000 && zeros < SAMPLES * 3 / 4 + 2000)
+
+    free(out);
+    free_rng(rng);
+    free_alias_sampler(sampler);
+END_TEST
+
+DEFINE_TEST(alias_sampler_cdf_file)
+    alias_sampler_t sampler = create_alias_sampler_from_cdf_file("./traffic/flow_sizes.cdf");
+    ASSERT_TRUE(sampler != NULL)
+    ASSERT_EQ(alias_sampler_size(sampler), 4)
+
+    rng_t rng = create_rng(9);
+    double *out = malloc(sizeof(double) * SAMPLES);
+    alias_sampler_sample_values(sampler, rng, out, SAMPLES);
+
+    unsigned int below_1000 = 0;
+    double sum = 0.0;
+    int i;
+    for (i = 0; i < SAMPLES; i++) {
+        ASSERT_TRUE(out[i] >= 100.0 && out[i] <= 100000.0)
+        below_1000 += out[i] <= 1000.0;
+        sum += out[i];
+    }
+
+    /*  Half the flows are at most 1000 bytes, and the sample mean matches
+        the mean of the piecewise uniform distribution. */
+    ASSERT_TRUE(below_1000 > SAMPLES / 2 - 2000 && below_1000 < SAMPLES / 2 + 2000)
+    double mean = alias_sampler_mean(sampler);
+    ASSERT_TRUE(sum / SAMPLES > mean * 0.97 && sum / SAMPLES < mean * 1.03)
+
+    free(out);
+    free_rng(rng);
+    free_alias_sampler(sampler);
+END_TEST
+
+DEFINE_TEST(alias_sampler_missing_file)
+    ASSERT_TRUE(create_alias_sampler_from_cdf_file("./traffic/no_such_file.cdf") == NULL)
+END_TEST
+
+DEFINE_TEST(alias_sampler_clone_same_stream)
+    double weights[5] = { 1.0, 2.0, 3.0, 4.0, 5.0 };
+    alias_sampler_t sampler = create_alias_sampler(weights, 5);
+    alias_sampler_t copy = alias_sampler_clone(sampler);
+    rng_t a = create_rng(10);
+    rng_t b = create_rng(10);
+
+    int i;
+    for (i = 0; i < 1000; i++) {
+        ASSERT_EQ(alias_sampler_sample(sampler, a), alias_sampler_sample(copy, b))
+    }
+
+    free_rng(a);
+    free_rng(b);
+    free_alias_sampler(copy);
+    free_alias_sampler(sampler);
+END_TEST
+
+REGISTER_TESTS(
+    alias_sampler_weights,
+    alias_sampler_batch_matches_distribution,
+    alias_sampler_cdf_file,
+    alias_sampler_missing_file,
+    alias_sampler_clone_same_stream
+)
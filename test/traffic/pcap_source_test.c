@@ -0,0 +1,287 @@
+#include "test.h"
+#include "pcap_source.h"
+#include "event_source.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*  Helpers to write small captures. Multi-byte fields are written in host
+    order unless big_endian is set. */
+static int big_endian = 0;
+
+static void put32(FILE *file, uint32_t x) {
+    if (big_endian) {
+        x = __builtin_bswap32(x);
+    }
+    fwrite(&x, sizeof(x), 1, file);
+}
+
+static void put16(FILE *file, uint16_t x) {
+    if (big_endian) {
+        x = __builtin_bswap16(x);
+    }
+    fwrite(&x, sizeof(x), 1, file);
+}
+
+/*  A 60 byte Ethernet/IPv4/UDP frame with the given source port. */
+static void make_frame(unsigned char *frame, unsigned int src_port) {
+    memset(frame, 0, 60);
+    frame[12] = 0x08;
+    frame[14] = 0x45;
+    frame[23] = 17;
+    frame[26] = 10;
+    frame[29] = 1;
+    frame[30] = 10;
+    frame[33] = 2;
+    frame[34] = (unsigned char) (src_port >> 8);
+    frame[35] = (unsigned char) src_port;
+    frame[37] = 80;
+}
+
+static void make_path(char *path) {
+    strcpy(path, "/tmp/pcap_source_testXXXXXX");
+    int fd = mkstemp(path);
+    close(fd);
+}
+
+/*  Classic pcap with microsecond timestamps. */
+static void write_pcap(const char *path, const uint32_t *usec, const unsigned int *ports, int n) {
+    FILE *file = fopen(path, "wb");
+    unsigned char frame[60];
+
+    put32(file, 0xa1b2c3d4);
+    put16(file, 2);
+    put16(file, 4);
+    put32(file, 0);
+    put32(file, 0);
+    put32(file, 65535);
+    put32(file, 1);
+
+    int i;
+    for (i = 0; i < n; i++) {
+        make_frame(frame, ports[i]);
+        put32(file, 100 + usec[i] / 1000000);
+        put32(file, usec[i] % 1000000);
+        put32(file, 60);
+        put32(file, 1500);
+        fwrite(frame, 1, 60, file);
+    }
+
+    fclose(file);
+}
+
+/*  pcapng with one nanosecond resolution interface. */
+static void write_pcapng(const char *path, const uint64_t *nsec, int n) {
+    FILE *file = fopen(path, "wb");
+    unsigned char frame[60];
+
+    /*  Section header. */
+    put32(file, 0x0a0d0d0a);
+    put32(file, 28);
+    put32(file, 0x1a2b3c4d);
+    put16(file, 1);
+    put16(file, 0);
+    put32(file, 0xffffffff);
+    put32(file, 0xffffffff);
+    put32(file, 28);
+
+    /*  Interface description with if_tsresol = 9 and an end option. */
+    put32(file, 1);
+    put32(file, 32);
+    put16(file, 1);
+    put16(file, 0);
+    put32(file, 65535);
+    put16(file, 9);
+    put16(file, 1);
+    unsigned char resol[4] = { 9, 0, 0, 0 };
+    fwrite(resol, 1, 4, file);
+    put32(file, 0);
+    put32(file, 32);
+
+    /*  An unknown block which must be skipped. */
+    put32(file, 0x00000bad);
+    put32(file, 16);
+    put32(file, 0);
+    put32(file, 16);
+
+    int i;
+    for (i = 0; i < n; i++) {
+        make_frame(frame, 1000);
+        put32(file, 6);
+        put32(file, 32 + 60);
+        put32(file, 0);
+        put32(file, (uint32_t) (nsec[i] >> 32));
+        put32(file, (uint32_t) nsec[i]);
+        put32(file, 60);
+        put32(file, 60);
+        fwrite(frame, 1, 60, file);
+        put32(file, 32 + 60);
+    }
+
+    fclose(file);
+}
+
+struct trace_log {
+    object_pool_t pool;
+    unsigned int times[8];
+    unsigned int lengths[8];
+    unsigned int flows[8];
+    unsigned int max_pending;
+    int count;
+};
+
+static void log_packet(simulator_t sim, void *item, void *arg) {
+    struct trace_log *log = (struct trace_log *) arg;
+    packet_t packet = (packet_t) item;
+
+    log->times[log->count] = simulator_now(sim);
+    log->lengths[log->count] = packet->length;
+    log->flows[log->count] = packet->flow_id;
+    log->count = log->count + 1;
+
+    if (simulator_pending(sim) > log->max_pending) {
+        log->max_pending = simulator_pending(sim);
+    }
+
+    object_pool_release(log->pool, packet);
+}
+
+/*  Replay a capture through an event source. */
+static pcap_source_t replay(const char *path, unsigned int ns_per_tick, struct trace_log *log) {
+    pcap_source_t source = open_pcap_source(path, ns_per_tick, log->pool);
+    if (source == NULL) {
+        return NULL;
+    }
+
+    simulator_t sim = create_simulator();
+    event_source_t events = create_event_source(pcap_source_next, source, log_packet, log);
+    event_source_start(events, sim);
+    simulator_run_until(sim, UINT32_MAX);
+
+    free_event_source(events);
+    free_simulator(sim);
+
+    return source;
+}
+
+DEFINE_TEST(pcap_source_classic)
+    char path[64];
+    make_path(path);
+    uint32_t usec[3] = { 0, 10, 2000000 };
+    unsigned int ports[3] = { 1000, 1000, 2000 };
+    write_pcap(path, usec, ports, 3);
+
+    struct trace_log log = { .pool = create_packet_pool(), .count = 0, .max_pending = 0 };
+    pcap_source_t source = replay(path, 1000, &log);
+    ASSERT_TRUE(source != NULL)
+
+    /*  Times relative to the first packet in microsecond ticks, lengths
+        from the original length field. */
+    ASSERT_EQ(log.count, 3)
+    ASSERT_EQ(log.times[0], 0)
+    ASSERT_EQ(log.times[1], 10)
+    ASSERT_EQ(log.times[2], 2000000)
+    ASSERT_EQ(log.lengths[0], 1500)
+    ASSERT_EQ(log.max_pending, 1)
+
+    /*  Flows are told apart by their 5-tuple. */
+    ASSERT_TRUE(log.flows[0] != 0)
+    ASSERT_EQ(log.flows[0], log.flows[1])
+    ASSERT_TRUE(log.flows[0] != log.flows[2])
+
+    /*  The last frame is available in place. */
+    unsigned int caplen;
+    const unsigned char *frame = pcap_source_frame(source, &caplen);
+    ASSERT_EQ(caplen, 60)
+    ASSERT_EQ(frame[35], 2000 & 0xff)
+
+    free_pcap_source(source);
+    free_object_pool(log.pool);
+    unlink(path);
+END_TEST
+
+DEFINE_TEST(pcap_source_swapped)
+    char path[64];
+    make_path(path);
+    uint32_t usec[2] = { 5, 25 };
+    unsigned int ports[2] = { 1, 2 };
+
+    big_endian = 1;
+    write_pcap(path, usec, ports, 2);
+    big_endian = 0;
+
+    struct trace_log log = { .pool = create_packet_pool(), .count = 0 };
+    pcap_source_t source = replay(path, 1000, &log);
+    ASSERT_TRUE(source != NULL)
+    ASSERT_EQ(log.count, 2)
+    ASSERT_EQ(log.times[1], 20)
+    ASSERT_EQ(log.lengths[1], 1500)
+
+    free_pcap_source(source);
+    free_object_pool(log.pool);
+    unlink(path);
+END_TEST
+
+DEFINE_TEST(pcap_source_out_of_order)
+    char path[64];
+    make_path(path);
+    uint32_t usec[3] = { 0, 50, 40 };
+    unsigned int ports[3] = { 1, 1, 1 };
+    write_pcap(path, usec, ports, 3);
+
+    struct trace_log log = { .pool = create_packet_pool(), .count = 0 };
+    pcap_source_t source = replay(path, 1000, &log);
+    ASSERT_TRUE(source != NULL)
+    ASSERT_EQ(log.count, 3)
+    ASSERT_EQ(log.times[2], 50)
+    ASSERT_EQ(pcap_source_reordered(source), 1)
+
+    free_pcap_source(source);
+    free_object_pool(log.pool);
+    unlink(path);
+END_TEST
+
+DEFINE_TEST(pcap_source_pcapng)
+    char path[64];
+    make_path(path);
+    uint64_t nsec[3] = { 5000000000ULL, 5000000123ULL, 5000001000ULL };
+    write_pcapng(path, nsec, 3);
+
+    struct trace_log log = { .pool = create_packet_pool(), .count = 0 };
+    pcap_source_t source = replay(path, 1, &log);
+    ASSERT_TRUE(source != NULL)
+    ASSERT_EQ(log.count, 3)
+    ASSERT_EQ(log.times[1], 123)
+    ASSERT_EQ(log.times[2], 1000)
+    ASSERT_EQ(pcap_source_packets(source), 3)
+
+    free_pcap_source(source);
+    free_object_pool(log.pool);
+    unlink(path);
+END_TEST
+
+DEFINE_TEST(pcap_source_invalid)
+    object_pool_t pool = create_packet_pool();
+    ASSERT_TRUE(open_pcap_source("/tmp/no_such_capture.pcap", 1, pool) == NULL)
+
+    char path[64];
+    make_path(path);
+    FILE *file = fopen(path, "wb");
+    fputs("this is not a packet capture file", file);
+    fclose(file);
+    ASSERT_TRUE(open_pcap_source(path, 1, pool) == NULL)
+
+    unlink(path);
+    free_object_pool(pool);
+END_TEST
+
+REGISTER_TESTS(
+    pcap_source_classic,
+    pcap_source_swapped,
+    pcap_source_out_of_order,
+    pcap_source_pcapng,
+    pcap_source_invalid
+)
@@ -0,0 +1,89 @@
+#include "test.h"
+#include "rng.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SAMPLES 100000
+
+DEFINE_TEST(rng_deterministic)
+    rng_t a = create_rng(42);
+    rng_t b = create_rng(42);
+    rng_t c = create_rng(43);
+
+    uint64_t out_a[37], out_b[37], out_c[37];
+    rng_fill_u64(a, out_a, 37);
+    rng_fill_u64(b, out_b, 37);
+    rng_fill_u64(c, out_c, 37);
+
+    int i;
+    int differs = 0;
+    for (i = 0; i < 37; i++) {
+        ASSERT_EQ(out_a[i], out_b[i])
+        differs = differs || out_a[i] != out_c[i];
+    }
+    ASSERT_TRUE(differs)
+
+    free_rng(a);
+    free_rng(b);
+    free_rng(c);
+END_TEST
+
+DEFINE_TEST(rng_uniform_range_and_mean)
+    rng_t rng = create_rng(1);
+    double *out = malloc(sizeof(double) * SAMPLES);
+    rng_fill_uniform(rng, out, SAMPLES);
+
+    double sum = 0.0;
+    int i;
+    for (i = 0; i < SAMPLES; i++) {
+        ASSERT_TRUE(out[i] > 0.0 && out[i] <= 1.0)
+        sum += out[i];
+    }
+    ASSERT_TRUE(sum / SAMPLES > 0.49 && sum / SAMPLES < 0.51)
+
+    free(out);
+    free_rng(rng);
+END_TEST
+
+DEFINE_TEST(rng_exponential_mean)
+    rng_t rng = create_rng(2);
+    double *out = malloc(sizeof(double) * SAMPLES);
+    rng_fill_exponential(rng, out, SAMPLES, 100.0);
+
+    double sum = 0.0;
+    int i;
+    for (i = 0; i < SAMPLES; i++) {
+        ASSERT_TRUE(out[i] >= 0.0)
+        sum += out[i];
+    }
+    ASSERT_TRUE(sum / SAMPLES > 98.0 && sum / SAMPLES < 102.0)
+
+    free(out);
+    free_rng(rng);
+END_TEST
+
+DEFINE_TEST(rng_next_below_bound)
+    rng_t rng = create_rng(3);
+    unsigned int counts[5] = { 0 };
+
+    int i;
+    for (i = 0; i < SAMPLES; i++) {
+        unsigned int x = rng_next_below(rng, 5);
+        ASSERT_TRUE(x < 5)
+        counts[x] = counts[x] + 1;
+    }
+
+    for (i = 0; i < 5; i++) {
+        ASSERT_TRUE(counts[i] > SAMPLES / 5 - 1000 && counts[i] < SAMPLES / 5 + 1000)
+    }
+
+    free_rng(rng);
+END_TEST
+
+REGISTER_TESTS(
+    rng_deterministic,
+    rng_uniform_range_and_mean,
+    rng_exponential_mean,
+    rng_next_below_bound
+)
@@ -0,0 +1,231 @@
+#include "test.h"
+#include "traffic_generator.h"
+#include "event_source.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define NUM_PORTS 8
+#define END_TIME 10000000
+
+/*  Collects statistics on generated packets and returns them to the
+    pool. */
+struct traffic_stats {
+    object_pool_t pool;
+    unsigned long count;
+    unsigned long per_port[NUM_PORTS];
+    unsigned long total_bytes;
+    unsigned int last_time;
+    unsigned int max_pending;
+    int off_slot;
+    unsigned int slot;
+};
+
+static void collect(simulator_t sim, void *item, void *arg) {
+    struct traffic_stats *stats = (struct traffic_stats *) arg;
+    packet_t packet = (packet_t) item;
+
+    stats->count = stats->count + 1;
+    stats->per_port[packet->egress_port] += 1;
+    stats->total_bytes += packet->length;
+    stats->last_time = simulator_now(sim);
+
+    if (stats->slot && simulator_now(sim) % stats->slot != 0) {
+        stats->off_slot = 1;
+    }
+    if (simulator_pending(sim) > stats->max_pending) {
+        stats->max_pending = simulator_pending(sim);
+    }
+
+    object_pool_release(stats->pool, packet);
+}
+
+static void base_config(traffic_config_t *config) {
+    config->process = TRAFFIC_POISSON;
+    config->mean_gap = 100.0;
+    config->slot_time = 0.0;
+    config->probability = 0.0;
+    config->pareto_shape = 0.0;
+    config->mean_burst = 1.0;
+    config->burst_gap = 0.0;
+    config->mean_off = 0.0;
+    config->pattern = TRAFFIC_UNIFORM;
+    config->num_ports = NUM_PORTS;
+    config->hotspot_port = 0;
+    config->hotspot_fraction = 0.0;
+    config->diagonal_fraction = 0.0;
+    config->destination_samplers = NULL;
+    config->packet_length = 1500;
+    config->size_sampler = NULL;
+    config->priority = 0;
+    config->end_time = END_TIME;
+}
+
+/*  Run a single generator for input port 2 to completion. */
+static void run_generator(traffic_config_t *config, struct traffic_stats *stats) {
+    simulator_t sim = create_simulator();
+    stats->pool = create_packet_pool();
+
+    traffic_generator_t gen = create_traffic_generator(config, 2, 1234, stats->pool);
+    event_source_t source = create_event_source(traffic_generator_next, gen, collect, stats);
+
+    event_source_start(source, sim);
+    simulator_run_until(sim, END_TIME);
+
+    free_event_source(source);
+    free_traffic_generator(gen);
+    free_object_pool(stats->pool);
+    free_simulator(sim);
+}
+
+DEFINE_TEST(traffic_poisson_rate)
+    traffic_config_t config;
+    base_config(&config);
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    /*  100000 arrivals expected. Only one is ever pending. */
+    ASSERT_TRUE(stats.count > 99000 && stats.count < 101000)
+    ASSERT_EQ(stats.max_pending, 1)
+    ASSERT_TRUE(stats.last_time < END_TIME)
+END_TEST
+
+DEFINE_TEST(traffic_bernoulli_slots)
+    traffic_config_t config;
+    base_config(&config);
+    config.process = TRAFFIC_BERNOULLI;
+    config.slot_time = 10.0;
+    config.probability = 0.25;
+    struct traffic_stats stats = { .count = 0, .slot = 10 };
+
+    run_generator(&config, &stats);
+
+    /*  250000 arrivals expected, all on slot boundaries. */
+    ASSERT_TRUE(stats.count > 247500 && stats.count < 252500)
+    ASSERT_FALSE(stats.off_slot)
+END_TEST
+
+DEFINE_TEST(traffic_on_off_rate)
+    traffic_config_t config;
+    base_config(&config);
+    config.process = TRAFFIC_ON_OFF;
+    config.mean_burst = 10.0;
+    config.burst_gap = 10.0;
+    config.mean_off = 900.0;
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    /*  Each cycle is 10 packets over 100 + 900 ticks on average. */
+    ASSERT_TRUE(stats.count > 95000 && stats.count < 105000)
+END_TEST
+
+DEFINE_TEST(traffic_pareto_rate)
+    traffic_config_t config;
+    base_config(&config);
+    config.process = TRAFFIC_PARETO;
+    config.pareto_shape = 2.5;
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    /*  Heavy tails converge slowly, so the bounds are loose. */
+    ASSERT_TRUE(stats.count > 95000 && stats.count < 105000)
+END_TEST
+
+DEFINE_TEST(traffic_uniform_pattern)
+    traffic_config_t config;
+    base_config(&config);
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    int i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        ASSERT_TRUE(stats.per_port[i] * NUM_PORTS > stats.count * 9 / 10)
+        ASSERT_TRUE(stats.per_port[i] * NUM_PORTS < stats.count * 11 / 10)
+    }
+END_TEST
+
+DEFINE_TEST(traffic_hotspot_pattern)
+    traffic_config_t config;
+    base_config(&config);
+    config.pattern = TRAFFIC_HOTSPOT;
+    config.hotspot_port = 5;
+    config.hotspot_fraction = 0.5;
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    /*  Half the traffic plus a uniform share of the rest. */
+    double expected = 0.5 + 0.5 / NUM_PORTS;
+    double share = (double) stats.per_port[5] / stats.count;
+    ASSERT_TRUE(share > expected - 0.01 && share < expected + 0.01)
+END_TEST
+
+DEFINE_TEST(traffic_diagonal_pattern)
+    traffic_config_t config;
+    base_config(&config);
+    config.pattern = TRAFFIC_DIAGONAL;
+    config.diagonal_fraction = 2.0 / 3.0;
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    ASSERT_EQ(stats.per_port[2] + stats.per_port[3], stats.count)
+    double share = (double) stats.per_port[2] / stats.count;
+    ASSERT_TRUE(share > 0.66 && share < 0.675)
+END_TEST
+
+DEFINE_TEST(traffic_matrix_pattern)
+    traffic_config_t config;
+    base_config(&config);
+    config.pattern = TRAFFIC_MATRIX;
+
+    /*  Input 2 only sends to outputs 1 and 6, three times as often to 6. */
+    double row[NUM_PORTS] = { 0, 1, 0, 0, 0, 0, 3, 0 };
+    alias_sampler_t sampler = create_alias_sampler(row, NUM_PORTS);
+    alias_sampler_t samplers[NUM_PORTS] = { NULL, NULL, sampler };
+    config.destination_samplers = samplers;
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    ASSERT_EQ(stats.per_port[1] + stats.per_port[6], stats.count)
+    double share = (double) stats.per_port[6] / stats.count;
+    ASSERT_TRUE(share > 0.74 && share < 0.76)
+
+    free_alias_sampler(sampler);
+END_TEST
+
+DEFINE_TEST(traffic_sampled_lengths)
+    traffic_config_t config;
+    base_config(&config);
+
+    /*  Half 64 byte packets, half spread uniformly over (64, 1500]. */
+    double values[2] = { 64, 1500 };
+    double cdf[2] = { 0.5, 1.0 };
+    config.size_sampler = create_alias_sampler_from_cdf(values, cdf, 2);
+    struct traffic_stats stats = { .count = 0 };
+
+    run_generator(&config, &stats);
+
+    double mean = (double) stats.total_bytes / stats.count;
+    double expected = alias_sampler_mean(config.size_sampler);
+    ASSERT_TRUE(mean > expected - 10.0 && mean < expected + 10.0)
+
+    free_alias_sampler(config.size_sampler);
+END_TEST
+
+REGISTER_TESTS(
+    traffic_poisson_rate,
+    traffic_bernoulli_slots,
+    traffic_on_off_rate,
+    traffic_pareto_rate,
+    traffic_uniform_pattern,
+    traffic_hotspot_pattern,
+    traffic_diagonal_pattern,
+    traffic_matrix_pattern,
+    traffic_sampled_lengths
+)